@@ -64,6 +64,19 @@ struct crypt_prf *crypt_prf_init_bytes(const char *prf_name,
 #define crypt_prf_init_hunk(PRF_NAME, PRF, KEY_NAME, KEY, LOGGER)	\
 	crypt_prf_init_bytes(PRF_NAME, PRF, KEY_NAME, (KEY).ptr, (KEY).len, LOGGER)
 
+/*
+ * Using KEY, a PRF that is used repeatedly (for instance, the IKE
+ * SA's integrity) can be created once and then, each time it is
+ * needed, cloned.  This avoids the cost of re-importing KEY.
+ *
+ * PRF must not have been updated; the clone is finalized as normal;
+ * and PRF itself is discarded using crypt_prf_destroy().
+ */
+struct crypt_prf *crypt_prf_clone(const char *prf_name,
+				  const struct crypt_prf *prf,
+				  struct logger *logger);
+void crypt_prf_destroy(struct crypt_prf **prfp);
+
 /*
  * Call these to accumulate the seed/data/text.
  */
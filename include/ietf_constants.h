@@ -638,7 +638,8 @@ enum next_payload_types_ikev2 {
 	ISAKMP_NEXT_v2GSA = 51, /* Group Security Association draft-yeung-g-ikev2 */
 	ISAKMP_NEXT_v2KD = 52, /* Key Download draft-yeung-g-ikev2 */
 	ISAKMP_NEXT_v2SKF = 53,	/* Encrypted and Authenticated Fragment fragment */
-	/* 54-127 Unassigned */
+	ISAKMP_NEXT_v2PS = 54,	/* RFC-8019 Puzzle Solution */
+	/* 55-127 Unassigned */
 	/* 128 - 255 Private Use */
 	/* Cisco/Microsoft proprietary IKE fragmentation - private use for libreswan */
 	ISAKMP_NEXT_v2IKE_FRAGMENTATION = 132,
@@ -1608,6 +1609,7 @@ typedef enum v2_notification {
 	v2N_INVALID_GROUP_ID = 45,		/* draft-yeung-g-ikev2 */
 	v2N_AUTHORIZATION_FAILED = 46,		/* draft-yeung-g-ikev2 */
 	v2N_STATE_NOT_FOUND = 47,		/* RFC-9370 */
+	v2N_TS_MAX_QUEUE = 48,			/* RFC-9611 */
 
 	v2N_ERROR_PSTATS_ROOF, /* used to cap error statistics array */
 
@@ -1679,6 +1681,7 @@ typedef enum v2_notification {
 	v2N_ADDITIONAL_KEY_EXCHANGE = 16441,	/* RFC-9370 */
 	v2N_USE_AGGFRAG = 16442,		/* RFC-9347 */
 	v2N_SUPPORTED_AUTH_METHODS = 16443,	/* draft-ietf-ipsecme-ikev2-auth-announce-10 */
+	v2N_SA_RESOURCE_INFO = 16444,		/* RFC-9611 */
 
 	v2N_STATUS_PSTATS_ROOF, /* used to cap status statistics array */
 
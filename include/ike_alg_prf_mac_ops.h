@@ -40,6 +40,14 @@ struct prf_mac_ops {
 			     const char *name, const uint8_t *bytes, size_t sizeof_bytes);
 	PK11SymKey *(*final_symkey)(struct prf_context **prf);
 	void (*final_bytes)(struct prf_context **prf, uint8_t *bytes, size_t sizeof_bytes);
+	/*
+	 * Copy a freshly initialized PRF (i.e., one that has yet to
+	 * consume data) without re-importing its key; discard a PRF
+	 * without computing anything.
+	 */
+	struct prf_context *(*clone)(const struct prf_context *prf, const char *name,
+				     struct logger *logger);
+	void (*destroy)(struct prf_context **prf);
 };
 
 extern const struct prf_mac_ops ike_alg_prf_mac_hmac_ops;
@@ -79,6 +79,7 @@ enum keywords {
 	KSF_SYSLOG,
 	KSF_DUMPDIR,
 	KSF_STATSBINARY,
+	KSF_METRICS_SOCKET,
 	KSF_IPSECDIR,
 	KSF_NSSDIR,
 	KSF_SECRETSFILE,
@@ -111,6 +112,7 @@ enum keywords {
 #ifdef XFRM_LIFETIME_DEFAULT
 	KBF_XFRMLIFETIME,
 #endif
+	KBF_KERNEL_RECONCILE,
 	KBF_CRL_STRICT,
 	KBF_CRL_CHECKINTERVAL_MS,
 	KBF_OCSP_STRICT,
@@ -120,17 +122,22 @@ enum keywords {
 	KBF_OCSP_CACHE_MIN_AGE_SECONDS,
 	KBF_OCSP_CACHE_MAX_AGE_SECONDS,
 	KBF_OCSP_METHOD,
+	KBF_OCSP_PREFETCH,
 	KBF_CURL_TIMEOUT_SECONDS,
 	KBF_SEEDBITS,
 	KBF_DROP_OPPO_NULL,
 	KBF_KEEPALIVE,
 	KBF_NHELPERS,
+	KBF_UPDOWN_JOBS,
+	KBF_NATIVE_UPDOWN,
+	KBF_PAM_WORKERS,
 	KBF_SHUNTLIFETIME_MS,
 	KBF_FORCEBUSY, 		/* obsoleted for KBF_DDOS_MODE */
 	KBF_DDOS_IKE_THRESHOLD,
 	KBF_MAX_HALFOPEN_IKE,
 	KBF_NFLOG_ALL,		/* Enable global nflog device */
 	KBF_DDOS_MODE,		/* set DDOS mode */
+	KBF_DDOS_PUZZLES,	/* send RFC 8019 puzzles with cookies */
 	KBF_SECCOMP,		/* set SECCOMP mode */
 
 	KBF_LISTEN_TCP,		/* listen on TCP port 4500 - default no */
@@ -242,6 +249,7 @@ enum keywords {
 	KNCF_DECAP_DSCP,
 	KNCF_ENCAP_DSCP,
 	KNCF_NOPMTUDISC,
+	KNCF_PER_CPU_SAS,	/* RFC 9611 per-resource Child SAs */
 	KNCF_NARROWING,
 	KNCF_PAM_AUTHORIZE,
 	KNCF_SEND_REDIRECT,	/* this and next word are used for IKEv2 Redirect Mechanism */
@@ -50,6 +50,18 @@ void realloc_bytes(void **ptr, size_t old_size, size_t new_size, const char *nam
 extern bool leak_detective;
 extern bool report_leaks(struct logger *logger); /* true is bad */
 
+/*
+ * Running totals, only counted with leak_detective (otherwise
+ * zero).  A realloc counts as a free and an allocation.
+ */
+struct alloc_stats {
+	uintmax_t allocs;
+	uintmax_t frees;
+	uintmax_t bytes;	/* allocated, not live */
+};
+
+struct alloc_stats get_alloc_stats(void);
+
 /*
  * Notes on __typeof__().
  *
@@ -58,6 +58,14 @@ extern const monotime_t monotime_epoch;
 bool is_monotime_epoch(monotime_t t);
 
 monotime_t mononow(void);
+
+/*
+ * Move mononow() forward by D, as if the system had been suspended.
+ * Only for whack --replay (which requires protostack=none) to replay
+ * captured traffic against a virtual clock.  The clock never goes
+ * backwards so the skew is never undone.
+ */
+void advance_mononow(deltatime_t d);
 monotime_t monotime_max(monotime_t l, monotime_t r);
 monotime_t monotime_min(monotime_t l, monotime_t r);
 monotime_t monotime_add(monotime_t l, deltatime_t r);
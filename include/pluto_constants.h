@@ -199,7 +199,10 @@ enum global_timer {
 	EVENT_RESET_LOG_LIMITER,	/* set rate limited log message count back to 0 */
 #define RESET_LOG_LIMITER_FREQUENCY	deltatime(secs_per_hour)
 
-#define GLOBAL_TIMER_ROOF (EVENT_RESET_LOG_LIMITER+1)
+	EVENT_CHECK_OVERLOAD,		/* sample load, adjust DDoS stage */
+#define CHECK_OVERLOAD_PERIOD		deltatime(1)
+
+#define GLOBAL_TIMER_ROOF (EVENT_CHECK_OVERLOAD+1)
 };
 
 /*
@@ -0,0 +1,34 @@
+/* per-CPU SA, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef SA_PCPU_H
+#define SA_PCPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * RFC 9611: a per-resource Child SA is pinned to a CPU.  Outbound
+ * traffic on that CPU uses the pinned SA; traffic on other CPUs falls
+ * back to the connection's main (unpinned) Child SA.
+ */
+
+struct sa_pcpu {
+	bool is_set;
+	uint32_t cpu;
+};
+
+#endif
@@ -157,6 +157,7 @@ struct whack_message {
 	bool whack_showstates;
 	bool whack_seccomp_crashtest;
 	bool whack_processstatus;
+	bool whack_coststatus;
 	bool whack_leave_state;		/* .basic.shutdown should not
 					 * send delete or clean kernel
 					 * state on shutdown */
@@ -224,6 +225,7 @@ struct whack_message {
 	enum yn_options decap_dscp;	/* decap ToS/DSCP bits */
 	enum yn_options encap_dscp;	/* encap ToS/DSCP bits */
 	enum yn_options nopmtudisc;	/* ??? */
+	enum yn_options per_cpu_sas;	/* RFC 9611 per-CPU Child SAs */
 	enum ynf_options fragmentation;	/* fragment IKE payload */
 	enum yne_options esn;		/* accept or request ESN{yes,no} */
 	enum nppi_options ppk;		/* pre-shared post-quantum key */
@@ -455,6 +457,9 @@ struct whack_message {
 
 	char *dnshostname;
 
+	/* capture to feed through pluto */
+	char *whack_replay;
+
 	/* space for strings (hope there is enough room) */
 	size_t str_size;
 	unsigned char string[4096];
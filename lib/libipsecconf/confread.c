@@ -98,6 +98,7 @@ static void ipsecconf_default_values(struct starter_config *cfg)
 	/* Don't inflict BSI requirements on everyone */
 	SOPT(KBF_SEEDBITS, 0);
 	SOPT(KBF_DROP_OPPO_NULL, false);
+	SOPT(KBF_NATIVE_UPDOWN, true);
 	SOPT(KBF_GLOBAL_IKEv1, GLOBAL_IKEv1_DROP);
 
 	SOPT(KBF_DDOS_MODE, DDOS_AUTO);
@@ -337,6 +337,7 @@ const struct keyword_def ipsec_conf_keywords[] = {
   { "nssdir", kv_config, kt_dirname, KSF_NSSDIR, NULL, NULL, },
   { "secretsfile",  kv_config,  kt_dirname,  KSF_SECRETSFILE, NULL, NULL, },
   { "statsbin",  kv_config,  kt_dirname,  KSF_STATSBINARY, NULL, NULL, },
+  { "metrics-socket",  kv_config,  kt_filename,  KSF_METRICS_SOCKET, NULL, NULL, },
   { "uniqueids",  kv_config,  kt_bool,  KBF_UNIQUEIDS, NULL, NULL, },
   { "shuntlifetime",  kv_config,  kt_time,  KBF_SHUNTLIFETIME_MS, NULL, NULL, },
   { "global-redirect", kv_config, kt_string, KSF_GLOBAL_REDIRECT, NULL, NULL },
@@ -354,12 +355,14 @@ const struct keyword_def ipsec_conf_keywords[] = {
   { "ocsp-cache-min-age",  kv_config,  kt_seconds,  KBF_OCSP_CACHE_MIN_AGE_SECONDS, NULL, NULL, },
   { "ocsp-cache-max-age",  kv_config,  kt_seconds,  KBF_OCSP_CACHE_MAX_AGE_SECONDS, NULL, NULL, },
   { "ocsp-method",  kv_config | kv_processed,  kt_sparse_name,  KBF_OCSP_METHOD, &kw_ocsp_method_names, NULL, },
+  { "ocsp-prefetch",  kv_config,  kt_bool,  KBF_OCSP_PREFETCH, NULL, NULL, },
 
   { "ddos-mode",  kv_config | kv_processed ,  kt_sparse_name,  KBF_DDOS_MODE, &kw_ddos_names, NULL, },
 #ifdef USE_SECCOMP
   { "seccomp",  kv_config | kv_processed ,  kt_sparse_name,  KBF_SECCOMP,  &kw_seccomp_names, NULL, },
 #endif
   { "ddos-ike-threshold",  kv_config,  kt_unsigned,  KBF_DDOS_IKE_THRESHOLD, NULL, NULL, },
+  { "ddos-puzzles",  kv_config,  kt_bool,  KBF_DDOS_PUZZLES, NULL, NULL, },
   { "max-halfopen-ike",  kv_config,  kt_unsigned,  KBF_MAX_HALFOPEN_IKE, NULL, NULL, },
   { "ike-socket-bufsize",  kv_config,  kt_unsigned,  KBF_IKEBUF, NULL, NULL, },
   { "ike-socket-errqueue",  kv_config,  kt_bool,  KBF_IKE_ERRQUEUE, NULL, NULL, },
@@ -369,6 +372,7 @@ const struct keyword_def ipsec_conf_keywords[] = {
 #ifdef XFRM_LIFETIME_DEFAULT
   { "xfrmlifetime",  kv_config,  kt_unsigned,  KBF_XFRMLIFETIME, NULL, NULL, },
 #endif
+  { "kernel-reconcile",  kv_config,  kt_bool,  KBF_KERNEL_RECONCILE, NULL, NULL, },
   { "virtual-private",  kv_config,  kt_string,  KSF_VIRTUALPRIVATE, NULL, NULL, },
   { "virtual_private",  kv_config,  kt_string,  KSF_VIRTUALPRIVATE, NULL, NULL, }, /* obsolete variant, very common */
   { "seedbits",  kv_config,  kt_unsigned,  KBF_SEEDBITS, NULL, NULL, },
@@ -380,6 +384,9 @@ const struct keyword_def ipsec_conf_keywords[] = {
   { "listen",  kv_config,  kt_string,  KSF_LISTEN, NULL, NULL, },
   { "protostack",  kv_config,  kt_string,  KSF_PROTOSTACK,  NULL, NULL, },
   { "nhelpers",  kv_config,  kt_unsigned,  KBF_NHELPERS, NULL, NULL, },
+  { "updown-jobs",  kv_config,  kt_unsigned,  KBF_UPDOWN_JOBS, NULL, NULL, },
+  { "native-updown",  kv_config,  kt_bool,  KBF_NATIVE_UPDOWN, NULL, NULL, },
+  { "pam-workers",  kv_config,  kt_unsigned,  KBF_PAM_WORKERS, NULL, NULL, },
   { "drop-oppo-null",  kv_config,  kt_bool,  KBF_DROP_OPPO_NULL, NULL, NULL, },
   { "interfaces",  kv_config, kt_obsolete, KNCF_OBSOLETE, NULL, NULL, }, /* obsoleted but often present keyword */
 
@@ -440,6 +447,7 @@ const struct keyword_def ipsec_conf_keywords[] = {
   { "decap-dscp",  kv_conn | kv_processed,  kt_sparse_name,  KNCF_DECAP_DSCP, &yn_option_names, NULL, },
   { "encap-dscp",  kv_conn | kv_processed,  kt_sparse_name,  KNCF_ENCAP_DSCP, &yn_option_names, NULL, },
   { "nopmtudisc",  kv_conn | kv_processed,  kt_sparse_name,  KNCF_NOPMTUDISC, &yn_option_names, NULL, },
+  { "per-cpu-sas",  kv_conn | kv_processed,  kt_sparse_name,  KNCF_PER_CPU_SAS, &yn_option_names, NULL, },
   { "fragmentation",  kv_conn | kv_processed,  kt_sparse_name,  KNCF_FRAGMENTATION, &ynf_option_names, NULL, },
   { "mobike",  kv_conn,  kt_sparse_name,  KNCF_MOBIKE, &yn_option_names, NULL, },
   { "narrowing",  kv_conn,  kt_sparse_name,  KNCF_NARROWING, &yn_option_names, NULL, },
@@ -468,6 +468,7 @@ int starter_whack_add_conn(const char *ctlsocket,
 	msg.decap_dscp = conn->options[KNCF_DECAP_DSCP]; /* yn_options */
 	msg.encap_dscp = conn->options[KNCF_ENCAP_DSCP]; /* yn_options */
 	msg.nopmtudisc = conn->options[KNCF_NOPMTUDISC]; /* yn_options */
+	msg.per_cpu_sas = conn->options[KNCF_PER_CPU_SAS]; /* yn_options */
 	msg.accept_redirect = conn->options[KNCF_ACCEPT_REDIRECT]; /* yn_options */
 	msg.fragmentation = conn->options[KNCF_FRAGMENTATION]; /* yna_options */
 	msg.esn = conn->options[KNCF_ESN]; /* yne_options */
@@ -139,6 +139,7 @@ void pmemory_where(void *ptr, where_t where)
 static pthread_mutex_t leak_detective_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static union mhdr *allocs = NULL;
+static struct alloc_stats alloc_stats;	/* also protected */
 
 static void install_allocation(union mhdr *p, size_t size, const char *name)
 {
@@ -152,6 +153,8 @@ static void install_allocation(union mhdr *p, size_t size, const char *name)
 		if (allocs != NULL)
 			allocs->i.newer = p;
 		allocs = p;
+		alloc_stats.allocs++;
+		alloc_stats.bytes += size;
 		pthread_mutex_unlock(&leak_detective_mutex);
 	}
 }
@@ -170,6 +173,7 @@ static void remove_allocation(union mhdr *p)
 		passert(p->i.newer->i.older == p);
 		p->i.newer->i.older = p->i.older;
 	}
+	alloc_stats.frees++;
 	pthread_mutex_unlock(&leak_detective_mutex);
 	p->i.magic = ~LEAK_MAGIC;
 }
@@ -227,6 +231,14 @@ void pfree(void *ptr)
 	}
 }
 
+struct alloc_stats get_alloc_stats(void)
+{
+	pthread_mutex_lock(&leak_detective_mutex);
+	struct alloc_stats stats = alloc_stats;
+	pthread_mutex_unlock(&leak_detective_mutex);
+	return stats;
+}
+
 bool report_leaks(struct logger *logger)
 {
 	union mhdr *p,
@@ -523,6 +523,7 @@ static const char *const payload_name_ikev2_main[] = {
 	S(ISAKMP_NEXT_v2GSA), /* [draft-yeung-g-ikev2] */
 	S(ISAKMP_NEXT_v2KD), /* [draft-yeung-g-ikev2] */
 	S(ISAKMP_NEXT_v2SKF), /* RFC 7383 */
+	S(ISAKMP_NEXT_v2PS), /* RFC 8019 */
 #undef S
 };
 
@@ -546,7 +547,7 @@ static enum_names payload_names_ikev2_private_use = {
 
 static enum_names payload_names_ikev2_main = {
 	ISAKMP_NEXT_v2SA,
-	ISAKMP_NEXT_v2SKF,
+	ISAKMP_NEXT_v2PS,
 	ARRAY_REF(payload_name_ikev2_main),
 	NULL, /* prefix */
 	&payload_names_ikev2_private_use
@@ -563,7 +564,7 @@ enum_names ikev2_payload_names = {
 /* either V1 or V2 payload kind */
 static enum_names payload_names_ikev2copy_main = {
 	ISAKMP_NEXT_v2SA,
-	ISAKMP_NEXT_v2SKF,
+	ISAKMP_NEXT_v2PS,
 	ARRAY_REF(payload_name_ikev2_main),
 	NULL, /* prefix */
 	&payload_names_ikev1_private_use
@@ -2015,6 +2016,7 @@ static const char *const v2_notification_error_name[] = {
 	S(v2N_INVALID_GROUP_ID),
 	S(v2N_AUTHORIZATION_FAILED),
 	S(v2N_STATE_NOT_FOUND),
+	S(v2N_TS_MAX_QUEUE),
 #undef S
 };
 
@@ -2080,6 +2082,7 @@ static const char *const v2_notification_status_name[] = {
 	S(v2N_IP6_ALLOWED),
 	S(v2N_ADDITIONAL_KEY_EXCHANGE),
 	S(v2N_USE_AGGFRAG),
+	S(v2N_SA_RESOURCE_INFO),
 #undef S
 };
 
@@ -2099,7 +2102,7 @@ static const struct enum_names v2_notification_private_names = {
 
 static const struct enum_names v2_notification_status_names = {
 	v2N_INITIAL_CONTACT,
-	v2N_USE_AGGFRAG,
+	v2N_SA_RESOURCE_INFO,
 	ARRAY_REF(v2_notification_status_name),
 	"v2N_", /* prefix */
 	&v2_notification_private_names,
@@ -2107,7 +2110,7 @@ static const struct enum_names v2_notification_status_names = {
 
 const struct enum_names v2_notification_names = {
 	v2N_NOTHING_WRONG,
-	v2N_STATE_NOT_FOUND,
+	v2N_TS_MAX_QUEUE,
 	ARRAY_REF(v2_notification_error_name),
 	"v2N_", /* prefix */
 	&v2_notification_status_names
@@ -2563,6 +2566,7 @@ static const char *global_timer_name[] = {
 	S(EVENT_CHECK_CRLS),
 	S(EVENT_FREE_ROOT_CERTS),
 	S(EVENT_RESET_LOG_LIMITER),
+	S(EVENT_CHECK_OVERLOAD),
 #undef S
 };
 const struct enum_names global_timer_names = {
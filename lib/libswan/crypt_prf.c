@@ -126,6 +126,28 @@ struct crypt_prf *crypt_prf_init_symkey(const char *name,
 						       logger));
 }
 
+struct crypt_prf *crypt_prf_clone(const char *name,
+				  const struct crypt_prf *prf,
+				  struct logger *logger)
+{
+	ldbgf(DBG_CRYPT, logger, "%s PRF %s clone %s PRF %p",
+	      name, prf->desc->common.fqn, prf->name, prf);
+	return wrap(prf->desc, name, logger,
+		    prf->desc->prf_mac_ops->clone(prf->context, name, logger));
+}
+
+void crypt_prf_destroy(struct crypt_prf **prfp)
+{
+	if (*prfp == NULL) {
+		return;
+	}
+	ldbgf(DBG_CRYPT, (*prfp)->logger, "%s PRF %s destroy %p",
+	      (*prfp)->name, (*prfp)->desc->common.fqn, *prfp);
+	(*prfp)->desc->prf_mac_ops->destroy(&(*prfp)->context);
+	pfree(*prfp);
+	*prfp = NULL;
+}
+
 /*
  * Accumulate data.
  */
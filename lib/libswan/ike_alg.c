@@ -539,6 +539,8 @@ static void prf_desc_check(const struct ike_alg *alg, struct logger *logger)
 		pexpect_ike_alg(logger, alg, prf->prf_mac_ops->digest_bytes != NULL);
 		pexpect_ike_alg(logger, alg, prf->prf_mac_ops->final_symkey != NULL);
 		pexpect_ike_alg(logger, alg, prf->prf_mac_ops->final_bytes != NULL);
+		pexpect_ike_alg(logger, alg, prf->prf_mac_ops->clone != NULL);
+		pexpect_ike_alg(logger, alg, prf->prf_mac_ops->destroy != NULL);
 		/*
 		 * IKEv1 IKE algorithms must have a hasher - used for
 		 * things like computing IV.
@@ -41,12 +41,17 @@ static PK11SymKey *prfplus(const struct prf_desc *prf_desc,
 {
 	uint8_t count = 1;
 
+	/*
+	 * Each Tn uses the same KEY; import it once and then clone
+	 * the keyed PRF.
+	 */
+	struct crypt_prf *keyed = crypt_prf_init_symkey("prf+", prf_desc,
+							"key", key, logger);
+
 	/* T1(prfplus) = prf(KEY, SEED|1) */
 	PK11SymKey *concatenated;
 	{
-		struct crypt_prf *prf = crypt_prf_init_symkey("prf+0", prf_desc,
-							      "key", key,
-							      logger);
+		struct crypt_prf *prf = crypt_prf_clone("prf+0", keyed, logger);
 		crypt_prf_update_symkey(prf, "seed", seed);
 		crypt_prf_update_byte(prf, "1++", count++);
 		concatenated = crypt_prf_final_symkey(&prf);
@@ -56,8 +61,7 @@ static PK11SymKey *prfplus(const struct prf_desc *prf_desc,
 	PK11SymKey *old_t = symkey_addref(logger, "old_t[1]", concatenated);
 	while (sizeof_symkey(concatenated) < required_keymat) {
 		/* Tn = prf(KEY, Tn-1|SEED|n) */
-		struct crypt_prf *prf = crypt_prf_init_symkey("prf+N", prf_desc,
-							      "key", key, logger);
+		struct crypt_prf *prf = crypt_prf_clone("prf+N", keyed, logger);
 		crypt_prf_update_symkey(prf, "old_t", old_t);
 		crypt_prf_update_symkey(prf, "seed", seed);
 		crypt_prf_update_byte(prf, "N++", count++);
@@ -66,6 +70,7 @@ static PK11SymKey *prfplus(const struct prf_desc *prf_desc,
 		symkey_delref(logger, "old_t[N]", &old_t);
 		old_t = new_t;
 	}
+	crypt_prf_destroy(&keyed);
 	symkey_delref(logger, "old_t[final]", &old_t);
 
 	/* truncate the result to match the length with required_keymat */
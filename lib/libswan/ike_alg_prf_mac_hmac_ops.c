@@ -193,6 +193,26 @@ static void final_bytes(struct prf_context **prfp,
 	*prfp = NULL;
 }
 
+static struct prf_context *clone(const struct prf_context *prf, const char *name,
+				 struct logger *logger)
+{
+	passert(clone == prf->desc->prf_mac_ops->clone);
+	struct prf_context *copy = prf_init(prf->desc, name, logger);
+	/* keys are never modified, only replaced */
+	copy->key = symkey_addref(logger, name, prf->key);
+	copy->inner = symkey_addref(logger, name, prf->inner);
+	return copy;
+}
+
+static void destroy(struct prf_context **prfp)
+{
+	passert(destroy == (*prfp)->desc->prf_mac_ops->destroy);
+	symkey_delref((*prfp)->logger, "inner", &(*prfp)->inner);
+	symkey_delref((*prfp)->logger, "key", &(*prfp)->key);
+	pfree(*prfp);
+	*prfp = NULL;
+}
+
 static void hmac_prf_check(const struct prf_desc *prf, struct logger *logger)
 {
 	const struct ike_alg *alg = &prf->common;
@@ -208,4 +228,6 @@ const struct prf_mac_ops ike_alg_prf_mac_hmac_ops = {
 	digest_bytes,
 	final_symkey,
 	final_bytes,
+	clone,
+	destroy,
 };
@@ -31,6 +31,7 @@
 struct prf_context {
 	const char *name;
 	const struct prf_desc *desc;
+	PK11SymKey *key;	/* of the correct type, for clone() */
 	PK11Context *context;
 	struct logger *logger;
 };
@@ -80,6 +81,7 @@ static struct prf_context *init(const struct prf_desc *prf_desc,
 	struct prf_context prf = {
 		.name = name,
 		.desc = prf_desc,
+		.key = symkey_addref(logger, name, key),
 		.context = context,
 		.logger = logger,
 	};
@@ -161,6 +163,7 @@ static void final(struct prf_context *prf, void *bytes, size_t sizeof_bytes)
 	pexpect(bytes_out == sizeof_bytes);
 	PK11_DestroyContext(prf->context, PR_TRUE);
 	prf->context = NULL;
+	symkey_delref(prf->logger, prf->name, &prf->key);
 }
 
 static void final_bytes(struct prf_context **prf, uint8_t *bytes, size_t sizeof_bytes)
@@ -182,6 +185,26 @@ static PK11SymKey *final_symkey(struct prf_context **prf)
 	return final;
 }
 
+/*
+ * NSS can't clone a HMAC context (C_GetOperationState() isn't
+ * supported) so create a new context from the already converted key;
+ * it's the conversion that is expensive.
+ */
+
+static struct prf_context *clone(const struct prf_context *prf, const char *name,
+				 struct logger *logger)
+{
+	return init(prf->desc, name, prf->name, prf->key, logger);
+}
+
+static void destroy(struct prf_context **prf)
+{
+	PK11_DestroyContext((*prf)->context, PR_TRUE);
+	symkey_delref((*prf)->logger, (*prf)->name, &(*prf)->key);
+	pfree(*prf);
+	*prf = NULL;
+}
+
 static void nss_prf_check(const struct prf_desc *prf, struct logger *logger)
 {
 	const struct ike_alg *alg = &prf->common;
@@ -197,4 +220,6 @@ const struct prf_mac_ops ike_alg_prf_mac_nss_ops = {
 	digest_bytes,
 	final_symkey,
 	final_bytes,
+	clone,
+	destroy,
 };
@@ -298,6 +298,28 @@ static PK11SymKey *nss_xcbc_final_symkey(struct prf_context **prf)
 	return key;
 }
 
+static struct prf_context *nss_xcbc_clone(const struct prf_context *prf,
+					  const char *name,
+					  struct logger *logger)
+{
+	struct prf_context copy = {
+		.key = symkey_addref(logger, name, prf->key),
+		.bytes = clone_hunk(prf->bytes, name),
+		.name = name,
+		.desc = prf->desc,
+		.logger = logger,
+	};
+	return clone_thing(copy, name);
+}
+
+static void nss_xcbc_destroy(struct prf_context **prf)
+{
+	free_chunk_content(&(*prf)->bytes);
+	symkey_delref((*prf)->logger, "key", &(*prf)->key);
+	pfree(*prf);
+	*prf = NULL;
+}
+
 static void nss_xcbc_check(const struct prf_desc *prf, struct logger *logger)
 {
 	const struct ike_alg *alg = &prf->common;
@@ -313,4 +335,6 @@ const struct prf_mac_ops ike_alg_prf_mac_nss_xcbc_ops = {
 	nss_xcbc_digest_bytes,
 	nss_xcbc_final_symkey,
 	nss_xcbc_final_bytes,
+	nss_xcbc_clone,
+	nss_xcbc_destroy,
 };
@@ -51,6 +51,20 @@ clockid_t monotime_clockid(void)
 #endif
 }
 
+/*
+ * Microseconds added to the clock.  Advanced by the main thread but
+ * read by any thread.
+ */
+static intmax_t mononow_skew;
+
+void advance_mononow(deltatime_t d)
+{
+	intmax_t us = d.dt.tv_sec * INTMAX_C(1000000) + d.dt.tv_usec;
+	if (us > 0) {
+		__atomic_add_fetch(&mononow_skew, us, __ATOMIC_RELAXED);
+	}
+}
+
 monotime_t mononow(void)
 {
 	struct timespec t;
@@ -67,10 +81,12 @@ monotime_t mononow(void)
 			    monotime_clockid());
 	}
 	/* OK */
+	intmax_t us = (t.tv_sec * INTMAX_C(1000000) + t.tv_nsec / 1000 +
+		       __atomic_load_n(&mononow_skew, __ATOMIC_RELAXED));
 	return (monotime_t) {
 		.mt = {
-			.tv_sec = t.tv_sec,
-			.tv_usec = t.tv_nsec / 1000,
+			.tv_sec = us / 1000000,
+			.tv_usec = us % 1000000,
 		},
 	};
 }
@@ -340,6 +340,7 @@ TRANSFORMS += 's:@@MANDIR@@:$(MANDIR):'
 # where readonly configuration files go
 SYSCONFDIR ?= /etc
 TRANSFORMS += 's:@@SYSCONFDIR@@:$(SYSCONFDIR):g'
+USERLAND_CFLAGS += -DIPSEC_SYSCONFDIR=\"$(SYSCONFDIR)\"
 
 #
 # INITSYSTEM
@@ -740,6 +741,13 @@ ifeq ($(USE_SYSTEMD_WATCHDOG),true)
 USERLAND_CFLAGS += -DUSE_SYSTEMD_WATCHDOG
 endif
 
+# Add USDT probes to pluto, for tracing with eBPF or SystemTap;
+# requires <sys/sdt.h> (systemtap-sdt-devel or systemtap-sdt-dev).
+USE_USDT ?= false
+ifeq ($(USE_USDT),true)
+USERLAND_CFLAGS += -DUSE_USDT
+endif
+
 ifeq ($(USE_LDAP),true)
 USERLAND_CFLAGS += -DLIBLDAP
 LDAP_LDFLAGS ?= -lldap -llber
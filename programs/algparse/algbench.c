@@ -0,0 +1,463 @@
+/* algorithm throughput benchmark, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Measure the cost of each IKE algorithm using the same NSS code
+ * paths as pluto:
+ *
+ *   dh-keygen:    the KE sent to the peer (calc_local_secret)
+ *   dh-shared:    g^ir from the peer's KE (calc_shared_secret)
+ *   ike-keymat:   SKEYSEED then prf+ for an IKE SA's keys
+ *   child-keymat: prf+ from SK_d for a Child SA's keys
+ *   seal, open:   encrypt and decrypt an SK payload (AEAD only)
+ *
+ * Each measurement runs for a fixed time, first on one thread and
+ * then (optionally) on several at once; the latter shows how well
+ * pluto's helper threads will scale.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <keyhi.h>		/* for SECKEY_Destroy*() */
+
+#include "lswlog.h"
+#include "lswalloc.h"
+#include "lswnss.h"
+#include "ike_alg.h"
+#include "ike_alg_dh.h"		/* for ike_alg_dh_none */
+#include "ike_alg_dh_ops.h"
+#include "crypt_symkey.h"
+#include "crypt_cipher.h"
+#include "ikev2_prf.h"
+
+#include "algbench.h"
+
+/*
+ * Keying material for an AES_GCM_16_256 Child SA, both directions;
+ * and the extra bytes an IKE SA needs on top of its PRF keys.
+ */
+#define CHILD_KEYMAT_SIZE (2 * (32 + 4))
+#define NONCE_SIZE 32
+
+struct bench {
+	const char *what;
+	const struct ike_alg *alg;
+	unsigned keylen;		/* bits, 0 when n/a */
+	size_t bytes;			/* per op, 0 when n/a */
+	size_t message_size;
+	void *(*setup)(const struct bench *bench, struct logger *logger);
+	void (*op)(void *context, struct logger *logger);
+	void (*cleanup)(void *context, struct logger *logger);
+};
+
+static double seconds_now(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		perror("clock_gettime");
+		exit(1);
+	}
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * DH.
+ */
+
+struct dh_context {
+	const struct dh_desc *dh;
+	SECKEYPrivateKey *privk;
+	SECKEYPublicKey *pubk;
+	chunk_t remote_ke;
+};
+
+static void *dh_setup(const struct bench *bench, struct logger *logger)
+{
+	struct dh_context *ctx = alloc_thing(struct dh_context, "dh context");
+	ctx->dh = (const struct dh_desc *)bench->alg;
+	ctx->dh->dh_ops->calc_local_secret(ctx->dh, &ctx->privk, &ctx->pubk, logger);
+	/* the peer */
+	SECKEYPrivateKey *privk;
+	SECKEYPublicKey *pubk;
+	ctx->dh->dh_ops->calc_local_secret(ctx->dh, &privk, &pubk, logger);
+	ctx->remote_ke = clone_hunk(ctx->dh->dh_ops->local_secret_ke(ctx->dh, pubk),
+				    "remote KE");
+	SECKEY_DestroyPublicKey(pubk);
+	SECKEY_DestroyPrivateKey(privk);
+	return ctx;
+}
+
+static void dh_keygen(void *context, struct logger *logger)
+{
+	struct dh_context *ctx = context;
+	SECKEYPrivateKey *privk;
+	SECKEYPublicKey *pubk;
+	ctx->dh->dh_ops->calc_local_secret(ctx->dh, &privk, &pubk, logger);
+	SECKEY_DestroyPublicKey(pubk);
+	SECKEY_DestroyPrivateKey(privk);
+}
+
+static void dh_shared(void *context, struct logger *logger)
+{
+	struct dh_context *ctx = context;
+	PK11SymKey *shared = NULL;
+	diag_t d = ctx->dh->dh_ops->calc_shared_secret(ctx->dh, ctx->privk, ctx->pubk,
+						       ctx->remote_ke, &shared, logger);
+	if (d != NULL) {
+		llog_passert(logger, HERE, "%s: %s", ctx->dh->common.fqn, str_diag(d));
+	}
+	symkey_delref(logger, "shared", &shared);
+}
+
+static void dh_cleanup(void *context, struct logger *logger UNUSED)
+{
+	struct dh_context *ctx = context;
+	SECKEY_DestroyPublicKey(ctx->pubk);
+	SECKEY_DestroyPrivateKey(ctx->privk);
+	free_chunk_content(&ctx->remote_ke);
+	pfree(ctx);
+}
+
+/*
+ * PRF+
+ */
+
+struct prf_context {
+	const struct prf_desc *prf;
+	PK11SymKey *key;		/* g^ir or SK_d */
+	chunk_t ni, nr;
+	ike_spis_t ike_spis;
+};
+
+static void *prf_setup(const struct bench *bench, struct logger *logger)
+{
+	struct prf_context *ctx = alloc_thing(struct prf_context, "prf context");
+	ctx->prf = (const struct prf_desc *)bench->alg;
+	chunk_t key = alloc_chunk(ctx->prf->prf_key_size, "key");
+	ctx->key = symkey_from_hunk("key", key, logger);
+	free_chunk_content(&key);
+	ctx->ni = alloc_chunk(NONCE_SIZE, "Ni");
+	ctx->nr = alloc_chunk(NONCE_SIZE, "Nr");
+	return ctx;
+}
+
+static void prf_ike_keymat(void *context, struct logger *logger)
+{
+	struct prf_context *ctx = context;
+	PK11SymKey *skeyseed = ikev2_ike_sa_skeyseed(ctx->prf, ctx->ni, ctx->nr,
+						     ctx->key, logger);
+	PK11SymKey *keymat = ikev2_ike_sa_keymat(ctx->prf, skeyseed,
+						 ctx->ni, ctx->nr, &ctx->ike_spis,
+						 3 * ctx->prf->prf_key_size + CHILD_KEYMAT_SIZE,
+						 logger);
+	symkey_delref(logger, "keymat", &keymat);
+	symkey_delref(logger, "skeyseed", &skeyseed);
+}
+
+static void prf_child_keymat(void *context, struct logger *logger)
+{
+	struct prf_context *ctx = context;
+	PK11SymKey *keymat = ikev2_child_sa_keymat(ctx->prf, ctx->key, NULL,
+						   ctx->ni, ctx->nr,
+						   CHILD_KEYMAT_SIZE, logger);
+	symkey_delref(logger, "keymat", &keymat);
+}
+
+static void prf_cleanup(void *context, struct logger *logger)
+{
+	struct prf_context *ctx = context;
+	symkey_delref(logger, "key", &ctx->key);
+	free_chunk_content(&ctx->ni);
+	free_chunk_content(&ctx->nr);
+	pfree(ctx);
+}
+
+/*
+ * AEAD; as in pluto, the cipher context is created once per SA.
+ */
+
+struct aead_context {
+	const struct encrypt_desc *encrypt;
+	PK11SymKey *key;
+	chunk_t salt;
+	chunk_t wire_iv;
+	chunk_t aad;
+	chunk_t text_and_tag;
+	chunk_t sealed;		/* for open */
+	size_t text_size;
+	struct cipher_context *seal;
+	struct cipher_context *open;
+};
+
+static void *aead_setup(const struct bench *bench, struct logger *logger)
+{
+	struct aead_context *ctx = alloc_thing(struct aead_context, "aead context");
+	ctx->encrypt = (const struct encrypt_desc *)bench->alg;
+	chunk_t key = alloc_chunk(BYTES_FOR_BITS(bench->keylen), "key");
+	ctx->key = encrypt_key_from_hunk("key", ctx->encrypt, key, logger);
+	free_chunk_content(&key);
+	ctx->salt = alloc_chunk(ctx->encrypt->salt_size, "salt");
+	ctx->wire_iv = alloc_chunk(ctx->encrypt->wire_iv_size, "wire IV");
+	ctx->aad = alloc_chunk(28/*IKE header*/ + 4/*SK header*/, "AAD");
+	ctx->text_size = bench->message_size;
+	ctx->text_and_tag = alloc_chunk(ctx->text_size + ctx->encrypt->aead_tag_size,
+					"text and tag");
+	ctx->seal = cipher_context_create(ctx->encrypt, ENCRYPT, FILL_WIRE_IV,
+					  ctx->key, HUNK_AS_SHUNK(ctx->salt), logger);
+	ctx->open = cipher_context_create(ctx->encrypt, DECRYPT, USE_WIRE_IV,
+					  ctx->key, HUNK_AS_SHUNK(ctx->salt), logger);
+	/* something to open */
+	passert(cipher_context_op_aead(ctx->seal, ctx->wire_iv, HUNK_AS_SHUNK(ctx->aad),
+				       ctx->text_and_tag, ctx->text_size,
+				       ctx->encrypt->aead_tag_size, logger));
+	ctx->sealed = clone_hunk(ctx->text_and_tag, "sealed");
+	return ctx;
+}
+
+static void aead_seal(void *context, struct logger *logger)
+{
+	struct aead_context *ctx = context;
+	passert(cipher_context_op_aead(ctx->seal, ctx->wire_iv, HUNK_AS_SHUNK(ctx->aad),
+				       ctx->text_and_tag, ctx->text_size,
+				       ctx->encrypt->aead_tag_size, logger));
+}
+
+static void aead_open(void *context, struct logger *logger)
+{
+	struct aead_context *ctx = context;
+	/* decryption is in place */
+	memcpy(ctx->text_and_tag.ptr, ctx->sealed.ptr, ctx->sealed.len);
+	passert(cipher_context_op_aead(ctx->open, ctx->wire_iv, HUNK_AS_SHUNK(ctx->aad),
+				       ctx->text_and_tag, ctx->text_size,
+				       ctx->encrypt->aead_tag_size, logger));
+}
+
+static void aead_cleanup(void *context, struct logger *logger)
+{
+	struct aead_context *ctx = context;
+	cipher_context_destroy(&ctx->seal, logger);
+	cipher_context_destroy(&ctx->open, logger);
+	symkey_delref(logger, "key", &ctx->key);
+	free_chunk_content(&ctx->salt);
+	free_chunk_content(&ctx->wire_iv);
+	free_chunk_content(&ctx->aad);
+	free_chunk_content(&ctx->text_and_tag);
+	free_chunk_content(&ctx->sealed);
+	pfree(ctx);
+}
+
+/*
+ * Run BENCH on each thread for the same length of time.
+ */
+
+struct bench_thread {
+	pthread_t thread;
+	const struct bench *bench;
+	pthread_barrier_t *start;
+	double duration;
+	unsigned long ops;
+	double elapsed;
+	struct logger *logger;
+};
+
+static void *bench_thread(void *arg)
+{
+	struct bench_thread *t = arg;
+	void *ctx = t->bench->setup(t->bench, t->logger);
+	/* warm up */
+	t->bench->op(ctx, t->logger);
+	pthread_barrier_wait(t->start);
+	double start = seconds_now();
+	double now;
+	do {
+		t->bench->op(ctx, t->logger);
+		t->ops++;
+		now = seconds_now();
+	} while (now - start < t->duration);
+	t->elapsed = now - start;
+	t->bench->cleanup(ctx, t->logger);
+	return NULL;
+}
+
+static void run_bench(const struct bench *bench, unsigned nr_threads,
+		      const struct bench_options *options, struct logger *logger)
+{
+	struct bench_thread *threads = alloc_things(struct bench_thread, nr_threads,
+						    "bench threads");
+	pthread_barrier_t start;
+	pthread_barrier_init(&start, NULL, nr_threads);
+	for (unsigned i = 0; i < nr_threads; i++) {
+		threads[i] = (struct bench_thread) {
+			.bench = bench,
+			.start = &start,
+			.duration = options->milliseconds / 1000.0,
+			.logger = logger,
+		};
+		if (pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]) != 0) {
+			fatal(PLUTO_EXIT_FAIL, logger, "pthread_create() failed");
+		}
+	}
+
+	unsigned long ops = 0;
+	double elapsed = 0;
+	for (unsigned i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		ops += threads[i].ops;
+		if (threads[i].elapsed > elapsed) {
+			elapsed = threads[i].elapsed;
+		}
+	}
+	pthread_barrier_destroy(&start);
+	pfree(threads);
+
+	double ops_per_second = ops / elapsed;
+	char keylen[16] = "";
+	if (bench->keylen > 0) {
+		snprintf(keylen, sizeof(keylen), "%u", bench->keylen);
+	}
+	char bytes[32] = "-";
+	if (bench->bytes > 0) {
+		snprintf(bytes, sizeof(bytes), "%.1f",
+			 ops_per_second * bench->bytes / (1024 * 1024));
+	}
+	printf("%-12s %-24s %6s %7u %14.1f %12s %10.2f\n",
+	       bench->what, bench->alg->fqn, keylen, nr_threads,
+	       ops_per_second, bytes, 1e6 / ops_per_second * nr_threads);
+	fflush(stdout);
+}
+
+static bool selected(const struct bench *bench, const struct bench_options *options)
+{
+	if (options->names == NULL || options->names[0] == NULL) {
+		return true;
+	}
+	for (char **name = options->names; *name != NULL; name++) {
+		if (strcaseeq(*name, bench->alg->fqn) ||
+		    strcaseeq(*name, bench->what)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void bench(const struct bench *bench, const struct bench_options *options,
+		  struct logger *logger)
+{
+	if (!selected(bench, options)) {
+		return;
+	}
+	run_bench(bench, 1, options, logger);
+	if (options->threads > 1) {
+		run_bench(bench, options->threads, options, logger);
+	}
+}
+
+void bench_ike_alg(const struct bench_options *options, struct logger *logger)
+{
+	printf("%-12s %-24s %6s %7s %14s %12s %10s\n",
+	       "operation", "algorithm", "keylen", "threads",
+	       "ops/s", "MiB/s", "us/op");
+
+	for (const struct dh_desc **dhp = next_dh_desc(NULL);
+	     dhp != NULL; dhp = next_dh_desc(dhp)) {
+		const struct dh_desc *dh = *dhp;
+		if (dh == &ike_alg_dh_none /* nothing to time */ ||
+		    !ike_alg_is_ike(&dh->common)) {
+			continue;
+		}
+		struct bench keygen = {
+			.what = "dh-keygen",
+			.alg = &dh->common,
+			.setup = dh_setup,
+			.op = dh_keygen,
+			.cleanup = dh_cleanup,
+		};
+		bench(&keygen, options, logger);
+		struct bench shared = {
+			.what = "dh-shared",
+			.alg = &dh->common,
+			.setup = dh_setup,
+			.op = dh_shared,
+			.cleanup = dh_cleanup,
+		};
+		bench(&shared, options, logger);
+	}
+
+	for (const struct prf_desc **prfp = next_prf_desc(NULL);
+	     prfp != NULL; prfp = next_prf_desc(prfp)) {
+		const struct prf_desc *prf = *prfp;
+		if (prf->prf_ikev2_ops == NULL || !ike_alg_is_ike(&prf->common)) {
+			continue;
+		}
+		struct bench ike = {
+			.what = "ike-keymat",
+			.alg = &prf->common,
+			.bytes = 3 * prf->prf_key_size + CHILD_KEYMAT_SIZE,
+			.setup = prf_setup,
+			.op = prf_ike_keymat,
+			.cleanup = prf_cleanup,
+		};
+		bench(&ike, options, logger);
+		struct bench child = {
+			.what = "child-keymat",
+			.alg = &prf->common,
+			.bytes = CHILD_KEYMAT_SIZE,
+			.setup = prf_setup,
+			.op = prf_child_keymat,
+			.cleanup = prf_cleanup,
+		};
+		bench(&child, options, logger);
+	}
+
+	for (const struct encrypt_desc **encryptp = next_encrypt_desc(NULL);
+	     encryptp != NULL; encryptp = next_encrypt_desc(encryptp)) {
+		const struct encrypt_desc *encrypt = *encryptp;
+		if (encrypt->encrypt_ops == NULL ||
+		    !encrypt_desc_is_aead(encrypt) ||
+		    !ike_alg_is_ike(&encrypt->common)) {
+			continue;
+		}
+		for (const unsigned *keylen = encrypt->key_bit_lengths;
+		     keylen < encrypt->key_bit_lengths + elemsof(encrypt->key_bit_lengths) &&
+			     *keylen > 0; keylen++) {
+			struct bench seal = {
+				.what = "seal",
+				.alg = &encrypt->common,
+				.keylen = *keylen,
+				.bytes = options->message_size,
+				.message_size = options->message_size,
+				.setup = aead_setup,
+				.op = aead_seal,
+				.cleanup = aead_cleanup,
+			};
+			bench(&seal, options, logger);
+			struct bench open = {
+				.what = "open",
+				.alg = &encrypt->common,
+				.keylen = *keylen,
+				.bytes = options->message_size,
+				.message_size = options->message_size,
+				.setup = aead_setup,
+				.op = aead_open,
+				.cleanup = aead_cleanup,
+			};
+			bench(&open, options, logger);
+		}
+	}
+}
@@ -0,0 +1,33 @@
+/* algorithm throughput benchmark, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef ALGBENCH_H
+#define ALGBENCH_H
+
+#include <stddef.h>
+
+struct logger;
+
+struct bench_options {
+	unsigned threads;		/* >1 also runs across THREADS */
+	unsigned milliseconds;		/* per measurement */
+	size_t message_size;		/* AEAD plaintext */
+	char **names;			/* NULL terminated filter */
+};
+
+/* algparse --bench; call after init_ike_alg() */
+void bench_ike_alg(const struct bench_options *options, struct logger *logger);
+
+#endif
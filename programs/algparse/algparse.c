@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "lswlog.h"
 #include "lswtool.h"
@@ -11,6 +12,8 @@
 #include "ike_alg.h"
 #include "proposals.h"
 
+#include "algbench.h"
+
 static bool test_proposals = false;
 static bool test_algs = false;
 static bool verbose = false;
@@ -20,6 +23,12 @@ static enum ike_version ike_version = IKEv2;
 static bool ignore_parser_errors = false;
 static bool fips = false;
 static bool pfs = false;
+static bool benchmark = false;
+static struct bench_options bench_options = {
+	.threads = 1,
+	.milliseconds = 500,
+	.message_size = 1280,
+};
 static int failures = 0;
 
 #define ERROR 124
@@ -541,6 +550,7 @@ static void usage(void)
 		"Usage:\n"
 		"\n"
 		"    algparse [ <option> ... ] -tp | -ta | [<protocol>=][<proposal>{,<proposal>}] ...\n"
+		"    algparse [ <option> ... ] -bench [ <algorithm> | <operation> ... ]\n"
 		"\n"
 		"Parse one or more proposals using the algorithm parser.\n"
 		"Either specify the proposals to be parsed on the command line\n"
@@ -557,6 +567,15 @@ static void usage(void)
 		"    -tp: run the proposal testsuite\n"
 		"    -ta: also run the algorithm testsuite\n"
 		"\n"
+		"or measure the throughput of each IKE algorithm:\n"
+		"\n"
+		"    -bench: time DH (dh-keygen, dh-shared), PRF+ (ike-keymat,\n"
+		"        child-keymat) and AEAD (seal, open); the optional list of\n"
+		"        algorithm and operation names limits what is timed\n"
+		"    -bench-threads <n>: also time <n> threads running in parallel\n"
+		"    -bench-time <ms>: how long to time each operation (default 500)\n"
+		"    -bench-size <bytes>: AEAD message size (default 1280)\n"
+		"\n"
 		"Additional options:\n"
 		"\n"
 		"    -v2 | -ikev2: configure for IKEv2 (default)\n"
@@ -631,6 +650,26 @@ int main(int argc, char *argv[])
 			ignore_parser_errors = true;
 		} else if (streq(arg, "impair")) {
 			impaired = true;
+		} else if (streq(arg, "bench")) {
+			benchmark = true;
+		} else if (streq(arg, "bench-threads") ||
+			   streq(arg, "bench-time") ||
+			   streq(arg, "bench-size")) {
+			const char *val = *++argp;
+			char *end;
+			unsigned long u = (val == NULL ? 0 : strtoul(val, &end, 0));
+			if (val == NULL || *end != '\0' || u == 0 || u > UINT_MAX) {
+				fprintf(stderr, "invalid or missing %s value\n", arg);
+				exit(ERROR);
+			}
+			benchmark = true;
+			if (streq(arg, "bench-threads")) {
+				bench_options.threads = u;
+			} else if (streq(arg, "bench-time")) {
+				bench_options.milliseconds = u;
+			} else {
+				bench_options.message_size = u;
+			}
 		} else if (streq(arg, "P") || streq(arg, "nsspw") || streq(arg, "password")) {
 			char *nsspw = *++argp;
 			if (nsspw == NULL) {
@@ -676,7 +715,15 @@ int main(int argc, char *argv[])
 		test_ike_alg(logger);
 	}
 
-	if (*argp) {
+	if (benchmark) {
+		if (test_proposals) {
+			fprintf(stderr, "-bench conflicts with -tp\n");
+			exit(ERROR);
+		}
+		/* remaining arguments select what to time */
+		bench_options.names = argp;
+		bench_ike_alg(&bench_options, logger);
+	} else if (*argp) {
 		if (test_proposals) {
 			fprintf(stderr, "-t conflicts with algorithm list\n");
 			exit(ERROR);
@@ -34,6 +34,10 @@
 #include "orient.h"
 #include "instantiate.h"
 #include "initiate.h"
+#include "hash_table.h"
+#include "ip_info.h"
+#include "ikev2.h"
+#include "ikev2_create_child_sa.h"	/* for submit_v2_CREATE_CHILD_SA_resource_child() */
 
 /* (Possibly) Opportunistic Initiation:
  *
@@ -151,6 +155,20 @@ void initiate_ondemand(const struct kernel_acquire *b)
 		jam_kernel_acquire(buf, b);
 	}
 
+	/*
+	 * RFC 9611: the kernel has no SA for this CPU; when the
+	 * connection is up, add a per-CPU Child SA to it.
+	 */
+	if (b->pcpu.is_set &&
+	    cp->config->child_sa.per_cpu &&
+	    submit_v2_CREATE_CHILD_SA_resource_child(cp, b->pcpu,
+						     b->background,
+						     cp->logger)) {
+		connection_detach(cp, b->logger);
+		connection_delref(&cp, b->logger);
+		return;
+	}
+
 	const struct child_policy policy = child_sa_policy(cp);
 	initiate(cp, &policy, SOS_NOBODY,
 		 &inception, b->sec_label,
@@ -162,3 +180,297 @@ void initiate_ondemand(const struct kernel_acquire *b)
 	connection_delref(&cp, b->logger);
 
 }
+
+/*
+ * ACQUIRE ingestion.
+ *
+ * A scan across addresses covered by a %trap (for instance an
+ * opportunistic template) generates an ACQUIRE per flow; each would
+ * otherwise mean a connection search and possibly an instantiate.
+ *
+ * Before any of that work happens, the ACQUIRE is dropped when:
+ *
+ * - it duplicates (src, dst, protocol, sec_label, CPU) of an ACQUIRE
+ *   triggered by the same kernel policy and admitted during the
+ *   last ACQUIRE_DEDUP_WINDOW_MS (the ports are ignored, the
+ *   negotiation will cover them)
+ *
+ * - the destination has used up its budget (a token bucket allowing
+ *   ACQUIRE_DESTINATION_BURST ACQUIREs and then one every
+ *   ACQUIRE_DESTINATION_INTERVAL_MS)
+ *
+ * A dropped ACQUIRE isn't lost for good: the kernel sends another
+ * once its larval state expires (see xfrmlifetime=).
+ */
+
+#define ACQUIRE_MAX_ENTRIES 8192
+#define ACQUIRE_QUEUE_SIZE 64
+#define ACQUIRE_DEDUP_WINDOW_MS 2000
+#define ACQUIRE_DESTINATION_BURST 8
+#define ACQUIRE_DESTINATION_INTERVAL_MS 500
+
+struct acquire_key {
+	enum acquire_kind { ACQUIRE_FLOW = 1, ACQUIRE_DESTINATION, } kind;
+	const struct ip_info *info;
+	struct ip_bytes src;	/* zero for ACQUIRE_DESTINATION */
+	struct ip_bytes dst;
+	unsigned ipproto;	/* zero for ACQUIRE_DESTINATION */
+	hash_t sec_label;	/* zero for ACQUIRE_DESTINATION */
+	enum kernel_policy_id policy_id;	/* zero for ACQUIRE_DESTINATION */
+	struct sa_pcpu pcpu;	/* zero for ACQUIRE_DESTINATION */
+};
+
+struct acquire_entry {
+	struct acquire_key key;
+	monotime_t seen;	/* flow: admitted; destination: credit updated */
+	intmax_t credit_ms;	/* destination only */
+	struct {
+		struct list_entry list;
+		struct list_entry key;
+	} acquire_entry_db_entries;
+};
+
+static size_t jam_acquire_entry(struct jambuf *buf, const struct acquire_entry *e)
+{
+	size_t s = 0;
+	s += jam_string(buf, (e->key.kind == ACQUIRE_FLOW ? "flow " : "destination "));
+	ip_address dst = address_from_raw(HERE, e->key.info->ip_version, e->key.dst);
+	s += jam_address(buf, &dst);
+	return s;
+}
+
+static hash_t hash_acquire_entry_key(const struct acquire_key *key)
+{
+	return hash_thing(*key, zero_hash);
+}
+
+HASH_TABLE(acquire_entry, key, .key, 1021);
+
+static void acquire_entry_db_init(struct logger *logger);
+static void acquire_entry_db_check(struct logger *logger);
+static void acquire_entry_db_init_acquire_entry(struct acquire_entry *);
+static void acquire_entry_db_add(struct acquire_entry *);
+static void acquire_entry_db_del(struct acquire_entry *);
+
+HASH_DB(acquire_entry, &acquire_entry_key_hash_table);
+
+static struct {
+	unsigned nr_entries;
+	monotime_t pruned;
+	struct {
+		unsigned duplicate;
+		unsigned rate_limited;
+	} dropped;
+	unsigned nr_queued;
+	struct queued_acquire {
+		ip_packet packet;
+		chunk_t sec_label;
+		bool background;
+		enum kernel_state_id state_id;
+		enum kernel_policy_id policy_id;
+		struct sa_pcpu pcpu;
+	} queue[ACQUIRE_QUEUE_SIZE];
+} acquires;
+
+void init_acquire_queue(struct logger *logger)
+{
+	acquire_entry_db_init(logger);
+}
+
+static struct acquire_entry *acquire_entry_by_key(const struct acquire_key *key)
+{
+	hash_t hash = hash_acquire_entry_key(key);
+	struct list_head *bucket = hash_table_bucket(&acquire_entry_key_hash_table, hash);
+	struct acquire_entry *e;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(e, bucket) {
+		if (memeq(&e->key, key, sizeof(*key))) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void free_acquire_entry(struct acquire_entry **e)
+{
+	acquire_entry_db_del(*e);
+	pfree(*e);
+	*e = NULL;
+	acquires.nr_entries--;
+}
+
+static bool entry_expired(const struct acquire_entry *e, monotime_t now)
+{
+	intmax_t age_ms = deltamillisecs(monotimediff(now, e->seen));
+	switch (e->key.kind) {
+	case ACQUIRE_FLOW:
+		return age_ms >= ACQUIRE_DEDUP_WINDOW_MS;
+	case ACQUIRE_DESTINATION:
+		/* bucket is full again */
+		return (e->credit_ms + age_ms >=
+			ACQUIRE_DESTINATION_BURST * ACQUIRE_DESTINATION_INTERVAL_MS);
+	}
+	bad_case(e->key.kind);
+}
+
+static void prune_acquire_entries(monotime_t now, struct logger *logger)
+{
+	struct acquire_entry *e;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(e, &acquire_entry_db_list_head) {
+		if (entry_expired(e, now)) {
+			free_acquire_entry(&e);
+		}
+	}
+
+	if (acquires.dropped.duplicate > 0 || acquires.dropped.rate_limited > 0) {
+		llog(RC_LOG, logger,
+		     "kernel: dropped %u duplicate and %u rate limited ACQUIREs in the last %jds",
+		     acquires.dropped.duplicate, acquires.dropped.rate_limited,
+		     deltasecs(monotimediff(now, acquires.pruned)));
+		acquires.dropped.duplicate = 0;
+		acquires.dropped.rate_limited = 0;
+	}
+	acquires.pruned = now;
+}
+
+static struct acquire_entry *acquire_entry(const struct acquire_key *key, monotime_t now,
+					   bool *new_entry)
+{
+	struct acquire_entry *entry = acquire_entry_by_key(key);
+	if (entry != NULL) {
+		*new_entry = false;
+		return entry;
+	}
+	if (acquires.nr_entries >= ACQUIRE_MAX_ENTRIES) {
+		return NULL;
+	}
+	struct acquire_entry e = {
+		.key = *key,
+		.seen = now,
+		.credit_ms = ACQUIRE_DESTINATION_BURST * ACQUIRE_DESTINATION_INTERVAL_MS,
+	};
+	entry = clone_thing(e, "acquire entry");
+	acquire_entry_db_init_acquire_entry(entry);
+	acquire_entry_db_add(entry);
+	acquires.nr_entries++;
+	*new_entry = true;
+	return entry;
+}
+
+static const char *admit_acquire(const struct kernel_acquire *b, monotime_t now)
+{
+	struct acquire_key flow;
+	zero(&flow);
+	flow.kind = ACQUIRE_FLOW;
+	flow.info = b->packet.info;
+	flow.src = b->packet.src.bytes;
+	flow.dst = b->packet.dst.bytes;
+	flow.ipproto = (b->packet.protocol != NULL ? b->packet.protocol->ipproto : 0);
+	flow.sec_label = hash_hunk(b->sec_label, zero_hash);
+	flow.policy_id = b->policy_id;
+	flow.pcpu.is_set = b->pcpu.is_set;
+	flow.pcpu.cpu = b->pcpu.cpu;
+
+	struct acquire_key destination;
+	zero(&destination);
+	destination.kind = ACQUIRE_DESTINATION;
+	destination.info = b->packet.info;
+	destination.dst = b->packet.dst.bytes;
+
+	/* when the tables are full, assume a flood */
+	bool new_flow, new_destination;
+	struct acquire_entry *f = acquire_entry(&flow, now, &new_flow);
+	struct acquire_entry *d = acquire_entry(&destination, now, &new_destination);
+	if (f == NULL || d == NULL) {
+		acquires.dropped.rate_limited++;
+		return "too many ACQUIREs";
+	}
+
+	if (!new_flow) {
+		if (!entry_expired(f, now)) {
+			acquires.dropped.duplicate++;
+			return "duplicate ACQUIRE";
+		}
+		f->seen = now;
+	}
+
+	intmax_t elapsed_ms = deltamillisecs(monotimediff(now, d->seen));
+	d->credit_ms = min(d->credit_ms + elapsed_ms,
+			   (intmax_t)ACQUIRE_DESTINATION_BURST * ACQUIRE_DESTINATION_INTERVAL_MS);
+	d->seen = now;
+	if (d->credit_ms < ACQUIRE_DESTINATION_INTERVAL_MS) {
+		acquires.dropped.rate_limited++;
+		return "destination is rate limited";
+	}
+	d->credit_ms -= ACQUIRE_DESTINATION_INTERVAL_MS;
+	return NULL;
+}
+
+void queue_acquire(const struct kernel_acquire *b)
+{
+	monotime_t now = mononow();
+	if (deltamillisecs(monotimediff(now, acquires.pruned)) >= 1000) {
+		prune_acquire_entries(now, b->logger);
+	}
+
+	const char *dropped = admit_acquire(b, now);
+	if (dropped != NULL) {
+		LDBGP_JAMBUF(DBG_BASE, b->logger, buf) {
+			jam(buf, "dropping ");
+			jam_kernel_acquire(buf, b);
+			jam(buf, ": %s", dropped);
+		}
+		return;
+	}
+
+	if (acquires.nr_queued == ACQUIRE_QUEUE_SIZE) {
+		process_queued_acquires(b->logger);
+	}
+
+	struct queued_acquire *q = &acquires.queue[acquires.nr_queued++];
+	q->packet = b->packet;
+	q->sec_label = clone_hunk(b->sec_label, "queued acquire sec_label");
+	q->background = b->background;
+	q->state_id = b->state_id;
+	q->policy_id = b->policy_id;
+	q->pcpu = b->pcpu;
+}
+
+void process_queued_acquires(struct logger *logger)
+{
+	/* initiate_ondemand() could, in theory, queue more */
+	unsigned nr_queued = acquires.nr_queued;
+	acquires.nr_queued = 0;
+	if (nr_queued > 0) {
+		ldbg(logger, "kernel: processing %u queued ACQUIREs", nr_queued);
+	}
+	struct queued_acquire queue[ACQUIRE_QUEUE_SIZE];
+	memcpy(queue, acquires.queue, nr_queued * sizeof(queue[0]));
+	for (unsigned i = 0; i < nr_queued; i++) {
+		struct queued_acquire *q = &queue[i];
+		struct kernel_acquire b = {
+			.packet = q->packet,
+			.by_acquire = true,
+			.logger = logger,
+			.background = q->background,
+			.sec_label = HUNK_AS_SHUNK(q->sec_label),
+			.state_id = q->state_id,
+			.policy_id = q->policy_id,
+			.pcpu = q->pcpu,
+		};
+		initiate_ondemand(&b);
+		free_chunk_content(&q->sec_label);
+	}
+}
+
+void free_acquire_queue(void)
+{
+	for (unsigned i = 0; i < acquires.nr_queued; i++) {
+		free_chunk_content(&acquires.queue[i].sec_label);
+	}
+	acquires.nr_queued = 0;
+	struct acquire_entry *e;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(e, &acquire_entry_db_list_head) {
+		free_acquire_entry(&e);
+	}
+	acquire_entry_db_check(&global_logger);
+}
@@ -18,7 +18,21 @@
 #define ACQUIRE_H
 
 struct kernel_acquire;
+struct logger;
 
 extern void initiate_ondemand(const struct kernel_acquire *b);
 
+/*
+ * ACQUIRE ingestion.
+ *
+ * While draining its socket, the kernel code queues each ACQUIRE
+ * (duplicates and those over the per-destination rate limit are
+ * dropped); once the socket is empty the queue is processed.
+ */
+
+void init_acquire_queue(struct logger *logger);
+void queue_acquire(const struct kernel_acquire *b);
+void process_queued_acquires(struct logger *logger);
+void free_acquire_queue(void);
+
 #endif
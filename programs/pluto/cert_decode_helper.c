@@ -87,6 +87,7 @@ void submit_v2_cert_decode(struct ike_sa *ike,
 			.ocsp = ocsp_enable,
 			.ocsp_strict = ocsp_strict,
 			.ocsp_post = ocsp_post,
+			.ocsp_prefetch = ocsp_prefetch,
 			.crl_strict = crl_strict,
 		},
 	};
@@ -1566,11 +1566,14 @@ diag_t add_end_cert_and_preload_private_key(CERTCertificate *cert,
 	}
 
 	dbg("loading %s certificate \'%s\' pubkey", leftright, nickname);
-	if (!add_pubkey_from_nss_cert(&pluto_pubkeys, &host_end->id, cert, logger)) {
+	struct pubkey_list *pubkeys = NULL;
+	if (!add_pubkey_from_nss_cert(&pubkeys, &host_end->id, cert, logger)) {
 		/* XXX: push diag_t into add_pubkey_from_nss_cert()? */
+		free_public_keys(&pubkeys);
 		return diag("%s certificate \'%s\' pubkey could not be loaded",
 			    leftright, nickname);
 	}
+	replace_preloaded_pubkeys(&pubkeys);
 
 	host_end_config->cert.nss_cert = cert;
 
@@ -2791,6 +2794,30 @@ static diag_t extract_connection(const struct whack_message *wm,
 		}
 	}
 
+	if (extract_yn("", "per-cpu-sas", wm->per_cpu_sas, /*default*/false, wm, c->logger)) {
+		if (wm->ike_version == IKEv1) {
+			llog(RC_LOG, c->logger,
+			     "warning: ignoring per-cpu-sas=yes as IKEv1");
+		} else if (never_negotiate_wm(wm)) {
+			llog(RC_LOG, c->logger,
+			     "warning: ignoring per-cpu-sas=yes for never-negotiate connection");
+		} else if (kernel_ops->pcpu_ipsec_sa_is_enabled == NULL) {
+			llog(RC_LOG, c->logger,
+			     "warning: %s kernel interface does not support per-CPU SAs so disabling",
+			     kernel_ops->interface_name);
+		} else {
+			/* probe the interface */
+			err_t err = kernel_ops->pcpu_ipsec_sa_is_enabled(c->logger);
+			if (err != NULL) {
+				llog(RC_LOG, c->logger,
+				     "warning: per-CPU SAs are not supported by %s kernel interface, %s, so disabling",
+				     kernel_ops->interface_name, err);
+			} else {
+				config->child_sa.per_cpu = true;
+			}
+		}
+	}
+
 	connection_buf cb;
 	policy_buf pb;
 	dbg("added new %s connection "PRI_CONNECTION" with policy %s",
@@ -3885,6 +3912,7 @@ size_t jam_connection_policies(struct jambuf *buf, const struct connection *c)
 		CS(str_enum_short(&encap_mode_names, c->config->child_sa.encap_mode, &eb));
 	}
 	CT(child_sa.pfs, PFS);
+	CT(child_sa.per_cpu, PER_CPU_SAS);
 	CT(decap_dscp, DECAP_DSCP);
 	CF(encap_dscp, DONT_ENCAP_DSCP);
 	CT(nopmtudisc, NOPMTUDISC);
@@ -4380,6 +4408,14 @@ so_serial_t get_newer_sa_from_connection(struct state *st)
 		newest = c->established_ike_sa;
 		dbg("picked established_ike_sa #%lu for #%lu",
 		    newest, st->st_serialno);
+	} else if (st->st_resource_sa) {
+		/*
+		 * RFC 9611: a per-resource Child SA never owns the
+		 * connection; it is only replaced by its own rekey.
+		 */
+		dbg("per-resource Child SA #%lu has no newer SA",
+		    st->st_serialno);
+		return SOS_NOBODY;
 	} else {
 		newest = c->established_child_sa;
 		dbg("picked established_child_sa #%lu for #%lu",
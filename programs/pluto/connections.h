@@ -346,6 +346,7 @@ struct config {
 		enum encap_proto encap_proto;	/* ESP or AH */
 		enum encap_mode encap_mode;	/* tunnel or transport */
 		bool pfs;			/* use DH */
+		bool per_cpu;			/* RFC 9611 per-CPU Child SAs */
 		/*
 		 * The child proposals specified in the config file,
 		 * and for IKEv2, that proposal converted to IKEv2
@@ -15,6 +15,7 @@
  */
 
 #include <pthread.h>
+#include <errno.h>		/* for ETIMEDOUT */
 
 #include "lswalloc.h"
 #include "secrets.h"		/* for clone_secitem_as_chunk() */
@@ -26,17 +27,20 @@
 #include "log.h"
 #include "whack_shutdown.h"		/* for exiting_pluto; */
 #include "show.h"
+#include "hash_table.h"
 
 /*
  * List of lists.
  *
  * The main thread appends to these lists (with everything locked).
  *
- * The fetch thread traverses these lists.  While traversing these
- * structures the lock is held.  However once it reaches a node it
- * releases the lock (it then re-claims it when traversal is resumed).
+ * The fetch threads traverse these lists.  While traversing these
+ * structures the lock is held.  However once a thread claims a
+ * request (marking it busy) it releases the lock while fetching each
+ * distribution point (it then re-claims it when traversal is
+ * resumed).
  *
- * This means that, while the fetch thread is processing a node
+ * This means that, while a fetch thread is processing a node
  * (distribution point), the lists can be growing.  Hence the
  * volatile's sprinkled across this code.
  */
@@ -51,6 +55,8 @@ struct crl_fetch_queue {
 	chunk_t issuer_dn;
 	struct crl_distribution_point *volatile distribution_points;
 	int trials;
+	bool busy;		/* a fetch thread is working on it */
+	unsigned generation;	/* when last claimed */
 	struct logger *logger;
 	struct crl_fetch_queue *volatile next;
 };
@@ -85,6 +91,8 @@ static void free_crl_fetch_request(struct crl_fetch_queue **request)
 static pthread_mutex_t crl_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t crl_queue_cond = PTHREAD_COND_INITIALIZER;
 static struct crl_fetch_queue *volatile crl_fetch_queue = NULL;
+/* bumped each time the queue is poked; stops wakeups getting lost */
+static volatile unsigned crl_queue_generation = 0;
 
 /*
  * *ALWAYS* Append additional distribution points.
@@ -174,6 +182,8 @@ void submit_crl_fetch_requests(struct crl_fetch_request **requests, struct logge
 				.request_time = realnow(),
 				.issuer_dn = clone_hunk(request->issuer_dn, "crl issuer dn"),
 				.distribution_points = NULL,
+				/* i.e., not yet tried */
+				.generation = crl_queue_generation,
 				.logger = clone_logger(logger, HERE),
 				.next = NULL,
 			};
@@ -183,8 +193,9 @@ void submit_crl_fetch_requests(struct crl_fetch_request **requests, struct logge
 			*entry = clone_thing(new_entry, "crl entry");
 		}
 	}
-	dbg("CRL: poke the sleeping dragon (fetch thread)");
-	pthread_cond_signal(&crl_queue_cond);
+	dbg("CRL: poke the sleeping dragons (fetch threads)");
+	crl_queue_generation++;
+	pthread_cond_broadcast(&crl_queue_cond);
 	pthread_mutex_unlock(&crl_queue_mutex);
 
 	/* clean up */
@@ -259,21 +270,177 @@ void add_crl_fetch_request(asn1_t issuer_dn, shunk_t url,
 void submit_crl_fetch_request(asn1_t issuer_dn, struct logger *logger)
 {
 	struct crl_fetch_request *requests = NULL;
+	/* remember it for the next check_crls() */
+	add_crl_issuer(issuer_dn, /*URL*/null_shunk);
 	add_crl_fetch_request(issuer_dn, /*URL*/null_shunk, &requests, logger);
 	submit_crl_fetch_requests(&requests, logger);
 }
 
-void process_crl_fetch_requests(fetch_crl_fn *fetch_crl, struct logger *unused_logger UNUSED)
+/*
+ * The set of known issuers (and, when NSS has a CRL, its URL) that
+ * check_crls() submits every crlcheckinterval.
+ *
+ * Enumerating NSS's CRLs and certificates is expensive (every CRL
+ * is decoded) so it is done once; after that the set grows as new
+ * issuers are seen.  whack --rereadcerts flushes the set so that
+ * changes made to the NSS DB behind pluto's back are picked up.
+ *
+ * Main thread only.
+ */
+
+struct crl_issuer {
+	chunk_t issuer_dn;
+	char *url;		/* could be NULL */
+	struct {
+		struct list_entry list;
+		struct list_entry issuer_dn;
+	} crl_issuer_db_entries;
+};
+
+static size_t jam_crl_issuer(struct jambuf *buf, const struct crl_issuer *i)
+{
+	return jam_dn(buf, ASN1(i->issuer_dn), jam_sanitized_bytes);
+}
+
+static hash_t hash_crl_issuer_issuer_dn(const chunk_t *issuer_dn)
+{
+	return hash_hunk(*issuer_dn, zero_hash);
+}
+
+HASH_TABLE(crl_issuer, issuer_dn, .issuer_dn, 251);
+
+static void crl_issuer_db_init(struct logger *logger);
+static void crl_issuer_db_check(struct logger *logger);
+static void crl_issuer_db_init_crl_issuer(struct crl_issuer *);
+static void crl_issuer_db_add(struct crl_issuer *);
+static void crl_issuer_db_del(struct crl_issuer *);
+
+HASH_DB(crl_issuer, &crl_issuer_issuer_dn_hash_table);
+
+static unsigned crl_issuer_count;
+static bool crl_issuer_set_loaded;
+
+void init_crl_issuers(struct logger *logger)
+{
+	crl_issuer_db_init(logger);
+}
+
+bool crl_issuers_loaded(void)
+{
+	return crl_issuer_set_loaded;
+}
+
+static struct crl_issuer *crl_issuer_by_dn(asn1_t issuer_dn)
+{
+	hash_t hash = hash_hunk(issuer_dn, zero_hash);
+	struct list_head *bucket = hash_table_bucket(&crl_issuer_issuer_dn_hash_table, hash);
+	struct crl_issuer *i;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(i, bucket) {
+		if (same_dn(issuer_dn, ASN1(i->issuer_dn))) {
+			return i;
+		}
+	}
+	return NULL;
+}
+
+void add_crl_issuer(asn1_t issuer_dn, shunk_t url)
+{
+	struct crl_issuer *i = crl_issuer_by_dn(issuer_dn);
+	if (i == NULL) {
+		dn_buf dnb;
+		dbg("CRL: adding issuer %s", str_dn(issuer_dn, &dnb));
+		i = alloc_thing(struct crl_issuer, "crl issuer");
+		i->issuer_dn = clone_hunk(issuer_dn, "crl issuer dn");
+		crl_issuer_db_init_crl_issuer(i);
+		crl_issuer_db_add(i);
+		crl_issuer_count++;
+	}
+	/* NSS's CRL has the most recent URL */
+	if (url.len > 0 && (i->url == NULL || !hunk_streq(url, i->url))) {
+		pfreeany(i->url);
+		i->url = clone_hunk_as_string(url, "crl issuer url");
+	}
+}
+
+void submit_crl_issuers(struct logger *logger)
+{
+	dbg("CRL: submitting %u issuers", crl_issuer_count);
+	crl_issuer_set_loaded = true;
+	struct crl_fetch_request *requests = NULL;
+	const struct crl_issuer *i;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(i, &crl_issuer_db_list_head) {
+		add_crl_fetch_request(ASN1(i->issuer_dn), shunk1(i->url),
+				      &requests, logger);
+	}
+	submit_crl_fetch_requests(&requests, logger);
+}
+
+void flush_crl_issuers(void)
+{
+	dbg("CRL: flushing %u issuers", crl_issuer_count);
+	struct crl_issuer *i;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(i, &crl_issuer_db_list_head) {
+		crl_issuer_db_del(i);
+		free_chunk_content(&i->issuer_dn);
+		pfreeany(i->url);
+		pfree(i);
+	}
+	crl_issuer_db_check(&global_logger);
+	crl_issuer_count = 0;
+	crl_issuer_set_loaded = false;
+}
+
+/*
+ * Claim the first request that isn't being worked on and that hasn't
+ * been tried since the queue was last poked.
+ */
+
+static struct crl_fetch_queue *unlocked_claim_crl_fetch_request(void)
+{
+	for (struct crl_fetch_queue *req = crl_fetch_queue; req != NULL; req = req->next) {
+		if (!req->busy && req->generation != crl_queue_generation) {
+			req->busy = true;
+			req->generation = crl_queue_generation;
+			return req;
+		}
+	}
+	return NULL;
+}
+
+static void unlocked_release_crl_fetch_request(struct crl_fetch_queue *req, bool fetched)
+{
+	req->busy = false;
+	if (!fetched) {
+		req->trials++;
+		return;
+	}
+	/* other threads may have changed the list; find it again */
+	for (struct crl_fetch_queue *volatile *reqp = &crl_fetch_queue;
+	     *reqp != NULL; reqp = &(*reqp)->next) {
+		if (*reqp == req) {
+			*reqp = req->next;
+			free_crl_fetch_request(&req);
+			return;
+		}
+	}
+	/* only the thread that claimed REQ can remove it */
+	pexpect(0);
+}
+
+void process_crl_fetch_requests(fetch_crl_fn *fetch_crl,
+				refresh_ocsp_fn *refresh_ocsp,
+				struct logger *logger)
 {
 	pthread_mutex_lock(&crl_queue_mutex);
 	while (!exiting_pluto) {
 		/* if there's something process it */
 		dbg("CRL: the sleeping dragon awakes");
+		unsigned generation = crl_queue_generation;
 		unsigned requests_processed = 0;
-		for (struct crl_fetch_queue *volatile *volatile reqp = &crl_fetch_queue;
-		     *reqp != NULL && !exiting_pluto; ) {
+		struct crl_fetch_queue *req;
+		while (!exiting_pluto &&
+		       (req = unlocked_claim_crl_fetch_request()) != NULL) {
 			requests_processed++;
-			struct crl_fetch_queue *req = *reqp;
 			pexpect(req->distribution_points != NULL);
 			bool fetched = false;
 			for (struct crl_distribution_point *volatile dp = req->distribution_points;
@@ -285,6 +452,8 @@ void process_crl_fetch_requests(fetch_crl_fn *fetch_crl, struct logger *unused_l
 				 * main thread can append to either
 				 * crl_fetch_request list, or its
 				 * crl_distribution_point list.
+				 * Since REQ is busy, no other thread
+				 * will touch it.
 				 */
 				dbg("CRL:   unlocking crl queue");
 				pthread_mutex_unlock(&crl_queue_mutex);
@@ -297,25 +466,65 @@ void process_crl_fetch_requests(fetch_crl_fn *fetch_crl, struct logger *unused_l
 				dbg("CRL:   locked crl queue");
 				pthread_mutex_lock(&crl_queue_mutex);
 			}
-			if (fetched) {
-				*reqp = req->next;
-				free_crl_fetch_request(&req);
-			} else {
-				req->trials++;
-				reqp = &req->next;
-			}
+			unlocked_release_crl_fetch_request(req, fetched);
 		}
 		if (exiting_pluto) {
 			break;
 		}
-		dbg("CRL: %u requests processed, the dragon sleeps",
-		    requests_processed);
-		int status = pthread_cond_wait(&crl_queue_cond, &crl_queue_mutex);
-		passert(status == 0);
+		dbg("CRL: %u requests processed", requests_processed);
+
+		/*
+		 * Refresh any OCSP responses that are missing or due
+		 * to expire; while doing this the queue is unlocked
+		 * and can be poked.
+		 */
+		realtime_t wakeup = realtime_epoch;
+		if (refresh_ocsp != NULL) {
+			pthread_mutex_unlock(&crl_queue_mutex);
+			wakeup = refresh_ocsp(logger);
+			pthread_mutex_lock(&crl_queue_mutex);
+		}
+
+		/*
+		 * Sleep until the queue is next poked.  Comparing
+		 * generations stops wakeups getting lost.
+		 */
+		dbg("CRL: the dragon sleeps");
+		while (generation == crl_queue_generation && !exiting_pluto) {
+			if (is_realtime_epoch(wakeup)) {
+				int status = pthread_cond_wait(&crl_queue_cond, &crl_queue_mutex);
+				passert(status == 0);
+				continue;
+			}
+			struct timespec abstime = {
+				.tv_sec = wakeup.rt.tv_sec,
+				.tv_nsec = wakeup.rt.tv_usec * 1000,
+			};
+			int status = pthread_cond_timedwait(&crl_queue_cond, &crl_queue_mutex,
+							    &abstime);
+			if (status == ETIMEDOUT) {
+				break;
+			}
+			passert(status == 0);
+		}
 	}
 	pthread_mutex_unlock(&crl_queue_mutex);
 }
 
+/*
+ * Wake the fetch thread without adding a CRL request; for instance
+ * when an OCSP response has been queued.
+ */
+
+void poke_crl_fetch_thread(struct logger *logger)
+{
+	pthread_mutex_lock(&crl_queue_mutex);
+	ldbg(logger, "CRL: poke the sleeping dragons (fetch threads)");
+	crl_queue_generation++;
+	pthread_cond_broadcast(&crl_queue_cond);
+	pthread_mutex_unlock(&crl_queue_mutex);
+}
+
 /*
  * list all fetch requests
  */
@@ -367,4 +576,5 @@ void free_crl_queue(void)
 		}
 	}
 	pthread_mutex_unlock(&crl_queue_mutex);
+	flush_crl_issuers();
 }
@@ -34,9 +34,24 @@ void add_crl_fetch_request(asn1_t issuer_dn, shunk_t url/*could be empty*/,
 			   struct crl_fetch_request **requests,
 			   struct logger *logger);
 
+/*
+ * The issuers that get submitted every crlcheckinterval; main thread
+ * only.
+ */
+void init_crl_issuers(struct logger *logger);
+bool crl_issuers_loaded(void);
+void add_crl_issuer(asn1_t issuer_dn, shunk_t url/*could be empty*/);
+void submit_crl_issuers(struct logger *logger);
+void flush_crl_issuers(void);
+
 typedef bool (fetch_crl_fn)(chunk_t issuer, const char *url, struct logger *logger);
-void process_crl_fetch_requests(fetch_crl_fn *fetch_crl, struct logger *logger);
+/* returns when next to call; epoch for never */
+typedef realtime_t (refresh_ocsp_fn)(struct logger *logger);
+void process_crl_fetch_requests(fetch_crl_fn *fetch_crl,
+				refresh_ocsp_fn *refresh_ocsp/*could be NULL*/,
+				struct logger *logger);
 
+void poke_crl_fetch_thread(struct logger *logger);
 void free_crl_queue(void);
 void list_crl_fetch_requests(struct show *s, bool utc);
 
@@ -135,22 +135,21 @@ struct task {
  */
 /* MUST BE THREAD-SAFE */
 
-static void compute_dh_shared_secret(struct logger *logger,
-				     struct task *task,
-				     int thread_unused UNUSED)
+PK11SymKey *calc_dh_shared_secret(struct dh_local_secret *secret,
+				  chunk_t remote_ke,
+				  struct logger *logger)
 {
-
-	struct dh_local_secret *secret = task->local_secret;
+	PK11SymKey *shared_secret = NULL;
 	diag_t diag = secret->group->dh_ops->calc_shared_secret(secret->group,
 								secret->privk,
 								secret->pubk,
-								task->remote_ke,
-								&task->shared_secret,
+								remote_ke,
+								&shared_secret,
 								logger);
 	if (diag != NULL) {
 		llog(RC_LOG, logger, "%s", str_diag(diag));
 		pfree_diag(&diag);
-		return;
+		return NULL;
 	}
 	/*
 	 * The IKEv2 documentation, even for ECP, refers to "g^ir".
@@ -159,10 +158,20 @@ static void compute_dh_shared_secret(struct logger *logger,
 		LLOG_JAMBUF(DEBUG_STREAM, logger, buf) {
 			jam_dh_local_secret(buf, secret);
 			jam(buf, "computed shared DH secret key@%p",
-			    task->shared_secret);
+			    shared_secret);
 		}
-		LDBG_symkey(logger, "dh-shared ", "g^ir", task->shared_secret);
+		LDBG_symkey(logger, "dh-shared ", "g^ir", shared_secret);
 	}
+	return shared_secret;
+}
+
+static void compute_dh_shared_secret(struct logger *logger,
+				     struct task *task,
+				     int thread_unused UNUSED)
+{
+	task->shared_secret = calc_dh_shared_secret(task->local_secret,
+						    task->remote_ke,
+						    logger);
 }
 
 static void cleanup_dh_shared_secret(struct task **task)
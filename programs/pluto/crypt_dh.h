@@ -51,6 +51,14 @@ const struct dh_desc *dh_local_secret_desc(struct dh_local_secret *local_secret)
 struct dh_local_secret *dh_local_secret_addref(struct dh_local_secret *local_secret, where_t where);
 void dh_local_secret_delref(struct dh_local_secret **local_secret, where_t where);
 
+/*
+ * Compute g^ir using LOCAL_SECRET and REMOTE_KE; returns NULL (after
+ * logging) when NSS doesn't like REMOTE_KE.  Called by helpers.
+ */
+PK11SymKey *calc_dh_shared_secret(struct dh_local_secret *local_secret,
+				  chunk_t remote_ke,
+				  struct logger *logger);
+
 /*
  * Compute dh using .st_dh_local_secret and REMOTE_KE, storing result
  * in .st_dh_shared_secret.
@@ -34,6 +34,7 @@
 #include "crypt_dh.h"
 #include "state.h"
 #include "crypt_cipher.h"
+#include "crypt_prf.h"
 
 void calc_v2_keymat(struct state *st,
 		    PK11SymKey *old_skey_d, /* SKEYSEED IKE Rekey */
@@ -166,8 +167,17 @@ void calc_v2_keymat(struct state *st,
 	ldbgf(DBG_CRYPT, logger, "NSS ikev2: finished computing individual keys for IKEv2 SA");
 	symkey_delref(logger, "finalkey", &finalkey);
 
+	/*
+	 * Non-AEAD ciphers also need integrity; import SK_a[ir] once
+	 * so that each message only needs to clone the keyed PRF.
+	 */
+	PK11SymKey *encrypt_integ_key = NULL;
+	PK11SymKey *decrypt_integ_key = NULL;
+
 	switch (st->st_sa_role) {
 	case SA_INITIATOR:
+		encrypt_integ_key = st->st_skey_ai_nss;
+		decrypt_integ_key = st->st_skey_ar_nss;
 		/* encrypt outbound uses I */
 		st->st_ike_encrypt_cipher_context =
 			cipher_context_create(st->st_oakley.ta_encrypt,
@@ -184,6 +194,8 @@ void calc_v2_keymat(struct state *st,
 					      st->logger);
 		break;
 	case SA_RESPONDER:
+		encrypt_integ_key = st->st_skey_ar_nss;
+		decrypt_integ_key = st->st_skey_ai_nss;
 		/* encrypt outbound uses R */
 		st->st_ike_encrypt_cipher_context =
 			cipher_context_create(st->st_oakley.ta_encrypt,
@@ -203,5 +215,16 @@ void calc_v2_keymat(struct state *st,
 		bad_case(st->st_sa_role);
 	}
 
+	if (integ != NULL && integ->prf != NULL) {
+		st->st_ike_encrypt_integ_prf =
+			crypt_prf_init_symkey("encrypt integ", integ->prf,
+					      "authkey", encrypt_integ_key,
+					      st->logger);
+		st->st_ike_decrypt_integ_prf =
+			crypt_prf_init_symkey("decrypt integ", integ->prf,
+					      "authkey", decrypt_integ_key,
+					      st->logger);
+	}
+
 	st->hidden_variables.st_skeyid_calculated = true;
 }
@@ -51,12 +51,15 @@
 #include "test_buffer.h"
 #include "ike_alg.h"
 #include "crypt_dh.h"
+#include "crypt_symkey.h"
 #include "crypt_ke.h"
 
 struct task {
 	const struct dh_desc *dh;
 	chunk_t nonce;
 	struct dh_local_secret *local_secret;
+	chunk_t remote_ke;		/* when set, also compute g^ir */
+	PK11SymKey *shared_secret;
 	ke_and_nonce_cb *cb;
 };
 
@@ -70,6 +73,11 @@ static void compute_ke_and_nonce(struct logger *logger,
 			DBG_log("NSS: Local DH %s secret (pointer): %p",
 				task->dh->common.fqn, task->local_secret);
 		}
+		if (task->remote_ke.ptr != NULL) {
+			task->shared_secret = calc_dh_shared_secret(task->local_secret,
+								    task->remote_ke,
+								    logger);
+		}
 	}
 	task->nonce = alloc_rnd_chunk(DEFAULT_NONCE_SIZE, "nonce");
 	if (DBGP(DBG_CRYPT)) {
@@ -81,6 +89,8 @@ static void cleanup_ke_and_nonce(struct task **task)
 {
 	dh_local_secret_delref(&(*task)->local_secret, HERE);
 	free_chunk_content(&(*task)->nonce);
+	free_chunk_content(&(*task)->remote_ke);
+	symkey_delref(&global_logger, "DH secret", &(*task)->shared_secret);
 	pfreeany(*task);
 }
 
@@ -88,6 +98,13 @@ static stf_status complete_ke_and_nonce(struct state *st,
 					struct msg_digest *md,
 					struct task *task)
 {
+	if (task->shared_secret != NULL) {
+		pexpect(st->st_dh_shared_secret == NULL);
+		symkey_delref(st->logger, "st_dh_shared_secret", &st->st_dh_shared_secret);
+		/* transfer */
+		st->st_dh_shared_secret = task->shared_secret;
+		task->shared_secret = NULL;
+	}
 	stf_status status = task->cb(st, md,
 				     task->local_secret,
 				     &task->nonce);
@@ -116,6 +133,23 @@ void submit_ke_and_nonce(struct state *callback_sa,
 		    task, &ke_and_nonce_handler, where);
 }
 
+void submit_ke_nonce_and_dh_shared_secret(struct state *callback_sa,
+					  struct state *task_sa,
+					  struct msg_digest *md,
+					  const struct dh_desc *dh,
+					  chunk_t remote_ke,
+					  ke_and_nonce_cb *cb,
+					  where_t where)
+{
+	struct task *task = alloc_thing(struct task, "dh");
+	task->dh = dh;
+	task->remote_ke = clone_hunk(remote_ke, "DH crypto");
+	task->cb = cb;
+	submit_task(/*callback*/callback_sa, /*task*/task_sa, md,
+		    /*detach_whack*/false,
+		    task, &ke_and_nonce_handler, where);
+}
+
 /*
  * Process KE values.
  */
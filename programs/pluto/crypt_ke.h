@@ -42,6 +42,20 @@ void submit_ke_and_nonce(struct state *callback_sa,
 			 ke_and_nonce_cb *cb,
 			 bool detach_whack, where_t where);
 
+/*
+ * As above, but also compute the DH shared secret (g^ir) using
+ * REMOTE_KE, storing it in .st_dh_shared_secret before CB is called
+ * (when DH fails, .st_dh_shared_secret is left NULL).
+ */
+
+void submit_ke_nonce_and_dh_shared_secret(struct state *callback_sa,
+					  struct state *task_sa,
+					  struct msg_digest *md,
+					  const struct dh_desc *dh,
+					  chunk_t remote_ke,
+					  ke_and_nonce_cb *cb,
+					  where_t where);
+
 /*
  * KE and NONCE
  */
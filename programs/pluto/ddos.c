@@ -0,0 +1,152 @@
+/* adaptive DDoS protection, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include "monotime.h"
+
+#include "defs.h"
+#include "log.h"
+#include "ddos.h"
+#include "timer.h"
+#include "show.h"
+#include "state.h"		/* for update_new_exchange_filters() */
+#include "server_pool.h"	/* for sample_server_helper_load() */
+
+enum ddos_overload ddos_overload = DDOS_OVERLOAD_NONE;
+
+/*
+ * A stage is entered when any one of its limits is exceeded.  It is
+ * left (dropping down one stage) once every signal has stayed below
+ * half its limit for CALM_SAMPLES consecutive samples.
+ *
+ * The backlog limit scales with the number of helper threads.
+ */
+
+static const struct overload_limit {
+	const char *name;
+	intmax_t wait_ms;		/* job waiting for a helper */
+	intmax_t lag_ms;		/* event-loop running late */
+	unsigned backlog_per_helper;	/* jobs waiting for a helper */
+} overload_limits[DDOS_OVERLOAD_ROOF] = {
+	[DDOS_OVERLOAD_NONE] = {
+		.name = "none",
+	},
+	[DDOS_OVERLOAD_COOKIES] = {
+		.name = "cookies",
+		.wait_ms = 500,
+		.lag_ms = 100,
+		.backlog_per_helper = 16,
+	},
+	[DDOS_OVERLOAD_DROP] = {
+		.name = "drop",
+		.wait_ms = 2000,
+		.lag_ms = 500,
+		.backlog_per_helper = 64,
+	},
+};
+
+#define CALM_SAMPLES 10
+
+static struct {
+	monotime_t time;
+	deltatime_t lag;
+	struct helper_load load;
+	unsigned calm;
+} last_sample;
+
+/* SCALE=1 checks the limit, SCALE=2 checks half the limit */
+
+static bool over_limit(enum ddos_overload stage,
+		       const struct helper_load *load,
+		       deltatime_t lag, unsigned scale)
+{
+	const struct overload_limit *limit = &overload_limits[stage];
+	unsigned helpers = (load->helpers > 0 ? load->helpers : 1);
+	return (deltamillisecs(load->wait) * scale > limit->wait_ms ||
+		deltamillisecs(lag) * scale > limit->lag_ms ||
+		load->backlog * scale > limit->backlog_per_helper * helpers);
+}
+
+static global_timer_cb check_overload;	/* type check */
+
+static void check_overload(struct logger *logger)
+{
+	/*
+	 * The timer is periodic; how late it fired is the event-loop
+	 * lag.
+	 */
+	monotime_t now = mononow();
+	deltatime_t lag = deltatime_zero;
+	if (!is_monotime_epoch(last_sample.time)) {
+		deltatime_t late = deltatime_sub(monotimediff(now, last_sample.time),
+						 CHECK_OVERLOAD_PERIOD);
+		lag = deltatime_max(late, deltatime_zero);
+	}
+	struct helper_load load = sample_server_helper_load();
+	last_sample.time = now;
+	last_sample.lag = lag;
+	last_sample.load = load;
+
+	enum ddos_overload target = DDOS_OVERLOAD_NONE;
+	for (enum ddos_overload o = DDOS_OVERLOAD_COOKIES; o < DDOS_OVERLOAD_ROOF; o++) {
+		if (over_limit(o, &load, lag, 1)) {
+			target = o;
+		}
+	}
+
+	enum ddos_overload stage = ddos_overload;
+	if (target > stage) {
+		stage = target;
+		last_sample.calm = 0;
+	} else if (stage > DDOS_OVERLOAD_NONE &&
+		   !over_limit(stage, &load, lag, 2)) {
+		if (++last_sample.calm >= CALM_SAMPLES) {
+			stage--;
+			last_sample.calm = 0;
+		}
+	} else {
+		last_sample.calm = 0;
+	}
+
+	if (stage == ddos_overload) {
+		return;
+	}
+
+	deltatime_buf wb, lb;
+	llog(RC_LOG, logger,
+	     "DDoS overload changed from %s to %s; %u jobs backlogged for %u helpers waiting up to %s seconds, event-loop lag %s seconds",
+	     overload_limits[ddos_overload].name,
+	     overload_limits[stage].name,
+	     load.backlog, load.helpers,
+	     str_deltatime(load.wait, &wb),
+	     str_deltatime(lag, &lb));
+	ddos_overload = stage;
+	update_new_exchange_filters(logger);
+}
+
+void init_ddos_overload(void)
+{
+	enable_periodic_timer(EVENT_CHECK_OVERLOAD, check_overload,
+			      CHECK_OVERLOAD_PERIOD);
+}
+
+void show_ddos_overload_status(struct show *s)
+{
+	deltatime_buf wb, lb;
+	show(s, "current.ddos.overload=%s", overload_limits[ddos_overload].name);
+	show(s, "current.ddos.helpers.backlog=%u", last_sample.load.backlog);
+	show(s, "current.ddos.helpers.wait=%s", str_deltatime(last_sample.load.wait, &wb));
+	show(s, "current.ddos.eventloop.lag=%s", str_deltatime(last_sample.lag, &lb));
+}
@@ -0,0 +1,46 @@
+/* adaptive DDoS protection, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef DDOS_H
+#define DDOS_H
+
+struct logger;
+struct show;
+
+/*
+ * When ddos-mode=auto, in addition to the half-open thresholds,
+ * pluto samples how overloaded it really is (helper backlog, how
+ * long jobs wait for a helper, and main event-loop lag) and steps
+ * through the stages below.
+ *
+ * Stages are entered as soon as any signal crosses the stage's limit
+ * but are only left once all signals have stayed well below it for a
+ * while.
+ */
+
+enum ddos_overload {
+	DDOS_OVERLOAD_NONE,
+	DDOS_OVERLOAD_COOKIES,		/* require_ddos_cookies() */
+	DDOS_OVERLOAD_DROP,		/* drop_new_exchanges() */
+#define DDOS_OVERLOAD_ROOF (DDOS_OVERLOAD_DROP + 1)
+};
+
+extern enum ddos_overload ddos_overload;
+
+void init_ddos_overload(void);
+void show_ddos_overload_status(struct show *s);
+
+#endif
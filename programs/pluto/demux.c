@@ -73,6 +73,7 @@
 #include "iface.h"
 #include "impair_message.h"
 #include "log_limiter.h"
+#include "pluto_usdt.h"
 
 static callback_cb handle_md_event;		/* type assertion */
 
@@ -134,6 +135,9 @@ void process_md(struct msg_digest *md)
 	unsigned vmaj = md->hdr.isa_version >> ISA_MAJ_SHIFT;
 	unsigned vmin = md->hdr.isa_version & ISA_MIN_MASK;
 
+	PLUTO_PROBE(process_md, vmaj, md->hdr.isa_xchg,
+		    md->hdr.isa_msgid, md->hdr.isa_flags);
+
 	switch (vmaj) {
 	case 0:
 		/*
@@ -306,6 +310,9 @@ void process_iface_packet(int fd, void *ifp_arg, struct logger *logger)
 		}
 
 		pstats_ike_bytes.in += pbs_in_all(&md->packet_pbs).len;
+		PLUTO_PROBE(receive,
+			    pluto_probe_msgid(pbs_in_all(&md->packet_pbs)),
+			    pbs_in_all(&md->packet_pbs).len);
 
 		md->md_inception = md_start;
 		if (!impair_inbound(md)) {
@@ -112,10 +112,12 @@ enum v2_pd {
 	PD_v2N_NO_PROPOSAL_CHOSEN,
 	PD_v2N_NULL_AUTH,
 	PD_v2N_PPK_IDENTITY,
+	PD_v2N_PUZZLE,
 	PD_v2N_REDIRECT,
 	PD_v2N_REDIRECTED_FROM,
 	PD_v2N_REDIRECT_SUPPORTED,
 	PD_v2N_REKEY_SA,
+	PD_v2N_SA_RESOURCE_INFO,
 	PD_v2N_SIGNATURE_HASH_ALGORITHMS,
 	PD_v2N_SINGLE_PAIR_REQUIRED,
 	PD_v2N_TS_UNACCEPTABLE,
@@ -152,6 +154,8 @@ struct msg_digest {
 	struct logger *logger;			/* logger for this MD */
 
 	threadtime_t md_inception;		/* when was this started */
+	threadtime_t md_resumed;		/* when last un-suspended */
+	struct cpu_usage md_usage;		/* used before being suspended */
 
 	v1_notification_t v1_note;			/* reason for failure */
 	bool dpd;				/* (v1) Peer supports RFC 3706 DPD */
@@ -43,15 +43,100 @@
 #include "nss_crl_import.h"
 #include "keys.h"
 #include "crl_queue.h"
+#include "ocsp_cache.h"
 #include "server.h"
 #include "lswnss.h"			/* for llog_nss_error() */
 #include "whack_shutdown.h"		/* for exiting_pluto; */
 
 #define FETCH_CMD_TIMEOUT       5       /* seconds */
+/*
+ * Number of threads fetching CRLs; enough that one slow distribution
+ * point doesn't hold up all the others.
+ */
+#define CRL_FETCH_HELPERS	4
 
 deltatime_t curl_timeout = DELTATIME_INIT(FETCH_CMD_TIMEOUT);
 
-static pthread_t fetch_thread_id;
+static pthread_t fetch_thread_id[CRL_FETCH_HELPERS];
+
+/*
+ * HTTP validators from the last response that was successfully
+ * imported (or found to be unchanged); sent back as If-None-Match:
+ * and If-Modified-Since: so that the server can reply 304 Not
+ * Modified instead of re-sending a multi-megabyte CRL.
+ */
+
+struct http_validators {
+	char *etag;		/* could be NULL */
+	char *last_modified;	/* could be NULL */
+};
+
+struct crl_validators {
+	char *url;
+	struct http_validators validators;
+	struct crl_validators *next;
+};
+
+/* shared by the fetch threads */
+static pthread_mutex_t crl_validators_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct crl_validators *crl_validators = NULL;
+
+static void free_http_validators(struct http_validators *validators)
+{
+	pfreeany(validators->etag);
+	pfreeany(validators->last_modified);
+}
+
+static struct http_validators get_crl_validators(const char *url)
+{
+	struct http_validators validators = {0};
+	pthread_mutex_lock(&crl_validators_mutex);
+	for (struct crl_validators *v = crl_validators; v != NULL; v = v->next) {
+		if (streq(v->url, url)) {
+			validators.etag = clone_str(v->validators.etag, "etag");
+			validators.last_modified = clone_str(v->validators.last_modified,
+							     "last-modified");
+			break;
+		}
+	}
+	pthread_mutex_unlock(&crl_validators_mutex);
+	return validators;
+}
+
+/* takes ownership of VALIDATORS */
+static void save_crl_validators(const char *url, struct http_validators *validators)
+{
+	pthread_mutex_lock(&crl_validators_mutex);
+	struct crl_validators **v;
+	for (v = &crl_validators; *v != NULL; v = &(*v)->next) {
+		if (streq((*v)->url, url)) {
+			break;
+		}
+	}
+	if (*v == NULL) {
+		struct crl_validators new_validators = {
+			.url = clone_str(url, "crl validators url"),
+		};
+		*v = clone_thing(new_validators, "crl validators");
+	}
+	free_http_validators(&(*v)->validators);
+	(*v)->validators = *validators;
+	zero(validators);
+	pthread_mutex_unlock(&crl_validators_mutex);
+}
+
+static void free_crl_validators(void)
+{
+	pthread_mutex_lock(&crl_validators_mutex);
+	while (crl_validators != NULL) {
+		struct crl_validators *tbd = crl_validators;
+		crl_validators = tbd->next;
+		free_http_validators(&tbd->validators);
+		pfree(tbd->url);
+		pfree(tbd);
+	}
+	pthread_mutex_unlock(&crl_validators_mutex);
+}
 
 #ifdef LIBCURL
 
@@ -80,10 +165,57 @@ static size_t write_buffer(void *ptr, size_t size, size_t nmemb, void *data)
 	}
 }
 
+/*
+ * Saves the ETag: and Last-Modified: response headers into (struct
+ * http_validators *)data.
+ * A call-back used with libcurl.
+ */
+static size_t save_validators(char *ptr, size_t size, size_t nmemb, void *data)
+{
+	size_t realsize = size * nmemb;
+	struct http_validators *validators = data;
+	shunk_t header = shunk2(ptr, realsize);
+
+	if (hunk_strcasestarteq(header, "HTTP/")) {
+		/* new response (e.g., after a redirect); start again */
+		free_http_validators(validators);
+		return realsize;
+	}
+
+	char **value = (hunk_strcaseeat(&header, "ETag:") ? &validators->etag :
+			hunk_strcaseeat(&header, "Last-Modified:") ? &validators->last_modified :
+			NULL);
+	if (value != NULL) {
+		/* strip white space and CRLF */
+		const char *start = header.ptr;
+		const char *end = start + header.len;
+		while (start < end && char_isspace(*start)) {
+			start++;
+		}
+		while (end > start && char_isspace(end[-1])) {
+			end--;
+		}
+		pfreeany(*value);
+		if (end > start) {
+			*value = clone_hunk_as_string(shunk2(start, end - start), "http validator");
+		}
+	}
+	return realsize;
+}
+
 /*
  * fetches a binary blob from a url with libcurl
+ *
+ * When CONDITIONAL contains validators the fetch is conditional;
+ * should the server reply 304 Not Modified, *NOT_MODIFIED is set and
+ * BLOB is left empty.  VALIDATORS is filled in from the response.
  */
-static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
+static err_t fetch_curl(const char *url,
+			const struct http_validators *conditional,
+			chunk_t *blob,
+			struct http_validators *validators,
+			bool *not_modified,
+			struct logger *logger)
 {
 	char errorbuffer[CURL_ERROR_SIZE] = "?";
 	chunk_t response = EMPTY_CHUNK;	/* managed by realloc/free */
@@ -97,6 +229,23 @@ static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
 
 	dbg("Trying cURL '%s' with connect timeout of %ld", url, timeout);
 
+	struct curl_slist *headers = NULL; /* must free */
+	if (conditional->etag != NULL) {
+		char *header = alloc_printf("If-None-Match: %s", conditional->etag);
+		headers = curl_slist_append(headers, header);
+		pfree(header);
+	}
+	if (conditional->last_modified != NULL) {
+		char *header = alloc_printf("If-Modified-Since: %s", conditional->last_modified);
+		headers = curl_slist_append(headers, header);
+		pfree(header);
+	}
+	if (headers != NULL) {
+		dbg("  conditional request: etag=%s last-modified=%s",
+		    (conditional->etag == NULL ? "<none>" : conditional->etag),
+		    (conditional->last_modified == NULL ? "<none>" : conditional->last_modified));
+	}
+
 	CURLcode res = CURLE_OK;
 
 #	define CESO(optype, optarg) { \
@@ -116,6 +265,10 @@ static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
 	 * In fact, this code is correct.
 	 */
 	CESO(CURLOPT_WRITEDATA, (void *)&response);
+	CESO(CURLOPT_HEADERFUNCTION, save_validators);
+	CESO(CURLOPT_HEADERDATA, (void *)validators);
+	if (headers != NULL)
+		CESO(CURLOPT_HTTPHEADER, headers);
 	CESO(CURLOPT_ERRORBUFFER, errorbuffer);
 	CESO(CURLOPT_CONNECTTIMEOUT, timeout);
 	CESO(CURLOPT_TIMEOUT, 2 * timeout);
@@ -129,7 +282,14 @@ static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
 	if (res == CURLE_OK)
 		res = curl_easy_perform(curl);
 
-	if (res == CURLE_OK) {
+	long code = 0;
+	if (res == CURLE_OK &&
+	    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code) == CURLE_OK &&
+	    code == 304) {
+		errorbuffer[0] = '\0';
+		dbg("  %s not modified", url);
+		*not_modified = true;
+	} else if (res == CURLE_OK) {
 		/* clone from realloc(3)ed memory to pluto-allocated memory */
 		errorbuffer[0] = '\0';
 		*blob = clone_hunk(response, "curl blob");
@@ -138,6 +298,7 @@ static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
 		     "fetching uri (%s) with libcurl failed: %s", url, errorbuffer);
 	}
 	curl_easy_cleanup(curl);
+	curl_slist_free_all(headers);
 
 	/* ??? where/how should this be logged? */
 	if (errorbuffer[0] != '\0') {
@@ -154,7 +315,11 @@ static err_t fetch_curl(const char *url, chunk_t *blob, struct logger *logger)
 #else	/* LIBCURL */
 
 static err_t fetch_curl(const char *url UNUSED,
-			chunk_t *blob UNUSED)
+			const struct http_validators *request UNUSED,
+			chunk_t *blob UNUSED,
+			struct http_validators *response UNUSED,
+			bool *not_modified UNUSED,
+			struct logger *logger UNUSED)
 {
 	return "not compiled with libcurl support";
 }
@@ -307,23 +472,33 @@ static err_t fetch_ldap_url(const char *url UNUSED,
 /*
  * fetch an ASN.1 blob coded in PEM or DER format from a URL
  * Returns error message or NULL.
- * Iff no error, *blob contains fetched ASN.1 blob (to be freed by caller).
+ * Iff no error, *blob contains fetched ASN.1 blob (to be freed by caller),
+ * or, for a conditional HTTP request, *not_modified is set.
  */
 
-static err_t fetch_asn1_blob(const char *url, chunk_t *blob, struct logger *logger)
+static err_t fetch_asn1_blob(const char *url,
+			     const struct http_validators *request,
+			     chunk_t *blob,
+			     struct http_validators *response,
+			     bool *not_modified,
+			     struct logger *logger)
 {
 	err_t ugh = NULL;
 
 	*blob = EMPTY_CHUNK;
+	*not_modified = false;
 	if (startswith(url, "ldap:")) {
 		ugh = fetch_ldap_url(url, blob, logger);
 	} else {
-		ugh = fetch_curl(url, blob, logger);
+		ugh = fetch_curl(url, request, blob, response, not_modified, logger);
 	}
 	if (ugh != NULL) {
 		free_chunk_content(blob);
 		return ugh;
 	}
+	if (*not_modified) {
+		return NULL;
+	}
 
 	ugh = asn1_ok(ASN1(*blob));
 	if (ugh == NULL) {
@@ -344,11 +519,19 @@ static err_t fetch_asn1_blob(const char *url, chunk_t *blob, struct logger *logg
 	return ugh;
 }
 
+/*
+ * The fetch threads share the one CRL import helper; don't fork()
+ * several at once.
+ */
+static pthread_mutex_t crl_import_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* Note: insert_crl_nss frees *blob */
 static bool insert_crl_nss(chunk_t blob, chunk_t issuer, const char *url, struct logger *logger)
 {
 	/* for CRL use the name passed to helper for the uri */
+	pthread_mutex_lock(&crl_import_mutex);
 	int r = send_crl_to_import(blob.ptr, blob.len, url, logger);
+	pthread_mutex_unlock(&crl_import_mutex);
 	bool ret;
 	if (r == -1) {
 		ret = false;
@@ -367,6 +550,84 @@ static bool insert_crl_nss(chunk_t blob, chunk_t issuer, const char *url, struct
 	return ret;
 }
 
+/*
+ * Return the CRL's cRLNumber as an unsigned big-endian integer
+ * (leading zeros stripped); or NULL_SHUNK when there isn't one.
+ * The result points into ARENA.
+ */
+
+static shunk_t crl_number(PLArenaPool *arena, CERTSignedCrl *crl)
+{
+	SECItem number;
+	if (CERT_FindCRLNumberExten(arena, &crl->crl, &number) != SECSuccess) {
+		return null_shunk;
+	}
+	shunk_t n = same_secitem_as_shunk(number);
+	while (n.len > 1 && *(const uint8_t *)n.ptr == 0) {
+		n.ptr = (const uint8_t *)n.ptr + 1;
+		n.len--;
+	}
+	return n;
+}
+
+/*
+ * Return true when BLOB's CRL should be imported: NSS doesn't have
+ * a CRL for the issuer; or BLOB's cRLNumber is larger than the one
+ * NSS has (or either is missing).  Re-importing an unchanged CRL
+ * means forking the helper and flushing NSS's CRL cache for
+ * nothing.
+ */
+
+static bool crl_number_increased(chunk_t blob, const char *url, struct logger *logger)
+{
+	CERTCertDBHandle *handle = CERT_GetDefaultCertDB();
+	passert(handle != NULL);
+
+	SECItem der = same_chunk_as_secitem(blob, siBuffer);
+	CERTSignedCrl *new_crl = CERT_DecodeDERCrlWithFlags(NULL, &der, SEC_CRL_TYPE,
+							    (CRL_DECODE_DONT_COPY_DER |
+							     CRL_DECODE_SKIP_ENTRIES));
+	if (new_crl == NULL) {
+		/* let the import sort it out */
+		ldbg_nss_error(logger, "decoding CRL using CERT_DecodeDERCrlWithFlags() failed");
+		return true;
+	}
+
+	bool increased = true;
+	CERTSignedCrl *old_crl = SEC_FindCrlByName(handle, &new_crl->crl.derName, SEC_CRL_TYPE);
+	if (old_crl != NULL) {
+		PLArenaPool *arena = PORT_NewArena(SEC_ASN1_DEFAULT_ARENA_SIZE);
+		passert(arena != NULL);
+		shunk_t new_number = crl_number(arena, new_crl);
+		shunk_t old_number = crl_number(arena, old_crl);
+		if (new_number.len > 0 && old_number.len > 0) {
+			increased = (new_number.len != old_number.len ?
+				     new_number.len > old_number.len :
+				     memcmp(new_number.ptr, old_number.ptr, new_number.len) > 0);
+			if (!increased) {
+				dbg("CRL: %s: cRLNumber has not increased; skipping import", url);
+			}
+		}
+		PORT_FreeArena(arena, PR_FALSE);
+		SEC_DestroyCrl(old_crl);
+	}
+	SEC_DestroyCrl(new_crl);
+	return increased;
+}
+
+static bool nss_has_crl(chunk_t issuer_dn)
+{
+	CERTCertDBHandle *handle = CERT_GetDefaultCertDB();
+	passert(handle != NULL);
+	SECItem name = same_chunk_as_secitem(issuer_dn, siBuffer);
+	CERTSignedCrl *crl = SEC_FindCrlByName(handle, &name, SEC_CRL_TYPE);
+	if (crl == NULL) {
+		return false;
+	}
+	SEC_DestroyCrl(crl);
+	return true;
+}
+
 /*
  * try to fetch the crls defined by the fetch requests
  */
@@ -380,44 +641,50 @@ static bool fetch_crl(chunk_t issuer_dn, const char *url, struct logger *logger)
 		return false;
 	}
 
+	/*
+	 * Only make the request conditional when NSS still has the
+	 * CRL; a 304 is no use when the CRL has gone missing.
+	 */
+	struct http_validators request = {0}; /* must free */
+	if (nss_has_crl(issuer_dn)) {
+		request = get_crl_validators(url);
+	}
+
 	chunk_t blob = empty_chunk; /* must free */
-	err_t ugh = fetch_asn1_blob(url, &blob, logger);
+	struct http_validators response = {0}; /* must free */
+	bool not_modified = false;
+	err_t ugh = fetch_asn1_blob(url, &request, &blob, &response, &not_modified, logger);
+	free_http_validators(&request);
 	if (ugh != NULL) {
 		dbg("CRL: fetch failed:  %s", ugh);
+		free_http_validators(&response);
 		return false;
 	}
 
-	bool ok = insert_crl_nss(blob, issuer_dn, url, logger);
+	if (not_modified) {
+		dbg("CRL: %s not modified; skipping import", url);
+		free_http_validators(&response);
+		return true;
+	}
+
+	bool ok = (crl_number_increased(blob, url, logger) ?
+		   insert_crl_nss(blob, issuer_dn, url, logger) :
+		   true);
+	if (ok) {
+		save_crl_validators(url, &response);
+	}
+	free_http_validators(&response);
 	free_chunk_content(&blob);
 	return ok;
 }
 
 /*
- * Submit all known CRLS for processing using
- * append_crl_fetch_request().
- *
- * Any duplicates will be eliminated by submit_crl_fetch_request()
- * when it merges these requests with any still unprocessed requests.
- *
- * Similarly, if check_crls() is called more frequently than
- * fetch_crl() can process, redundant fetches will be merged.
+ * Add the issuers of NSS's CRLs and certificates to the set of known
+ * issuers.
  */
 
-static void check_crls(struct logger *logger)
+static void load_crl_issuers(struct logger *logger)
 {
-	/*
-	 * Shallow - contents point into existing structures.
-	 */
-	struct crl_fetch_request *requests = NULL;
-
-	if (deltasecs(crl_check_interval) <= 0) {
-		llog(RC_LOG, logger, "config crlcheckinterval= is unset");
-		return;
-	}
-
-	/* schedule the next probe */
-	schedule_oneshot_timer(EVENT_CHECK_CRLS, crl_check_interval);
-
 	/*
 	 * CERT_GetDefaultCertDB() simply returns the contents of a
 	 * static variable set by NSS_Initialize().  It doesn't check
@@ -431,75 +698,105 @@ static void check_crls(struct logger *logger)
 	 * Add NSS's CRLs.
 	 */
 
-	CERTCrlHeadNode *crl_list = NULL; /* must free; but after submitting requests */
-	if (SEC_LookupCrls(handle, &crl_list, SEC_CRL_TYPE) != SECSuccess) {
-		return;
-	}
-
-	for (CERTCrlNode *n = crl_list->first; n != NULL; n = n->next) {
-		if (n->crl != NULL) {
-			chunk_t issuer = same_secitem_as_chunk(n->crl->crl.derName);
-			/* XXX: URL can be null, gets filled in later */
-			add_crl_fetch_request(ASN1(issuer), shunk1(n->crl->url), &requests, logger);
-		}
-	}
-
-	/*
-	 * Add the pubkeys distribution points to fetch list.
-	 */
-
-	for (struct pubkey_list *pkl = pluto_pubkeys; pkl != NULL; pkl = pkl->next) {
-		struct pubkey *key = pkl->key;
-		if (key != NULL) {
-			add_crl_fetch_request(key->issuer, null_shunk, &requests, logger);
+	CERTCrlHeadNode *crl_list = NULL; /* must free */
+	if (SEC_LookupCrls(handle, &crl_list, SEC_CRL_TYPE) == SECSuccess) {
+		for (CERTCrlNode *n = crl_list->first; n != NULL; n = n->next) {
+			if (n->crl != NULL) {
+				chunk_t issuer = same_secitem_as_chunk(n->crl->crl.derName);
+				/* XXX: URL can be null, gets filled in later */
+				add_crl_issuer(ASN1(issuer), shunk1(n->crl->url));
+			}
 		}
+		dbg("CRL: releasing crl list in %s()", __func__);
+		PORT_FreeArena(crl_list->arena, PR_FALSE);
 	}
 
 	/*
 	 * Iterate all X.509 certificates in database. This is needed to
 	 * process middle and end certificates.
-	 *
-	 * Free this after the requests have been appended.
 	 */
-	CERTCertList *certs = get_all_certificates(logger); /* must free; but after submitting requests */
+	CERTCertList *certs = get_all_certificates(logger); /* must free */
 	if (certs != NULL) {
 		for (CERTCertListNode *node = CERT_LIST_HEAD(certs);
 		     !CERT_LIST_END(node, certs);
 		     node = CERT_LIST_NEXT(node)) {
 			chunk_t issuer = same_secitem_as_chunk(node->cert->derSubject);
-			add_crl_fetch_request(ASN1(issuer), null_shunk, &requests, logger);
+			add_crl_issuer(ASN1(issuer), null_shunk);
 		}
+		dbg("CRL: releasing cert list in %s()", __func__);
+		CERT_DestroyCertList(certs);
+	}
+}
+
+/*
+ * Submit all known CRLS for processing using
+ * submit_crl_issuers().
+ *
+ * Any duplicates will be eliminated by submit_crl_fetch_request()
+ * when it merges these requests with any still unprocessed requests.
+ *
+ * Similarly, if check_crls() is called more frequently than
+ * fetch_crl() can process, redundant fetches will be merged.
+ */
+
+static void check_crls(struct logger *logger)
+{
+	if (deltasecs(crl_check_interval) <= 0) {
+		llog(RC_LOG, logger, "config crlcheckinterval= is unset");
+		return;
 	}
 
+	/* schedule the next probe */
+	schedule_oneshot_timer(EVENT_CHECK_CRLS, crl_check_interval);
+
 	/*
-	 * Submit the requests and then release them.
-	 *
-	 * Only then release all the data structures that the requests
-	 * are pointing into.
+	 * Enumerating NSS is expensive; only do it the first time
+	 * (and after whack --rereadcerts).
 	 */
+	if (!crl_issuers_loaded()) {
+		load_crl_issuers(logger);
+	}
 
-	submit_crl_fetch_requests(&requests, logger);
+	/*
+	 * Add the pubkeys distribution points to fetch list.  These
+	 * come and go with the peers so check each time.
+	 */
 
-	dbg("CRL: releasing cert list in %s()", __func__);
-	if (certs != NULL) {
-		CERT_DestroyCertList(certs);
+	struct preloaded_pubkey_filter pkf = {
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		add_crl_issuer(pkf.key->issuer, null_shunk);
 	}
 
-	dbg("CRL: releasing crl list in %s()", __func__);
-	PORT_FreeArena(crl_list->arena, PR_FALSE);
+	submit_crl_issuers(logger);
 }
 
-static void *fetch_thread(void *arg UNUSED)
+static void *fetch_thread(void *arg)
 {
-	dbg("CRL: fetch thread started");
+	uintptr_t helper = (uintptr_t)arg;
+	dbg("CRL: fetch thread %ju started", (uintmax_t)helper);
 	/* XXX: on thread so no whack */
-	struct logger *logger = string_logger(HERE, "crl thread: "); /* must free */
-	process_crl_fetch_requests(fetch_crl, logger);
+	struct logger *logger = string_logger(HERE, "crl thread %ju: ", (uintmax_t)helper); /* must free */
+	/* only the first thread keeps the OCSP cache fresh */
+	process_crl_fetch_requests(fetch_crl,
+				   (helper == 0 && ocsp_enable && ocsp_prefetch ? refresh_ocsp_cache : NULL),
+				   logger);
 	free_logger(&logger, HERE);
-	dbg("CRL: fetch thread stopped");
+	dbg("CRL: fetch thread %ju stopped", (uintmax_t)helper);
 	return NULL;
 }
 
+/*
+ * The fetch thread is needed when either CRLs are being checked or
+ * OCSP responses are being prefetched.
+ */
+static bool fetch_helper_needed(void)
+{
+	return (deltasecs(crl_check_interval) > 0 ||
+		(ocsp_enable && ocsp_prefetch));
+}
+
 /*
  * initializes curl and starts the fetching thread
  */
@@ -511,8 +808,9 @@ void start_crl_fetch_helper(struct logger *logger)
 	 * further fetches are defined by the config(?) file (is that
 	 * loaded before this function was called? yes).
 	 */
+	init_crl_issuers(logger);
 	init_oneshot_timer(EVENT_CHECK_CRLS, check_crls);
-	if (deltasecs(crl_check_interval) <= 0) {
+	if (!fetch_helper_needed()) {
 		dbg("CRL: checking disabled");
 		return;
 	}
@@ -528,11 +826,18 @@ void start_crl_fetch_helper(struct logger *logger)
 	}
 #endif
 
-	status = pthread_create(&fetch_thread_id, NULL,
-				fetch_thread, NULL);
-	if (status != 0) {
-		fatal(PLUTO_EXIT_FAIL, logger,
-		      "could not start thread for fetching certificate, status = %d", status);
+	for (uintptr_t helper = 0; helper < CRL_FETCH_HELPERS; helper++) {
+		status = pthread_create(&fetch_thread_id[helper], NULL,
+					fetch_thread, (void *)helper);
+		if (status != 0) {
+			fatal(PLUTO_EXIT_FAIL, logger,
+			      "could not start thread for fetching certificate, status = %d", status);
+		}
+	}
+
+	if (deltasecs(crl_check_interval) <= 0) {
+		dbg("CRL: checking disabled; thread only prefetches OCSP responses");
+		return;
 	}
 
 	if (impair.event_check_crls) {
@@ -552,19 +857,21 @@ void start_crl_fetch_helper(struct logger *logger)
 
 void stop_crl_fetch_helper(struct logger *logger)
 {
-	if (deltasecs(crl_check_interval) > 0) {
+	if (fetch_helper_needed()) {
 		/*
 		 * Log before blocking.  If the CRL fetch helper is
 		 * currently fetching a CRL, this could take a bit.
 		 */
-		llog(RC_LOG, logger, "shutting down the CRL fetch helper thread");
+		llog(RC_LOG, logger, "shutting down the CRL fetch helper threads");
 		pexpect(exiting_pluto);
-		/* wake the sleeping dragon from its slumber */
+		/* wake the sleeping dragons from their slumber */
 		submit_crl_fetch_requests(NULL, logger);
 		/* use a timer? */
-		int status = pthread_join(fetch_thread_id, NULL);
-		if (status != 0) {
-			llog_error(logger, status, "problem waiting for crl fetch thread to exit");
+		for (unsigned helper = 0; helper < CRL_FETCH_HELPERS; helper++) {
+			int status = pthread_join(fetch_thread_id[helper], NULL);
+			if (status != 0) {
+				llog_error(logger, status, "problem waiting for crl fetch thread to exit");
+			}
 		}
 	}
 }
@@ -572,11 +879,12 @@ void stop_crl_fetch_helper(struct logger *logger)
 void free_crl_fetch(void)
 {
 #ifdef LIBCURL
-	if (deltasecs(crl_check_interval) > 0) {
+	if (fetch_helper_needed()) {
 		/* cleanup curl */
 		curl_global_cleanup();
 	}
 #endif
+	free_crl_validators();
 }
 
 #else /* defined(LIBCURL) || defined(LIBLDAP) */
@@ -27,5 +27,6 @@ extern bool crl_strict;
 extern bool ocsp_strict;
 extern bool ocsp_enable;
 extern bool ocsp_post;
+extern bool ocsp_prefetch;
 
 #endif
@@ -520,6 +520,10 @@ struct iface_endpoint *bind_iface_endpoint(struct iface_device *ifd,
 				     local_endpoint,
 				     HERE);
 
+	if (io->attach_filter != NULL) {
+		io->attach_filter(ifp, logger);
+	}
+
 	/*
 	 * Insert into public interface list.
 	 *
@@ -625,6 +629,15 @@ void listen_on_iface_endpoint(struct iface_endpoint *ifp, struct logger *logger)
 	    ifp->fd, ifp->io->protocol->name);
 }
 
+void update_iface_endpoint_filters(struct logger *logger)
+{
+	for (struct iface_endpoint *ifp = interfaces; ifp != NULL; ifp = ifp->next) {
+		if (ifp->io->attach_filter != NULL) {
+			ifp->io->attach_filter(ifp, logger);
+		}
+	}
+}
+
 static void process_kernel_ifaces(struct kernel_iface *rifaces, struct logger *logger)
 {
 	ip_address lip;	/* --listen filter option */
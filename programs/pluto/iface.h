@@ -56,6 +56,8 @@ struct iface_io {
 	void (*listen)(struct iface_endpoint *fip, struct logger *logger);
 	/* returns 0 or ERRNO */
 	int (*enable_esp_encapsulation)(int fd, struct logger *logger);
+	/* optional; (re)install a kernel filter discarding junk */
+	void (*attach_filter)(const struct iface_endpoint *ifp, struct logger *logger);
 };
 
 extern const struct iface_io udp_iface_io;
@@ -190,6 +192,8 @@ extern struct iface_endpoint *find_iface_endpoint_by_local_endpoint(ip_endpoint
 extern void find_ifaces(bool rm_dead, struct logger *logger);
 extern void show_ifaces_status(struct show *s);
 void listen_on_iface_endpoint(struct iface_endpoint *ifp, struct logger *logger);
+/* for instance, when pluto starts or stops dropping new exchanges */
+void update_iface_endpoint_filters(struct logger *logger);
 
 enum iface_esp_encapsulation {
 	ESP_ENCAPSULATION_ENABLED = 1,
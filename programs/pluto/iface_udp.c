@@ -36,6 +36,11 @@
 # include <poll.h>
 #endif
 
+#ifdef SO_ATTACH_FILTER
+# include <linux/filter.h>
+# include <stddef.h>		/* for offsetof() */
+#endif
+
 #include "ip_address.h"
 
 #include "defs.h"
@@ -47,6 +52,7 @@
 #include "log.h"
 #include "ip_info.h"
 #include "ip_sockaddr.h"
+#include "state.h"		/* for drop_new_exchanges() */
 
 #ifdef UDP_ENCAP
 static int espinudp_enable_esp_encapsulation(int fd, struct logger *logger)
@@ -307,6 +313,144 @@ static void udp_listen(struct iface_endpoint *ifp,
 	}
 }
 
+#ifdef SO_ATTACH_FILTER
+
+/*
+ * Generate a classic BPF program that discards, in the kernel,
+ * datagrams that process_md() would only drop:
+ *
+ * - too short to contain an IKE header (includes NAT-T keep-alives)
+ *
+ * - on an ESP encapsulation socket, a non-zero Non-ESP marker (ESP
+ *   has already been consumed) or a spurious second marker
+ *
+ * - an IKE header length longer than the datagram
+ *
+ * - major version 0, and IKEv1 when it is being dropped
+ *
+ * - when pluto is dropping new exchanges, IKE_SA_INIT requests
+ *
+ * IKE_SA_INIT requests without a cookie are let through: pluto needs
+ * to see them to respond with a COOKIE.
+ *
+ * The filter sees the UDP header, hence the offsets.
+ */
+
+#define FILTER_DROP 255		/* jump fixups */
+#define FILTER_PASS 254
+
+struct udp_filter {
+	struct sock_filter insn[32];
+	unsigned len;
+};
+
+static void filter_stmt(struct udp_filter *f, uint16_t code, uint32_t k)
+{
+	passert(f->len < elemsof(f->insn));
+	f->insn[f->len++] = (struct sock_filter) BPF_STMT(code, k);
+}
+
+static void filter_jump(struct udp_filter *f, uint16_t code, uint32_t k,
+			uint8_t jt, uint8_t jf)
+{
+	passert(f->len < elemsof(f->insn));
+	f->insn[f->len++] = (struct sock_filter) BPF_JUMP(code, k, jt, jf);
+}
+
+static uint8_t filter_target(unsigned from, uint8_t label,
+			     unsigned pass, unsigned drop)
+{
+	switch (label) {
+	case FILTER_PASS: return pass - (from + 1);
+	case FILTER_DROP: return drop - (from + 1);
+	default: return label;
+	}
+}
+
+static void udp_attach_filter(const struct iface_endpoint *ifp,
+			      struct logger *logger)
+{
+	const uint32_t udp = 8;	/* sizeof(struct udphdr) */
+	const uint32_t ike = udp + (ifp->esp_encapsulation_enabled ? NON_ESP_MARKER_SIZE : 0);
+	const bool drop_ikev1 =
+#ifdef USE_IKEv1
+		(pluto_ikev1_pol == GLOBAL_IKEv1_DROP);
+#else
+		true;
+#endif
+	const bool drop_ike_sa_init = drop_new_exchanges();
+
+	struct udp_filter f = { .len = 0, };
+
+	/* too short? */
+	filter_stmt(&f, BPF_LD|BPF_W|BPF_LEN, 0);
+	filter_jump(&f, BPF_JMP|BPF_JGE|BPF_K, ike + NSIZEOF_isakmp_hdr, 0, FILTER_DROP);
+
+	/* header length longer than datagram? */
+	filter_stmt(&f, BPF_ALU|BPF_SUB|BPF_K, ike);
+	filter_stmt(&f, BPF_MISC|BPF_TAX, 0);
+	filter_stmt(&f, BPF_LD|BPF_W|BPF_ABS, ike + offsetof(struct isakmp_hdr, isa_length));
+	filter_jump(&f, BPF_JMP|BPF_JGT|BPF_X, 0, FILTER_DROP, 0);
+
+	if (ifp->esp_encapsulation_enabled) {
+		/* non-zero Non-ESP marker */
+		filter_stmt(&f, BPF_LD|BPF_W|BPF_ABS, udp);
+		filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, 0, 0, FILTER_DROP);
+		/* spurious second Non-ESP marker */
+		filter_stmt(&f, BPF_LD|BPF_W|BPF_ABS, ike);
+		filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, 0, FILTER_DROP, 0);
+	}
+
+	/* major version */
+	filter_stmt(&f, BPF_LD|BPF_B|BPF_ABS, ike + offsetof(struct isakmp_hdr, isa_version));
+	filter_stmt(&f, BPF_ALU|BPF_RSH|BPF_K, ISA_MAJ_SHIFT);
+	filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, 0, FILTER_DROP, 0);
+	filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, ISAKMP_MAJOR_VERSION,
+		    (drop_ikev1 ? FILTER_DROP : FILTER_PASS), 0);
+
+	if (drop_ike_sa_init) {
+		filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, IKEv2_MAJOR_VERSION, 0, FILTER_PASS);
+		filter_stmt(&f, BPF_LD|BPF_B|BPF_ABS, ike + offsetof(struct isakmp_hdr, isa_xchg));
+		filter_jump(&f, BPF_JMP|BPF_JEQ|BPF_K, ISAKMP_v2_IKE_SA_INIT, 0, FILTER_PASS);
+		filter_stmt(&f, BPF_LD|BPF_B|BPF_ABS, ike + offsetof(struct isakmp_hdr, isa_flags));
+		filter_jump(&f, BPF_JMP|BPF_JSET|BPF_K, ISAKMP_FLAGS_v2_MSG_R, FILTER_PASS, FILTER_DROP);
+	}
+
+	/* i.e., all of it */
+	unsigned pass = f.len;
+	filter_stmt(&f, BPF_RET|BPF_K, UINT32_MAX);
+	unsigned drop = f.len;
+	filter_stmt(&f, BPF_RET|BPF_K, 0);
+
+	for (unsigned i = 0; i < f.len; i++) {
+		if (BPF_CLASS(f.insn[i].code) == BPF_JMP) {
+			f.insn[i].jt = filter_target(i, f.insn[i].jt, pass, drop);
+			f.insn[i].jf = filter_target(i, f.insn[i].jf, pass, drop);
+		}
+	}
+
+	struct sock_fprog prog = {
+		.len = f.len,
+		.filter = f.insn,
+	};
+	if (setsockopt(ifp->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+		/* non-fatal; pluto still checks everything */
+		llog_errno(RC_LOG, logger, errno,
+			   "setsockopt(SOL_SOCKET, SO_ATTACH_FILTER) on %s failed: ",
+			   ifp->ip_dev->real_device_name);
+		return;
+	}
+
+	endpoint_buf eb;
+	ldbg(logger, "attached %u instruction IKE filter to %s %s%s%s",
+	     f.len, ifp->ip_dev->real_device_name,
+	     str_endpoint(&ifp->local_endpoint, &eb),
+	     (drop_ikev1 ? "; dropping IKEv1" : ""),
+	     (drop_ike_sa_init ? "; dropping IKE_SA_INIT requests" : ""));
+}
+
+#endif
+
 static void udp_cleanup(struct iface_endpoint *ifp)
 {
 	detach_fd_read_listener(&ifp->udp.read_listener);
@@ -322,6 +466,9 @@ const struct iface_io udp_iface_io = {
 	.read_packet = udp_read_packet,
 	.write_packet = udp_write_packet,
 	.listen = udp_listen,
+#ifdef SO_ATTACH_FILTER
+	.attach_filter = udp_attach_filter,
+#endif
 #ifdef UDP_ENCAP
 	.enable_esp_encapsulation = espinudp_enable_esp_encapsulation,
 #endif
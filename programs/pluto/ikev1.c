@@ -174,6 +174,9 @@
 #endif
 
 #include "pluto_stats.h"
+#include "pluto_latency.h"		/* for record_transition_latency() */
+#include "pluto_usdt.h"
+#include "pluto_cost.h"			/* for count_state_transition() */
 
 static bool v1_state_busy(const struct state *st);
 static bool verbose_v1_state_busy(const struct state *st);
@@ -1632,6 +1635,8 @@ void process_packet_tail(struct msg_digest *md)
 	 * SA?
 	 */
 	statetime_t start = statetime_start(st);
+	PLUTO_PROBE(transition_start, (st != NULL ? st->st_serialno : SOS_NOBODY),
+		    md->hdr.isa_msgid, md->hdr.isa_xchg);
 	stf_status e = smc->processor(st, md);
 	complete_v1_state_transition(md->v1_st, md, e);
 	statetime_stop(&start, "%s()", __func__);
@@ -1707,6 +1712,17 @@ void complete_v1_state_transition(struct state *st, struct msg_digest *md, stf_s
 	 * statistics; all STF_FAIL_v1N+v1N are lumped together
 	 */
 	pstat(stf_status, result);
+	if (result == STF_SUSPEND) {
+		md_latency_suspend(md);
+	} else {
+		record_transition_latency(md, result);
+	}
+	if (st != NULL) {
+		count_state_transition(st, result);
+	}
+	PLUTO_PROBE(transition_finish, (st != NULL ? st->st_serialno : SOS_NOBODY),
+		    (md != NULL ? (int64_t)md->hdr.isa_msgid : -1),
+		    result);
 
 	/* DANGER: MD might be NULL; ST might be NULL */
 	enum_buf neb;
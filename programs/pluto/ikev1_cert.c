@@ -122,6 +122,7 @@ bool v1_decode_certs(struct msg_digest *md)
 		.ocsp = ocsp_enable,
 		.ocsp_strict = ocsp_strict,
 		.ocsp_post = ocsp_post,
+		.ocsp_prefetch = ocsp_prefetch,
 		.crl_strict = crl_strict,
 	};
 
@@ -86,6 +86,9 @@
 #include "ikev2_eap.h"
 #include "terminate.h"
 #include "ikev2_parent.h"
+#include "pluto_latency.h"		/* for record_transition_latency() */
+#include "pluto_usdt.h"
+#include "pluto_cost.h"			/* for count_state_transition() */
 
 static callback_cb reinitiate_v2_ike_sa_init;	/* type assertion */
 
@@ -1603,6 +1606,9 @@ void start_v2_transition(struct ike_sa *ike,
 {
 	set_v2_transition(&ike->sa, next_transition, where);
 	v2_msgid_start(ike, NULL, md, HERE);
+	PLUTO_PROBE(transition_start, ike->sa.st_serialno,
+		    (md != NULL ? (int64_t)md->hdr.isa_msgid : -1),
+		    next_transition->exchange);
 }
 
 void start_v2_exchange(struct ike_sa *ike,
@@ -1611,6 +1617,9 @@ void start_v2_exchange(struct ike_sa *ike,
 {
 	set_v2_transition(&ike->sa, exchange->initiate, where);
 	v2_msgid_start(ike, exchange, NULL, HERE);
+	PLUTO_PROBE(transition_start, ike->sa.st_serialno,
+		    ike->sa.st_v2_msgid_windows.initiator.wip,
+		    exchange->initiate->exchange);
 }
 
 stf_status next_v2_exchange(struct ike_sa *ike, struct msg_digest *md,
@@ -1698,6 +1707,15 @@ void complete_v2_state_transition(struct ike_sa *ike,
 
 	/* statistics */
 	pstat(stf_status, result);
+	if (result == STF_SUSPEND) {
+		md_latency_suspend(md);
+	} else {
+		record_transition_latency(md, result);
+	}
+	count_state_transition(&ike->sa, result);
+	PLUTO_PROBE(transition_finish, ike->sa.st_serialno,
+		    (md != NULL ? (int64_t)md->hdr.isa_msgid : -1),
+		    result);
 
 #if 0
 	/*
@@ -2024,6 +2042,32 @@ bool accept_v2_notification(v2_notification_t n,
 	return false;
 }
 
+/*
+ * RFC 9611: the per-resource Child SAs share the main Child SA's
+ * traffic selectors; rekey them along with it so that a CPU's pinned
+ * SA never outlives the SA the other CPUs fall back to.
+ */
+
+static void rekey_v2_resource_children(struct ike_sa *ike, struct child_sa *child)
+{
+	struct state_filter sf = {
+		.clonedfrom = ike->sa.st_serialno,
+		.connection_serialno = child->sa.st_connection->serialno,
+		.where = HERE,
+	};
+	while (next_state(NEW2OLD, &sf)) {
+		if (!sf.st->st_resource_sa ||
+		    !IS_CHILD_SA_ESTABLISHED(sf.st) ||
+		    sf.st->st_v2_rekey_event == NULL/*already rekeying*/) {
+			continue;
+		}
+		ldbg_sa(child, "rekeying per-resource Child SA "PRI_SO" (cpu=%"PRIu32") alongside "PRI_SO,
+			pri_so(sf.st->st_serialno), sf.st->st_pcpu.cpu,
+			pri_so(child->sa.st_serialno));
+		event_force(EVENT_v2_REKEY, sf.st);
+	}
+}
+
 void event_v2_rekey(struct state *st, bool detach_whack)
 {
 	if (v2_state_is_expired(st, "rekey")) {
@@ -2036,8 +2080,12 @@ void event_v2_rekey(struct state *st, bool detach_whack)
 	if (IS_IKE_SA(st)) {
 		larval_sa = submit_v2_CREATE_CHILD_SA_rekey_ike(ike, /*detach_whack*/false);
 	} else {
-		larval_sa = submit_v2_CREATE_CHILD_SA_rekey_child(ike, pexpect_child_sa(st),
-								  detach_whack);
+		struct child_sa *child = pexpect_child_sa(st);
+		larval_sa = submit_v2_CREATE_CHILD_SA_rekey_child(ike, child, detach_whack);
+		if (child->sa.st_connection->config->child_sa.per_cpu &&
+		    !child->sa.st_resource_sa) {
+			rekey_v2_resource_children(ike, child);
+		}
 	}
 
 	llog(RC_LOG, larval_sa->sa.logger,
@@ -283,9 +283,102 @@ bool emit_v2_child_request_payloads(const struct ike_sa *ike,
 		return false;
 	}
 
+	/* RFC 9611: willing to have per-resource Child SAs */
+
+	if (cc->config->child_sa.per_cpu &&
+	    !emit_v2N(v2N_SA_RESOURCE_INFO, pbs)) {
+		return false;
+	}
+
 	return true;
 }
 
+/*
+ * RFC 9611: an additional per-resource Child SA only needs kernel
+ * state; the connection's main Child SA continues to own the kernel
+ * policies and routing.
+ */
+
+static bool establish_v2_child(struct ike_sa *ike, struct child_sa *child, where_t where)
+{
+	if (child->sa.st_resource_sa) {
+		return install_resource_ipsec_sa(child, where);
+	}
+	return connection_establish_child(ike, child, where);
+}
+
+/*
+ * RFC 9611: the peer sent SA_RESOURCE_INFO.
+ *
+ * When the connection already has an established Child SA, the new
+ * Child SA is an additional per-resource SA for the same traffic
+ * selectors.  Limit them to one per local CPU.  A rekey inherits
+ * from the Child SA being replaced.
+ */
+
+static v2_notification_t process_v2N_SA_RESOURCE_INFO_request(struct child_sa *larval_child)
+{
+	struct connection *cc = larval_child->sa.st_connection;
+
+	if (!cc->config->child_sa.per_cpu) {
+		ldbg_sa(larval_child, "ignoring SA_RESOURCE_INFO as per-cpu-sas=no");
+		return v2N_NOTHING_WRONG;
+	}
+
+	if (larval_child->sa.st_v2_rekey_pred != SOS_NOBODY ||
+	    cc->established_child_sa == SOS_NOBODY) {
+		ldbg_sa(larval_child, "SA_RESOURCE_INFO for a rekey or first Child SA");
+		return v2N_NOTHING_WRONG;
+	}
+
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (cpus <= 0) {
+		cpus = 1;
+	}
+
+	/*
+	 * Pin the responder's outbound SA to the lowest CPU that
+	 * doesn't yet have one (the main Child SA is unpinned).
+	 */
+	unsigned siblings = 0;
+	uint32_t cpu = 0;
+	bool retry;
+	do {
+		retry = false;
+		siblings = 0;
+		struct state_filter sf = {
+			.connection_serialno = cc->serialno,
+			.where = HERE,
+		};
+		while (next_state(NEW2OLD, &sf)) {
+			if (!sf.st->st_resource_sa || !IS_CHILD_SA_ESTABLISHED(sf.st)) {
+				continue;
+			}
+			siblings++;
+			if (sf.st->st_pcpu.is_set && sf.st->st_pcpu.cpu == cpu) {
+				cpu++;
+				retry = true;
+			}
+		}
+	} while (retry && cpu < (unsigned long)cpus);
+
+	if (siblings >= (unsigned long)cpus || cpu >= (unsigned long)cpus) {
+		llog_sa(RC_LOG, larval_child,
+			"rejecting per-resource Child SA; already have %u for %ld CPUs",
+			siblings, cpus);
+		return v2N_TS_MAX_QUEUE;
+	}
+
+	larval_child->sa.st_resource_sa = true;
+	larval_child->sa.st_pcpu = (struct sa_pcpu) {
+		.is_set = true,
+		.cpu = cpu,
+	};
+	ldbg_sa(larval_child, "additional per-resource Child SA %u alongside "PRI_SO", outbound pinned to cpu=%"PRIu32,
+		siblings + 1, pri_so(cc->established_child_sa), cpu);
+	return v2N_NOTHING_WRONG;
+}
+
 /*
  * Process the CHILD payloads (assumes the SA proposal payloads were
  * handled earlier).
@@ -364,6 +457,13 @@ v2_notification_t process_v2_child_request_payloads(struct ike_sa *ike,
 
 	larval_child->sa.st_kernel_mode = required_mode;
 
+	if (request_md->pd[PD_v2N_SA_RESOURCE_INFO] != NULL) {
+		v2_notification_t n = process_v2N_SA_RESOURCE_INFO_request(larval_child);
+		if (n != v2N_NOTHING_WRONG) {
+			return n;
+		}
+	}
+
 	if (!compute_v2_child_spi(larval_child)) {
 		return v2N_INVALID_SYNTAX;/* something fatal */
 	}
@@ -438,7 +538,7 @@ v2_notification_t process_v2_child_request_payloads(struct ike_sa *ike,
 	pexpect(ike->sa.st_connection->established_ike_sa == ike->sa.st_serialno);
 
 	/* install inbound and outbound SPI info */
-	if (!connection_establish_child(ike, larval_child, HERE)) {
+	if (!establish_v2_child(ike, larval_child, HERE)) {
 		/* already logged */
 		return v2N_TEMPORARY_FAILURE;
 	}
@@ -548,6 +648,12 @@ bool emit_v2_child_response_payloads(struct ike_sa *ike,
 		return false;
 	}
 
+	if (cc->config->child_sa.per_cpu &&
+	    request_md->pd[PD_v2N_SA_RESOURCE_INFO] != NULL &&
+	    !emit_v2N(v2N_SA_RESOURCE_INFO, outpbs)) {
+		return false;
+	}
+
 	return true;
 }
 
@@ -799,6 +905,11 @@ v2_notification_t process_v2_child_response_payloads(struct ike_sa *ike, struct
 	child->sa.st_kernel_mode = required_mode;
 
 	child->sa.st_seen_no_tfc = md->pd[PD_v2N_ESP_TFC_PADDING_NOT_SUPPORTED] != NULL;
+	if (child->sa.st_resource_sa &&
+	    md->pd[PD_v2N_SA_RESOURCE_INFO] == NULL) {
+		/* RFC 9611 says the responder MAY omit it */
+		ldbg_sa(child, "per-resource Child SA response without SA_RESOURCE_INFO");
+	}
 	if (md->pd[PD_v2N_IPCOMP_SUPPORTED] != NULL) {
 		struct pbs_in pbs = md->pd[PD_v2N_IPCOMP_SUPPORTED]->pbs;
 		size_t len = pbs_left(&pbs);
@@ -847,7 +958,7 @@ v2_notification_t process_v2_child_response_payloads(struct ike_sa *ike, struct
 	ikev2_derive_child_keys(ike, child);
 
 	/* now install child SAs */
-	if (!connection_establish_child(ike, child, HERE)) {
+	if (!establish_v2_child(ike, child, HERE)) {
 		return v2N_TEMPORARY_FAILURE; /* delete child */
 	}
 
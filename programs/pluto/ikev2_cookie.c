@@ -38,6 +38,8 @@
 #include "state.h"
 #include "ikev2.h"
 #include "ikev2_ike_sa_init.h"
+#include "ikev2_puzzle.h"
+#include "server.h"		/* for pluto_ddos_puzzles */
 
 /*
  * That the cookie size of 32-bytes happens to match
@@ -151,6 +153,10 @@ bool v2_rejected_initiator_cookie(struct msg_digest *md,
 
 	/* No cookie? demand one */
 	if (me_want_cookie && cookie_digest == NULL) {
+		if (pluto_ddos_puzzles) {
+			send_v2_cookie_and_puzzle_response_from_md(md, local_cookie);
+			return true; /* reject cookie */
+		}
 		llog_md(md, "DOS mode on; responding to IKE_SA_INIT with cookie notification request");
 		send_v2N_response_from_md(md, v2N_COOKIE, &local_cookie);
 		return true; /* reject cookie */
@@ -187,6 +193,12 @@ bool v2_rejected_initiator_cookie(struct msg_digest *md,
 	}
 	dbg("cookies match");
 
+	/* RFC 8019: with a puzzle, the solution must be acceptable */
+	if (me_want_cookie && pluto_ddos_puzzles &&
+	    v2_rejected_puzzle_solution(md, remote_cookie)) {
+		return true; /* reject cookie */
+	}
+
 	return false; /* love the cookie */
 }
 
@@ -255,6 +267,16 @@ stf_status process_v2_IKE_SA_INIT_response_v2N_COOKIE(struct ike_sa *ike,
 		DBG_dump_hunk("IKEv2 cookie received", ike->sa.st_dcookie);
 	}
 
+	/*
+	 * RFC 8019: a previous solution is for a different cookie;
+	 * when there's a PUZZLE, solve it before re-sending.
+	 */
+	free_chunk_content(&ike->sa.st_v2_puzzle_solution);
+	if (md->pd[PD_v2N_PUZZLE] != NULL &&
+	    submit_v2_puzzle(ike, md)) {
+		return STF_SUSPEND;
+	}
+
 	if (!suppress_log(ike->sa.logger)) {
 		llog_sa(RC_LOG, ike,
 			  "received anti-DDOS COOKIE response, resending IKE_SA_INIT request with COOKIE payload");
@@ -489,6 +489,9 @@ struct child_sa *submit_v2_CREATE_CHILD_SA_rekey_child(struct ike_sa *ike,
 	 */
 	larval_child->sa.st_policy = capture_child_rekey_policy(&child_being_replaced->sa);
 	larval_child->sa.st_v2_rekey_pred = child_being_replaced->sa.st_serialno;
+	/* RFC 9611: the replacement stays on the same CPU */
+	larval_child->sa.st_resource_sa = child_being_replaced->sa.st_resource_sa;
+	larval_child->sa.st_pcpu = child_being_replaced->sa.st_pcpu;
 
 	larval_child->sa.st_v2_create_child_sa_proposals =
 		get_v2_CREATE_CHILD_SA_rekey_child_proposals(ike,
@@ -840,6 +843,8 @@ stf_status process_v2_CREATE_CHILD_SA_rekey_child_request(struct ike_sa *ike,
 				       STATE_V2_REKEY_CHILD_R0);
 
 	larval_child->sa.st_v2_rekey_pred = predecessor->sa.st_serialno;
+	larval_child->sa.st_resource_sa = predecessor->sa.st_resource_sa;
+	larval_child->sa.st_pcpu = predecessor->sa.st_pcpu;
 	larval_child->sa.st_v2_create_child_sa_proposals =
 		get_v2_CREATE_CHILD_SA_rekey_child_proposals(ike, predecessor,
 							     larval_child->sa.logger);
@@ -908,6 +913,60 @@ struct child_sa *submit_v2_CREATE_CHILD_SA_new_child(struct ike_sa *ike,
 	return larval_child;
 }
 
+/*
+ * RFC 9611: the kernel found no SA for a CPU.  When the connection
+ * already has an established Child SA, add a per-resource Child SA,
+ * for the same traffic selectors, pinned to that CPU.
+ *
+ * Returns false, having done nothing, when there's no established
+ * Child SA (the caller initiates the connection as normal).
+ */
+
+bool submit_v2_CREATE_CHILD_SA_resource_child(struct connection *c,
+					      struct sa_pcpu pcpu,
+					      bool detach_whack,
+					      struct logger *logger)
+{
+	struct child_sa *established = child_sa_by_serialno(c->established_child_sa);
+	if (established == NULL) {
+		ldbg(logger, "no established Child SA for CPU %"PRIu32" to join",
+		     pcpu.cpu);
+		return false;
+	}
+
+	struct ike_sa *ike = ike_sa(&established->sa, HERE);
+	if (ike == NULL || !IS_IKE_SA_ESTABLISHED(&ike->sa)) {
+		ldbg(logger, "no established IKE SA for CPU %"PRIu32" Child SA",
+		     pcpu.cpu);
+		return false;
+	}
+
+	/* larval or established, one per CPU */
+	struct state_filter sf = {
+		.connection_serialno = c->serialno,
+		.where = HERE,
+	};
+	while (next_state(NEW2OLD, &sf)) {
+		if (sf.st->st_resource_sa &&
+		    sf.st->st_pcpu.is_set &&
+		    sf.st->st_pcpu.cpu == pcpu.cpu) {
+			ldbg(logger, "CPU %"PRIu32" already has Child SA "PRI_SO,
+			     pcpu.cpu, pri_so(sf.st->st_serialno));
+			return true;
+		}
+	}
+
+	const struct child_policy policy = child_sa_policy(c);
+	struct child_sa *larval_child =
+		submit_v2_CREATE_CHILD_SA_new_child(ike, c, &policy, detach_whack);
+	larval_child->sa.st_resource_sa = true;
+	larval_child->sa.st_pcpu = pcpu;
+	ldbg(logger, "per-resource Child SA "PRI_SO" for CPU %"PRIu32" alongside "PRI_SO,
+	     pri_so(larval_child->sa.st_serialno), pcpu.cpu,
+	     pri_so(established->sa.st_serialno));
+	return true;
+}
+
 static void llog_v2_success_new_child_request(struct ike_sa *ike)
 {
 	/* XXX: should the lerval SA be a parameter? */
@@ -18,10 +18,12 @@
 
 #include "shunk.h"
 #include "lset.h"
+#include "sa_pcpu.h"
 
 struct ike_sa;
 struct child_sa;
 struct connection;
+struct logger;
 
 struct child_sa *submit_v2_CREATE_CHILD_SA_rekey_ike(struct ike_sa *ike,
 						     bool detach_whack);
@@ -36,6 +38,11 @@ struct child_sa *submit_v2_CREATE_CHILD_SA_new_child(struct ike_sa *ike,
 
 extern ikev2_state_transition_fn process_v2_CREATE_CHILD_SA_new_child_request;
 
+bool submit_v2_CREATE_CHILD_SA_resource_child(struct connection *c,
+					      struct sa_pcpu pcpu,
+					      bool detach_whack,
+					      struct logger *logger);
+
 extern struct child_sa *submit_v2_CREATE_CHILD_SA_rekey_child(struct ike_sa *ike,
 							      struct child_sa *child,
 							      bool detach_whack);
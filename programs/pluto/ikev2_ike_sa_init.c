@@ -65,6 +65,7 @@
 #include "ike_alg_integ.h"	/* for ike_alg_integ_none */
 #include "ikev2_parent.h"
 #include "ikev2_eap.h"
+#include "ikev2_puzzle.h"
 
 static ke_and_nonce_cb initiate_v2_IKE_SA_INIT_request_continue;	/* type assertion */
 static dh_shared_secret_cb process_v2_IKE_SA_INIT_response_continue;	/* type assertion */
@@ -883,6 +884,13 @@ bool record_v2_IKE_SA_INIT_request(struct ike_sa *ike)
 		}
 	}
 
+	/* RFC 8019: HDR, N(COOKIE), [PS,] SA, KE, Ni */
+	if (ike->sa.st_v2_puzzle_solution.ptr != NULL) {
+		if (!emit_v2PS(HUNK_AS_SHUNK(ike->sa.st_v2_puzzle_solution), request.pbs)) {
+			return false;
+		}
+	}
+
 	/* SA out */
 
 	const struct ikev2_proposals *ike_proposals = c->config->v2_ike_proposals;
@@ -1162,11 +1170,29 @@ stf_status process_v2_IKE_SA_INIT_request(struct ike_sa *ike,
 		ike->sa.st_seen_hashnotify = true;
 	}
 
-	/* calculate the nonce and the KE */
-	submit_ke_and_nonce(/*callback*/&ike->sa, /*task*/&ike->sa, md,
-			    ike->sa.st_oakley.ta_dh,
-			    process_v2_IKE_SA_INIT_request_continue,
-			    /*detach_whack*/false, HERE);
+	/*
+	 * Calculate the nonce and the KE.
+	 *
+	 * When not under attack, also compute g^ir in the same helper
+	 * job so that, once the response has been sent, SKEYSEED is
+	 * ready for the IKE_AUTH (or IKE_INTERMEDIATE) request.
+	 *
+	 * Otherwise defer g^ir until the initiator has proven that it
+	 * is willing to spend the effort of sending IKE_AUTH (see
+	 * process_v2_request_no_skeyseed()).
+	 */
+	if (require_ddos_cookies()) {
+		submit_ke_and_nonce(/*callback*/&ike->sa, /*task*/&ike->sa, md,
+				    ike->sa.st_oakley.ta_dh,
+				    process_v2_IKE_SA_INIT_request_continue,
+				    /*detach_whack*/false, HERE);
+	} else {
+		submit_ke_nonce_and_dh_shared_secret(/*callback*/&ike->sa, /*task*/&ike->sa, md,
+						     ike->sa.st_oakley.ta_dh,
+						     ike->sa.st_gi/*responder needs initiator KE*/,
+						     process_v2_IKE_SA_INIT_request_continue,
+						     HERE);
+	}
 	return STF_SUSPEND;
 }
 
@@ -1359,6 +1385,21 @@ static stf_status process_v2_IKE_SA_INIT_request_continue(struct state *ike_st,
 		      pbs_out_all(&response.message),
 		      "saved first packet");
 
+	/*
+	 * When the helper also computed g^ir, derive SKEYSEED now so
+	 * that the IKE_AUTH request can be decrypted on arrival.
+	 *
+	 * This must happen after the (unencrypted) response has been
+	 * emitted.  Should DH have failed, leave things for
+	 * process_v2_request_no_skeyseed() to sort out.
+	 */
+	if (ike->sa.st_dh_shared_secret != NULL) {
+		calc_v2_keymat(&ike->sa,
+			       NULL /* no old keymat; not a rekey */,
+			       NULL /* no old prf; not a rekey */,
+			       &ike->sa.st_ike_spis);
+	}
+
 	return STF_OK;
 }
 
@@ -1762,6 +1803,7 @@ static const struct v2_transition v2_IKE_SA_INIT_responder_transition[] = {
 	  .exchange   = ISAKMP_v2_IKE_SA_INIT,
 	  .recv_role  = MESSAGE_REQUEST,
 	  .message_payloads.required = v2P(SA) | v2P(KE) | v2P(Ni),
+	  .message_payloads.optional = v2P(PS),
 	  .processor  = process_v2_IKE_SA_INIT_request,
 	  .llog_success = llog_process_v2_IKE_SA_INIT_request_success,
 	  .timeout_event = EVENT_v2_DISCARD, },
@@ -70,7 +70,7 @@ static void add_dns_pubkeys_to_pluto(struct p_dns_req *dnsr, struct dns_pubkey *
 
 	/* algorithm is hardcoded RSA -- PUBKEY_ALG_RSA */
 	/* delete only once. then multiple keys could be added */
-	delete_public_keys(&pluto_pubkeys, keyid, &pubkey_type_rsa);
+	delete_preloaded_pubkeys(keyid, &pubkey_type_rsa);
 
 	realtime_t install_time = realnow();
 	for (struct dns_pubkey *dns_pubkey = dns_pubkeys; dns_pubkey != NULL; dns_pubkey = dns_pubkey->next) {
@@ -91,6 +91,7 @@ static void add_dns_pubkeys_to_pluto(struct p_dns_req *dnsr, struct dns_pubkey *
 				 ttl, ttl_used);
 		}
 
+		struct pubkey_list *pubkeys = NULL;
 		enum dns_auth_level al = dnsr->secure == UB_EVENT_SECURE ?
 			DNSSEC_SECURE : DNSSEC_INSECURE;
 
@@ -115,7 +116,8 @@ static void add_dns_pubkeys_to_pluto(struct p_dns_req *dnsr, struct dns_pubkey *
 					       realtimesum(install_time, deltatime(ttl_used)),
 					       ttl,
 					       dns_pubkey->pubkey,
-					       NULL/*don't-return-pubkey*/, &pluto_pubkeys);
+					       NULL/*don't-return-pubkey*/, &pubkeys);
+		add_preloaded_pubkeys(&pubkeys);
 		if (d != NULL) {
 			id_buf thatidbuf;
 			llog(RC_LOG, dnsr->logger,
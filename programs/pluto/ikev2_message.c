@@ -396,15 +396,12 @@ bool encrypt_v2SK_payload(struct v2SK_payload *sk)
 	chunk_t enc = chunk2(sk->cleartext.ptr, sk->cleartext.len + sk->padding.len);
 
 	chunk_t salt;
-	PK11SymKey *authkey;
 	/* encrypt with our end's key */
 	switch (ike->sa.st_sa_role) {
 	case SA_INITIATOR:
-		authkey = ike->sa.st_skey_ai_nss;
 		salt = ike->sa.st_skey_initiator_salt;
 		break;
 	case SA_RESPONDER:
-		authkey = ike->sa.st_skey_ar_nss;
 		salt = ike->sa.st_skey_responder_salt;
 		break;
 	default:
@@ -449,8 +446,9 @@ bool encrypt_v2SK_payload(struct v2SK_payload *sk)
 		/* note: saved_iv's updated value is discarded */
 
 		/* okay, authenticate from beginning of IV */
-		struct crypt_prf *ctx = crypt_prf_init_symkey("integ", ike->sa.st_oakley.ta_integ->prf,
-							      "authkey", authkey, sk->logger);
+		PASSERT(sk->logger, ike->sa.st_ike_encrypt_integ_prf != NULL);
+		struct crypt_prf *ctx = crypt_prf_clone("integ", ike->sa.st_ike_encrypt_integ_prf,
+							sk->logger);
 		chunk_t message = chunk2(sk->aad.ptr, sk->integrity.ptr - sk->aad.ptr);
 		crypt_prf_update_bytes(ctx, "message", message.ptr, message.len);
 		passert(sk->integrity.len == ike->sa.st_oakley.ta_integ->integ_output_size);
@@ -550,16 +548,13 @@ static bool verify_and_decrypt_v2_message(struct ike_sa *ike,
 	}
 
 	chunk_t salt;
-	PK11SymKey *authkey;
 	switch (ike->sa.st_sa_role) {
 	case SA_INITIATOR:
 		/* need responders key */
-		authkey = ike->sa.st_skey_ar_nss;
 		salt = ike->sa.st_skey_responder_salt;
 		break;
 	case SA_RESPONDER:
 		/* need initiators key */
-		authkey = ike->sa.st_skey_ai_nss;
 		salt = ike->sa.st_skey_initiator_salt;
 		break;
 	default:
@@ -609,8 +604,9 @@ static bool verify_and_decrypt_v2_message(struct ike_sa *ike,
 		 * check authenticator.  The last INTEG_SIZE bytes are
 		 * the truncated digest.
 		 */
-		struct crypt_prf *ctx = crypt_prf_init_symkey("auth", ike->sa.st_oakley.ta_integ->prf,
-							      "authkey", authkey, ike->sa.logger);
+		PASSERT(ike->sa.logger, ike->sa.st_ike_decrypt_integ_prf != NULL);
+		struct crypt_prf *ctx = crypt_prf_clone("auth", ike->sa.st_ike_decrypt_integ_prf,
+							ike->sa.logger);
 		crypt_prf_update_bytes(ctx, "message", auth_start, integ.ptr - auth_start);
 		struct crypt_mac td = crypt_prf_final_mac(&ctx, ike->sa.st_oakley.ta_integ);
 
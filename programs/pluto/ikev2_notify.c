@@ -59,10 +59,12 @@ enum v2_pd v2_pd_from_notification(v2_notification_t n)
 	C(NO_PROPOSAL_CHOSEN);
 	C(NULL_AUTH);
 	C(PPK_IDENTITY);
+	C(PUZZLE);
 	C(REDIRECT);
 	C(REDIRECTED_FROM);
 	C(REDIRECT_SUPPORTED);
 	C(REKEY_SA);
+	C(SA_RESOURCE_INFO);
 	C(SIGNATURE_HASH_ALGORITHMS);
 	C(SINGLE_PAIR_REQUIRED);
 	C(TS_UNACCEPTABLE);
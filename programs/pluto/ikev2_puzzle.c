@@ -0,0 +1,418 @@
+/* IKEv2 client puzzles (RFC 8019), for Libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include "defs.h"
+#include "ike_alg.h"
+#include "rnd.h"
+#include "ikev2_puzzle.h"
+#include "demux.h"
+#include "ike_alg_prf.h"	/* for ike_alg_prf_sha2_256 */
+#include "packet.h"		/* for ikev2_prop_desc et.al. */
+#include "crypt_prf.h"
+#include "ikev2_send.h"
+#include "ikev2_message.h"	/* for open_v2_message() */
+#include "send.h"		/* for send_pbs_out_using_md() */
+#include "log.h"
+#include "state.h"
+#include "server.h"		/* for pluto_max_halfopen */
+#include "server_pool.h"
+#include "ikev2.h"
+#include "ikev2_ike_sa_init.h"
+#include "ddos.h"		/* for ddos_overload */
+#include "pluto_stats.h"	/* for pstat() */
+
+/*
+ * RFC 8019 7.1.1: the puzzle is solved by finding PUZZLE_KEYS
+ * different keys Ki (each the PRF's preferred key size) such that
+ * PRF(Ki, cookie) has at least DIFFICULTY trailing zero bits.
+ *
+ * The responder doesn't keep state, so when checking a solution it
+ * re-computes the difficulty; PUZZLE_SLACK_BITS allows for the load
+ * having increased since the puzzle was sent.
+ *
+ * The puzzle's PRF is taken from the initiator's IKE_SA_INIT
+ * proposals (see v2_puzzle_prf()); an initiator will solve using any
+ * PRF it knows.
+ */
+
+#define PUZZLE_KEYS 4
+#define PUZZLE_MIN_DIFFICULTY 8		/* ~1ms per key */
+#define PUZZLE_HALF_OPEN_BITS 8		/* added as half-open nears max */
+#define PUZZLE_OVERLOAD_BITS 4		/* added per DDoS overload stage */
+#define PUZZLE_MAX_DIFFICULTY 20
+#define PUZZLE_SLACK_BITS 4
+#define PUZZLE_MAX_SOLVE 20		/* initiator gives up beyond this */
+
+/*
+ * RFC 8019 7.1.1: the responder picks a PRF that the initiator
+ * proposed in its IKE_SA_INIT request, and only when none is usable
+ * falls back to one of its own (HMAC_SHA2_256).
+ *
+ * The responder keeps no state so this choice is made again, from
+ * the same proposals, when the request carrying the solution comes
+ * back.
+ */
+
+static const struct prf_desc *v2_puzzle_prf(struct msg_digest *md)
+{
+	const struct prf_desc *fallback = &ike_alg_prf_sha2_256;
+	const struct payload_digest *sa = md->chain[ISAKMP_NEXT_v2SA];
+	if (sa == NULL) {
+		dbg("puzzle: no SA payload; using %s", fallback->common.fqn);
+		return fallback;
+	}
+
+	/* don't consume the payload */
+	struct pbs_in sa_pbs = sa->pbs;
+	while (pbs_left(&sa_pbs) > 0) {
+		struct ikev2_prop proposal;
+		struct pbs_in proposal_pbs;
+		diag_t d = pbs_in_struct(&sa_pbs, &ikev2_prop_desc,
+					 &proposal, sizeof(proposal),
+					 &proposal_pbs);
+		if (d != NULL) {
+			/* the real parser will complain */
+			pfree_diag(&d);
+			break;
+		}
+		if (proposal.isap_protoid == IKEv2_SEC_PROTO_IKE &&
+		    proposal.isap_spisize == 0) {
+			for (unsigned t = 0; t < proposal.isap_numtrans; t++) {
+				struct ikev2_trans transform;
+				struct pbs_in transform_pbs;
+				diag_t d = pbs_in_struct(&proposal_pbs, &ikev2_trans_desc,
+							 &transform, sizeof(transform),
+							 &transform_pbs);
+				if (d != NULL) {
+					pfree_diag(&d);
+					break;
+				}
+				if (transform.isat_type != IKEv2_TRANS_TYPE_PRF) {
+					continue;
+				}
+				enum_buf eb;
+				const struct prf_desc *prf = ikev2_prf_desc(transform.isat_transid, &eb);
+				if (prf != NULL) {
+					dbg("puzzle: using proposed PRF %s", prf->common.fqn);
+					return prf;
+				}
+				dbg("puzzle: skipping proposed PRF %s", eb.buf);
+			}
+		}
+		if (proposal.isap_lp != v2_PROPOSAL_NON_LAST) {
+			break;
+		}
+	}
+
+	dbg("puzzle: no usable proposed PRF; using %s", fallback->common.fqn);
+	return fallback;
+}
+
+static unsigned v2_puzzle_difficulty(void)
+{
+	unsigned difficulty = PUZZLE_MIN_DIFFICULTY;
+	if (pluto_max_halfopen > 0) {
+		unsigned half_open = half_open_ike_sa_count();
+		if (half_open > pluto_max_halfopen) {
+			half_open = pluto_max_halfopen;
+		}
+		difficulty += (PUZZLE_HALF_OPEN_BITS * half_open) / pluto_max_halfopen;
+	}
+	difficulty += PUZZLE_OVERLOAD_BITS * ddos_overload;
+	return (difficulty > PUZZLE_MAX_DIFFICULTY ? PUZZLE_MAX_DIFFICULTY : difficulty);
+}
+
+static unsigned puzzle_zero_bits(const struct prf_desc *prf,
+				 shunk_t key, shunk_t cookie,
+				 struct logger *logger)
+{
+	struct crypt_prf *ctx = crypt_prf_init_hunk("puzzle", prf, "Ki", key, logger);
+	crypt_prf_update_hunk(ctx, "cookie", cookie);
+	struct crypt_mac digest = crypt_prf_final_mac(&ctx, NULL/*no-truncation*/);
+
+	unsigned zero_bits = 0;
+	for (size_t i = digest.len; i > 0; i--) {
+		uint8_t byte = digest.ptr[i - 1];
+		if (byte != 0) {
+			while ((byte & 1) == 0) {
+				zero_bits++;
+				byte >>= 1;
+			}
+			break;
+		}
+		zero_bits += 8;
+	}
+	return zero_bits;
+}
+
+/*
+ * Responder.
+ */
+
+void send_v2_cookie_and_puzzle_response_from_md(struct msg_digest *md,
+						shunk_t cookie)
+{
+	unsigned difficulty = v2_puzzle_difficulty();
+	const struct prf_desc *puzzle_prf = v2_puzzle_prf(md);
+	llog(RC_LOG, md->logger,
+	     "DOS mode on; responding to IKE_SA_INIT with cookie and puzzle (%s, difficulty %u) notification request",
+	     puzzle_prf->common.fqn, difficulty);
+
+	uint8_t buf[MIN_OUTPUT_UDP_SIZE];
+	struct v2_message response;
+	if (!open_v2_message("cookie and puzzle response",
+			     NULL/*no-IKE*/, md->logger, md/*response*/,
+			     ISAKMP_v2_IKE_SA_INIT,
+			     buf, sizeof(buf),
+			     &response, UNENCRYPTED_PAYLOAD)) {
+		llog_pexpect(md->logger, HERE, "error building header for cookie and puzzle response");
+		return;
+	}
+
+	/*
+	 * RFC 8019 8.1: PUZZLE notification data is the PRF's
+	 * transform ID followed by the difficulty.
+	 */
+	uint16_t prf_id = puzzle_prf->common.ikev2_alg_id;
+	uint8_t puzzle[] = {
+		prf_id >> 8, prf_id & 0xff,
+		difficulty,
+	};
+	if (!emit_v2N_hunk(v2N_COOKIE, cookie, response.pbs) ||
+	    !emit_v2N_bytes(v2N_PUZZLE, puzzle, sizeof(puzzle), response.pbs)) {
+		llog_pexpect(md->logger, HERE, "error building cookie and puzzle response");
+		return;
+	}
+
+	close_v2_message(&response);
+
+	/* fire-and-forget, like the bare cookie */
+	send_pbs_out_using_md(md, "v2 cookie and puzzle", &response.message);
+
+	pstat(ikev2_sent_notifies_e, v2N_COOKIE);
+	pstat(ikev2_sent_notifies_e, v2N_PUZZLE);
+}
+
+bool v2_rejected_puzzle_solution(struct msg_digest *md, shunk_t cookie)
+{
+	struct payload_digest *ps = md->chain[ISAKMP_NEXT_v2PS];
+	if (ps == NULL) {
+		/*
+		 * RFC 8019 7.1.2: the initiator may not support
+		 * puzzles.  Let it through only while pluto isn't
+		 * really overloaded (i.e., cookies were demanded
+		 * because of ddos-ike-threshold or ddos-mode=busy).
+		 */
+		if (ddos_overload == DDOS_OVERLOAD_NONE) {
+			dbg("no puzzle solution; accepting cookie as pluto is not overloaded");
+			return false;
+		}
+		llog_md(md, "DOS puzzle solution missing while overloaded - dropping message");
+		return true; /* reject solution */
+	}
+
+	shunk_t solution = pbs_in_left(&ps->pbs);
+	const struct prf_desc *puzzle_prf = v2_puzzle_prf(md);
+	size_t key_size = puzzle_prf->prf_key_size;
+	if (solution.len != PUZZLE_KEYS * key_size) {
+		llog_md(md, "DOS puzzle solution has wrong length - dropping message");
+		return true; /* reject solution */
+	}
+
+	unsigned difficulty = v2_puzzle_difficulty();
+	unsigned minimum = (difficulty > PUZZLE_SLACK_BITS ? difficulty - PUZZLE_SLACK_BITS : 0);
+	unsigned weakest = UINT_MAX;
+	for (unsigned k = 0; k < PUZZLE_KEYS; k++) {
+		shunk_t key = hunk_slice(solution, k * key_size, (k + 1) * key_size);
+		for (unsigned j = 0; j < k; j++) {
+			if (hunk_eq(key, hunk_slice(solution, j * key_size, (j + 1) * key_size))) {
+				llog_md(md, "DOS puzzle solution contains duplicate keys - dropping message");
+				return true; /* reject solution */
+			}
+		}
+		unsigned zero_bits = puzzle_zero_bits(puzzle_prf, key, cookie, md->logger);
+		if (zero_bits < minimum) {
+			llog_md(md, "DOS puzzle solution too weak, %u zero bits but need %u - dropping message",
+				zero_bits, minimum);
+			return true; /* reject solution */
+		}
+		weakest = (zero_bits < weakest ? zero_bits : weakest);
+	}
+
+	dbg("puzzle solved with %u zero bits (wanted %u)", weakest, difficulty);
+	return false; /* love the solution */
+}
+
+/*
+ * Initiator.
+ */
+
+struct task {
+	const struct prf_desc *prf;
+	unsigned difficulty;
+	chunk_t cookie;
+	chunk_t solution;
+	bool solved;
+};
+
+static task_computer_fn solve_v2_puzzle; /* type check */
+static task_completed_cb solved_v2_puzzle; /* type check */
+static task_cleanup_cb cleanup_v2_puzzle; /* type check */
+
+static const struct task_handler puzzle_handler = {
+	.name = "solve puzzle",
+	.computer_fn = solve_v2_puzzle,
+	.completed_cb = solved_v2_puzzle,
+	.cleanup_cb = cleanup_v2_puzzle,
+};
+
+bool submit_v2_puzzle(struct ike_sa *ike, struct msg_digest *md)
+{
+	struct pbs_in pbs = md->pd[PD_v2N_PUZZLE]->pbs;
+	uint8_t puzzle[3];
+	diag_t d = pbs_in_thing(&pbs, puzzle, "puzzle");
+	if (d != NULL) {
+		llog(RC_LOG, ike->sa.logger, "ignoring malformed PUZZLE notification: %s",
+		     str_diag(d));
+		pfree_diag(&d);
+		return false;
+	}
+
+	enum ikev2_trans_type_prf prf_id = (puzzle[0] << 8) | puzzle[1];
+	unsigned difficulty = puzzle[2];
+	enum_buf eb;
+	const struct prf_desc *prf = ikev2_prf_desc(prf_id, &eb);
+	if (prf == NULL) {
+		llog(RC_LOG, ike->sa.logger, "ignoring PUZZLE using unsupported PRF %s", eb.buf);
+		return false;
+	}
+	if (difficulty > PUZZLE_MAX_SOLVE) {
+		llog(RC_LOG, ike->sa.logger,
+		     "ignoring PUZZLE with difficulty %u; more than %u",
+		     difficulty, PUZZLE_MAX_SOLVE);
+		return false;
+	}
+
+	struct task task = {
+		.prf = prf,
+		.difficulty = difficulty,
+		.cookie = clone_hunk(ike->sa.st_dcookie, "puzzle cookie"),
+		/* random keys; the last bytes are varied */
+		.solution = alloc_rnd_chunk(PUZZLE_KEYS * prf->prf_key_size, "puzzle solution"),
+	};
+	llog(RC_LOG, ike->sa.logger,
+	     "received anti-DDOS PUZZLE response (%s, difficulty %u), solving",
+	     prf->common.fqn, difficulty);
+	submit_task(/*callback*/&ike->sa, /*task*/&ike->sa, md,
+		    /*detach_whack*/false,
+		    clone_thing(task, "puzzle task"),
+		    &puzzle_handler, HERE);
+	return true;
+}
+
+/*
+ * Each key is <random> | K | <counter> where K, the key's index,
+ * ensures the keys are different.
+ */
+
+static void solve_v2_puzzle(struct logger *logger,
+			    struct task *task,
+			    int my_thread UNUSED)
+{
+	size_t key_size = task->prf->prf_key_size;
+	PASSERT(logger, key_size > 5);
+	for (unsigned k = 0; k < PUZZLE_KEYS; k++) {
+		uint8_t *key = task->solution.ptr + k * key_size;
+		uint8_t *counter = key + key_size - 4;
+		key[key_size - 5] = k;
+		for (uint64_t c = 0; ; c++) {
+			if (c > UINT32_MAX) {
+				llog(RC_LOG, logger, "PUZZLE has no solution");
+				return;
+			}
+			counter[0] = c >> 24;
+			counter[1] = c >> 16;
+			counter[2] = c >> 8;
+			counter[3] = c;
+			if (puzzle_zero_bits(task->prf, shunk2(key, key_size),
+					     HUNK_AS_SHUNK(task->cookie),
+					     logger) >= task->difficulty) {
+				break;
+			}
+		}
+	}
+	task->solved = true;
+}
+
+static stf_status resume_IKE_SA_INIT_with_puzzle_solution(struct ike_sa *ike)
+{
+	if (!record_v2_IKE_SA_INIT_request(ike)) {
+		return STF_INTERNAL_ERROR;
+	}
+	return STF_OK;
+}
+
+static stf_status solved_v2_puzzle(struct state *ike_sa,
+				   struct msg_digest *md UNUSED,
+				   struct task *task)
+{
+	struct ike_sa *ike = pexpect_ike_sa(ike_sa);
+	if (ike == NULL) {
+		return STF_INTERNAL_ERROR;
+	}
+
+	if (task->solved) {
+		/* transfer */
+		free_chunk_content(&ike->sa.st_v2_puzzle_solution);
+		ike->sa.st_v2_puzzle_solution = task->solution;
+		task->solution = empty_chunk;
+		llog_sa(RC_LOG, ike,
+			"solved anti-DDOS PUZZLE, resending IKE_SA_INIT request with COOKIE and PS payloads");
+	} else {
+		llog_sa(RC_LOG, ike,
+			"failed to solve anti-DDOS PUZZLE, resending IKE_SA_INIT request with COOKIE payload");
+	}
+
+	schedule_reinitiate_v2_ike_sa_init(ike, resume_IKE_SA_INIT_with_puzzle_solution);
+	return STF_OK;
+}
+
+static void cleanup_v2_puzzle(struct task **task)
+{
+	free_chunk_content(&(*task)->cookie);
+	free_chunk_content(&(*task)->solution);
+	pfreeany(*task);
+}
+
+bool emit_v2PS(shunk_t solution, struct pbs_out *outs)
+{
+	struct ikev2_generic gen = {
+		.isag_np = 0,
+	};
+
+	struct pbs_out pbs;
+	if (!pbs_out_struct(outs, &ikev2_ps_desc, &gen, sizeof(gen), &pbs)) {
+		/* already logged */
+		return false; /*fatal*/
+	}
+
+	if (!pbs_out_hunk(&pbs, solution, "puzzle solution")) {
+		/* already logged */
+		return false;
+	}
+	close_output_pbs(&pbs);
+	return true;
+}
@@ -0,0 +1,50 @@
+/* IKEv2 client puzzles (RFC 8019), for Libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef IKEV2_PUZZLE_H
+#define IKEV2_PUZZLE_H
+
+#include <stdbool.h>
+
+#include "shunk.h"
+
+struct msg_digest;
+struct ike_sa;
+struct pbs_out;
+
+/*
+ * Responder: instead of a bare N(COOKIE), respond with N(COOKIE)
+ * N(PUZZLE) (the difficulty is scaled to the current load).
+ */
+void send_v2_cookie_and_puzzle_response_from_md(struct msg_digest *md,
+						shunk_t cookie);
+
+/*
+ * Responder: having matched COOKIE, check the PS payload's solution;
+ * return true, having logged, when the message should be dropped.
+ */
+bool v2_rejected_puzzle_solution(struct msg_digest *md, shunk_t cookie);
+
+/*
+ * Initiator: solve the N(PUZZLE) that came with N(COOKIE) on a
+ * helper thread and then re-send IKE_SA_INIT with the solution.
+ * Returns false, having submitted nothing, when the puzzle is
+ * ignored (the request is then re-sent with just the cookie).
+ */
+bool submit_v2_puzzle(struct ike_sa *ike, struct msg_digest *md);
+
+bool emit_v2PS(shunk_t solution, struct pbs_out *outs);
+
+#endif
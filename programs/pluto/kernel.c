@@ -59,6 +59,7 @@
 #include "kernel_ops.h"
 #include "kernel_xfrm.h"
 #include "kernel_policy.h"
+#include "acquire.h"		/* for init_acquire_queue() free_acquire_queue() */
 #include "x509.h"
 #include "pluto_x509.h"
 #include "certs.h"
@@ -1266,6 +1267,8 @@ static bool setup_half_kernel_state(struct child_sa *child, enum direction direc
 		.sa_ipsec_max_bytes = c->config->sa_ipsec_max_bytes,
 		.sa_ipsec_max_packets = c->config->sa_ipsec_max_packets,
 		.sec_label = c->child.sec_label /* assume connection outlive their kernel_sa's */,
+		/* RFC 9611: only outbound is pinned */
+		.pcpu = (direction == DIRECTION_OUTBOUND ? child->sa.st_pcpu : (struct sa_pcpu) {0}),
 	};
 
 	address_buf sab, dab;
@@ -2076,6 +2079,36 @@ bool install_outbound_ipsec_sa(struct child_sa *child, enum routing new_routing,
 	return true;
 }
 
+/*
+ * RFC 9611: an additional per-resource Child SA shares the
+ * connection's kernel policies (and routing) with the connection's
+ * main Child SA; all that's needed is the kernel state.
+ */
+
+bool install_resource_ipsec_sa(struct child_sa *child, where_t where)
+{
+	struct logger *logger = child->sa.logger;
+
+	ldbg(logger, "kernel: %s() for "PRI_SO": per-resource "PRI_WHERE,
+	     __func__, pri_so(child->sa.st_serialno),
+	     pri_where(where));
+
+	if (!setup_half_kernel_state(child, DIRECTION_INBOUND)) {
+		ldbg(logger, "kernel: %s() failed to install inbound kernel state", __func__);
+		return false;
+	}
+
+	if (!setup_half_kernel_state(child, DIRECTION_OUTBOUND)) {
+		ldbg(logger, "kernel: %s() failed to install outbound kernel state", __func__);
+		uninstall_kernel_state(child, DIRECTION_INBOUND);
+		return false;
+	}
+
+	linux_audit_conn(&child->sa, LAK_CHILD_START);
+
+	return true;
+}
+
 void uninstall_kernel_states(struct child_sa *child)
 {
 	if (child->sa.st_esp.protocol == &ip_protocol_esp || child->sa.st_ah.protocol == &ip_protocol_ah) {
@@ -2553,6 +2586,9 @@ void jam_kernel_acquire(struct jambuf *buf, const struct kernel_acquire *b)
 		jam(buf, " sec_label=");
 		jam_sanitized_hunk(buf, b->sec_label);
 	}
+	if (b->pcpu.is_set) {
+		jam(buf, " cpu=%"PRIu32, b->pcpu.cpu);
+	}
 #if 0
 	if (b->state_id > 0) {
 		jam(buf, " seq=%u", (unsigned)b->state_id);
@@ -2570,12 +2606,15 @@ const struct kernel_ops *const kernel_stacks[] = {
 #ifdef KERNEL_PFKEYV2
 	&pfkeyv2_kernel_ops,
 #endif
+	&none_kernel_ops,	/* never the default */
 	NULL,
 };
 
 const struct kernel_ops *kernel_ops = NULL/*kernel_stacks[0]*/;
 
 static bool kernel_initialized = false;
+static bool kernel_reconciling = false;
+bool pluto_kernel_reconcile = false;
 
 deltatime_t bare_shunt_interval = DELTATIME_INIT(SHUNT_SCAN_INTERVAL);
 
@@ -2594,6 +2633,7 @@ void init_kernel(struct logger *logger)
 	 * kernel gets shutdown.
 	 */
 	kernel_initialized = true;
+	init_acquire_queue(logger);
 
 	struct utsname un;
 
@@ -2608,7 +2648,17 @@ void init_kernel(struct logger *logger)
 	PASSERT(logger, kernel_ops->poke_holes != NULL);
 
 	kernel_ops->init(logger);
-	kernel_ops->flush(logger);
+	if (pluto_kernel_reconcile && kernel_ops->reconcile_start == NULL) {
+		llog(RC_LOG, logger,
+		     "kernel: %s does not support kernel-reconcile=yes; flushing",
+		     kernel_ops->interface_name);
+	}
+	kernel_reconciling = (pluto_kernel_reconcile &&
+			      kernel_ops->reconcile_start != NULL &&
+			      kernel_ops->reconcile_start(logger));
+	if (!kernel_reconciling) {
+		kernel_ops->flush(logger);
+	}
 	/* after flush, else they get flushed! */
 	kernel_ops->poke_holes(logger);
 
@@ -2616,6 +2666,20 @@ void init_kernel(struct logger *logger)
 			      bare_shunt_interval);
 }
 
+/*
+ * Called once the connections loaded at startup have been routed
+ * (i.e., on the first whack --listen): delete the kernel policies
+ * left behind by the previous pluto that weren't re-installed.
+ */
+
+void reconcile_kernel(struct logger *logger)
+{
+	if (kernel_reconciling) {
+		kernel_reconciling = false;
+		kernel_ops->reconcile_finish(logger);
+	}
+}
+
 void show_kernel_interface(struct show *s)
 {
 	if (kernel_ops != NULL) {
@@ -2633,4 +2697,5 @@ void shutdown_kernel(struct logger *logger)
 		shutdown_kernel_ipsec_interface(logger);
 		kernel_ops->shutdown(logger);
 	}
+	free_acquire_queue();
 }
@@ -32,6 +32,7 @@
 #include "ip_said.h"		/* for SA_AH et.al. */
 #include "ip_packet.h"
 #include "kernel_mode.h"
+#include "sa_pcpu.h"
 
 struct sa_marks;
 struct spd;
@@ -39,6 +40,7 @@ struct iface_device;
 struct kernel_iface;
 struct show;
 struct kernel_policy;
+enum updown;
 
 enum kernel_state_id { DEFAULT_KERNEL_STATE_ID, };	/* sizeof() >= sizeof(uint32_t) */
 enum kernel_policy_id { DEFAULT_KERNEL_POLICY_ID, };	/* sizeof() >= sizeof(uint32_t) */
@@ -158,6 +160,7 @@ struct kernel_state {
 	struct nic_offload nic_offload;
 	uint32_t xfrm_if_id;
 	struct sa_mark mark_set; /* config keyword mark-out */
+	struct sa_pcpu pcpu;	/* RFC 9611; outbound only */
 	uint64_t sa_ipsec_max_bytes;
 	uint64_t sa_max_soft_bytes;
 	uint64_t sa_ipsec_max_packets;
@@ -235,6 +238,15 @@ struct kernel_ops {
 	void (*plug_holes)(struct logger *logger);
 	void (*shutdown)(struct logger *logger);
 
+	/*
+	 * Optional: instead of flushing everything at startup,
+	 * snapshot the existing policies (returning false falls back
+	 * to flush).  Once the connections have been routed, finish
+	 * deletes whatever wasn't re-installed.
+	 */
+	bool (*reconcile_start)(struct logger *logger);
+	void (*reconcile_finish)(struct logger *logger);
+
 	bool (*policy_add)(enum kernel_policy_op op,
 			   enum direction dir,
 			   const ip_selector *src_client,
@@ -300,11 +312,24 @@ struct kernel_ops {
 	 * Returns NULL(ok) or what needs to be enabled.
 	 */
 	err_t (*migrate_ipsec_sa_is_enabled)(struct logger *);
+	err_t (*pcpu_ipsec_sa_is_enabled)(struct logger *);	/* RFC 9611 */
 	bool (*migrate_ipsec_sa)(struct child_sa *child);
 	bool (*poke_ipsec_policy_hole)(int fd, const struct ip_info *afi, struct logger *logger);
 	bool (*detect_nic_offload)(const char *name, struct logger *logger);
 	bool (*poke_ipsec_offload_policy_hole)(struct nic_offload *nic_offload, struct logger *logger);
 
+	/*
+	 * Optional: do what the default updown script would, but
+	 * without forking it.  Returns false, having done nothing,
+	 * when the script is needed; else sets OK.
+	 */
+	bool (*native_updown)(enum updown updown,
+			      const struct connection *c,
+			      const struct spd *spd,
+			      const struct child_sa *child,
+			      bool *ok,
+			      struct logger *logger);
+
 	/* extensions */
 	const struct kernel_ipsec_interface *ipsec_interface;
 };
@@ -318,6 +343,7 @@ extern const struct kernel_ops xfrm_kernel_ops;
 #ifdef KERNEL_PFKEYV2
 extern const struct kernel_ops pfkeyv2_kernel_ops;
 #endif
+extern const struct kernel_ops none_kernel_ops;
 
 extern const struct kernel_ops *const kernel_stacks[];
 
@@ -359,6 +385,8 @@ void free_bare_shunt(struct bare_shunt **pp);
 #endif
 
 extern void init_kernel(struct logger *logger);
+extern bool pluto_kernel_reconcile;	/* kernel-reconcile= */
+void reconcile_kernel(struct logger *logger);
 
 extern bool flush_bare_shunt(const ip_address *src, const ip_address *dst,
 			     const struct ip_protocol *transport_proto,
@@ -386,6 +414,8 @@ struct do_updown {
 bool install_outbound_ipsec_sa(struct child_sa *child, enum routing new_routing,
 			       struct do_updown updown, where_t where);
 
+bool install_resource_ipsec_sa(struct child_sa *child, where_t where);
+
 void teardown_ipsec_kernel_states(struct child_sa *child);
 void uninstall_kernel_states(struct child_sa *child);
 
@@ -418,6 +448,7 @@ struct kernel_acquire {
 	shunk_t sec_label;			/* on stack */
 	enum kernel_state_id state_id;		/* matches kernel state's .seq? */
 	enum kernel_policy_id policy_id;	/* matches kernel policy's .index? */
+	struct sa_pcpu pcpu;			/* RFC 9611; CPU without an SA */
 };
 
 void jam_kernel_acquire(struct jambuf *buf, const struct kernel_acquire *b);
@@ -0,0 +1,147 @@
+/* no-op interface to the kernel's IPsec mechanism, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+/*
+ * protostack=none: every kernel operation succeeds without touching
+ * the kernel.  Negotiations run to completion but no traffic is
+ * protected.  Intended for measuring pluto itself (for instance
+ * whack --replay) and for running more than one pluto on a host
+ * where only the IKE side is of interest.
+ *
+ * Nothing here is ever selected by default.
+ */
+
+#include "defs.h"
+#include "log.h"
+#include "kernel.h"
+#include "updown.h"		/* for enum updown */
+
+static void kernel_none_init(struct logger *logger)
+{
+	llog(RC_LOG, logger,
+	     "using the none kernel interface, IPsec SAs and policies will not be installed");
+}
+
+static void kernel_none_nop(struct logger *logger UNUSED)
+{
+}
+
+static bool kernel_none_policy_add(enum kernel_policy_op op UNUSED,
+				   enum direction dir UNUSED,
+				   const ip_selector *src_client UNUSED,
+				   const ip_selector *dst_client UNUSED,
+				   const struct kernel_policy *policy UNUSED,
+				   deltatime_t use_lifetime UNUSED,
+				   struct logger *logger UNUSED,
+				   const char *func UNUSED)
+{
+	return true;
+}
+
+static bool kernel_none_policy_del(enum direction dir UNUSED,
+				   enum expect_kernel_policy expect_kernel_policy UNUSED,
+				   const ip_selector *src_client UNUSED,
+				   const ip_selector *dst_client UNUSED,
+				   const struct sa_marks *sa_marks UNUSED,
+				   const struct ipsec_interface *xfrmi UNUSED,
+				   enum kernel_policy_id id UNUSED,
+				   const shunk_t sec_label UNUSED,
+				   struct logger *logger UNUSED,
+				   const char *func UNUSED)
+{
+	return true;
+}
+
+static bool kernel_none_add_sa(const struct kernel_state *sa UNUSED,
+			       bool replace UNUSED,
+			       struct logger *logger UNUSED)
+{
+	return true;
+}
+
+/*
+ * Hand out SPIs (and CPIs) sequentially within [MIN, MAX]; the kernel
+ * would pick them at random but repeatable values are more useful
+ * here.
+ */
+
+static ipsec_spi_t kernel_none_get_ipsec_spi(ipsec_spi_t avoid,
+					     const ip_address *src UNUSED,
+					     const ip_address *dst UNUSED,
+					     const struct ip_protocol *proto UNUSED,
+					     reqid_t reqid UNUSED,
+					     uintmax_t min, uintmax_t max,
+					     const char *story,
+					     struct logger *logger)
+{
+	static uintmax_t next;
+	if (next < min || next >= max) {
+		next = min;
+	}
+	uintmax_t spi = next++;
+	if (spi == ntohl(avoid)) {
+		spi = (next < max ? next++ : min);
+	}
+	ldbg(logger, "kernel: none allocated SPI %ju for %s", spi, story);
+	return htonl(spi);
+}
+
+static bool kernel_none_del_ipsec_spi(ipsec_spi_t spi UNUSED,
+				      const struct ip_protocol *proto UNUSED,
+				      const ip_address *src UNUSED,
+				      const ip_address *dst UNUSED,
+				      const char *story UNUSED,
+				      struct logger *logger UNUSED)
+{
+	return true;
+}
+
+/* there's nothing to run */
+static bool kernel_none_native_updown(enum updown updown UNUSED,
+				      const struct connection *c UNUSED,
+				      const struct spd *spd UNUSED,
+				      const struct child_sa *child UNUSED,
+				      bool *ok,
+				      struct logger *logger UNUSED)
+{
+	*ok = true;
+	return true;
+}
+
+static const char *none_protostack_names[] = { "none", NULL, };
+
+const struct kernel_ops none_kernel_ops = {
+	.protostack_names = none_protostack_names,
+	.interface_name = "none",
+	.updown_name = "none",
+	.max_replay_window = UINT32_MAX & ~7,
+	.esn_supported = true,
+	.overlap_supported = false,
+	.sha2_truncbug_support = true,
+
+	.init = kernel_none_init,
+	.flush = kernel_none_nop,
+	.poke_holes = kernel_none_nop,
+	.plug_holes = kernel_none_nop,
+	.shutdown = kernel_none_nop,
+
+	.policy_add = kernel_none_policy_add,
+	.policy_del = kernel_none_policy_del,
+	.add_sa = kernel_none_add_sa,
+	.get_ipsec_spi = kernel_none_get_ipsec_spi,
+	.del_ipsec_spi = kernel_none_del_ipsec_spi,
+	.native_updown = kernel_none_native_updown,
+};
@@ -357,6 +357,7 @@ bool kernel_ops_add_sa(const struct kernel_state *sa, bool replace, struct logge
 			if (sa->decap_dscp) jam(buf, " +decap_dscp");
 			if (!sa->encap_dscp) jam(buf, " +dont_encap_dscp");
 			if (sa->nopmtudisc) jam(buf, " +nopmtudisc");
+			if (sa->pcpu.is_set) jam(buf, " pcpu=%"PRIu32, sa->pcpu.cpu);
 
 			jam_string(buf, " ...");
 		}
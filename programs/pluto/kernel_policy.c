@@ -174,6 +174,8 @@ static struct kernel_policy kernel_policy_from_spd(struct kernel_policy_encap po
 	case DIRECTION_OUTBOUND:
 		kernel_policy.src = kernel_policy.local;
 		kernel_policy.dst = kernel_policy.remote;
+		/* ACQUIRE for each CPU lacking its own SA */
+		kernel_policy.cpu_acquire = spd->connection->config->child_sa.per_cpu;
 		break;
 	case DIRECTION_INBOUND:
 		kernel_policy.src = kernel_policy.remote;
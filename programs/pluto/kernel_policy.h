@@ -125,6 +125,7 @@ struct kernel_policy {
 	const struct sa_marks *sa_marks;
 	const struct ipsec_interface *xfrmi;
 	enum kernel_policy_id id;
+	bool cpu_acquire;	/* RFC 9611; outbound only */
 	/*
 	 * The rules are applied to an outgoing packet in order they
 	 * appear in the rule[] table.  Hence, the output from
@@ -102,15 +102,19 @@
 #include "ip_info.h"
 #include "ipsec_interface.h"
 #include "kernel_ipsec_interface.h"		/* for kernel_xfrm_ipsec_interface; */
+#include "kernel_xfrm_updown.h"			/* for xfrm_native_updown() */
 #include "iface.h"
 #include "ip_selector.h"
 #include "ip_encap.h"
-#include "acquire.h"		/* for initiate_ondemand() */
+#include "acquire.h"		/* for queue_acquire() */
 #include "labeled_ipsec.h"	/* for vet_seclabel() */
 #include "ikev2_mobike.h"
 #include "ip_packet.h"
 #include "sparse_names.h"
 #include "kernel_iface.h"
+#include "linux_netlink.h"
+#include "hash_table.h"
+#include "pluto_usdt.h"
 
 /* required for Linux 2.6.26 kernel and later */
 #ifndef XFRM_STATE_AF_UNSPEC
@@ -124,6 +128,8 @@ static bool sendrecv_xfrm_msg(struct nlmsghdr *hdr,
 			      const char *description, const char *story,
 			      int *recv_errno,
 			      struct logger *logger);
+static bool reconcile_policy_request(const struct nlmsghdr *hdr,
+				     struct logger *logger);
 
 static struct {
 	bool icmpv6;
@@ -131,6 +137,7 @@ static struct {
 } hyperspace_bypass;
 
 static int nl_send_fd = NULL_FD; /* to send to NETLINK_XFRM */
+static uint32_t nl_send_seq = 0; /* last sequence number sent on nl_send_fd */
 static int netlink_xfrm_fd = NULL_FD; /* listen to NETLINK_XFRM broadcast */
 static int netlink_rtm_fd = NULL_FD; /* listen to NETLINK_ROUTE broadcast */
 
@@ -461,11 +468,10 @@ static bool sendrecv_xfrm_msg(struct nlmsghdr *hdr,
 	}
 
 	ssize_t r;
-	static uint32_t seq = 0;	/* STATIC */
 
 	*recv_errno = 0;
 
-	hdr->nlmsg_seq = ++seq;
+	hdr->nlmsg_seq = ++nl_send_seq;
 	do {
 		r = write(nl_send_fd, hdr, len);
 	} while (r < 0 && errno == EINTR);
@@ -487,6 +493,7 @@ static bool sendrecv_xfrm_msg(struct nlmsghdr *hdr,
 			   description, story, r, len);
 		return false;
 	}
+	PLUTO_PROBE(netlink_send, hdr->nlmsg_seq, hdr->nlmsg_type, len);
 
 	struct nlm_resp rsp;
 	for (;;) {
@@ -529,15 +536,17 @@ static bool sendrecv_xfrm_msg(struct nlmsghdr *hdr,
 			continue;
 		}
 
-		if (rsp.n.nlmsg_seq != seq) {
+		if (rsp.n.nlmsg_seq != nl_send_seq) {
 			sparse_buf sb;
 			ldbg(logger, "%s() ignoring out of sequence (%u/%u) message %s",
-			     __func__, rsp.n.nlmsg_seq, seq,
+			     __func__, rsp.n.nlmsg_seq, nl_send_seq,
 			     str_sparse(&xfrm_type_names, rsp.n.nlmsg_type, &sb));
 			continue;
 		}
 		break;
 	}
+	PLUTO_PROBE(netlink_ack, rsp.n.nlmsg_seq, rsp.n.nlmsg_type,
+		    (rsp.n.nlmsg_type == NLMSG_ERROR ? -rsp.u.e.error : 0));
 
 	if (rsp.n.nlmsg_len > (size_t) r) {
 		sparse_buf sb;
@@ -598,6 +607,12 @@ static bool sendrecv_xfrm_policy(struct nlmsghdr *hdr,
 				 const char *story, const char *adstory,
 				 struct logger *logger, const char *func)
 {
+	if (reconcile_policy_request(hdr, logger)) {
+		ldbg(logger, "%s()   %s %s unchanged since startup; not sent",
+		     func, story, adstory);
+		return true;
+	}
+
 	struct nlm_resp rsp;
 
 	int recv_errno;
@@ -922,6 +937,11 @@ static bool kernel_xfrm_policy_add(enum kernel_policy_op op,
 	info->lft.hard_packet_limit = XFRM_INF;
 	info->dir = xfrm_dir;
 
+	if (policy->cpu_acquire && xfrm_dir == XFRM_POLICY_OUT) {
+		/* RFC 9611: ACQUIRE per-CPU SAs */
+		info->flags |= XFRM_POLICY_CPU_ACQUIRE;
+	}
+
 	/*
 	 * Add the encapsulation protocol found in proto_info[] that
 	 * will carry the packets (which the kernel seems to call
@@ -1863,6 +1883,13 @@ static bool netlink_add_sa(const struct kernel_state *sa, bool replace,
 	}
 #endif
 
+	if (sa->pcpu.is_set) {
+		/* RFC 9611: pin the (outbound) SA to a CPU */
+		ldbg(logger, "%s() XFRMA_SA_PCPU %"PRIu32, __func__, sa->pcpu.cpu);
+		nl_addattr32(&req.n, sizeof(req.data), XFRMA_SA_PCPU, sa->pcpu.cpu);
+		attr = (struct rtattr *)((char *)&req + req.n.nlmsg_len);
+	}
+
 	if (sa->nic_offload.dev != NULL) {
 		struct xfrm_user_offload xuo = {
 			.ifindex = if_nametoindex(sa->nic_offload.dev),
@@ -2090,6 +2117,7 @@ static void netlink_acquire(struct nlmsghdr *n, struct logger *logger)
 	}
 
 	shunk_t sec_label = NULL_HUNK;
+	struct sa_pcpu pcpu = {0};
 	const struct ip_info *afi = aftoinfo(acquire->policy.sel.family);
 	if (afi == NULL) {
 		llog(RC_LOG, logger,
@@ -2202,6 +2230,20 @@ static void netlink_acquire(struct nlmsghdr *n, struct logger *logger)
 			     (const char *) (xuctx + 1));
 			break;
 		}
+		case XFRMA_SA_PCPU:
+		{
+			/* RFC 9611: the CPU lacking an SA */
+			if (RTA_PAYLOAD(attr) < sizeof(uint32_t)) {
+				llog(RC_LOG, logger,
+				     "XFRM_MSG_ACQUIRE message from kernel malformed: XFRMA_SA_PCPU too short; ignoring");
+				break;
+			}
+			pcpu.is_set = true;
+			memcpy(&pcpu.cpu, RTA_DATA(attr), sizeof(pcpu.cpu));
+			ldbg(logger, "%s() xfrm acquire for CPU %"PRIu32,
+			     __func__, pcpu.cpu);
+			break;
+		}
 		default:
 			ldbg(logger, "%s() ... ignoring unknown xfrm acquire payload type %u",
 			     __func__, attr->rta_type);
@@ -2219,9 +2261,11 @@ static void netlink_acquire(struct nlmsghdr *n, struct logger *logger)
 		.sec_label = sec_label,
 		.state_id = acquire->seq,
 		.policy_id = acquire->policy.index,
+		.pcpu = pcpu,
 	};
 
-	initiate_ondemand(&b);
+	/* processed once the socket has been drained */
+	queue_acquire(&b);
 }
 
 static void netlink_shunt_expire(struct xfrm_userpolicy_info *pol,
@@ -2592,6 +2636,7 @@ static void netlink_process_xfrm_messages(int fd, void *arg UNUSED, struct logge
 {
 	ldbg(logger, "kernel: %s() process messages", __func__);
 	do {} while (netlink_get(fd, netlink_xfrm_message_processor, logger));
+	process_queued_acquires(logger);
 }
 
 static void netlink_process_rtm_messages(int fd, void *arg UNUSED, struct logger *logger)
@@ -2981,6 +3026,159 @@ static err_t xfrm_migrate_ipsec_sa_is_enabled(struct logger *logger)
 	}
 }
 
+/*
+ * Per-CPU SAs (XFRMA_SA_PCPU) arrived in Linux 6.13.
+ *
+ * Older kernels parse XFRM messages liberally and silently drop
+ * attributes they do not know, so trying to install an SA with the
+ * attribute proves nothing.  Instead ask for an SPI on the loopback
+ * while pinning it to an impossible CPU: a kernel that understands
+ * XFRMA_SA_PCPU rejects that with EINVAL; one that does not hands
+ * back a larval SA (which is then deleted).
+ */
+
+static bool xfrm_pcpu_probe_sendrecv(int nl_fd, struct nlmsghdr *hdr,
+				     struct nlm_resp *rsp,
+				     struct logger *logger)
+{
+	ssize_t r;
+	do {
+		r = write(nl_fd, hdr, hdr->nlmsg_len);
+	} while (r < 0 && errno == EINTR);
+
+	if (r < 0) {
+		llog_error(logger, errno, "netlink write() per-CPU SA probe");
+		return false;
+	}
+
+	if ((size_t)r != hdr->nlmsg_len) {
+		llog_error(logger, 0/*no-errno*/,
+			   "netlink write() per-CPU SA probe message truncated: %zd instead of %"PRIu32,
+			   r, hdr->nlmsg_len);
+		return false;
+	}
+
+	do {
+		r = recv(nl_fd, rsp, sizeof(*rsp), 0);
+	} while (r < 0 && errno == EINTR);
+
+	if (r < 0) {
+		llog_error(logger, errno, "netlink recv() per-CPU SA probe");
+		return false;
+	}
+
+	if ((size_t)r < sizeof(rsp->n) || rsp->n.nlmsg_seq != hdr->nlmsg_seq) {
+		llog_error(logger, 0/*no-errno*/,
+			   "netlink recv() per-CPU SA probe returned an unexpected response");
+		return false;
+	}
+
+	return true;
+}
+
+static bool qry_xfrm_pcpu_support(struct logger *logger)
+{
+	const ip_address *loopback = &ipv4_info.address.loopback;
+
+	struct {
+		struct nlmsghdr n;
+		struct xfrm_userspi_info spi;
+		char data[MAX_NETLINK_DATA_SIZE];
+	} req;
+
+	zero(&req);
+	req.n.nlmsg_flags = NLM_F_REQUEST;
+	req.n.nlmsg_type = XFRM_MSG_ALLOCSPI;
+	req.n.nlmsg_seq = 1;
+	req.n.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(req.spi)));
+
+	req.spi.info.saddr = xfrm_from_address(loopback);
+	req.spi.info.id.daddr = xfrm_from_address(loopback);
+	req.spi.info.id.proto = IPPROTO_ESP;
+	req.spi.info.family = AF_INET;
+	req.spi.min = 0x100;
+	req.spi.max = 0xffffffff;
+
+	/* no machine has this many CPUs */
+	nl_addattr32(&req.n, sizeof(req.data), XFRMA_SA_PCPU, UINT32_MAX);
+
+	int nl_fd = cloexec_socket(AF_NETLINK, SOCK_DGRAM, NETLINK_XFRM);
+	if (nl_fd < 0) {
+		llog_error(logger, errno, "socket() in %s()", __func__);
+		return false;
+	}
+
+	struct nlm_resp rsp;
+	if (!xfrm_pcpu_probe_sendrecv(nl_fd, &req.n, &rsp, logger)) {
+		close(nl_fd);
+		return false;
+	}
+
+	if (rsp.n.nlmsg_type == NLMSG_ERROR) {
+		close(nl_fd);
+		ldbg(logger, "%s() XFRM_MSG_ALLOCSPI with XFRMA_SA_PCPU returned %d",
+		     __func__, rsp.u.e.error);
+		/* EINVAL is the kernel rejecting the CPU */
+		return (rsp.u.e.error == -EINVAL);
+	}
+
+	if (rsp.n.nlmsg_type != XFRM_MSG_NEWSA ||
+	    rsp.n.nlmsg_len < NLMSG_LENGTH(sizeof(rsp.u.sa))) {
+		close(nl_fd);
+		llog_error(logger, 0/*no-errno*/,
+			   "netlink per-CPU SA probe returned message type %d",
+			   rsp.n.nlmsg_type);
+		return false;
+	}
+
+	/* the attribute was ignored; clean up the larval SA */
+	ldbg(logger, "%s() XFRMA_SA_PCPU ignored, deleting larval SA", __func__);
+
+	struct {
+		struct nlmsghdr n;
+		struct xfrm_usersa_id id;
+	} del;
+
+	zero(&del);
+	del.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	del.n.nlmsg_type = XFRM_MSG_DELSA;
+	del.n.nlmsg_seq = 2;
+	del.n.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(del.id)));
+
+	del.id.daddr = rsp.u.sa.id.daddr;
+	del.id.spi = rsp.u.sa.id.spi;
+	del.id.family = AF_INET;
+	del.id.proto = IPPROTO_ESP;
+
+	if (xfrm_pcpu_probe_sendrecv(nl_fd, &del.n, &rsp, logger) &&
+	    rsp.n.nlmsg_type == NLMSG_ERROR && rsp.u.e.error != 0) {
+		llog_error(logger, -rsp.u.e.error,
+			   "netlink per-CPU SA probe could not delete larval SA");
+	}
+
+	close(nl_fd);
+	return false;
+}
+
+static err_t xfrm_pcpu_ipsec_sa_is_enabled(struct logger *logger)
+{
+	static enum {
+		UNKNOWN, ENABLED, DISABLED,
+	} state = UNKNOWN;
+	static const char disabled_message[] = "requires Linux 6.13 or later (XFRMA_SA_PCPU)";
+	switch (state) {
+	case UNKNOWN:
+		state = (qry_xfrm_pcpu_support(logger) ? ENABLED : DISABLED);
+		return state == ENABLED ? NULL : disabled_message;
+	case ENABLED:
+		return NULL;
+	case DISABLED:
+		return disabled_message;
+	default:
+		bad_case(state);
+	}
+}
+
 static bool netlink_poke_ipsec_offload_policy_hole(struct nic_offload *nic_offload, struct logger *logger)
 {
 	if (nic_offload->type != KERNEL_OFFLOAD_PACKET)
@@ -3090,9 +3288,623 @@ static bool netlink_poke_ipsec_policy_hole(int fd, const struct ip_info *afi, st
 	return true;
 }
 
+/*
+ * kernel-reconcile=yes
+ *
+ * Rather than flushing at startup, remember the policies that are
+ * already in the kernel (typically left behind by a pluto that was
+ * shut down using --leave-state).  While the connections are being
+ * routed, a policy identical to one found at startup isn't sent to
+ * the kernel at all and a changed policy is replaced in place (the
+ * request is always XFRM_MSG_UPDPOLICY).  Either way traffic keeps
+ * flowing.
+ *
+ * Once routing is complete, the policies that weren't re-installed,
+ * and any SAs that the remaining policies can't use, are deleted.
+ * The deletes are sent in batches.
+ */
+
+#define RECONCILE_BATCH 64
+#define RECONCILE_MSG_SIZE 256	/* header + payload + mark + if_id */
+
+/*
+ * What the kernel uses to identify a policy (less the security
+ * context, which is compared separately).  Built field-by-field so
+ * there's no padding to confuse hash_thing() and memeq().
+ */
+
+struct reconcile_key {
+	xfrm_address_t daddr;
+	xfrm_address_t saddr;
+	uint16_t dport, dport_mask;
+	uint16_t sport, sport_mask;
+	uint16_t family;
+	uint8_t prefixlen_d, prefixlen_s;
+	uint8_t proto;
+	uint8_t dir;
+	int32_t ifindex;
+	uint32_t user;
+	uint32_t mark_v, mark_m;
+	uint32_t if_id;
+};
+
+struct reconcile_policy {
+	struct reconcile_key key;
+	uint32_t index;
+	uint32_t priority;
+	uint8_t action;
+	uint8_t flags;
+	chunk_t tmpl;
+	chunk_t sec_ctx;
+	chunk_t offload;
+	bool reinstalled;
+	struct {
+		struct list_entry list;
+		struct list_entry key;
+	} reconcile_policy_db_entries;
+};
+
+static struct {
+	bool active;
+	unsigned count;
+	unsigned unchanged;
+	unsigned updated;
+} reconcile;
+
+static size_t jam_reconcile_policy(struct jambuf *buf, const struct reconcile_policy *p)
+{
+	return jam(buf, "policy index %u dir %u", p->index, p->key.dir);
+}
+
+static hash_t hash_reconcile_policy_key(const struct reconcile_key *key)
+{
+	return hash_thing(*key, zero_hash);
+}
+
+HASH_TABLE(reconcile_policy, key, .key, 1021);
+
+static void reconcile_policy_db_init(struct logger *logger);
+static void reconcile_policy_db_check(struct logger *logger);
+static void reconcile_policy_db_init_reconcile_policy(struct reconcile_policy *);
+static void reconcile_policy_db_add(struct reconcile_policy *);
+static void reconcile_policy_db_del(struct reconcile_policy *);
+
+HASH_DB(reconcile_policy, &reconcile_policy_key_hash_table);
+
+struct reconcile_view {
+	struct reconcile_key key;
+	uint32_t priority;
+	uint8_t action;
+	uint8_t flags;
+	shunk_t tmpl;
+	shunk_t sec_ctx;
+	shunk_t offload;
+};
+
+static void reconcile_key_from_selector(struct reconcile_key *key,
+					const struct xfrm_selector *sel,
+					uint8_t dir)
+{
+	zero(key);
+	key->daddr = sel->daddr;
+	key->saddr = sel->saddr;
+	key->dport = sel->dport;
+	key->dport_mask = sel->dport_mask;
+	key->sport = sel->sport;
+	key->sport_mask = sel->sport_mask;
+	key->family = sel->family;
+	key->prefixlen_d = sel->prefixlen_d;
+	key->prefixlen_s = sel->prefixlen_s;
+	key->proto = sel->proto;
+	key->ifindex = sel->ifindex;
+	key->user = sel->user;
+	key->dir = dir;
+}
+
+/*
+ * Parse either a policy request (XFRM_MSG_UPDPOLICY et.al.) or a
+ * policy returned by the dump (XFRM_MSG_NEWPOLICY); they have the
+ * same layout.
+ */
+
+static void reconcile_view_attributes(struct reconcile_view *view,
+				      const struct nlmsghdr *n,
+				      size_t payload_size)
+{
+	const struct rtattr *attr =
+		(const struct rtattr *)((const uint8_t *)NLMSG_DATA(n) + NLMSG_ALIGN(payload_size));
+	int len = n->nlmsg_len - NLMSG_SPACE(payload_size);
+	for (; RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		shunk_t data = shunk2(RTA_DATA(attr), RTA_PAYLOAD(attr));
+		switch (attr->rta_type) {
+		case XFRMA_TMPL:
+			view->tmpl = data;
+			break;
+		case XFRMA_SEC_CTX:
+			view->sec_ctx = data;
+			break;
+		case XFRMA_OFFLOAD_DEV:
+			view->offload = data;
+			break;
+		case XFRMA_MARK:
+			if (data.len >= sizeof(struct xfrm_mark)) {
+				const struct xfrm_mark *mark = (const struct xfrm_mark *)data.ptr;
+				view->key.mark_v = mark->v;
+				view->key.mark_m = mark->m;
+			}
+			break;
+		case XFRMA_IF_ID:
+			if (data.len >= sizeof(uint32_t)) {
+				memcpy(&view->key.if_id, data.ptr, sizeof(uint32_t));
+			}
+			break;
+		}
+	}
+}
+
+static bool reconcile_view_policy(struct reconcile_view *view,
+				  const struct nlmsghdr *n)
+{
+	zero(view);
+	switch (n->nlmsg_type) {
+	case XFRM_MSG_NEWPOLICY:
+	case XFRM_MSG_UPDPOLICY:
+	{
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct xfrm_userpolicy_info))) {
+			return false;
+		}
+		const struct xfrm_userpolicy_info *info = NLMSG_DATA(n);
+		reconcile_key_from_selector(&view->key, &info->sel, info->dir);
+		view->priority = info->priority;
+		view->action = info->action;
+		view->flags = info->flags;
+		reconcile_view_attributes(view, n, sizeof(*info));
+		return true;
+	}
+	case XFRM_MSG_DELPOLICY:
+	{
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct xfrm_userpolicy_id))) {
+			return false;
+		}
+		const struct xfrm_userpolicy_id *id = NLMSG_DATA(n);
+		reconcile_key_from_selector(&view->key, &id->sel, id->dir);
+		reconcile_view_attributes(view, n, sizeof(*id));
+		return true;
+	}
+	}
+	return false;
+}
+
+static struct reconcile_policy *reconcile_policy_by_view(const struct reconcile_view *view)
+{
+	hash_t hash = hash_reconcile_policy_key(&view->key);
+	struct list_head *bucket = hash_table_bucket(&reconcile_policy_key_hash_table, hash);
+	struct reconcile_policy *p;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(p, bucket) {
+		if (memeq(&p->key, &view->key, sizeof(view->key)) &&
+		    hunk_eq(p->sec_ctx, view->sec_ctx)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static void free_reconcile_policy(struct reconcile_policy **p)
+{
+	reconcile_policy_db_del(*p);
+	free_chunk_content(&(*p)->tmpl);
+	free_chunk_content(&(*p)->sec_ctx);
+	free_chunk_content(&(*p)->offload);
+	pfree(*p);
+	*p = NULL;
+}
+
+static void free_reconcile_policies(void)
+{
+	struct reconcile_policy *p;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(p, &reconcile_policy_db_list_head) {
+		free_reconcile_policy(&p);
+	}
+	reconcile_policy_db_check(&global_logger);
+	reconcile.count = 0;
+	reconcile.active = false;
+}
+
+/*
+ * Called with every policy request while reconciling.  Returns true
+ * when the request is redundant (the kernel already has an identical
+ * policy) and need not be sent.
+ */
+
+static bool reconcile_policy_request(const struct nlmsghdr *hdr,
+				     struct logger *logger)
+{
+	if (!reconcile.active) {
+		return false;
+	}
+
+	struct reconcile_view view;
+	if (!reconcile_view_policy(&view, hdr)) {
+		return false;
+	}
+
+	struct reconcile_policy *p = reconcile_policy_by_view(&view);
+	if (p == NULL) {
+		/* new policy */
+		return false;
+	}
+
+	if (hdr->nlmsg_type == XFRM_MSG_DELPOLICY) {
+		/* going, going, gone */
+		ldbg(logger, "kernel: reconcile: policy index %u deleted by request",
+		     p->index);
+		free_reconcile_policy(&p);
+		reconcile.count--;
+		return false;
+	}
+
+	bool unchanged = (p->priority == view.priority &&
+			  p->action == view.action &&
+			  p->flags == view.flags &&
+			  hunk_eq(p->tmpl, view.tmpl) &&
+			  hunk_eq(p->offload, view.offload));
+	if (!p->reinstalled) {
+		p->reinstalled = true;
+		if (unchanged) {
+			reconcile.unchanged++;
+		} else {
+			reconcile.updated++;
+		}
+	}
+	if (!unchanged) {
+		/* UPDPOLICY replaces it in place */
+		ldbg(logger, "kernel: reconcile: updating policy index %u", p->index);
+		replace_chunk(&p->tmpl, view.tmpl, "reconcile tmpl");
+		replace_chunk(&p->offload, view.offload, "reconcile offload");
+		p->priority = view.priority;
+		p->action = view.action;
+		p->flags = view.flags;
+	}
+	return unchanged;
+}
+
+struct linux_netlink_context {
+	unsigned policies;
+	struct reconcile_sa {
+		struct xfrm_usersa_id id;
+		struct xfrm_mark mark;
+	} *stale_sas;
+	unsigned nr_stale_sas;
+	unsigned nr_kept_sas;
+	const reqid_t *reqids;
+	unsigned nr_reqids;
+};
+
+static bool reconcile_dump_policy(struct nlmsghdr *n,
+				  struct linux_netlink_context *context,
+				  struct verbose verbose)
+{
+	if (n->nlmsg_type != XFRM_MSG_NEWPOLICY) {
+		return true;
+	}
+
+	struct reconcile_view view;
+	if (!reconcile_view_policy(&view, n)) {
+		vlog("ignoring truncated policy");
+		return true;
+	}
+
+	if (reconcile_policy_by_view(&view) != NULL) {
+		vlog("ignoring duplicate policy");
+		return true;
+	}
+
+	const struct xfrm_userpolicy_info *info = NLMSG_DATA(n);
+	struct reconcile_policy p = {
+		.key = view.key,
+		.index = info->index,
+		.priority = view.priority,
+		.action = view.action,
+		.flags = view.flags,
+		.tmpl = clone_hunk(view.tmpl, "reconcile tmpl"),
+		.sec_ctx = clone_hunk(view.sec_ctx, "reconcile sec_ctx"),
+		.offload = clone_hunk(view.offload, "reconcile offload"),
+	};
+	struct reconcile_policy *policy = clone_thing(p, "reconcile policy");
+	reconcile_policy_db_init_reconcile_policy(policy);
+	reconcile_policy_db_add(policy);
+	context->policies++;
+	return true;
+}
+
+static bool reconcile_dump_sa(struct nlmsghdr *n,
+			      struct linux_netlink_context *context,
+			      struct verbose verbose)
+{
+	if (n->nlmsg_type != XFRM_MSG_NEWSA) {
+		return true;
+	}
+	if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct xfrm_usersa_info))) {
+		vlog("ignoring truncated SA");
+		return true;
+	}
+
+	const struct xfrm_usersa_info *sa = NLMSG_DATA(n);
+	for (unsigned r = 0; r < context->nr_reqids; r++) {
+		if (context->reqids[r] == sa->reqid) {
+			context->nr_kept_sas++;
+			return true;
+		}
+	}
+
+	struct reconcile_sa stale = {
+		.id = {
+			.daddr = sa->id.daddr,
+			.spi = sa->id.spi,
+			.family = sa->family,
+			.proto = sa->id.proto,
+		},
+	};
+	const struct rtattr *attr =
+		(const struct rtattr *)((const uint8_t *)NLMSG_DATA(n) + NLMSG_ALIGN(sizeof(*sa)));
+	int len = n->nlmsg_len - NLMSG_SPACE(sizeof(*sa));
+	for (; RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		if (attr->rta_type == XFRMA_MARK &&
+		    RTA_PAYLOAD(attr) >= sizeof(struct xfrm_mark)) {
+			memcpy(&stale.mark, RTA_DATA(attr), sizeof(stale.mark));
+		}
+	}
+
+	realloc_things(context->stale_sas, context->nr_stale_sas,
+		       context->nr_stale_sas + 1, "reconcile SAs");
+	context->stale_sas[context->nr_stale_sas++] = stale;
+	return true;
+}
+
+static bool reconcile_dump(uint16_t type,
+			   linux_netlink_response_processor *processor,
+			   struct linux_netlink_context *context,
+			   struct logger *logger)
+{
+	struct nlmsghdr req = {
+		.nlmsg_type = type,
+		.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+		.nlmsg_len = NLMSG_LENGTH(0),
+	};
+	VERBOSE(logger, "dumping %s", (type == XFRM_MSG_GETPOLICY ? "policies" : "SAs"));
+	return linux_netlink_query(&req, NETLINK_XFRM, processor, context, verbose);
+}
+
+/*
+ * Send several requests in a single write() and then collect their
+ * ACKs.
+ */
+
+struct reconcile_batch {
+	const char *what;
+	unsigned nr;
+	size_t len;
+	uint32_t first_seq;
+	unsigned deleted;
+	unsigned failed;
+	uint8_t buf[RECONCILE_BATCH * RECONCILE_MSG_SIZE];
+};
+
+static void flush_reconcile_batch(struct reconcile_batch *batch,
+				  struct logger *logger)
+{
+	if (batch->nr == 0) {
+		return;
+	}
+
+	ldbg(logger, "kernel: reconcile: sending batch of %u %s deletes",
+	     batch->nr, batch->what);
+
+	ssize_t r;
+	do {
+		r = write(nl_send_fd, batch->buf, batch->len);
+	} while (r < 0 && errno == EINTR);
+	if (r < 0 || (size_t)r != batch->len) {
+		llog_error(logger, (r < 0 ? errno : 0),
+			   "kernel: reconcile: netlink write() of %u %s deletes failed",
+			   batch->nr, batch->what);
+		batch->failed += batch->nr;
+		batch->nr = 0;
+		batch->len = 0;
+		return;
+	}
+
+	unsigned acked = 0;
+	while (acked < batch->nr) {
+		union {
+			struct nlmsghdr n;
+			uint8_t raw[LINUX_NETLINK_BUFSIZE];
+		} rsp;
+		struct sockaddr_nl addr;
+		socklen_t alen = sizeof(addr);
+		r = recvfrom(nl_send_fd, &rsp, sizeof(rsp), 0,
+			     (struct sockaddr *)&addr, &alen);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			llog_error(logger, errno,
+				   "kernel: reconcile: netlink recvfrom() of %s delete ACKs failed",
+				   batch->what);
+			batch->failed += batch->nr - acked;
+			break;
+		}
+		if (addr.nl_pid != 0) {
+			continue;
+		}
+
+		int len = r;
+		for (struct nlmsghdr *n = &rsp.n; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+			if (n->nlmsg_type != NLMSG_ERROR ||
+			    n->nlmsg_seq - batch->first_seq >= batch->nr) {
+				continue;
+			}
+			acked++;
+			const struct nlmsgerr *e = NLMSG_DATA(n);
+			if (e->error == 0) {
+				batch->deleted++;
+			} else if (e->error != -ENOENT) {
+				/* ENOENT: already gone */
+				llog_error(logger, -e->error,
+					   "kernel: reconcile: deleting stale %s failed",
+					   batch->what);
+				batch->failed++;
+			}
+		}
+	}
+
+	batch->nr = 0;
+	batch->len = 0;
+}
+
+static struct nlmsghdr *add_reconcile_batch(struct reconcile_batch *batch,
+					    uint16_t type, const void *payload,
+					    size_t payload_size,
+					    struct logger *logger)
+{
+	if (batch->nr == RECONCILE_BATCH) {
+		flush_reconcile_batch(batch, logger);
+	}
+
+	struct nlmsghdr *n = (struct nlmsghdr *)(batch->buf + batch->len);
+	memset(n, 0, RECONCILE_MSG_SIZE);
+	n->nlmsg_type = type;
+	n->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	n->nlmsg_len = NLMSG_LENGTH(payload_size);
+	n->nlmsg_seq = ++nl_send_seq;
+	memcpy(NLMSG_DATA(n), payload, payload_size);
+	if (batch->nr == 0) {
+		batch->first_seq = n->nlmsg_seq;
+	}
+	batch->nr++;
+	return n;
+}
+
+static void add_reconcile_mark(struct nlmsghdr *n, uint32_t v, uint32_t m)
+{
+	if (v != 0 || m != 0) {
+		struct xfrm_mark mark = { .v = v, .m = m, };
+		nl_addattr_l(n, RECONCILE_MSG_SIZE, XFRMA_MARK, &mark, sizeof(mark));
+	}
+}
+
+static void close_reconcile_batch(struct reconcile_batch *batch,
+				  struct nlmsghdr *n)
+{
+	batch->len += NLMSG_ALIGN(n->nlmsg_len);
+}
+
+static bool kernel_xfrm_reconcile_start(struct logger *logger)
+{
+	reconcile_policy_db_init(logger);
+	struct linux_netlink_context context = {0};
+	if (!reconcile_dump(XFRM_MSG_GETPOLICY, reconcile_dump_policy, &context, logger)) {
+		llog(RC_LOG, logger,
+		     "kernel: reconcile: dumping XFRM policies failed; flushing");
+		free_reconcile_policies();
+		return false;
+	}
+	reconcile.count = context.policies;
+	reconcile.active = true;
+	llog(RC_LOG, logger,
+	     "kernel: reconcile: found %u existing XFRM policies; keeping them until the connections are routed",
+	     reconcile.count);
+	return true;
+}
+
+static void kernel_xfrm_reconcile_finish(struct logger *logger)
+{
+	if (!reconcile.active) {
+		return;
+	}
+	/* from here on requests go straight to the kernel */
+	reconcile.active = false;
+
+	/*
+	 * Delete the policies that weren't re-installed, and
+	 * remember the reqids of those that were; an SA is only
+	 * useful if a template refers to its reqid.
+	 */
+	struct reconcile_batch *policies = alloc_thing(struct reconcile_batch, "reconcile batch");
+	policies->what = "policy";
+	reqid_t *reqids = NULL;
+	unsigned nr_reqids = 0;
+	const struct reconcile_policy *p;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(p, &reconcile_policy_db_list_head) {
+		if (p->reinstalled) {
+			const struct xfrm_user_tmpl *tmpl = (const struct xfrm_user_tmpl *)p->tmpl.ptr;
+			for (size_t t = 0; t < p->tmpl.len / sizeof(*tmpl); t++) {
+				if (tmpl[t].reqid != 0) {
+					realloc_things(reqids, nr_reqids, nr_reqids + 1, "reconcile reqids");
+					reqids[nr_reqids++] = tmpl[t].reqid;
+				}
+			}
+			continue;
+		}
+		struct xfrm_userpolicy_id id = {
+			.index = p->index,
+			.dir = p->key.dir,
+		};
+		struct nlmsghdr *n = add_reconcile_batch(policies, XFRM_MSG_DELPOLICY,
+							 &id, sizeof(id), logger);
+		add_reconcile_mark(n, p->key.mark_v, p->key.mark_m);
+		if (p->key.if_id != 0) {
+			nl_addattr32(n, RECONCILE_MSG_SIZE, XFRMA_IF_ID, p->key.if_id);
+		}
+		close_reconcile_batch(policies, n);
+	}
+	flush_reconcile_batch(policies, logger);
+
+	/*
+	 * Now the SAs.
+	 */
+	struct linux_netlink_context context = {
+		.reqids = reqids,
+		.nr_reqids = nr_reqids,
+	};
+	struct reconcile_batch *sas = alloc_thing(struct reconcile_batch, "reconcile batch");
+	sas->what = "SA";
+	if (reconcile_dump(XFRM_MSG_GETSA, reconcile_dump_sa, &context, logger)) {
+		for (unsigned s = 0; s < context.nr_stale_sas; s++) {
+			const struct reconcile_sa *sa = &context.stale_sas[s];
+			struct nlmsghdr *n = add_reconcile_batch(sas, XFRM_MSG_DELSA,
+								 &sa->id, sizeof(sa->id), logger);
+			add_reconcile_mark(n, sa->mark.v, sa->mark.m);
+			close_reconcile_batch(sas, n);
+		}
+		flush_reconcile_batch(sas, logger);
+	} else {
+		llog(RC_LOG, logger,
+		     "kernel: reconcile: dumping XFRM SAs failed; stale SAs will expire");
+	}
+
+	llog(RC_LOG, logger,
+	     "kernel: reconcile: %u policies unchanged, %u updated, %u stale deleted; %u SAs kept, %u stale deleted",
+	     reconcile.unchanged, reconcile.updated, policies->deleted,
+	     context.nr_kept_sas, sas->deleted);
+	if (policies->failed > 0 || sas->failed > 0) {
+		llog(RC_LOG, logger,
+		     "kernel: reconcile: failed to delete %u stale policies and %u stale SAs",
+		     policies->failed, sas->failed);
+	}
+
+	pfreeany(context.stale_sas);
+	pfreeany(reqids);
+	pfree(policies);
+	pfree(sas);
+	free_reconcile_policies();
+}
+
 static void kernel_xfrm_shutdown(struct logger *logger)
 {
-	ldbg(logger, "%s() no-op", __func__);
+	ldbg(logger, "%s() discarding %u reconcile policies", __func__, reconcile.count);
+	/* when pluto exits before the first listen */
+	free_reconcile_policies();
 }
 
 static const char *xfrm_protostack_names[] = { "xfrm", "netkey", NULL, };
@@ -3110,6 +3922,8 @@ const struct kernel_ops xfrm_kernel_ops = {
 	.poke_holes = kernel_xfrm_poke_holes,
 	.plug_holes = kernel_xfrm_plug_holes,
 	.shutdown = kernel_xfrm_shutdown,
+	.reconcile_start = kernel_xfrm_reconcile_start,
+	.reconcile_finish = kernel_xfrm_reconcile_finish,
 
 	.policy_del = kernel_xfrm_policy_del,
 	.policy_add = kernel_xfrm_policy_add,
@@ -3118,12 +3932,14 @@ const struct kernel_ops xfrm_kernel_ops = {
 	.get_ipsec_spi = xfrm_get_ipsec_spi,
 	.del_ipsec_spi = xfrm_del_ipsec_spi,
 	.migrate_ipsec_sa_is_enabled = xfrm_migrate_ipsec_sa_is_enabled,
+	.pcpu_ipsec_sa_is_enabled = xfrm_pcpu_ipsec_sa_is_enabled,
 	.migrate_ipsec_sa = xfrm_migrate_ipsec_sa,
 	.overlap_supported = false,
 	.sha2_truncbug_support = true,
 	.poke_ipsec_policy_hole = netlink_poke_ipsec_policy_hole,
 	.detect_nic_offload = xfrm_detect_nic_offload,
 	.poke_ipsec_offload_policy_hole = netlink_poke_ipsec_offload_policy_hole,
+	.native_updown = xfrm_native_updown,
 #ifdef USE_XFRM_INTERFACE
 	.ipsec_interface = &kernel_ipsec_interface_xfrm,
 #endif
@@ -0,0 +1,981 @@
+/* native updown using rtnetlink, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * The common, route and sourceip, cases of _updown.xfrm.
+ *
+ * Forking "ip route" and "ip addr", often several times per SA per
+ * event, costs more than the IKE exchange.  Instead do the same
+ * operations using rtnetlink: queries (the script's "ip route get"
+ * et.al.) are sent one at a time; changes are batched and sent using
+ * a single sendmsg() with the ACKs collected afterwards.
+ *
+ * This runs on the event-loop so must not block.  The kernel handles
+ * an rtnetlink request, queueing its response or ACK, before send()
+ * returns (and queues the next part of a dump while the previous part
+ * is being read), so everything is read using MSG_DONTWAIT: an empty
+ * socket means something went wrong, not that the kernel is slow.
+ *
+ * Anything beyond that (VTI, NFLOG, CAT, resolv.conf, NetworkManager,
+ * proxy ARP, Cisco interop) is left to the script.
+ */
+
+#include <errno.h>
+#include <inttypes.h>		/* for PRIx32 */
+#include <string.h>		/* for strerror() */
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <net/if.h>		/* for if_nametoindex() and IFF_* */
+
+/* see kernel_xfrm_interface.c; <netinet/in.h> must come first */
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/fib_rules.h>
+
+#include "lsw_socket.h"		/* for cloexec_socket() */
+#include "linux_netlink.h"	/* for LINUX_NETLINK_BUFSIZE */
+#include "netlink_attrib.h"
+#include "ip_info.h"
+
+#include "defs.h"
+#include "log.h"
+#include "connections.h"
+#include "state.h"
+#include "iface.h"
+#include "ipsec_interface.h"
+#include "updown.h"
+#include "kernel_xfrm_updown.h"
+
+/* _updown.xfrm's table and priority for XFRMi fwmark routing */
+#define XFRMI_ROUTE_TABLE 50
+#define XFRMI_RULE_PRIORITY 100
+/* _updown.xfrm's "scope 50" so delsource() finds what addsource() added */
+#define SOURCEIP_SCOPE_IPV4 50
+
+#define RTNL_BATCH_MAX 8
+#define RTNL_MSG_SIZE 256
+
+struct rtnl {
+	int fd;
+	uint32_t seq;
+	const char *verb;	/* for logging */
+	struct verbose verbose;
+};
+
+/*
+ * Queries.
+ */
+
+typedef void rtnl_response_processor(struct nlmsghdr *, void *context);
+
+/*
+ * Send REQ and feed any responses to PROCESSOR; return 0 or the
+ * errno.
+ */
+
+static int rtnl_query(struct rtnl *rtnl, struct nlmsghdr *req,
+		      rtnl_response_processor *processor, void *context)
+{
+	req->nlmsg_seq = ++rtnl->seq;
+	if (send(rtnl->fd, req, req->nlmsg_len, 0) < 0) {
+		return errno;
+	}
+
+	while (true) {
+		union {
+			struct nlmsghdr n;
+			uint8_t raw[LINUX_NETLINK_BUFSIZE];
+		} buf;
+		ssize_t len = recv(rtnl->fd, &buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		for (struct nlmsghdr *n = &buf.n; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+			if (n->nlmsg_seq != req->nlmsg_seq) {
+				/* stale */
+				continue;
+			}
+			if (n->nlmsg_type == NLMSG_DONE) {
+				return 0;
+			}
+			if (n->nlmsg_type == NLMSG_ERROR) {
+				const struct nlmsgerr *err = NLMSG_DATA(n);
+				return -err->error;
+			}
+			processor(n, context);
+			if ((n->nlmsg_flags & NLM_F_MULTI) == 0) {
+				return 0;
+			}
+		}
+	}
+}
+
+struct rtnl_route {
+	bool found;
+	unsigned type;		/* RTN_LOCAL et.al. */
+	bool gateway;
+	unsigned oif;
+	/* when listing */
+	const ip_subnet *exact;
+	const ip_address *prefsrc;
+};
+
+static void process_route(struct nlmsghdr *n, void *context)
+{
+	struct rtnl_route *route = context;
+	if (n->nlmsg_type != RTM_NEWROUTE) {
+		return;
+	}
+
+	struct rtmsg *rtm = NLMSG_DATA(n);
+	if ((route->exact != NULL || route->prefsrc != NULL) &&
+	    rtm->rtm_table != RT_TABLE_MAIN) {
+		/* "ip route list" only shows the main table */
+		return;
+	}
+
+	const struct ip_info *afi = aftoinfo(rtm->rtm_family);
+	bool gateway = false;
+	unsigned oif = 0;
+	ip_address dst = (afi == NULL ? unset_address : afi->address.unspec);
+	ip_address prefsrc = unset_address;
+	int len = RTM_PAYLOAD(n);
+	for (struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		shunk_t data = shunk2(RTA_DATA(rta), RTA_PAYLOAD(rta));
+		switch (rta->rta_type) {
+		case RTA_GATEWAY:
+			gateway = true;
+			break;
+		case RTA_OIF:
+			if (data.len == sizeof(uint32_t)) {
+				oif = *(const uint32_t *)data.ptr;
+			}
+			break;
+		case RTA_DST:
+			if (afi != NULL && hunk_to_address(data, afi, &dst) != NULL) {
+				dst = unset_address;
+			}
+			break;
+		case RTA_PREFSRC:
+			if (afi != NULL && hunk_to_address(data, afi, &prefsrc) != NULL) {
+				prefsrc = unset_address;
+			}
+			break;
+		}
+	}
+
+	if (route->exact != NULL &&
+	    (rtm->rtm_dst_len != subnet_prefix_bits(*route->exact) ||
+	     !address_eq_address(dst, subnet_prefix(*route->exact)))) {
+		return;
+	}
+	if (route->prefsrc != NULL &&
+	    !address_eq_address(prefsrc, *route->prefsrc)) {
+		return;
+	}
+
+	route->found = true;
+	route->type = rtm->rtm_type;
+	route->gateway = gateway;
+	route->oif = oif;
+}
+
+struct rtnl_route_req {
+	struct nlmsghdr n;
+	struct rtmsg r;
+	char data[64];
+};
+
+static struct rtnl_route_req init_route_req(const struct ip_info *afi, uint16_t flags)
+{
+	struct rtnl_route_req req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg)),
+		.n.nlmsg_type = RTM_GETROUTE,
+		.n.nlmsg_flags = NLM_F_REQUEST | flags,
+		.r.rtm_family = afi->af,
+	};
+	return req;
+}
+
+/* ip route get DST [from SRC] */
+
+static int rtnl_route_get(struct rtnl *rtnl, const ip_address dst,
+			  const ip_address *src, struct rtnl_route *route)
+{
+	zero(route);
+	const struct ip_info *afi = address_info(dst);
+	if (afi == NULL) {
+		return EINVAL;
+	}
+
+	struct rtnl_route_req req = init_route_req(afi, 0);
+	shunk_t bytes = address_as_shunk(&dst);
+	nl_addattr_l(&req.n, sizeof(req), RTA_DST, bytes.ptr, bytes.len);
+	req.r.rtm_dst_len = afi->mask_cnt;
+	if (src != NULL && address_info(*src) == afi) {
+		bytes = address_as_shunk(src);
+		nl_addattr_l(&req.n, sizeof(req), RTA_SRC, bytes.ptr, bytes.len);
+		req.r.rtm_src_len = afi->mask_cnt;
+	}
+
+	int error = rtnl_query(rtnl, &req.n, process_route, route);
+	struct verbose verbose = rtnl->verbose;
+	address_buf ab;
+	vdbg("route get %s: %s found=%s type=%u gateway=%s oif=%u",
+	     str_address(&dst, &ab), (error == 0 ? "ok" : strerror(error)),
+	     bool_str(route->found), route->type,
+	     bool_str(route->gateway), route->oif);
+	return error;
+}
+
+/* ip route list exact SUBNET; or ip route list src PREFSRC */
+
+static void rtnl_route_list(struct rtnl *rtnl, const struct ip_info *afi,
+			    struct rtnl_route *route)
+{
+	struct rtnl_route_req req = init_route_req(afi, NLM_F_DUMP);
+	int error = rtnl_query(rtnl, &req.n, process_route, route);
+	if (error != 0) {
+		llog_errno(RC_LOG, rtnl->verbose.logger, error,
+			   "%s: listing routes failed: ", rtnl->verb);
+	}
+}
+
+struct rtnl_address {
+	bool found;
+	unsigned ifindex;
+	unsigned scope;
+	ip_address address;
+};
+
+static void process_address(struct nlmsghdr *n, void *context)
+{
+	struct rtnl_address *match = context;
+	if (n->nlmsg_type != RTM_NEWADDR) {
+		return;
+	}
+
+	struct ifaddrmsg *ifa = NLMSG_DATA(n);
+	const struct ip_info *afi = address_info(match->address);
+	if (ifa->ifa_index != match->ifindex ||
+	    ifa->ifa_scope != match->scope ||
+	    ifa->ifa_prefixlen != afi->mask_cnt) {
+		return;
+	}
+
+	int len = IFA_PAYLOAD(n);
+	for (struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFA_LOCAL || rta->rta_type == IFA_ADDRESS) {
+			shunk_t data = shunk2(RTA_DATA(rta), RTA_PAYLOAD(rta));
+			ip_address address;
+			if (hunk_to_address(data, afi, &address) == NULL &&
+			    address_eq_address(address, match->address)) {
+				match->found = true;
+				return;
+			}
+		}
+	}
+}
+
+/* ip addr list dev DEV scope SCOPE | grep ADDRESS/MAX */
+
+static bool rtnl_address_on_device(struct rtnl *rtnl, const ip_address address,
+				   unsigned ifindex, unsigned scope)
+{
+	const struct ip_info *afi = address_info(address);
+	struct {
+		struct nlmsghdr n;
+		struct ifaddrmsg ifa;
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg)),
+		.n.nlmsg_type = RTM_GETADDR,
+		.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+		.ifa.ifa_family = afi->af,
+	};
+	struct rtnl_address match = {
+		.ifindex = ifindex,
+		.scope = scope,
+		.address = address,
+	};
+	int error = rtnl_query(rtnl, &req.n, process_address, &match);
+	if (error != 0) {
+		llog_errno(RC_LOG, rtnl->verbose.logger, error,
+			   "%s: listing addresses failed: ", rtnl->verb);
+	}
+	return match.found;
+}
+
+static void process_link(struct nlmsghdr *n, void *context)
+{
+	unsigned *flags = context;
+	if (n->nlmsg_type == RTM_NEWLINK) {
+		struct ifinfomsg *ifi = NLMSG_DATA(n);
+		*flags = ifi->ifi_flags;
+	}
+}
+
+/* ip link show DEV | grep POINTOPOINT */
+
+static bool rtnl_link_is_pointopoint(struct rtnl *rtnl, unsigned ifindex)
+{
+	if (ifindex == 0) {
+		return false;
+	}
+	struct {
+		struct nlmsghdr n;
+		struct ifinfomsg ifi;
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+		.n.nlmsg_type = RTM_GETLINK,
+		.n.nlmsg_flags = NLM_F_REQUEST,
+		.ifi.ifi_family = AF_UNSPEC,
+		.ifi.ifi_index = ifindex,
+	};
+	unsigned flags = 0;
+	rtnl_query(rtnl, &req.n, process_link, &flags);
+	return (flags & IFF_POINTOPOINT);
+}
+
+/*
+ * Changes.
+ *
+ * Each request asks for an ACK; like _updown.xfrm, some errors
+ * (e.g., adding what is already there) are ignored.
+ */
+
+struct rtnl_batch {
+	unsigned len;
+	struct rtnl_op {
+		char story[96];
+		int ignore[2];
+		union {
+			struct nlmsghdr n;
+			uint8_t raw[RTNL_MSG_SIZE];
+		} msg;
+	} op[RTNL_BATCH_MAX];
+};
+
+static bool flush_rtnl_batch(struct rtnl *rtnl, struct rtnl_batch *batch)
+{
+	struct verbose verbose = rtnl->verbose;
+	if (batch->len == 0) {
+		return true;
+	}
+
+	struct iovec iov[RTNL_BATCH_MAX];
+	uint32_t first_seq = rtnl->seq + 1;
+	for (unsigned i = 0; i < batch->len; i++) {
+		struct rtnl_op *op = &batch->op[i];
+		op->msg.n.nlmsg_seq = ++rtnl->seq;
+		iov[i] = (struct iovec) {
+			.iov_base = &op->msg,
+			.iov_len = NLMSG_ALIGN(op->msg.n.nlmsg_len),
+		};
+		vdbg("%s: batching %s", rtnl->verb, op->story);
+	}
+
+	struct sockaddr_nl kernel = {
+		.nl_family = AF_NETLINK,
+	};
+	struct msghdr msg = {
+		.msg_name = &kernel,
+		.msg_namelen = sizeof(kernel),
+		.msg_iov = iov,
+		.msg_iovlen = batch->len,
+	};
+	if (sendmsg(rtnl->fd, &msg, 0) < 0) {
+		llog_errno(RC_LOG, verbose.logger, errno,
+			   "%s: sending %u rtnetlink requests failed: ",
+			   rtnl->verb, batch->len);
+		batch->len = 0;
+		return false;
+	}
+
+	bool ok = true;
+	unsigned acks = 0;
+	while (acks < batch->len) {
+		union {
+			struct nlmsghdr n;
+			uint8_t raw[LINUX_NETLINK_BUFSIZE];
+		} buf;
+		ssize_t len = recv(rtnl->fd, &buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			llog_errno(RC_LOG, verbose.logger, errno,
+				   "%s: reading rtnetlink ACKs failed: ", rtnl->verb);
+			ok = false;
+			break;
+		}
+		for (struct nlmsghdr *n = &buf.n; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+			if (n->nlmsg_type != NLMSG_ERROR ||
+			    n->nlmsg_seq < first_seq ||
+			    n->nlmsg_seq - first_seq >= batch->len) {
+				continue;
+			}
+			acks++;
+			const struct rtnl_op *op = &batch->op[n->nlmsg_seq - first_seq];
+			const struct nlmsgerr *err = NLMSG_DATA(n);
+			int error = -err->error;
+			if (error == 0) {
+				continue;
+			}
+			if (error == op->ignore[0] || error == op->ignore[1]) {
+				vdbg("%s: %s: ignoring %s", rtnl->verb, op->story, strerror(error));
+				continue;
+			}
+			llog_errno(RC_LOG, verbose.logger, error, "%s: %s failed: ",
+				   rtnl->verb, op->story);
+			ok = false;
+		}
+	}
+
+	batch->len = 0;
+	return ok;
+}
+
+static struct rtnl_op *add_rtnl_op(struct rtnl *rtnl, struct rtnl_batch *batch,
+				   uint16_t type, uint16_t flags, size_t payload,
+				   int ignore0, int ignore1)
+{
+	PASSERT(rtnl->verbose.logger, batch->len < elemsof(batch->op));
+	struct rtnl_op *op = &batch->op[batch->len++];
+	zero(op);
+	op->ignore[0] = ignore0;
+	op->ignore[1] = ignore1;
+	op->msg.n.nlmsg_len = NLMSG_LENGTH(payload);
+	op->msg.n.nlmsg_type = type;
+	op->msg.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	return op;
+}
+
+static void add_attr_address(struct rtnl_op *op, unsigned short type,
+			     const ip_address address)
+{
+	shunk_t bytes = address_as_shunk(&address);
+	nl_addattr_l(&op->msg.n, sizeof(op->msg), type, bytes.ptr, bytes.len);
+}
+
+/* ip route {replace,del} DST [via GATEWAY] [mtu MTU] [metric METRIC] dev OIF [src PREFSRC] [table TABLE] */
+
+static void add_route_op(struct rtnl *rtnl, struct rtnl_batch *batch, bool add,
+			 const ip_subnet dst, unsigned table,
+			 const ip_address *gateway, unsigned oif,
+			 const ip_address *prefsrc,
+			 unsigned mtu, unsigned metric)
+{
+	const struct ip_info *afi = subnet_info(dst);
+	struct rtnl_op *op = add_rtnl_op(rtnl, batch,
+					 (add ? RTM_NEWROUTE : RTM_DELROUTE),
+					 (add ? NLM_F_CREATE | NLM_F_REPLACE : 0),
+					 sizeof(struct rtmsg),
+					 EEXIST, ESRCH);
+	subnet_buf sb;
+	snprintf(op->story, sizeof(op->story), "ip route %s %s table %u",
+		 (add ? "replace" : "del"), str_subnet(&dst, &sb), table);
+
+	struct rtmsg *rtm = NLMSG_DATA(&op->msg.n);
+	rtm->rtm_family = afi->af;
+	rtm->rtm_dst_len = subnet_prefix_bits(dst);
+	rtm->rtm_table = table;
+	/* same as ip(8) */
+	if (add) {
+		rtm->rtm_protocol = RTPROT_BOOT;
+		rtm->rtm_type = RTN_UNICAST;
+		rtm->rtm_scope = (afi == &ipv4_info && gateway == NULL ?
+				  RT_SCOPE_LINK : RT_SCOPE_UNIVERSE);
+	} else {
+		rtm->rtm_scope = (afi == &ipv4_info ? RT_SCOPE_NOWHERE : RT_SCOPE_UNIVERSE);
+	}
+
+	add_attr_address(op, RTA_DST, subnet_prefix(dst));
+	if (gateway != NULL) {
+		add_attr_address(op, RTA_GATEWAY, *gateway);
+	}
+	if (oif != 0) {
+		nl_addattr32(&op->msg.n, sizeof(op->msg), RTA_OIF, oif);
+	}
+	if (prefsrc != NULL) {
+		add_attr_address(op, RTA_PREFSRC, *prefsrc);
+	}
+	if (metric != 0) {
+		nl_addattr32(&op->msg.n, sizeof(op->msg), RTA_PRIORITY, metric);
+	}
+	if (mtu != 0) {
+		struct rtattr *metrics = nl_addattr_nest(&op->msg.n, sizeof(op->msg), RTA_METRICS);
+		nl_addattr32(&op->msg.n, sizeof(op->msg), RTAX_MTU, mtu);
+		nl_addattr_nest_end(&op->msg.n, metrics);
+	}
+}
+
+/* ip addr {add,del} ADDRESS/MAX dev IFINDEX [scope SCOPE] */
+
+static void add_address_op(struct rtnl *rtnl, struct rtnl_batch *batch, bool add,
+			   const ip_address address, unsigned ifindex, unsigned scope)
+{
+	const struct ip_info *afi = address_info(address);
+	struct rtnl_op *op = add_rtnl_op(rtnl, batch,
+					 (add ? RTM_NEWADDR : RTM_DELADDR),
+					 (add ? NLM_F_CREATE | NLM_F_EXCL : 0),
+					 sizeof(struct ifaddrmsg),
+					 EEXIST, (add ? 0 : EADDRNOTAVAIL));
+	address_buf ab;
+	snprintf(op->story, sizeof(op->story), "ip addr %s %s/%u",
+		 (add ? "add" : "del"), str_address(&address, &ab), afi->mask_cnt);
+
+	struct ifaddrmsg *ifa = NLMSG_DATA(&op->msg.n);
+	ifa->ifa_family = afi->af;
+	ifa->ifa_prefixlen = afi->mask_cnt;
+	ifa->ifa_index = ifindex;
+	ifa->ifa_scope = (add ? scope : 0);
+	add_attr_address(op, IFA_LOCAL, address);
+	add_attr_address(op, IFA_ADDRESS, address);
+}
+
+/* ip rule {add,del} prio 100 to DST fwmark MARK/MASK lookup 50 */
+
+static void add_rule_op(struct rtnl *rtnl, struct rtnl_batch *batch, bool add,
+			const ip_subnet dst, uint32_t fwmark, uint32_t fwmask)
+{
+	const struct ip_info *afi = subnet_info(dst);
+	struct rtnl_op *op = add_rtnl_op(rtnl, batch,
+					 (add ? RTM_NEWRULE : RTM_DELRULE),
+					 (add ? NLM_F_CREATE | NLM_F_EXCL : 0),
+					 sizeof(struct fib_rule_hdr),
+					 EEXIST, ESRCH);
+	subnet_buf sb;
+	snprintf(op->story, sizeof(op->story), "ip rule %s to %s fwmark %#"PRIx32"/%#"PRIx32,
+		 (add ? "add" : "del"), str_subnet(&dst, &sb), fwmark, fwmask);
+
+	struct fib_rule_hdr *frh = NLMSG_DATA(&op->msg.n);
+	frh->family = afi->af;
+	frh->dst_len = subnet_prefix_bits(dst);
+	frh->table = XFRMI_ROUTE_TABLE;
+	frh->action = (add ? FR_ACT_TO_TBL : FR_ACT_UNSPEC);
+	nl_addattr32(&op->msg.n, sizeof(op->msg), FRA_PRIORITY, XFRMI_RULE_PRIORITY);
+	add_attr_address(op, FRA_DST, subnet_prefix(dst));
+	nl_addattr32(&op->msg.n, sizeof(op->msg), FRA_FWMARK, fwmark);
+	nl_addattr32(&op->msg.n, sizeof(op->msg), FRA_FWMASK, fwmask);
+}
+
+/*
+ * What the script would find in its environment.
+ */
+
+struct updown_env {
+	const struct ip_info *afi;		/* FAMILY */
+	const struct ip_info *host_afi;		/* HOST_FAMILY */
+	bool client;				/* VERB-client vs VERB-host */
+	ip_subnet peer_client;			/* PLUTO_PEER_CLIENT */
+	ip_address peer_client_net;		/* PLUTO_PEER_CLIENT_NET */
+	ip_subnet my_client;			/* PLUTO_MY_CLIENT */
+	ip_address me;				/* PLUTO_ME */
+	ip_address peer;			/* PLUTO_PEER */
+	ip_address nexthop;			/* PLUTO_NEXT_HOP */
+	ip_address sourceip;			/* PLUTO_MY_SOURCEIP */
+	bool mobike_event;			/* PLUTO_MOBIKE_EVENT */
+	const char *interface;			/* PLUTO_INTERFACE */
+	const char *virt_interface;		/* PLUTO_VIRT_INTERFACE */
+	bool xfrmi_route;			/* PLUTO_XFRMI_ROUTE */
+	bool xfrmi_fwmark;			/* PLUTO_XFRMI_FWMARK */
+	uint32_t fwmark;
+	uint32_t fwmask;
+	unsigned mtu;				/* PLUTO_MTU */
+	unsigned metric;			/* PLUTO_METRIC */
+};
+
+static bool init_updown_env(struct updown_env *env,
+			    const struct connection *c,
+			    const struct spd *spd,
+			    const struct child_sa *child,
+			    struct verbose verbose)
+{
+	zero(env);
+
+	/*
+	 * Things only the script can do.
+	 */
+	if (c->config->vti.interface != NULL) {
+		vdbg("using script, VTI");
+		return false;
+	}
+	if (c->nflog_group != 0) {
+		vdbg("using script, NFLOG");
+		return false;
+	}
+	if (c->local->child.has_cat) {
+		vdbg("using script, CAT");
+		return false;
+	}
+	if (c->config->remote_peer_cisco) {
+		vdbg("using script, Cisco interop");
+		return false;
+	}
+	if (spd->local->host->config->modecfg.client) {
+		vdbg("using script, resolv.conf");
+		return false;
+	}
+#ifdef HAVE_NM
+	if (c->config->nm_configured) {
+		vdbg("using script, NetworkManager");
+		return false;
+	}
+#endif
+	if (c->iface == NULL) {
+		vdbg("using script, no interface");
+		return false;
+	}
+
+	env->afi = selector_info(spd->local->client);
+	env->host_afi = address_info(spd->local->host->addr);
+	if (env->afi == NULL || env->host_afi == NULL) {
+		vdbg("using script, unknown address family");
+		return false;
+	}
+
+	env->client = !selector_range_eq_address(spd->local->client, spd->local->host->addr);
+	env->me = spd->local->host->addr;
+	env->peer = spd->remote->host->addr;
+	env->my_client = selector_subnet(spd->local->client);
+
+	/* for transport mode, things are complicated */
+	const bool tunneling = (c->config->child_sa.encap_mode == ENCAP_MODE_TUNNEL);
+	if (!tunneling && child != NULL &&
+	    child->sa.hidden_variables.st_nated_peer) {
+		env->peer_client = subnet_from_address(spd->remote->host->addr);
+	} else {
+		env->peer_client = selector_subnet(spd->remote->client);
+	}
+	env->peer_client_net = subnet_prefix(env->peer_client);
+
+	if (address_is_specified(spd->local->host->nexthop)) {
+		env->nexthop = spd->local->host->nexthop;
+	}
+
+	env->sourceip = spd_end_sourceip(spd->local);
+	env->mobike_event = (env->sourceip.is_set && child != NULL &&
+			     child->sa.st_v2_mobike.del_src_ip);
+
+	env->interface = c->iface->real_device_name;
+	if (c->ipsec_interface != NULL) {
+		env->virt_interface = c->ipsec_interface->name;
+		env->xfrmi_route = (c->ipsec_interface->if_id > 0);
+		if (c->sa_marks.out.val != 0) {
+			env->xfrmi_fwmark = true;
+			env->fwmark = c->sa_marks.out.val;
+			env->fwmask = c->sa_marks.out.mask;
+		} else if (address_in_selector_range(spd->remote->host->addr, spd->remote->client)) {
+			env->xfrmi_fwmark = true;
+			env->fwmark = c->ipsec_interface->if_id;
+			env->fwmask = UINT32_MAX;
+		}
+	}
+
+	env->mtu = c->config->child_sa.mtu;
+	env->metric = c->config->child_sa.metric;
+	return true;
+}
+
+static unsigned device_index(const char *name)
+{
+	/* strip any alias, as in ${PLUTO_INTERFACE%:*} */
+	char device[IF_NAMESIZE];
+	size_t len = strcspn(name, ":");
+	if (len >= sizeof(device)) {
+		return 0;
+	}
+	memcpy(device, name, len);
+	device[len] = '\0';
+	return if_nametoindex(device);
+}
+
+/*
+ * doproxyarp() adds a proxy ARP entry when the peer's client is a
+ * single address on a directly connected network; leave that to the
+ * script.
+ */
+
+static bool needs_proxy_arp(struct rtnl *rtnl, const struct updown_env *env)
+{
+	if (subnet_prefix_bits(env->peer_client) != env->afi->mask_cnt) {
+		return false;
+	}
+	if (address_eq_address(env->peer_client_net, env->afi->address.unspec) ||
+	    address_eq_address(env->peer_client_net, env->peer) ||
+	    address_eq_address(subnet_prefix(env->my_client), env->me)) {
+		return false;
+	}
+	struct rtnl_route route;
+	if (rtnl_route_get(rtnl, env->peer_client_net, NULL, &route) != 0 ||
+	    !route.found) {
+		return false;
+	}
+	return (!route.gateway && route.type != RTN_LOCAL);
+}
+
+/* addsource() */
+
+static void add_sourceip(struct rtnl *rtnl, struct rtnl_batch *batch,
+			 const struct updown_env *env)
+{
+	if (!env->sourceip.is_set || env->xfrmi_route) {
+		return;
+	}
+	struct rtnl_route route;
+	if (rtnl_route_get(rtnl, env->sourceip, NULL, &route) == 0 &&
+	    route.found && route.type == RTN_LOCAL) {
+		return;
+	}
+	add_address_op(rtnl, batch, /*add*/true, env->sourceip,
+		       if_nametoindex("lo"),
+		       (env->afi == &ipv4_info ? SOURCEIP_SCOPE_IPV4 : RT_SCOPE_UNIVERSE));
+}
+
+/* delsource(); requires the routes to have been deleted */
+
+static void del_sourceip(struct rtnl *rtnl, struct rtnl_batch *batch,
+			 const struct updown_env *env)
+{
+	if (!env->sourceip.is_set || env->xfrmi_route) {
+		return;
+	}
+	/* remove the source IP when it's no longer used */
+	struct rtnl_route used = {
+		.prefsrc = &env->sourceip,
+	};
+	rtnl_route_list(rtnl, env->afi, &used);
+	if (used.found) {
+		return;
+	}
+	unsigned lo = if_nametoindex("lo");
+	unsigned scope = (env->afi == &ipv4_info ? SOURCEIP_SCOPE_IPV4 : RT_SCOPE_UNIVERSE);
+	if (!rtnl_address_on_device(rtnl, env->sourceip, lo, scope)) {
+		return;
+	}
+	if (env->mobike_event) {
+		return;
+	}
+	add_address_op(rtnl, batch, /*add*/false, env->sourceip, lo, scope);
+}
+
+/* doroute() */
+
+static void do_route(struct rtnl *rtnl, struct rtnl_batch *batch,
+		     const struct updown_env *env, bool add)
+{
+	struct verbose verbose = rtnl->verbose;
+	struct rtnl_route route;
+
+	bool route_it = false;
+	if (add &&
+	    rtnl_route_get(rtnl, env->peer_client_net, NULL, &route) == EHOSTUNREACH &&
+	    !env->xfrmi_route) {
+		route_it = true;	/* routing is mandatory for IPsec */
+	}
+
+	bool xfrmi_rule = env->xfrmi_fwmark;
+	if (xfrmi_rule) {
+		route_it = false;	/* xfrmi_route will add the route */
+	}
+
+	if (env->sourceip.is_set || env->mtu != 0) {
+		route_it = true;
+	}
+
+	bool xfrmi_route = env->xfrmi_route;
+	if (xfrmi_route && subnet_eq_subnet(env->peer_client, env->my_client)) {
+		subnet_buf sb;
+		llog(RC_LOG, verbose.logger,
+		     "%s: leftsubnet == rightsubnet = %s cannot add route",
+		     rtnl->verb, str_subnet(&env->peer_client, &sb));
+		xfrmi_route = false;
+	}
+
+	/* nexthop is not needed on ppp interfaces */
+	const ip_address *gateway = NULL;
+	const ip_address *esp_gateway = NULL;
+	if (env->afi == env->host_afi && env->nexthop.is_set &&
+	    !address_eq_address(env->nexthop, env->peer) &&
+	    !rtnl_link_is_pointopoint(rtnl, device_index(env->interface))) {
+		/* XFRM interface needs no nexthop but one is needed for ESP */
+		if (env->xfrmi_route) {
+			esp_gateway = &env->nexthop;
+		} else {
+			gateway = &env->nexthop;
+		}
+	}
+
+	/* route via proper interface according to routing table */
+	unsigned oif = 0;
+	if (!add) {
+		if (subnet_is_all(env->peer_client)) {
+			/* in case of default route we use half routes */
+			ip_subnet half = (env->afi == &ipv4_info ?
+					  subnet_from_raw(HERE, IPv4, unset_ip_bytes, 1) :
+					  subnet_from_raw(HERE, IPv6, (struct ip_bytes) { .byte = { 0x20, }, }, 3));
+			struct rtnl_route exact = {
+				.exact = &half,
+			};
+			rtnl_route_list(rtnl, env->afi, &exact);
+			oif = exact.oif;
+		} else if (rtnl_route_get(rtnl, env->peer_client_net, NULL, &route) == 0) {
+			oif = route.oif;
+		}
+	} else if (env->nexthop.is_set &&
+		   rtnl_route_get(rtnl, env->nexthop, NULL, &route) == 0) {
+		oif = route.oif;
+	}
+	if (oif == 0) {
+		oif = device_index(env->interface);
+	}
+	if (env->xfrmi_route) {
+		oif = device_index(env->virt_interface);
+	}
+
+	/* make sure we have sourceip locally in this machine */
+	const ip_address *prefsrc = NULL;
+	if (add && env->sourceip.is_set) {
+		add_sourceip(rtnl, batch, env);
+		/* use sourceip as route default source */
+		prefsrc = &env->sourceip;
+	}
+
+	if (route_it || xfrmi_route) {
+		if (subnet_is_all(env->peer_client) && env->afi == &ipv4_info) {
+			/* need to provide route that eclipses default, without replacing it */
+			struct ip_bytes upper = { .byte = { 0x80, }, };
+			add_route_op(rtnl, batch, add,
+				     subnet_from_raw(HERE, IPv4, unset_ip_bytes, 1),
+				     RT_TABLE_MAIN, gateway, oif, prefsrc,
+				     env->mtu, env->metric);
+			add_route_op(rtnl, batch, add,
+				     subnet_from_raw(HERE, IPv4, upper, 1),
+				     RT_TABLE_MAIN, gateway, oif, prefsrc,
+				     env->mtu, env->metric);
+		} else if (subnet_is_all(env->peer_client)) {
+			struct ip_bytes global = { .byte = { 0x20, }, };
+			add_route_op(rtnl, batch, add,
+				     subnet_from_raw(HERE, IPv6, global, 3),
+				     RT_TABLE_MAIN, gateway, oif, prefsrc,
+				     env->mtu, env->metric);
+		} else {
+			add_route_op(rtnl, batch, add, env->peer_client,
+				     RT_TABLE_MAIN, gateway, oif, prefsrc,
+				     env->mtu, env->metric);
+		}
+	}
+
+	if (xfrmi_rule) {
+		unsigned esp_oif = 0;
+		if (env->nexthop.is_set &&
+		    rtnl_route_get(rtnl, env->nexthop, &env->me, &route) == 0) {
+			esp_oif = route.oif;
+		}
+		if (esp_oif == 0) {
+			esp_oif = device_index(env->interface);
+		}
+		add_route_op(rtnl, batch, add, subnet_from_address(env->peer),
+			     XFRMI_ROUTE_TABLE, esp_gateway, esp_oif, NULL,
+			     0, env->metric);
+		add_rule_op(rtnl, batch, add, env->peer_client,
+			    env->fwmark, env->fwmask);
+	}
+}
+
+bool xfrm_native_updown(enum updown updown,
+			const struct connection *c,
+			const struct spd *spd,
+			const struct child_sa *child,
+			bool *ok,
+			struct logger *logger)
+{
+	static const char *const verbs[] = {
+		[UPDOWN_PREPARE] = "prepare",
+		[UPDOWN_ROUTE] = "route",
+		[UPDOWN_UNROUTE] = "unroute",
+		[UPDOWN_UP] = "up",
+		[UPDOWN_DOWN] = "down",
+	};
+	if (updown >= elemsof(verbs) || verbs[updown] == NULL) {
+		return false;
+	}
+
+	VERBOSE(logger, "%s", verbs[updown]);
+
+	struct updown_env env;
+	if (!init_updown_env(&env, c, spd, child, verbose)) {
+		return false;
+	}
+
+	if (updown == UPDOWN_PREPARE ||
+	    updown == UPDOWN_DOWN ||
+	    (updown == UPDOWN_UP && !env.client)) {
+		/* nothing to do */
+		*ok = true;
+		return true;
+	}
+
+	struct rtnl rtnl = {
+		.verb = verbs[updown],
+		.verbose = verbose,
+	};
+	rtnl.fd = cloexec_socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (rtnl.fd < 0) {
+		llog_errno(RC_LOG, logger, errno,
+			   "%s: opening rtnetlink socket failed, using script: ",
+			   rtnl.verb);
+		return false;
+	}
+
+	if ((updown == UPDOWN_ROUTE || updown == UPDOWN_UNROUTE) &&
+	    needs_proxy_arp(&rtnl, &env)) {
+		vdbg("using script, proxy ARP");
+		close(rtnl.fd);
+		return false;
+	}
+
+	/* big; keep off the stack */
+	struct rtnl_batch *batch = alloc_thing(struct rtnl_batch, "rtnl batch");
+
+	switch (updown) {
+	case UPDOWN_ROUTE:
+		do_route(&rtnl, batch, &env, /*add*/true);
+		*ok = flush_rtnl_batch(&rtnl, batch);
+		break;
+	case UPDOWN_UNROUTE:
+		do_route(&rtnl, batch, &env, /*add*/false);
+		*ok = flush_rtnl_batch(&rtnl, batch);
+		/* once the routes are gone */
+		del_sourceip(&rtnl, batch, &env);
+		*ok = flush_rtnl_batch(&rtnl, batch) && *ok;
+		break;
+	case UPDOWN_UP:
+		add_sourceip(&rtnl, batch, &env);
+		*ok = flush_rtnl_batch(&rtnl, batch);
+		break;
+	default:
+		bad_case(updown);
+	}
+
+	pfree(batch);
+	close(rtnl.fd);
+	return true;
+}
@@ -0,0 +1,41 @@
+/* native updown using rtnetlink, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef KERNEL_XFRM_UPDOWN_H
+#define KERNEL_XFRM_UPDOWN_H
+
+#include <stdbool.h>
+
+enum updown;
+struct connection;
+struct spd;
+struct child_sa;
+struct logger;
+
+/*
+ * Perform the route and source-address operations of the default
+ * _updown.xfrm script directly using rtnetlink.  Returns false,
+ * having done nothing, when the connection needs something only the
+ * script can do.
+ */
+
+bool xfrm_native_updown(enum updown updown,
+			const struct connection *c,
+			const struct spd *spd,
+			const struct child_sa *child,
+			bool *ok,
+			struct logger *logger);
+
+#endif
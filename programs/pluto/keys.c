@@ -67,6 +67,7 @@
 #include "ike_alg_hash.h"
 #include "pluto_timing.h"
 #include "show.h"
+#include "hash_table.h"
 
 static struct secret *pluto_secrets = NULL;
 
@@ -194,7 +195,7 @@ struct tac_state {
 };
 
 /*
- * Try all keys from PUBKEY_DB.
+ * Try KEY.
  *
  * Return true when searching should stop (not when it succeeded);
  * return false when searching can continue.
@@ -206,6 +207,93 @@ struct tac_state {
  *    true      NULL    <valid>     N/A     KEY worked
  */
 
+static bool try_key(struct pubkey *key, bool *described, struct tac_state *s)
+{
+	if (key->content.type != s->signer->type) {
+		id_buf printkid;
+		dbg("  skipping '%s' with type %s",
+		    str_id(&key->id, &printkid), key->content.type->name);
+		return false; /* keep searching */
+	}
+
+	int wildcards; /* value ignored */
+	if (!match_id("  ", &key->id, &s->remote->id, &wildcards)) {
+		id_buf printkid;
+		dbg("  skipping '%s' with wrong ID",
+		    str_id(&key->id, &printkid));
+		return false; /* keep searching */
+	}
+
+	int pl;	/* value ignored */
+	if (!trusted_ca(key->issuer, ASN1(s->remote->config->ca), &pl)) {
+		id_buf printkid;
+		dn_buf buf;
+		dbg("  skipping '%s' with untrusted CA '%s'",
+		    str_id(&key->id, &printkid),
+		    str_dn_or_null(key->issuer, "%any", &buf));
+		return false; /* keep searching */
+	}
+
+	/*
+	 * XXX: even though loop above filtered out these
+	 * certs, keep this check, at some point the above
+	 * loop will be deleted.
+	 */
+	if (!is_realtime_epoch(key->until_time) &&
+	    realtime_cmp(key->until_time, <, s->now)) {
+		id_buf printkid;
+		realtime_buf buf;
+		dbg("  skipping '%s' which expired on %s",
+		    str_id(&key->id, &printkid),
+		    str_realtime(key->until_time, /*utc?*/false, &buf));
+		return false; /* keep searching */
+	}
+
+	id_buf printkid;
+	dn_buf buf;
+	const char *keyid_str = str_keyid(*pubkey_keyid(key));
+	dbg("  trying '%s' aka *%s issued by CA '%s'",
+	    str_id(&key->id, &printkid), keyid_str,
+	    str_dn_or_null(key->issuer, "%any", &buf));
+	s->tried_cnt++;
+
+	if (!*described) {
+		jam(&s->tried_jambuf, " %s:",
+		    str_cert_origin(s->cert_origin));
+		*described = true;
+	}
+	jam(&s->tried_jambuf, " *%s", keyid_str);
+
+	logtime_t try_time = logtime_start(s->logger);
+	bool passed = (s->signer->authenticate_signature)(s->hash, s->signature,
+							  key, s->hash_algo,
+							  &s->fatal_diag, s->logger);
+	logtime_stop(&try_time, "%s() trying a pubkey", __func__);
+
+	if (s->fatal_diag != NULL) {
+		/* already logged */
+		dbg("  '%s' fatal", keyid_str);
+		jam(&s->tried_jambuf, "(fatal)");
+		s->key = key; /* also return failing key */
+		return true; /* stop searching; enough is enough */
+	}
+
+	if (passed) {
+		dbg("  '%s' passed", keyid_str);
+		s->key = key;
+		return true; /* stop searching */
+	}
+
+	/* should have been logged */
+	dbg("  '%s' failed", keyid_str);
+	pexpect(s->key == NULL);
+	return false; /* keep searching */
+}
+
+/*
+ * Try all keys from PUBKEY_DB.
+ */
+
 static bool try_all_keys(enum cert_origin cert_origin,
 			 struct pubkey_list *pubkey_db,
 			 struct tac_state *s)
@@ -219,86 +307,37 @@ static bool try_all_keys(enum cert_origin cert_origin,
 
 	bool described = false;
 	for (struct pubkey_list *p = pubkey_db; p != NULL; p = p->next) {
-		struct pubkey *key = p->key;
-
-		if (key->content.type != s->signer->type) {
-			id_buf printkid;
-			dbg("  skipping '%s' with type %s",
-			    str_id(&key->id, &printkid), key->content.type->name);
-			continue;
-		}
-
-		int wildcards; /* value ignored */
-		if (!match_id("  ", &key->id, &s->remote->id, &wildcards)) {
-			id_buf printkid;
-			dbg("  skipping '%s' with wrong ID",
-			    str_id(&key->id, &printkid));
-			continue;
-		}
-
-		int pl;	/* value ignored */
-		if (!trusted_ca(key->issuer, ASN1(s->remote->config->ca), &pl)) {
-			id_buf printkid;
-			dn_buf buf;
-			dbg("  skipping '%s' with untrusted CA '%s'",
-			    str_id(&key->id, &printkid),
-			    str_dn_or_null(key->issuer, "%any", &buf));
-			continue;
-		}
-
-		/*
-		 * XXX: even though loop above filtered out these
-		 * certs, keep this check, at some point the above
-		 * loop will be deleted.
-		 */
-		if (!is_realtime_epoch(key->until_time) &&
-		    realtime_cmp(key->until_time, <, s->now)) {
-			id_buf printkid;
-			realtime_buf buf;
-			dbg("  skipping '%s' which expired on %s",
-			    str_id(&key->id, &printkid),
-			    str_realtime(key->until_time, /*utc?*/false, &buf));
-			continue;
+		if (try_key(p->key, &described, s)) {
+			return true; /* stop searching */
 		}
+	}
 
-		id_buf printkid;
-		dn_buf buf;
-		const char *keyid_str = str_keyid(*pubkey_keyid(key));
-		dbg("  trying '%s' aka *%s issued by CA '%s'",
-		    str_id(&key->id, &printkid), keyid_str,
-		    str_dn_or_null(key->issuer, "%any", &buf));
-		s->tried_cnt++;
-
-		if (!described) {
-			jam(&s->tried_jambuf, " %s:",
-			    str_cert_origin(cert_origin));
-			described = true;
-		}
-		jam(&s->tried_jambuf, " *%s", keyid_str);
+	return false; /* keep searching */
+}
 
-		logtime_t try_time = logtime_start(s->logger);
-		bool passed = (s->signer->authenticate_signature)(s->hash, s->signature,
-								  key, s->hash_algo,
-								  &s->fatal_diag, s->logger);
-		logtime_stop(&try_time, "%s() trying a pubkey", __func__);
+/*
+ * Try the preloaded keys that could match the remote ID.
+ */
 
-		if (s->fatal_diag != NULL) {
-			/* already logged */
-			dbg("  '%s' fatal", keyid_str);
-			jam(&s->tried_jambuf, "(fatal)");
-			s->key = key; /* also return failing key */
-			return true; /* stop searching; enough is enough */
-		}
+static bool try_preloaded_keys(struct tac_state *s)
+{
+	id_buf thatid;
+	ldbg(s->logger, "trying all '%s's for %s key using %s signature that matches ID: %s",
+	     str_cert_origin(PRELOADED),
+	     s->signer->type->name, s->signer->name,
+	     str_id(&s->remote->id, &thatid));
+	s->cert_origin = PRELOADED;
 
-		if (passed) {
-			dbg("  '%s' passed", keyid_str);
-			s->key = key;
+	bool described = false;
+	struct preloaded_pubkey_filter pkf = {
+		.id = &s->remote->id,
+		.type = s->signer->type,
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		if (try_key(pkf.key, &described, s)) {
 			return true; /* stop searching */
 		}
-
-		/* should have been logged */
-		dbg("  '%s' failed", keyid_str);
-		pexpect(s->key == NULL);
 	}
 
 	return false; /* keep searching */
@@ -338,27 +377,30 @@ diag_t authsig_and_log_using_pubkey(struct ike_sa *ike,
 	passert(ike->sa.st_remote_certs.processed);
 
 	/*
-	 * Prune the expired public keys from the pre-loaded public
-	 * key list.  But why here, and why not as a separate job?
-	 * And why blame the IKE SA as it isn't really its fault?
+	 * Prune the expired public keys, that could match the remote
+	 * ID, from the pre-loaded public keys.  But why here, and why
+	 * not as a separate job?  And why blame the IKE SA as it
+	 * isn't really its fault?
 	 */
-	for (struct pubkey_list **pp = &pluto_pubkeys; *pp != NULL; ) {
-		struct pubkey *key = (*pp)->key;
+	struct preloaded_pubkey_filter expired = {
+		.id = &c->remote->host.id,
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &expired)) {
+		struct pubkey *key = expired.key;
 		if (!is_realtime_epoch(key->until_time) &&
 		    realtime_cmp(key->until_time, <, s.now)) {
 			id_buf printkid;
 			llog_sa(RC_LOG, ike,
 				  "cached %s public key '%s' has expired and has been deleted",
 				  key->content.type->name, str_id(&key->id, &printkid));
-			*pp = free_public_keyentry(*(pp));
-			continue; /* continue with next public key */
+			delete_preloaded_pubkey(key);
 		}
-		pp = &(*pp)->next;
 	}
 
 	bool stop = try_all_keys(PEER, ike->sa.st_remote_certs.pubkey_db, &s);
 	if (!stop) {
-		stop = try_all_keys(PRELOADED, pluto_pubkeys, &s);
+		stop = try_preloaded_keys(&s);
 	}
 
 	if (s.fatal_diag != NULL) {
@@ -774,13 +816,326 @@ const struct secret_stuff *get_local_private_key(const struct connection *c,
  * public key machinery
  */
 
-/* root of chained public key list */
+/*
+ * The preloaded public keys.
+ *
+ * With tens of thousands of raw or DNSSEC keys, a linear search on
+ * every authentication adds up; hence the keys are indexed by ID,
+ * keyid, and CKAID.
+ */
 
-struct pubkey_list *pluto_pubkeys = NULL;       /* keys from ipsec.conf */
+struct preloaded_pubkey {
+	struct pubkey *key;	/* counted reference */
+	struct {
+		struct list_entry list;
+		struct list_entry id;
+		struct list_entry keyid;
+		struct list_entry ckaid;
+	} preloaded_pubkey_db_entries;
+};
 
-void free_remembered_public_keys(void)
+static size_t jam_preloaded_pubkey(struct jambuf *buf, const struct preloaded_pubkey *pp)
 {
-	free_public_keys(&pluto_pubkeys);
+	size_t s = 0;
+	s += jam(buf, "%s key %s ", pp->key->content.type->name,
+		 str_keyid(pp->key->content.keyid));
+	s += jam_id_bytes(buf, &pp->key->id, jam_sanitized_bytes);
+	return s;
+}
+
+/*
+ * Anything that could be the same_id() or match_id() of an ID must
+ * land in the same bucket: hence DNs (which can have wildcards and
+ * be in any order) and ID_NONE only hash their kind; and FQDNs
+ * ignore case and trailing dots.
+ */
+
+static hash_t hash_preloaded_pubkey_id(const struct id *id)
+{
+	hash_t hash = hash_thing(id->kind, zero_hash);
+	switch (id->kind) {
+	case ID_IPV4_ADDR:
+	case ID_IPV6_ADDR:
+		return hash_hunk(address_as_shunk(&id->ip_addr), hash);
+	case ID_FQDN:
+	case ID_USER_FQDN:
+	{
+		const char *name = (const char *)id->name.ptr;
+		size_t len = id->name.len;
+		while (len > 0 && name[len - 1] == '.') {
+			len--;
+		}
+		for (size_t i = 0; i < len; i++) {
+			char c = char_tolower(name[i]);
+			hash = hash_thing(c, hash);
+		}
+		return hash;
+	}
+	case ID_KEY_ID:
+		return hash_hunk(id->name, hash);
+	default:
+		return hash;
+	}
+}
+
+HASH_TABLE(preloaded_pubkey, id, .key->id, STATE_TABLE_SIZE);
+
+static hash_t hash_preloaded_pubkey_keyid(const keyid_t *keyid)
+{
+	return hash_bytes(keyid->keyid, strlen(keyid->keyid), zero_hash);
+}
+
+HASH_TABLE(preloaded_pubkey, keyid, .key->content.keyid, STATE_TABLE_SIZE);
+
+static hash_t hash_preloaded_pubkey_ckaid(const ckaid_t *ckaid)
+{
+	return hash_bytes(ckaid->ptr, ckaid->len, zero_hash);
+}
+
+HASH_TABLE(preloaded_pubkey, ckaid, .key->content.ckaid, STATE_TABLE_SIZE);
+
+static void preloaded_pubkey_db_init(struct logger *logger);
+static void preloaded_pubkey_db_check(struct logger *logger);
+static void preloaded_pubkey_db_init_preloaded_pubkey(struct preloaded_pubkey *);
+static void preloaded_pubkey_db_add(struct preloaded_pubkey *);
+static void preloaded_pubkey_db_del(struct preloaded_pubkey *);
+
+HASH_DB(preloaded_pubkey,
+	&preloaded_pubkey_id_hash_table,
+	&preloaded_pubkey_keyid_hash_table,
+	&preloaded_pubkey_ckaid_hash_table);
+
+void init_preloaded_pubkeys(struct logger *logger)
+{
+	preloaded_pubkey_db_init(logger);
+}
+
+static struct list_head *preloaded_pubkey_filter_head(struct preloaded_pubkey_filter *filter)
+{
+	/* select list head */
+	if (filter->ckaid != NULL) {
+		if (filter->pass > 0) {
+			return NULL;
+		}
+		ckaid_buf cb;
+		dbg("FOR_EACH_PRELOADED_PUBKEY[ckaid=%s]... in "PRI_WHERE,
+		    str_ckaid(filter->ckaid, &cb), pri_where(filter->where));
+		hash_t hash = hash_preloaded_pubkey_ckaid(filter->ckaid);
+		return hash_table_bucket(&preloaded_pubkey_ckaid_hash_table, hash);
+	}
+
+	if (filter->keyid != NULL) {
+		if (filter->pass > 0) {
+			return NULL;
+		}
+		dbg("FOR_EACH_PRELOADED_PUBKEY[keyid=%s]... in "PRI_WHERE,
+		    str_keyid(*filter->keyid), pri_where(filter->where));
+		hash_t hash = hash_preloaded_pubkey_keyid(filter->keyid);
+		return hash_table_bucket(&preloaded_pubkey_keyid_hash_table, hash);
+	}
+
+	if (filter->id != NULL && filter->id->kind != ID_NONE) {
+		/*
+		 * First the ID's bucket, and then the bucket
+		 * containing ID_NONE (which is a wildcard) (unless
+		 * they are the same).
+		 */
+		static const struct id none_id = { .kind = ID_NONE, };
+		struct list_head *id_bucket =
+			hash_table_bucket(&preloaded_pubkey_id_hash_table,
+					  hash_preloaded_pubkey_id(filter->id));
+		struct list_head *none_bucket =
+			hash_table_bucket(&preloaded_pubkey_id_hash_table,
+					  hash_preloaded_pubkey_id(&none_id));
+		switch (filter->pass) {
+		case 0:
+		{
+			id_buf ib;
+			dbg("FOR_EACH_PRELOADED_PUBKEY[id=%s]... in "PRI_WHERE,
+			    str_id(filter->id, &ib), pri_where(filter->where));
+			return id_bucket;
+		}
+		case 1:
+			return (none_bucket == id_bucket ? NULL : none_bucket);
+		default:
+			return NULL;
+		}
+	}
+
+	/* else other queries? */
+	if (filter->pass > 0) {
+		return NULL;
+	}
+	dbg("FOR_EACH_PRELOADED_PUBKEY_... in "PRI_WHERE, pri_where(filter->where));
+	return &preloaded_pubkey_db_list_head;
+}
+
+static bool id_could_match(const struct id *key_id, const struct id *id)
+{
+	if (id->kind == ID_NONE || key_id->kind == ID_NONE) {
+		return true;
+	}
+	if (id->kind != key_id->kind) {
+		return false;
+	}
+	if (id->kind == ID_DER_ASN1_DN) {
+		/* wildcards and order are for the caller */
+		return true;
+	}
+	return id_eq(key_id, id);
+}
+
+static bool matches_preloaded_pubkey_filter(const struct pubkey *key,
+					    const struct preloaded_pubkey_filter *filter)
+{
+	if (filter->type != NULL && key->content.type != filter->type) {
+		return false;
+	}
+	if (filter->ckaid != NULL &&
+	    !hunk_eq(key->content.ckaid, *filter->ckaid)) {
+		return false;
+	}
+	if (filter->keyid != NULL &&
+	    !streq(key->content.keyid.keyid, filter->keyid->keyid)) {
+		return false;
+	}
+	if (filter->id != NULL && !id_could_match(&key->id, filter->id)) {
+		return false;
+	}
+	return true;
+}
+
+bool next_preloaded_pubkey(enum chrono order, struct preloaded_pubkey_filter *filter)
+{
+	filter->key = NULL;
+	while (true) {
+		if (filter->internal == NULL) {
+			/*
+			 * Advance to first entry of the circular list
+			 * (if the list is empty it ends up back on
+			 * HEAD which has no data).
+			 */
+			struct list_head *head = preloaded_pubkey_filter_head(filter);
+			if (head == NULL) {
+				break;
+			}
+			filter->internal = head->head.next[order];
+		}
+		/* Walk list until an entry matches */
+		for (struct list_entry *entry = filter->internal;
+		     entry->data != NULL /* head has DATA == NULL */;
+		     entry = entry->next[order]) {
+			struct preloaded_pubkey *pp = entry->data;
+			if (matches_preloaded_pubkey_filter(pp->key, filter)) {
+				/* save key; but step off current entry */
+				filter->internal = entry->next[order];
+				filter->count++;
+				LDBGP_JAMBUF(DBG_BASE, &global_logger, buf) {
+					jam_string(buf, "  found ");
+					jam_preloaded_pubkey(buf, pp);
+				}
+				filter->key = pp->key;
+				return true;
+			}
+		}
+		/* on to the next list */
+		filter->internal = NULL;
+		filter->pass++;
+	}
+	dbg("  matches: %d", filter->count);
+	return false;
+}
+
+/* steals *KEY */
+static void add_preloaded_pubkey(struct pubkey **key)
+{
+	struct preloaded_pubkey *pp = alloc_thing(struct preloaded_pubkey, "preloaded pubkey");
+	pp->key = *key;
+	*key = NULL; /* stolen */
+	preloaded_pubkey_db_init_preloaded_pubkey(pp);
+	preloaded_pubkey_db_add(pp);
+}
+
+static void free_preloaded_pubkey(struct preloaded_pubkey **ppp)
+{
+	struct preloaded_pubkey *pp = *ppp;
+	*ppp = NULL;
+	preloaded_pubkey_db_del(pp);
+	/* only freed when the last reference is released */
+	pubkey_delref(&pp->key);
+	pfree(pp);
+}
+
+void delete_preloaded_pubkey(const struct pubkey *key)
+{
+	hash_t hash = hash_preloaded_pubkey_ckaid(&key->content.ckaid);
+	struct list_head *bucket = hash_table_bucket(&preloaded_pubkey_ckaid_hash_table, hash);
+	struct preloaded_pubkey *pp;
+	FOR_EACH_LIST_ENTRY_NEW2OLD(pp, bucket) {
+		if (pp->key == key) {
+			free_preloaded_pubkey(&pp);
+			return;
+		}
+	}
+	llog_pexpect(&global_logger, HERE, "preloaded pubkey not found");
+}
+
+void delete_preloaded_pubkeys(const struct id *id, const struct pubkey_type *type)
+{
+	struct preloaded_pubkey_filter pkf = {
+		.id = id,
+		.type = type,
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		if (same_id(id, &pkf.key->id)) {
+			delete_preloaded_pubkey(pkf.key);
+		}
+	}
+}
+
+/*
+ * PUBKEYS is newest first; add oldest first so that the order is
+ * preserved.
+ */
+
+static void install_preloaded_pubkeys(struct pubkey_list **pubkeys, bool replace)
+{
+	struct pubkey_list *reversed = NULL;
+	while (*pubkeys != NULL) {
+		struct pubkey_list *p = *pubkeys;
+		*pubkeys = p->next;
+		p->next = reversed;
+		reversed = p;
+	}
+	while (reversed != NULL) {
+		struct pubkey_list *p = reversed;
+		reversed = p->next;
+		if (replace) {
+			delete_preloaded_pubkeys(&p->key->id, p->key->content.type);
+		}
+		add_preloaded_pubkey(&p->key);
+		pfree(p);
+	}
+}
+
+void replace_preloaded_pubkeys(struct pubkey_list **pubkeys)
+{
+	install_preloaded_pubkeys(pubkeys, /*replace*/true);
+}
+
+void add_preloaded_pubkeys(struct pubkey_list **pubkeys)
+{
+	install_preloaded_pubkeys(pubkeys, /*replace*/false);
+}
+
+void free_remembered_public_keys(struct logger *logger)
+{
+	preloaded_pubkey_db_check(logger);
+	struct preloaded_pubkey *pp;
+	FOR_EACH_LIST_ENTRY_NEW2OLD(pp, &preloaded_pubkey_db_list_head) {
+		free_preloaded_pubkey(&pp);
+	}
 }
 
 /*
@@ -876,8 +1231,11 @@ void show_pubkeys(struct show *s, bool utc, enum keys_to_show keys_to_show)
 		show_blank(s);
 	}
 
-	for (struct pubkey_list *p = pluto_pubkeys; p != NULL; p = p->next) {
-		struct pubkey *pubkey = p->key;
+	struct preloaded_pubkey_filter pkf = {
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		struct pubkey *pubkey = pkf.key;
 		expiry_buf eb;
 		const char *expiry_msg = check_expiry(pubkey->until_time, PUBKEY_WARNING_INTERVAL, &eb);
 		switch (keys_to_show) {
@@ -916,9 +1274,25 @@ err_t preload_private_key_by_ckaid(const ckaid_t *ckaid, bool *load_needed, stru
 
 const struct pubkey *find_pubkey_by_ckaid(const char *ckaid)
 {
-	for (struct pubkey_list *p = pluto_pubkeys; p != NULL; p = p->next) {
+	/* try the index; CKAID could be complete */
+	ckaid_t full_ckaid;
+	if (string_to_ckaid(ckaid, &full_ckaid) == NULL) {
+		struct preloaded_pubkey_filter pkf = {
+			.ckaid = &full_ckaid,
+			.where = HERE,
+		};
+		if (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+			dbg("ckaid matching pubkey");
+			return pkf.key;
+		}
+	}
+	/* else it's a prefix */
+	struct preloaded_pubkey_filter pkf = {
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
 		DBG_log("looking at a PUBKEY");
-		struct pubkey *key = p->key;
+		struct pubkey *key = pkf.key;
 		const ckaid_t *key_ckaid = pubkey_ckaid(key);
 		if (ckaid_starts_with(key_ckaid, ckaid)) {
 			dbg("ckaid matching pubkey");
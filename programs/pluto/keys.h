@@ -30,6 +30,9 @@
 #include "certs.h"
 #include "err.h"
 #include "ckaid.h"
+#include "keyid.h"
+#include "list_entry.h"		/* for enum chrono */
+#include "where.h"
 
 struct connection;
 struct RSA_private_key;
@@ -42,6 +45,8 @@ struct hash_desc;
 struct show;
 struct ike_sa;
 struct pubkey_signer;
+struct pubkey_list;
+struct id;
 
 const struct secret_stuff *get_local_private_key(const struct connection *c,
 						      const struct pubkey_type *type,
@@ -59,14 +64,59 @@ extern shunk_t get_connection_ppk_responder(const struct connection *c, chunk_t
 
 extern void load_preshared_secrets(struct logger *logger);
 extern void free_preshared_secrets(struct logger *logger);
-extern void free_remembered_public_keys(void);
+extern void free_remembered_public_keys(struct logger *logger);
 err_t preload_private_key_by_cert(const struct cert *cert, bool *load_needed, struct logger *logger);
 err_t preload_private_key_by_ckaid(const ckaid_t *ckaid, bool *load_needed, struct logger *logger);
 
 extern struct secret *lsw_get_xauthsecret(char *xauthname);
 
-/* keys from ipsec.conf */
-extern struct pubkey_list *pluto_pubkeys;
+/*
+ * The preloaded public keys: from ipsec.conf (via whack), DNS, and
+ * the certificates of loaded connections.
+ *
+ * The replace and add functions steal the keys on PUBKEYS (the list
+ * is left empty).  Replacing first deletes any existing keys with
+ * the same ID and type.
+ */
+
+void init_preloaded_pubkeys(struct logger *logger);
+void replace_preloaded_pubkeys(struct pubkey_list **pubkeys);
+void add_preloaded_pubkeys(struct pubkey_list **pubkeys);
+void delete_preloaded_pubkeys(const struct id *id, const struct pubkey_type *type);
+void delete_preloaded_pubkey(const struct pubkey *key);
+
+/*
+ * For iterating over the preloaded public keys.
+ *
+ * - parameters are only matched when non-NULL
+ * - .key can be deleted between calls
+ * - the lookup is hashed using, in order of preference, .ckaid,
+ *   .keyid, or .id; worst case is it scans through all keys
+ * - .id returns the keys that could be same_id() or match_id() (a
+ *   key with ID_NONE matches any ID; DNs can have wildcards and be
+ *   in any order); the caller still needs to check
+ *
+ * Note: the ORDER is based on insertion.
+ */
+
+struct preloaded_pubkey_filter {
+	const struct id *id;
+	const keyid_t *keyid;
+	const ckaid_t *ckaid;
+	const struct pubkey_type *type;
+	/* current result (can be safely deleted) */
+	struct pubkey *key;
+	/* internal: handle on next entry */
+	struct list_entry *internal;
+	/* internal: which list is being searched */
+	unsigned pass;
+	/* internal: total matches so far */
+	unsigned count;
+	/* .where MUST BE LAST (See GCC bug 102288) */
+	where_t where;
+};
+
+bool next_preloaded_pubkey(enum chrono order, struct preloaded_pubkey_filter *filter);
 
 const struct pubkey *find_pubkey_by_ckaid(const char *ckaid);
 
@@ -45,6 +45,7 @@
 #include "ip_info.h"
 #include "log.h"
 #include "log_limiter.h"
+#include "ocsp_cache.h"
 
 bool groundhogday;
 
@@ -142,13 +143,15 @@ static unsigned int rev_val_flags(PRBool strict, PRBool post)
 }
 
 static void set_rev_params(CERTRevocationFlags *rev,
-			   const struct rev_opts *rev_opts)
+			   const struct rev_opts *rev_opts,
+			   bool ocsp_cached)
 {
 	CERTRevocationTests *rt = &rev->leafTests;
 	PRUint64 *rf = rt->cert_rev_flags_per_method;
-	dbg("crl_strict: %d, ocsp: %d, ocsp_strict: %d, ocsp_post: %d",
+	dbg("crl_strict: %d, ocsp: %d, ocsp_strict: %d, ocsp_post: %d, ocsp_prefetch: %d, ocsp_cached: %d",
 	    rev_opts->crl_strict, rev_opts->ocsp,
-	    rev_opts->ocsp_strict, rev_opts->ocsp_post);
+	    rev_opts->ocsp_strict, rev_opts->ocsp_post,
+	    rev_opts->ocsp_prefetch, ocsp_cached);
 
 	rt->number_of_defined_methods = cert_revocation_method_count;
 	rt->number_of_preferred_methods = 0;
@@ -159,6 +162,16 @@ static void set_rev_params(CERTRevocationFlags *rev,
 	if (rev_opts->ocsp) {
 		rf[cert_revocation_method_ocsp] = rev_val_flags(rev_opts->ocsp_strict,
 								rev_opts->ocsp_post);
+		/*
+		 * When prefetching, the OCSP response is either
+		 * already in NSS's cache, or on its way.  Don't wait
+		 * on the responder unless strict mode requires an
+		 * answer now.
+		 */
+		if (rev_opts->ocsp_prefetch &&
+		    (ocsp_cached || !rev_opts->ocsp_strict)) {
+			rf[cert_revocation_method_ocsp] |= CERT_REV_M_FORBID_NETWORK_FETCHING;
+		}
 	}
 }
 
@@ -171,6 +184,7 @@ static bool verify_end_cert(struct logger *logger,
 			    const CERTCertList *trustcl,
 			    const struct rev_opts *rev_opts,
 			    PRTime groundhogtime,
+			    bool ocsp_cached,
 			    CERTCertificate *end_cert)
 {
 	CERTRevocationFlags rev;
@@ -180,7 +194,7 @@ static bool verify_end_cert(struct logger *logger,
 	PRUint64 revFlagsChain[2] = { 0, 0 };
 
 	set_rev_per_meth(&rev, revFlagsLeaf, revFlagsChain);
-	set_rev_params(&rev, rev_opts);
+	set_rev_params(&rev, rev_opts, ocsp_cached);
 
 	ldbg(logger, "groundhogtime is %ju", (uintmax_t)groundhogtime);
 
@@ -598,9 +612,16 @@ struct verified_certs find_and_verify_certs(struct logger *logger,
 		dbg("missing or expired CRL");
 	}
 
+	bool ocsp_cached = false;
+	if (rev_opts->ocsp && rev_opts->ocsp_prefetch) {
+		logtime_t ocsp_time = logtime_start(logger);
+		ocsp_cached = prime_ocsp_cache(handle, end_cert, logger);
+		logtime_stop(&ocsp_time, "%s() calling prime_ocsp_cache()", __func__);
+	}
+
 	logtime_t verify_time = logtime_start(logger);
 	bool end_ok = verify_end_cert(logger, root_certs->trustcl, rev_opts,
-				      0, end_cert);
+				      0, ocsp_cached, end_cert);
 	if (!end_ok && groundhogday) {
 		/*
 		 * Go through the CA certs retrying any with an
@@ -632,7 +653,7 @@ struct verified_certs find_and_verify_certs(struct logger *logger,
 			PR_INSERT_LINK(&ground_cert.links, &ground_certs.list);
 
 			if (verify_end_cert(logger, &ground_certs, rev_opts,
-					    groundhogtime, end_cert)) {
+					    groundhogtime, ocsp_cached, end_cert)) {
 				result.groundhog = true;
 				end_ok = true;
 				break;
@@ -38,6 +38,7 @@ struct rev_opts {
 	bool ocsp;
 	bool ocsp_strict;
 	bool ocsp_post;
+	bool ocsp_prefetch;
 	bool crl_strict;
 };
 
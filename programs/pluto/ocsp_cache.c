@@ -0,0 +1,591 @@
+/* OCSP response cache, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <pthread.h>
+
+#include <cert.h>
+#include <ocsp.h>
+#include <secder.h>
+#include <secerr.h>
+
+#include "lswalloc.h"
+#include "lswnss.h"
+#include "asn1.h"
+#include "x509.h"
+
+#include "defs.h"
+#include "log.h"
+#include "show.h"
+#include "whack_shutdown.h"		/* for exiting_pluto */
+#include "hash_table.h"
+#include "crl_queue.h"		/* for poke_crl_fetch_thread() */
+#include "ocsp_cache.h"
+
+/*
+ * Responses without a nextUpdate are, according to RFC 6960, always
+ * superseded by newer information; treat them as valid for an hour.
+ */
+#define OCSP_CACHE_DEFAULT_LIFETIME	deltatime(60 * 60)
+/* never refresh more often than this */
+#define OCSP_CACHE_MIN_REFRESH		deltatime(60)
+/* back off this much per failed fetch, up to an hour */
+#define OCSP_CACHE_RETRY_INTERVAL	deltatime(60)
+#define OCSP_CACHE_MAX_RETRY		deltatime(60 * 60)
+/* stop refreshing responses nothing has asked for in a day */
+#define OCSP_CACHE_IDLE_LIFETIME	deltatime(24 * 60 * 60)
+
+struct ocsp_cache_entry {
+	/* key */
+	chunk_t issuer;			/* DER */
+	chunk_t serial;			/* DER */
+	hash_t hash;
+	/* needed when creating a request */
+	CERTCertificate *cert;		/* must free */
+	CERTCertificate *issuer_cert;	/* must free; keeps temp certs alive */
+	char *responder;		/* must free */
+	/* the cached response; empty until the first fetch */
+	chunk_t response;		/* DER OCSPResponse */
+	realtime_t this_update;
+	realtime_t next_update;
+	/* housekeeping */
+	realtime_t refresh_time;	/* when to next fetch */
+	realtime_t last_used;
+	unsigned trials;
+	struct {
+		struct list_entry list;
+		struct list_entry hash;
+	} ocsp_cache_entry_db_entries;
+};
+
+/*
+ * The verifier (main and helper threads) and the CRL fetch thread
+ * all access the cache; hold the lock.  Pointers to entries never
+ * escape the lock.
+ */
+
+static pthread_mutex_t ocsp_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned ocsp_cache_entries;
+static unsigned ocsp_cache_max_entries;
+static char *ocsp_cache_default_responder;
+static bool ocsp_cache_enabled;
+
+static size_t jam_ocsp_cache_entry(struct jambuf *buf, const struct ocsp_cache_entry *entry)
+{
+	size_t s = 0;
+	s += jam_string(buf, "'");
+	s += jam_dn(buf, ASN1(entry->issuer), jam_sanitized_bytes);
+	s += jam_string(buf, "' serial ");
+	s += jam_hex_hunk(buf, entry->serial);
+	return s;
+}
+
+static hash_t hash_ocsp_key(shunk_t issuer, shunk_t serial)
+{
+	hash_t hash = zero_hash;
+	hash = hash_hunk(issuer, hash);
+	hash = hash_hunk(serial, hash);
+	return hash;
+}
+
+/* the key's hash is computed once, when the entry is created */
+static hash_t hash_ocsp_cache_entry_hash(const hash_t *hash)
+{
+	return *hash;
+}
+
+HASH_TABLE(ocsp_cache_entry, hash, .hash, 1021);
+
+static void ocsp_cache_entry_db_init(struct logger *logger);
+static void ocsp_cache_entry_db_check(struct logger *logger);
+static void ocsp_cache_entry_db_init_ocsp_cache_entry(struct ocsp_cache_entry *);
+static void ocsp_cache_entry_db_add(struct ocsp_cache_entry *);
+static void ocsp_cache_entry_db_del(struct ocsp_cache_entry *);
+
+HASH_DB(ocsp_cache_entry, &ocsp_cache_entry_hash_hash_table);
+
+static struct ocsp_cache_entry *unlocked_ocsp_cache_entry(shunk_t issuer, shunk_t serial)
+{
+	hash_t hash = hash_ocsp_key(issuer, serial);
+	struct list_head *bucket = hash_table_bucket(&ocsp_cache_entry_hash_hash_table, hash);
+	struct ocsp_cache_entry *entry;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(entry, bucket) {
+		if (entry->hash.hash == hash.hash &&
+		    hunk_eq(entry->issuer, issuer) &&
+		    hunk_eq(entry->serial, serial)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static void free_ocsp_cache_entry(struct ocsp_cache_entry **entry)
+{
+	struct ocsp_cache_entry *e = *entry;
+	ocsp_cache_entry_db_del(e);
+	free_chunk_content(&e->issuer);
+	free_chunk_content(&e->serial);
+	free_chunk_content(&e->response);
+	CERT_DestroyCertificate(e->cert);
+	CERT_DestroyCertificate(e->issuer_cert);
+	pfreeany(e->responder);
+	pfree(e);
+	*entry = NULL;
+	ocsp_cache_entries--;
+}
+
+static realtime_t realtime_from_prtime(PRTime t)
+{
+	return realtime_ms(t / PR_USEC_PER_MSEC);
+}
+
+/*
+ * Skip over, or extract, the next ASN.1 element.
+ */
+
+static err_t unwrap_asn1_any(asn1_t *cursor, enum asn1_type *type, asn1_t *value)
+{
+	err_t e = unwrap_asn1_type(cursor, type);
+	if (e != NULL) {
+		return e;
+	}
+	size_t length;
+	e = unwrap_asn1_length(cursor, &length);
+	if (e != NULL) {
+		return e;
+	}
+	return unwrap_asn1_value(cursor, length, value);
+}
+
+static bool asn1_peek(asn1_t cursor, enum asn1_type type)
+{
+	return (cursor.len > 0 && ((const uint8_t *)cursor.ptr)[0] == type);
+}
+
+static err_t unwrap_asn1_generalized_time(asn1_t *cursor, realtime_t *t)
+{
+	asn1_t value;
+	err_t e = unwrap_asn1_tlv(cursor, ASN1_GENERALIZEDTIME, &value);
+	if (e != NULL) {
+		return e;
+	}
+	SECItem si = same_shunk_as_secitem(value, siGeneralizedTime);
+	PRTime prtime;
+	if (DER_GeneralizedTimeToTime(&prtime, &si) != SECSuccess) {
+		return "invalid GeneralizedTime";
+	}
+	*t = realtime_from_prtime(prtime);
+	return NULL;
+}
+
+/*
+ * NSS doesn't export the decoded response (ocspti.h is private), so
+ * dig out the thisUpdate and (earliest) nextUpdate by hand.
+ *
+ *   OCSPResponse ::= SEQUENCE {
+ *      responseStatus ENUMERATED,
+ *      responseBytes [0] EXPLICIT SEQUENCE {
+ *         responseType OBJECT IDENTIFIER,
+ *         response OCTET STRING (BasicOCSPResponse) } }
+ *   BasicOCSPResponse ::= SEQUENCE { tbsResponseData ResponseData, ... }
+ *   ResponseData ::= SEQUENCE {
+ *      version [0] EXPLICIT Version DEFAULT v1,
+ *      responderID ResponderID,
+ *      producedAt GeneralizedTime,
+ *      responses SEQUENCE OF SingleResponse, ... }
+ *   SingleResponse ::= SEQUENCE {
+ *      certID CertID,
+ *      certStatus CertStatus,
+ *      thisUpdate GeneralizedTime,
+ *      nextUpdate [0] EXPLICIT GeneralizedTime OPTIONAL, ... }
+ */
+
+static err_t ocsp_response_times(shunk_t der, realtime_t *this_update,
+				 realtime_t *next_update)
+{
+	err_t e;
+	enum asn1_type type;
+	asn1_t cursor = der;
+	asn1_t value;
+
+	asn1_t response;
+	if ((e = unwrap_asn1_tlv(&cursor, ASN1_SEQUENCE, &response)) != NULL ||
+	    (e = unwrap_asn1_tlv(&response, ASN1_ENUMERATED, &value)) != NULL) {
+		return e;
+	}
+	if (value.len != 1 || ((const uint8_t *)value.ptr)[0] != 0) {
+		return "OCSP response status is not successful";
+	}
+
+	asn1_t bytes;
+	asn1_t basic;
+	if ((e = unwrap_asn1_tlv(&response, ASN1_CONTEXT_C_0, &bytes)) != NULL ||
+	    (e = unwrap_asn1_tlv(&bytes, ASN1_SEQUENCE, &bytes)) != NULL ||
+	    (e = unwrap_asn1_tlv(&bytes, ASN1_OID, &value)) != NULL ||
+	    (e = unwrap_asn1_tlv(&bytes, ASN1_OCTET_STRING, &basic)) != NULL ||
+	    (e = unwrap_asn1_tlv(&basic, ASN1_SEQUENCE, &basic)) != NULL) {
+		return e;
+	}
+
+	asn1_t tbs;
+	if ((e = unwrap_asn1_tlv(&basic, ASN1_SEQUENCE, &tbs)) != NULL) {
+		return e;
+	}
+	if (asn1_peek(tbs, ASN1_CONTEXT_C_0) &&
+	    (e = unwrap_asn1_any(&tbs, &type, &value)) != NULL) {
+		return e;
+	}
+	realtime_t produced_at;
+	asn1_t responses;
+	if ((e = unwrap_asn1_any(&tbs, &type, &value)) != NULL /*responderID*/ ||
+	    (e = unwrap_asn1_generalized_time(&tbs, &produced_at)) != NULL ||
+	    (e = unwrap_asn1_tlv(&tbs, ASN1_SEQUENCE, &responses)) != NULL) {
+		return e;
+	}
+
+	bool found = false;
+	while (responses.len > 0) {
+		asn1_t single;
+		realtime_t this, next = realtime_epoch;
+		if ((e = unwrap_asn1_tlv(&responses, ASN1_SEQUENCE, &single)) != NULL ||
+		    (e = unwrap_asn1_tlv(&single, ASN1_SEQUENCE, &value)) != NULL /*certID*/ ||
+		    (e = unwrap_asn1_any(&single, &type, &value)) != NULL /*certStatus*/ ||
+		    (e = unwrap_asn1_generalized_time(&single, &this)) != NULL) {
+			return e;
+		}
+		if (asn1_peek(single, ASN1_CONTEXT_C_0)) {
+			asn1_t explicit;
+			if ((e = unwrap_asn1_tlv(&single, ASN1_CONTEXT_C_0, &explicit)) != NULL ||
+			    (e = unwrap_asn1_generalized_time(&explicit, &next)) != NULL) {
+				return e;
+			}
+		}
+		if (is_realtime_epoch(next)) {
+			next = realtimesum(this, OCSP_CACHE_DEFAULT_LIFETIME);
+		}
+		if (!found || realtime_cmp(next, <, *next_update)) {
+			*this_update = this;
+			*next_update = next;
+			found = true;
+		}
+	}
+
+	if (!found) {
+		return "OCSP response contains no responses";
+	}
+	return NULL;
+}
+
+void init_ocsp_cache(const char *default_responder, int max_entries,
+		     struct logger *logger)
+{
+	ocsp_cache_entry_db_init(logger);
+	if (max_entries <= 0) {
+		llog(RC_LOG, logger, "ocsp-prefetch=yes ignored as ocsp-cache-size=0 disables the cache");
+		return;
+	}
+	ocsp_cache_enabled = true;
+	ocsp_cache_max_entries = max_entries;
+	ocsp_cache_default_responder = clone_str(default_responder, "ocsp default responder");
+	llog(RC_LOG, logger, "OCSP responses will be prefetched (cache size %u)",
+	     ocsp_cache_max_entries);
+}
+
+bool prime_ocsp_cache(CERTCertDBHandle *handle, CERTCertificate *cert,
+		      struct logger *logger)
+{
+	if (!ocsp_cache_enabled) {
+		return false;
+	}
+
+	shunk_t issuer = same_secitem_as_shunk(cert->derIssuer);
+	shunk_t serial = same_secitem_as_shunk(cert->serialNumber);
+	realtime_t now = realnow();
+
+	chunk_t response = empty_chunk; /* must free */
+	bool queued = false;
+
+	pthread_mutex_lock(&ocsp_cache_mutex);
+	{
+		struct ocsp_cache_entry *entry = unlocked_ocsp_cache_entry(issuer, serial);
+		if (entry != NULL) {
+			entry->last_used = now;
+			if (entry->response.len > 0 &&
+			    realtime_cmp(now, <, entry->next_update)) {
+				response = clone_hunk(entry->response, "ocsp response");
+			}
+		} else if (ocsp_cache_entries < ocsp_cache_max_entries) {
+			char *responder = (ocsp_cache_default_responder != NULL ?
+					   clone_str(ocsp_cache_default_responder, "ocsp responder") :
+					   NULL);
+			if (responder == NULL) {
+				char *aia = CERT_GetOCSPAuthorityInfoAccessLocation(cert);
+				if (aia != NULL) {
+					responder = clone_str(aia, "ocsp responder");
+					PORT_Free(aia);
+				}
+			}
+			CERTCertificate *issuer_cert = CERT_FindCertIssuer(cert, PR_Now(),
+									   certUsageAnyCA);
+			if (responder != NULL && issuer_cert != NULL) {
+				struct ocsp_cache_entry new_entry = {
+					.issuer = clone_hunk(issuer, "ocsp issuer"),
+					.serial = clone_hunk(serial, "ocsp serial"),
+					.hash = hash_ocsp_key(issuer, serial),
+					.cert = CERT_DupCertificate(cert),
+					.issuer_cert = issuer_cert,
+					.responder = responder,
+					.refresh_time = now,
+					.last_used = now,
+				};
+				entry = clone_thing(new_entry, "ocsp cache entry");
+				ocsp_cache_entry_db_init_ocsp_cache_entry(entry);
+				ocsp_cache_entry_db_add(entry);
+				ocsp_cache_entries++;
+				queued = true;
+			} else {
+				pfreeany(responder);
+				if (issuer_cert != NULL) {
+					CERT_DestroyCertificate(issuer_cert);
+				}
+				ldbg(logger, "OCSP: no responder or issuer for %s", cert->subjectName);
+			}
+		} else {
+			ldbg(logger, "OCSP: cache full, %s not cached", cert->subjectName);
+		}
+	}
+	pthread_mutex_unlock(&ocsp_cache_mutex);
+
+	if (queued) {
+		/* the fetch thread may be sleeping with no deadline */
+		poke_crl_fetch_thread(logger);
+	}
+
+	if (response.len == 0) {
+		ldbg(logger, "OCSP: cache miss for %s%s", cert->subjectName,
+		     (queued ? "; queued for fetch" : ""));
+		return false;
+	}
+
+	/*
+	 * Hand the response to NSS; it verifies the signature and,
+	 * since the response is fresh, NSS won't go looking for
+	 * another.  A revoked response is still cached (and the
+	 * verifier then fails the certificate).
+	 */
+	SECItem si = same_chunk_as_secitem(response, siBuffer);
+	SECStatus rv = CERT_CacheOCSPResponseFromSideChannel(handle, cert, PR_Now(),
+							     &si, NULL);
+	free_chunk_content(&response);
+	if (rv != SECSuccess && PORT_GetError() != SEC_ERROR_REVOKED_CERTIFICATE) {
+		ldbg_nss_error(logger, "OCSP: cached response for %s rejected",
+			       cert->subjectName);
+		return false;
+	}
+
+	ldbg(logger, "OCSP: cache hit for %s", cert->subjectName);
+	return true;
+}
+
+/*
+ * Fetch (on the CRL fetch thread) a single response.
+ */
+
+static void fetch_ocsp_response(struct ocsp_cache_entry *entry, struct logger *logger)
+{
+	/* copy out what is needed; the lock is dropped while fetching */
+	CERTCertificate *cert = CERT_DupCertificate(entry->cert);
+	char *responder = clone_str(entry->responder, "ocsp responder");
+	chunk_t issuer = clone_hunk(entry->issuer, "ocsp issuer");
+	chunk_t serial = clone_hunk(entry->serial, "ocsp serial");
+
+	pthread_mutex_unlock(&ocsp_cache_mutex);
+
+	ldbg(logger, "OCSP: fetching response for %s from %s",
+	     cert->subjectName, responder);
+
+	CERTCertDBHandle *handle = CERT_GetDefaultCertDB();
+	passert(handle != NULL);
+
+	chunk_t response = empty_chunk;
+	realtime_t this_update = realtime_epoch;
+	realtime_t next_update = realtime_epoch;
+
+	CERTCertList *certs = CERT_NewCertList();
+	CERT_AddCertToListTail(certs, CERT_DupCertificate(cert));
+	SECItem *encoded = CERT_GetEncodedOCSPResponse(NULL, certs, responder,
+						       PR_Now(), PR_FALSE,
+						       NULL, NULL, NULL);
+	CERT_DestroyCertList(certs);
+
+	if (encoded == NULL) {
+		llog_nss_error(RC_LOG, logger, "OCSP: fetching response for %s from %s failed",
+			       cert->subjectName, responder);
+	} else if (CERT_CacheOCSPResponseFromSideChannel(handle, cert, PR_Now(),
+							 encoded, NULL) != SECSuccess &&
+		   PORT_GetError() != SEC_ERROR_REVOKED_CERTIFICATE) {
+		llog_nss_error(RC_LOG, logger, "OCSP: response for %s from %s rejected",
+			       cert->subjectName, responder);
+	} else {
+		err_t e = ocsp_response_times(same_secitem_as_shunk(*encoded),
+					      &this_update, &next_update);
+		if (e != NULL) {
+			llog(RC_LOG, logger, "OCSP: response for %s from %s invalid: %s",
+			     cert->subjectName, responder, e);
+		} else {
+			response = clone_secitem_as_chunk(*encoded, "ocsp response");
+		}
+	}
+	if (encoded != NULL) {
+		SECITEM_FreeItem(encoded, PR_TRUE);
+	}
+
+	CERT_DestroyCertificate(cert);
+	pfree(responder);
+
+	pthread_mutex_lock(&ocsp_cache_mutex);
+
+	/* while unlocked, the entry may have been deleted */
+	entry = unlocked_ocsp_cache_entry(HUNK_AS_SHUNK(issuer), HUNK_AS_SHUNK(serial));
+	free_chunk_content(&issuer);
+	free_chunk_content(&serial);
+	if (entry == NULL) {
+		free_chunk_content(&response);
+		return;
+	}
+
+	realtime_t now = realnow();
+	if (response.len == 0) {
+		entry->trials++;
+		deltatime_t backoff = deltatime_min(deltatime_mulu(OCSP_CACHE_RETRY_INTERVAL,
+								   entry->trials),
+						    OCSP_CACHE_MAX_RETRY);
+		entry->refresh_time = realtimesum(now, backoff);
+		return;
+	}
+
+	/*
+	 * Refresh once three quarters of the response's validity has
+	 * passed, leaving plenty of time to retry before it expires.
+	 */
+	free_chunk_content(&entry->response);
+	entry->response = response;
+	entry->this_update = this_update;
+	entry->next_update = next_update;
+	entry->trials = 0;
+	deltatime_t validity = realtimediff(next_update, this_update);
+	realtime_t refresh = realtimesum(this_update, deltatime_scale(validity, 3, 4));
+	realtime_t earliest = realtimesum(now, OCSP_CACHE_MIN_REFRESH);
+	entry->refresh_time = (realtime_cmp(refresh, <, earliest) ? earliest : refresh);
+
+	if (DBGP(DBG_BASE)) {
+		realtime_buf nub, rtb;
+		LDBG_log(logger, "OCSP: cached response, next update %s, refresh %s",
+			 str_realtime(entry->next_update, /*utc*/false, &nub),
+			 str_realtime(entry->refresh_time, /*utc*/false, &rtb));
+	}
+}
+
+realtime_t refresh_ocsp_cache(struct logger *logger)
+{
+	realtime_t wakeup = realtime_epoch;
+	if (!ocsp_cache_enabled) {
+		return wakeup;
+	}
+
+	pthread_mutex_lock(&ocsp_cache_mutex);
+	{
+		bool again;
+		do {
+			again = false;
+			struct ocsp_cache_entry *entry;
+			FOR_EACH_LIST_ENTRY_OLD2NEW(entry, &ocsp_cache_entry_db_list_head) {
+				if (exiting_pluto) {
+					break;
+				}
+				realtime_t now = realnow();
+				if (realtime_cmp(now, >=, realtimesum(entry->last_used,
+								      OCSP_CACHE_IDLE_LIFETIME))) {
+					LDBG_log(logger, "OCSP: dropping idle cache entry for %s",
+						 entry->cert->subjectName);
+					free_ocsp_cache_entry(&entry);
+					continue;
+				}
+				if (realtime_cmp(now, >=, entry->refresh_time)) {
+					/*
+					 * Drops and re-claims the lock;
+					 * the entry, and those after it,
+					 * may be gone so start over.
+					 */
+					fetch_ocsp_response(entry, logger);
+					again = true;
+					break;
+				}
+				if (is_realtime_epoch(wakeup) ||
+				    realtime_cmp(entry->refresh_time, <, wakeup)) {
+					wakeup = entry->refresh_time;
+				}
+			}
+		} while (again && !exiting_pluto);
+	}
+	pthread_mutex_unlock(&ocsp_cache_mutex);
+	return wakeup;
+}
+
+void list_ocsp_cache(struct show *s, bool utc)
+{
+	pthread_mutex_lock(&ocsp_cache_mutex);
+	{
+		if (ocsp_cache_entries > 0) {
+			show_blank(s);
+			show(s, "List of cached OCSP responses:");
+			show_blank(s);
+			const struct ocsp_cache_entry *entry;
+			FOR_EACH_LIST_ENTRY_OLD2NEW(entry, &ocsp_cache_entry_db_list_head) {
+				SHOW_JAMBUF(s, buf) {
+					jam_ocsp_cache_entry(buf, entry);
+				}
+				if (entry->response.len == 0) {
+					show(s, "       response: none, trials: %u",
+					     entry->trials);
+				} else {
+					realtime_buf tub, nub;
+					show(s, "       this update: %s, next update: %s",
+					     str_realtime(entry->this_update, utc, &tub),
+					     str_realtime(entry->next_update, utc, &nub));
+				}
+				realtime_buf rtb;
+				show(s, "       refresh: %s, responder: %s",
+				     str_realtime(entry->refresh_time, utc, &rtb),
+				     entry->responder);
+			}
+		}
+	}
+	pthread_mutex_unlock(&ocsp_cache_mutex);
+}
+
+void free_ocsp_cache(void)
+{
+	pthread_mutex_lock(&ocsp_cache_mutex);
+	{
+		struct ocsp_cache_entry *entry;
+		FOR_EACH_LIST_ENTRY_OLD2NEW(entry, &ocsp_cache_entry_db_list_head) {
+			free_ocsp_cache_entry(&entry);
+		}
+		ocsp_cache_entry_db_check(&global_logger);
+		pfreeany(ocsp_cache_default_responder);
+		ocsp_cache_enabled = false;
+	}
+	pthread_mutex_unlock(&ocsp_cache_mutex);
+}
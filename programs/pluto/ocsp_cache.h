@@ -0,0 +1,60 @@
+/* OCSP response cache, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef OCSP_CACHE_H
+#define OCSP_CACHE_H
+
+#include <stdbool.h>
+
+#include <cert.h>		/* for CERTCertificate et.al. */
+
+#include "realtime.h"
+
+struct logger;
+struct show;
+
+/*
+ * Pluto's own cache of OCSP responses, keyed by (issuer, serial).
+ *
+ * NSS, when left to its own devices, fetches OCSP responses while
+ * verifying the certificate (i.e., while an IKE_AUTH is waiting).
+ * Instead, the CRL fetch thread keeps this cache fresh (refreshing
+ * each response well before its nextUpdate) and the verifier feeds
+ * the cached response to NSS before validating the certificate.
+ */
+
+void init_ocsp_cache(const char *default_responder, int max_entries,
+		     struct logger *logger);
+void free_ocsp_cache(void);
+
+/*
+ * Called by the certificate verifier (main or helper thread).
+ *
+ * If there's a fresh response for CERT, feed it to NSS and return
+ * true.  Otherwise, queue CERT for fetching and return false.
+ */
+bool prime_ocsp_cache(CERTCertDBHandle *handle, CERTCertificate *cert,
+		      struct logger *logger);
+
+/*
+ * Called by the CRL fetch thread.  Fetch any responses that are
+ * missing or due for a refresh; return when the cache next needs
+ * attention (the epoch when there's nothing to do).
+ */
+realtime_t refresh_ocsp_cache(struct logger *logger);
+
+void list_ocsp_cache(struct show *s, bool utc);
+
+#endif
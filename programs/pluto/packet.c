@@ -1625,6 +1625,26 @@ struct_desc ikev2_skf_desc = {
 	.pt = ISAKMP_NEXT_v2SKF,
 };
 
+/*
+ * RFC 8019 8.2.  Puzzle Solution Payload
+ *
+ *                         1                   2                   3
+ *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    | Next Payload  |C|  RESERVED   |         Payload Length        |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                               |
+ *    ~                     Puzzle Solution Data                      ~
+ *    |                                                               |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+struct_desc ikev2_ps_desc = {
+	.name = "IKEv2 Puzzle Solution Payload",
+	.fields = ikev2generic_fields,
+	.size = sizeof(struct ikev2_generic),
+	.pt = ISAKMP_NEXT_v2PS,
+};
+
 /*
  * IKEv2 REDIRECT Payload - variable part
  *
@@ -1778,6 +1798,7 @@ struct_desc *v2_payload_desc(unsigned p)
 		NULL,				/* 51 */
 		NULL,				/* 52 */
 		&ikev2_skf_desc,                /* 53 ISAKMP_NEXT_v2SKF */
+		&ikev2_ps_desc,                 /* 54 ISAKMP_NEXT_v2PS */
 	};
 	if (p < ISAKMP_v2PAYLOAD_TYPE_BASE) {
 		return NULL;
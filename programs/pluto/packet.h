@@ -1202,6 +1202,7 @@ struct ikev2_skf {
 };
 
 extern struct_desc ikev2_skf_desc;
+extern struct_desc ikev2_ps_desc;
 
 /*
  * 3.12.  Vendor ID Payload
@@ -1,6 +1,7 @@
 /* AUTH PAM handling
  *
  * Copyright (C) 2017 Andrew Cagney
+ * Copyright (C) 2024 The Libreswan Project
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -14,6 +15,10 @@
  */
 
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>		/* for close() */
+#include <fcntl.h>
+#include <sys/socket.h>		/* for socketpair() */
 #include <sys/wait.h>		/* for WIFEXITED() et.al. */
 #include <signal.h>		/* for kill() and signals in general */
 
@@ -33,6 +38,10 @@
 #include "deltatime.h"
 #include "monotime.h"
 #include "server_fork.h"
+#include "server.h"		/* for schedule_resume() */
+#include "whack_shutdown.h"	/* for exiting_pluto */
+
+unsigned pluto_pam_workers;
 
 /* information for tracking pamauth PAM work in flight */
 
@@ -41,8 +50,64 @@ struct pam_auth {
 	struct pam_thread_arg ptarg;
 	monotime_t start_time;
 	pam_auth_callback_fn *callback;
-	pid_t child;
+	pid_t child;		/* when forked just for this request */
 	const char *aborted;
+	struct logger *logger;
+	/* when handed to a worker */
+	struct pam_worker *worker;
+	struct pam_auth *next;	/* in worker's queue */
+	unsigned id;
+	struct msg_digest *md;
+	bool success;
+};
+
+/*
+ * The worker pool; see pam-workers=.
+ *
+ * Each worker is a long-lived child forked at startup, fed requests
+ * over a SOCK_SEQPACKET socketpair().  A worker handles its requests
+ * one at a time, in order, so the head of its queue is the request
+ * currently being authenticated and the replies can be matched
+ * against the queue.
+ */
+
+struct pam_worker {
+	unsigned nr;
+	pid_t pid;		/* 0 when not running */
+	int fd;			/* pluto's end of the socketpair() */
+	int child_fd;		/* worker's end; only while forking */
+	struct fd_read_listener *fdl;
+	struct pam_auth *queue;
+	struct pam_auth **queue_tail;
+	unsigned queued;
+};
+
+static struct pam_worker *pam_workers;
+static unsigned pam_worker_requests;	/* for request IDs */
+
+/*
+ * Request: the header followed by the NUL terminated name, password,
+ * connection name and atype, in that order.
+ */
+
+#define PAM_WORKER_MESSAGE_SIZE 4096
+
+struct pam_worker_request {
+	unsigned id;
+	so_serial_t st_serialno;
+	unsigned long c_instance_serial;
+	ip_address rhost;
+	unsigned short len[4];
+};
+
+union pam_worker_message {
+	struct pam_worker_request request;
+	char buf[PAM_WORKER_MESSAGE_SIZE];
+};
+
+struct pam_worker_reply {
+	unsigned id;
+	bool success;
 };
 
 static void pam_auth_free(struct pam_auth **p)
@@ -52,9 +117,18 @@ static void pam_auth_free(struct pam_auth **p)
 	pfree(x->ptarg.name);
 	pfree(x->ptarg.password);
 	pfree(x->ptarg.c_name);
+	md_delref(&x->md);
+	free_logger(&x->logger, HERE);
 	pfree(x);
 }
 
+static bool start_pam_worker(struct pam_worker *worker, struct logger *logger);
+static bool send_to_pam_worker(struct pam_auth *pamauth);
+static bool fork_pam_process(struct pam_auth *pamauth, struct msg_digest *md);
+static stf_status pam_auth_done(struct state *st, struct msg_digest *md,
+				struct pam_auth *pamauth, bool success,
+				struct logger *logger);
+
 /*
  * Abort the transaction, disconnecting it from state.
  *
@@ -85,11 +159,24 @@ void pam_auth_abort(struct state *st, const char *story)
 	 * XXX: need to fix child so that more friendly SIGTERM is
 	 * handled - currently the forked process has it blocked by
 	 * libevent.
+	 *
+	 * When a worker is busy with the request, kill the worker
+	 * (it is restarted); when the request is still queued, or
+	 * the result is waiting to be resumed, just let it be
+	 * discarded.
 	 */
-	kill(pamauth->child, SIGKILL);
+	if (pamauth->worker != NULL) {
+		if (pamauth->worker->queue == pamauth &&
+		    pamauth->worker->pid > 0) {
+			kill(pamauth->worker->pid, SIGKILL);
+		}
+	} else if (pamauth->child > 0) {
+		kill(pamauth->child, SIGKILL);
+	}
 	/*
 	 * PAMAUTH is deleted by pam_auth_callback() _after_ the
-	 * process exits and the callback has been called.
+	 * process exits and the callback has been called (or, with
+	 * a worker, once the worker has replied or exited).
 	 *
 	 * Free ST of any responsibility for releasing .st_pam_auth
 	 * (the fork handler will do that later).
@@ -113,12 +200,23 @@ static stf_status pam_callback(struct state *st,
 			       struct logger *logger)
 {
 	struct pam_auth *pamauth = arg;
+	bool success = (WIFEXITED(status) &&
+			WEXITSTATUS(status) == 0);
+	return pam_auth_done(st, md, pamauth, success, logger);
+}
+
+/*
+ * Log the result, notify the state (if it is present), and then
+ * release everything.
+ */
 
+static stf_status pam_auth_done(struct state *st, struct msg_digest *md,
+				struct pam_auth *pamauth, bool success,
+				struct logger *logger)
+{
 	pstats_pamauth_stopped++;
 
-	bool success = (pamauth->aborted == NULL &&
-			WIFEXITED(status) &&
-			WEXITSTATUS(status) == 0);
+	success = (success && pamauth->aborted == NULL);
 
 	LLOG_JAMBUF(RC_LOG, logger, buf) {
 		jam(buf, "PAM: authentication of user '%s' ", pamauth->ptarg.name);
@@ -167,6 +265,18 @@ static int pam_child(void *arg, struct logger *logger)
 	return success ? 0 : 1;
 }
 
+static bool fork_pam_process(struct pam_auth *pamauth, struct msg_digest *md)
+{
+	dbg("PAM: #%lu: main-process starting PAM-process for authenticating user '%s'",
+	    pamauth->serialno, pamauth->ptarg.name);
+	pamauth->worker = NULL;
+	pamauth->child = server_fork("pamauth", pamauth->serialno, md,
+				     pam_child,
+				     pam_callback, pamauth,
+				     pamauth->logger);
+	return (pamauth->child >= 0);
+}
+
 bool pam_auth_fork_request(struct state *st,
 			   struct msg_digest *md,
 			   const char *name,
@@ -183,6 +293,7 @@ bool pam_auth_fork_request(struct state *st,
 	pamauth->callback = callback;
 	pamauth->serialno = serialno;
 	pamauth->start_time = mononow();
+	pamauth->logger = clone_logger(st->logger, HERE);
 
 	/* fill in pam_thread_arg with info for the child process */
 
@@ -195,21 +306,375 @@ bool pam_auth_fork_request(struct state *st,
 	pamauth->ptarg.c_instance_serial = st->st_connection->instance_serial;
 	pamauth->ptarg.atype = atype;
 
-	dbg("PAM: #%lu: main-process starting PAM-process for authenticating user '%s'",
-	    pamauth->serialno, pamauth->ptarg.name);
-	pamauth->child = server_fork("pamauth", pamauth->serialno, md,
-				     pam_child,
-				     pam_callback, pamauth,
-				     st->logger);
-	if (pamauth->child < 0) {
-		log_state(RC_LOG, st,
-			  "PAM: creation of PAM authentication process for user '%s' failed",
-			  pamauth->ptarg.name);
-		pam_auth_free(&pamauth);
-		return false;
+	/* prefer an existing worker; fall back to a fork */
+	pamauth->md = md_addref(md);
+	if (!send_to_pam_worker(pamauth)) {
+		md_delref(&pamauth->md);
+		if (!fork_pam_process(pamauth, md)) {
+			log_state(RC_LOG, st,
+				  "PAM: creation of PAM authentication process for user '%s' failed",
+				  pamauth->ptarg.name);
+			pam_auth_free(&pamauth);
+			return false;
+		}
 	}
 
 	st->st_pam_auth = pamauth;
 	pstats_pamauth_started++;
 	return true;
 }
+
+/*
+ * The worker pool.
+ */
+
+static bool pack_pam_string(char *buf, size_t *offset, unsigned short *len,
+			    const char *string)
+{
+	size_t l = strlen(string) + 1;
+	if (*offset + l > PAM_WORKER_MESSAGE_SIZE) {
+		return false;
+	}
+	memcpy(buf + *offset, string, l);
+	*offset += l;
+	*len = l;
+	return true;
+}
+
+static char *unpack_pam_string(char *buf, size_t size, size_t *offset,
+			       unsigned short len)
+{
+	if (len == 0 || *offset + len > size ||
+	    buf[*offset + len - 1] != '\0') {
+		return NULL;
+	}
+	char *string = buf + *offset;
+	*offset += len;
+	return string;
+}
+
+/*
+ * Hand PAMAUTH to the least busy worker; the caller falls back to a
+ * fork when there's no worker or the request can't be sent.
+ */
+
+static bool send_to_pam_worker(struct pam_auth *pamauth)
+{
+	struct pam_worker *worker = NULL;
+	for (unsigned w = 0; w < pluto_pam_workers; w++) {
+		if (pam_workers[w].pid > 0 &&
+		    (worker == NULL || pam_workers[w].queued < worker->queued)) {
+			worker = &pam_workers[w];
+		}
+	}
+	if (worker == NULL) {
+		return false;
+	}
+
+	union pam_worker_message message;
+	char *buf = message.buf;
+	struct pam_worker_request *request = &message.request;
+	zero(request);
+	request->id = ++pam_worker_requests;
+	request->st_serialno = pamauth->ptarg.st_serialno;
+	request->c_instance_serial = pamauth->ptarg.c_instance_serial;
+	request->rhost = pamauth->ptarg.rhost;
+	size_t size = sizeof(*request);
+	bool ok = (pack_pam_string(buf, &size, &request->len[0], pamauth->ptarg.name) &&
+		   pack_pam_string(buf, &size, &request->len[1], pamauth->ptarg.password) &&
+		   pack_pam_string(buf, &size, &request->len[2], pamauth->ptarg.c_name) &&
+		   pack_pam_string(buf, &size, &request->len[3], pamauth->ptarg.atype));
+	if (!ok) {
+		llog(RC_LOG, pamauth->logger,
+		     "PAM: request for user '%s' is too big for a PAM worker",
+		     pamauth->ptarg.name);
+	} else if (send(worker->fd, buf, size, MSG_DONTWAIT) != (ssize_t)size) {
+		llog_error(pamauth->logger, errno,
+			   "PAM: sending request for user '%s' to PAM worker %u failed: ",
+			   pamauth->ptarg.name, worker->nr);
+		ok = false;
+	}
+	memset(buf, 0, size); /* the password */
+	if (!ok) {
+		return false;
+	}
+
+	dbg("PAM: #%lu: PAM worker %u (pid %d) queued request %u for authenticating user '%s'",
+	    pamauth->serialno, worker->nr, worker->pid, request->id,
+	    pamauth->ptarg.name);
+	pamauth->id = request->id;
+	pamauth->worker = worker;
+	pamauth->child = 0;
+	pamauth->next = NULL;
+	*worker->queue_tail = pamauth;
+	worker->queue_tail = &pamauth->next;
+	worker->queued++;
+	return true;
+}
+
+static struct pam_auth *dequeue_pam_auth(struct pam_worker *worker)
+{
+	struct pam_auth *pamauth = worker->queue;
+	if (pamauth != NULL) {
+		worker->queue = pamauth->next;
+		if (worker->queue == NULL) {
+			worker->queue_tail = &worker->queue;
+		}
+		worker->queued--;
+		pamauth->next = NULL;
+		pamauth->worker = NULL;
+	}
+	return pamauth;
+}
+
+static resume_cb pam_worker_resume; /* type assertion */
+
+static stf_status pam_worker_resume(struct state *st,
+				    struct msg_digest *md,
+				    void *context)
+{
+	struct pam_auth *pamauth = context;
+	stf_status ret = pam_auth_done(st, md, pamauth, pamauth->success,
+				       (st != NULL ? st->logger : pamauth->logger));
+	return (st == NULL ? STF_SKIP_COMPLETE_STATE_TRANSITION : ret);
+}
+
+/*
+ * Either finish off an aborted request now, or schedule the state's
+ * callback.
+ */
+
+static void pam_worker_done(struct pam_auth *pamauth, bool success)
+{
+	if (pamauth->aborted != NULL) {
+		pam_auth_done(NULL, NULL, pamauth, false, pamauth->logger);
+		return;
+	}
+	pamauth->success = success;
+	schedule_resume("pamauth", pamauth->serialno, &pamauth->md,
+			pam_worker_resume, pamauth);
+}
+
+static void pam_worker_listener(int fd, void *arg, struct logger *logger)
+{
+	struct pam_worker *worker = arg;
+	PASSERT(logger, worker->fd == fd);
+	while (true) {
+		struct pam_worker_reply reply;
+		ssize_t len = recv(fd, &reply, sizeof(reply), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				llog_error(logger, errno,
+					   "PAM: reading PAM worker %u failed: ",
+					   worker->nr);
+			}
+			return;
+		}
+		if (len == 0) {
+			/* EOF; the exit is handled by pam_worker_exited() */
+			return;
+		}
+		struct pam_auth *pamauth = dequeue_pam_auth(worker);
+		if (len != sizeof(reply) || pamauth == NULL ||
+		    !PEXPECT(logger, reply.id == pamauth->id)) {
+			llog(RC_LOG, logger, "PAM: PAM worker %u sent an unexpected reply; killing it",
+			     worker->nr);
+			if (pamauth != NULL) {
+				pam_worker_done(pamauth, false);
+			}
+			if (worker->pid > 0) {
+				kill(worker->pid, SIGKILL);
+			}
+			return;
+		}
+		dbg("PAM: #%lu: PAM worker %u completed request %u for user '%s' with result %s",
+		    pamauth->serialno, worker->nr, reply.id, pamauth->ptarg.name,
+		    reply.success ? "SUCCESS" : "FAILURE");
+		pam_worker_done(pamauth, reply.success);
+	}
+}
+
+/*
+ * Perform authentications in the worker process.
+ */
+
+static int pam_worker_child(void *arg, struct logger *logger)
+{
+	struct pam_worker *worker = arg;
+	int fd = worker->child_fd;
+
+	/* drop pluto's end of every worker's socketpair() */
+	for (unsigned w = 0; w < pluto_pam_workers; w++) {
+		if (pam_workers[w].fd >= 0) {
+			close(pam_workers[w].fd);
+		}
+	}
+
+	while (true) {
+		union pam_worker_message message;
+		char *buf = message.buf;
+		ssize_t size = recv(fd, buf, sizeof(message.buf), 0);
+		if (size < 0 && errno == EINTR) {
+			continue;
+		}
+		if (size <= 0) {
+			/* pluto went away */
+			return 0;
+		}
+
+		struct pam_worker_request *request = &message.request;
+		struct pam_worker_reply reply = {
+			.success = false,
+		};
+		size_t offset = sizeof(*request);
+		char *strings[4] = {0};
+		bool ok = ((size_t)size >= sizeof(*request));
+		for (unsigned i = 0; ok && i < elemsof(strings); i++) {
+			strings[i] = unpack_pam_string(buf, size, &offset, request->len[i]);
+			ok = (strings[i] != NULL);
+		}
+		if (ok) {
+			struct pam_thread_arg ptarg = {
+				.name = strings[0],
+				.password = strings[1],
+				.c_name = strings[2],
+				.atype = strings[3],
+				.rhost = request->rhost,
+				.st_serialno = request->st_serialno,
+				.c_instance_serial = request->c_instance_serial,
+			};
+			reply.id = request->id;
+			dbg("PAM: #%lu: PAM worker %u authenticating user '%s'",
+			    ptarg.st_serialno, worker->nr, ptarg.name);
+			reply.success = do_pam_authentication(&ptarg, logger);
+		}
+		memset(buf, 0, sizeof(message.buf)); /* the password */
+
+		if (send(fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+			return 1;
+		}
+	}
+}
+
+static server_fork_cb pam_worker_exited; /* type assertion */
+
+static stf_status pam_worker_exited(struct state *st UNUSED,
+				    struct msg_digest *md UNUSED,
+				    int status, void *arg,
+				    struct logger *logger)
+{
+	struct pam_worker *worker = arg;
+
+	/* collect anything sent before it died */
+	worker->pid = 0;
+	pam_worker_listener(worker->fd, worker, logger);
+	detach_fd_read_listener(&worker->fdl);
+	close(worker->fd);
+	worker->fd = -1;
+
+	/* take the requests still queued, in order */
+	struct pam_auth *requests = worker->queue;
+	worker->queue = NULL;
+	worker->queue_tail = &worker->queue;
+	worker->queued = 0;
+
+	if (!exiting_pluto) {
+		llog(RC_LOG, logger, "PAM: PAM worker %u exited with %s %d; restarting it",
+		     worker->nr,
+		     (WIFSIGNALED(status) ? "signal" : "status"),
+		     (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)));
+		start_pam_worker(worker, logger);
+	}
+
+	/*
+	 * The request being authenticated died with the worker; the
+	 * ones queued behind it are handed to another worker (or,
+	 * failing that, their own process).
+	 */
+	bool head = true;
+	while (requests != NULL) {
+		struct pam_auth *pamauth = requests;
+		requests = pamauth->next;
+		pamauth->next = NULL;
+		pamauth->worker = NULL;
+		if (head || pamauth->aborted != NULL || exiting_pluto) {
+			pam_worker_done(pamauth, false);
+		} else if (send_to_pam_worker(pamauth)) {
+			/* requeued */
+		} else if (fork_pam_process(pamauth, pamauth->md)) {
+			/* the fork holds its own MD reference */
+			md_delref(&pamauth->md);
+		} else {
+			pam_worker_done(pamauth, false);
+		}
+		head = false;
+	}
+	return STF_OK;
+}
+
+static bool start_pam_worker(struct pam_worker *worker, struct logger *logger)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, fds) < 0) {
+		llog_error(logger, errno, "PAM: socketpair() for PAM worker %u failed: ",
+			   worker->nr);
+		return false;
+	}
+
+	worker->fd = fds[0];
+	worker->child_fd = fds[1];
+	pid_t pid = server_fork("pamauth-worker", SOS_NOBODY, /*md*/NULL,
+				pam_worker_child,
+				pam_worker_exited, worker,
+				logger);
+	close(worker->child_fd);
+	worker->child_fd = -1;
+	if (pid < 0) {
+		close(worker->fd);
+		worker->fd = -1;
+		return false;
+	}
+
+	worker->pid = pid;
+	attach_fd_read_listener(&worker->fdl, worker->fd, "pamauth-worker",
+				pam_worker_listener, worker);
+	ldbg(logger, "PAM: started PAM worker %u (pid %d)", worker->nr, pid);
+	return true;
+}
+
+void start_pam_auth_workers(struct logger *logger)
+{
+	if (pluto_pam_workers == 0) {
+		return;
+	}
+	pam_workers = alloc_things(struct pam_worker, pluto_pam_workers, "pam workers");
+	unsigned started = 0;
+	for (unsigned w = 0; w < pluto_pam_workers; w++) {
+		struct pam_worker *worker = &pam_workers[w];
+		worker->nr = w + 1;
+		worker->fd = -1;
+		worker->child_fd = -1;
+		worker->queue_tail = &worker->queue;
+		if (start_pam_worker(worker, logger)) {
+			started++;
+		}
+	}
+	llog(RC_LOG, logger, "started %u PAM worker processes", started);
+}
+
+void stop_pam_auth_workers(struct logger *logger)
+{
+	if (pam_workers == NULL) {
+		return;
+	}
+	for (unsigned w = 0; w < pluto_pam_workers; w++) {
+		struct pam_worker *worker = &pam_workers[w];
+		if (worker->pid > 0) {
+			pid_t pid = worker->pid;
+			kill(pid, SIGKILL);
+			/* calls pam_worker_exited() */
+			server_fork_wait(pid, logger);
+		}
+	}
+	pfreeany(pam_workers);
+}
@@ -24,6 +24,7 @@
 
 struct state;
 struct msg_digest;
+struct logger;
 
 typedef stf_status pam_auth_callback_fn(struct state *st,
 					struct msg_digest *md,
@@ -42,4 +43,13 @@ bool pam_auth_fork_request(struct state *st,
 			   const char *atype,
 			   pam_auth_callback_fn *callback);
 
+/*
+ * Pool of pre-forked PAM worker processes; see pam-workers=.  When
+ * zero (or no worker is available) each request forks its own
+ * process.
+ */
+extern unsigned pluto_pam_workers;
+void start_pam_auth_workers(struct logger *logger);
+void stop_pam_auth_workers(struct logger *logger);
+
 #endif
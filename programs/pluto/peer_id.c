@@ -113,6 +113,21 @@ static asn1_t get_peer_ca(struct pubkey_list *const *pubkey_db,
 	return null_shunk;
 }
 
+static asn1_t get_preloaded_peer_ca(const struct id *peer_id)
+{
+	struct preloaded_pubkey_filter pkf = {
+		.id = peer_id,
+		.type = &pubkey_type_rsa,
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		struct pubkey *key = pkf.key;
+		if (same_id(peer_id, &key->id))
+			return key->issuer;
+	}
+	return null_shunk;
+}
+
 /*
  * During the IKE_SA_INIT exchange, the responder state's connection
  * is chosen based on the initiator's address (perhaps with minor
@@ -559,7 +574,7 @@ static struct connection *refine_host_connection_on_responder(int indent,
 	PEXPECT(ike->sa.logger, ike->sa.st_remote_certs.processed);
 	asn1_t peer_ca = get_peer_ca(&ike->sa.st_remote_certs.pubkey_db, peer_id);
 	if (hunk_isempty(peer_ca)) {
-		peer_ca = get_peer_ca(&pluto_pubkeys, peer_id);
+		peer_ca = get_preloaded_peer_ca(peer_id);
 	}
 
 	/*
@@ -0,0 +1,251 @@
+/* per-connection and per-peer cost accounting, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include <stdlib.h>		/* for qsort() */
+
+#include "defs.h"
+#include "log.h"
+#include "show.h"
+#include "state.h"
+#include "connections.h"
+#include "hash_table.h"
+#include "pluto_cost.h"
+
+/*
+ * Peers can be spoofed so cap the number tracked; any more are lumped
+ * together.
+ */
+#define MAX_COST_CONNECTIONS 1024
+#define MAX_COST_PEERS 4096
+#define COST_STATUS_TOP 20
+
+struct cost_table {
+	const char *what;
+	unsigned nr;
+	unsigned max;
+	struct cost *other;
+};
+
+static struct cost_table connection_costs = { .what = "connection", .max = MAX_COST_CONNECTIONS, };
+static struct cost_table peer_costs = { .what = "peer", .max = MAX_COST_PEERS, };
+
+struct cost {
+	char *name;
+	const struct cost_table *table;
+	uintmax_t sas;
+	uintmax_t exchanges;
+	uintmax_t failures;
+	double main_seconds;
+	double helper_seconds;
+	struct {
+		struct list_entry list;
+		struct list_entry name;
+	} cost_db_entries;
+};
+
+static size_t jam_cost(struct jambuf *buf, const struct cost *c)
+{
+	return jam(buf, "%s %s", c->table->what, c->name);
+}
+
+static hash_t hash_cost_name(char *const *name)
+{
+	return hash_bytes(*name, strlen(*name), zero_hash);
+}
+
+HASH_TABLE(cost, name, .name, 256);
+
+static void cost_db_init(struct logger *logger);
+static void cost_db_check(struct logger *logger);
+static void cost_db_init_cost(struct cost *);
+static void cost_db_add(struct cost *);
+static void cost_db_del(struct cost *);
+
+HASH_DB(cost, &cost_name_hash_table);
+
+void init_cost_status(struct logger *logger)
+{
+	cost_db_init(logger);
+}
+
+static struct cost *alloc_cost(const struct cost_table *table, const char *name)
+{
+	struct cost *c = alloc_thing(struct cost, "cost");
+	c->name = clone_str(name, "cost name");
+	c->table = table;
+	return c;
+}
+
+static void free_cost(struct cost **c)
+{
+	pfree((*c)->name);
+	pfree(*c);
+	*c = NULL;
+}
+
+static struct cost *cost_by_name(struct cost_table *table, const char *name)
+{
+	/* same as hash_cost_name() */
+	hash_t hash = hash_bytes(name, strlen(name), zero_hash);
+	struct list_head *bucket = hash_table_bucket(&cost_name_hash_table, hash);
+	struct cost *c;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(c, bucket) {
+		if (c->table == table && streq(c->name, name)) {
+			return c;
+		}
+	}
+	if (table->nr >= table->max) {
+		if (table->other == NULL) {
+			table->other = alloc_cost(table, "(other)");
+		}
+		return table->other;
+	}
+	c = alloc_cost(table, name);
+	cost_db_init_cost(c);
+	cost_db_add(c);
+	table->nr++;
+	return c;
+}
+
+void count_state_transition(struct state *st, stf_status status)
+{
+	switch (status) {
+	case STF_SKIP_COMPLETE_STATE_TRANSITION:
+	case STF_IGNORE:
+	case STF_SUSPEND:
+		return;
+	case STF_OK:
+	case STF_OK_INITIATOR_DELETE_IKE:
+	case STF_OK_INITIATOR_SEND_DELETE_IKE:
+	case STF_OK_RESPONDER_DELETE_IKE:
+		break;
+	case STF_INTERNAL_ERROR:
+	case STF_FATAL:
+	default: /* STF_FAIL_v1N+N */
+		st->st_transitions.failed++;
+		break;
+	}
+	st->st_transitions.completed++;
+}
+
+static void add_cost(struct cost *c, const struct state *st)
+{
+	c->sas++;
+	c->exchanges += st->st_transitions.completed;
+	c->failures += st->st_transitions.failed;
+	c->main_seconds += st->st_timing.main_usage.thread_seconds;
+	c->helper_seconds += st->st_timing.helper_usage.thread_seconds;
+}
+
+void record_state_cost(const struct state *st)
+{
+	const struct connection *c = st->st_connection;
+	if (c == NULL) {
+		return;
+	}
+
+	/* instances are billed to their template */
+	const struct connection *root = c;
+	while (root->clonedfrom != NULL) {
+		root = root->clonedfrom;
+	}
+	add_cost(cost_by_name(&connection_costs, root->name), st);
+
+	char name[sizeof(id_buf) + sizeof(address_buf)];
+	struct jambuf buf = ARRAY_AS_JAMBUF(name);
+	jam_id_bytes(&buf, &c->remote->host.id, jam_sanitized_bytes);
+	jam_string(&buf, " ");
+	ip_address remote = endpoint_address(st->st_remote_endpoint);
+	jam_address(&buf, &remote);
+	add_cost(cost_by_name(&peer_costs, name), st);
+}
+
+static double cost_seconds(const struct cost *c)
+{
+	return c->main_seconds + c->helper_seconds;
+}
+
+static int cost_cmp(const void *l, const void *r)
+{
+	const struct cost *const *lc = l;
+	const struct cost *const *rc = r;
+	double ls = cost_seconds(*lc);
+	double rs = cost_seconds(*rc);
+	/* most expensive first */
+	return (ls < rs ? 1 : ls > rs ? -1 : strcmp((*lc)->name, (*rc)->name));
+}
+
+static void show_cost_table(struct show *s, const struct cost_table *table)
+{
+	unsigned nr = table->nr + (table->other != NULL ? 1 : 0);
+	show_separator(s);
+	show(s, "%s costs (top %u of %u, by CPU seconds):",
+	     table->what, (nr < COST_STATUS_TOP ? nr : COST_STATUS_TOP), nr);
+	if (nr == 0) {
+		return;
+	}
+
+	const struct cost **costs = alloc_things(const struct cost *, nr, "costs");
+	unsigned n = 0;
+	const struct cost *c;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(c, &cost_db_list_head) {
+		if (c->table == table) {
+			costs[n++] = c;
+		}
+	}
+	if (table->other != NULL) {
+		costs[n++] = table->other;
+	}
+	PASSERT(show_logger(s), n == nr);
+	qsort(costs, nr, sizeof(costs[0]), cost_cmp);
+
+	for (unsigned i = 0; i < nr && i < COST_STATUS_TOP; i++) {
+		c = costs[i];
+		show(s, "  %s: cpu %.3f (main %.3f helper %.3f) seconds, %ju SAs, %ju exchanges, %ju failed",
+		     c->name, cost_seconds(c), c->main_seconds, c->helper_seconds,
+		     c->sas, c->exchanges, c->failures);
+	}
+	pfree(costs);
+}
+
+void show_cost_status(struct show *s)
+{
+	show_cost_table(s, &connection_costs);
+	show_cost_table(s, &peer_costs);
+}
+
+static void clear_cost_table(struct cost_table *table)
+{
+	struct cost *c;
+	FOR_EACH_LIST_ENTRY_OLD2NEW(c, &cost_db_list_head) {
+		if (c->table == table) {
+			cost_db_del(c);
+			free_cost(&c);
+		}
+	}
+	if (table->other != NULL) {
+		free_cost(&table->other);
+	}
+	table->nr = 0;
+}
+
+void clear_cost_status(void)
+{
+	dbg("clearing cost accounting");
+	clear_cost_table(&connection_costs);
+	clear_cost_table(&peer_costs);
+	cost_db_check(&global_logger);
+}
@@ -0,0 +1,42 @@
+/* per-connection and per-peer cost accounting, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef PLUTO_COST_H
+#define PLUTO_COST_H
+
+#include "pluto_constants.h"	/* for stf_status */
+
+struct state;
+struct show;
+struct logger;
+
+/*
+ * When a state is deleted, its CPU usage (see st_timing) and
+ * transition counts are added to totals kept for its connection
+ * template (the connection an instance was cloned from) and for its
+ * peer (remote ID and address).
+ *
+ * whack --coststatus shows the most expensive of each; whack
+ * --clearstats resets them.
+ */
+
+void init_cost_status(struct logger *logger);
+void count_state_transition(struct state *st, stf_status status);
+void record_state_cost(const struct state *st);
+void show_cost_status(struct show *s);
+void clear_cost_status(void);
+
+#endif
@@ -0,0 +1,534 @@
+/* latency histograms, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include "defs.h"
+#include "log.h"
+#include "show.h"
+#include "demux.h"		/* for struct msg_digest */
+#include "message_role.h"
+#include "pluto_latency.h"
+#include "names_constant.h"	/* for exchange_type_names */
+
+/*
+ * Bucket N counts times in [2^N, 2^(N+1)) microseconds (bucket 0
+ * also gets 0); the last bucket, ~35 minutes, catches everything
+ * longer.
+ */
+
+#define LATENCY_BUCKETS 32
+
+struct histogram {
+	uintmax_t bucket[LATENCY_BUCKETS];
+	uintmax_t max;		/* microseconds */
+};
+
+/* STF_IGNORE..STF_FAIL_v1N; STF_FAIL_v1N+N is counted as STF_FAIL_v1N */
+#define STATUS_FLOOR STF_IGNORE
+#define STATUS_ROOF (STF_FAIL_v1N + 1)
+
+struct latency {
+	char *name;
+	uintmax_t count;
+	struct histogram wall;
+	struct histogram cpu;
+	struct histogram wait;			/* tasks only */
+	uintmax_t status[STATUS_ROOF - STATUS_FLOOR]; /* transitions only */
+	struct latency *next;
+};
+
+struct latency_class {
+	const char *what;
+	struct latency *head;
+	struct latency **tail;
+};
+
+static struct latency_class transitions = { .what = "transition", .tail = &transitions.head, };
+static struct latency_class tasks = { .what = "task", .tail = &tasks.head, };
+static struct latency_class whacks = { .what = "whack", .tail = &whacks.head, };
+
+/*
+ * State transitions are frequent so index them directly; the
+ * exchange is the 8-bit header field.
+ */
+static struct latency *transition_latency[IKE_VERSION_ROOF][256][MESSAGE_ROLE_ROOF];
+
+static struct latency *alloc_latency(struct latency_class *class, char *name)
+{
+	struct latency *l = alloc_thing(struct latency, "latency");
+	l->name = name;
+	*class->tail = l;
+	class->tail = &l->next;
+	return l;
+}
+
+/* helper tasks and whack commands are few; a search is fine */
+static struct latency *latency_by_name(struct latency_class *class, const char *name)
+{
+	for (struct latency *l = class->head; l != NULL; l = l->next) {
+		if (streq(l->name, name)) {
+			return l;
+		}
+	}
+	return alloc_latency(class, clone_str(name, "latency name"));
+}
+
+static uintmax_t microseconds(double seconds)
+{
+	return (seconds <= 0 ? 0 : (uintmax_t)(seconds * 1000 * 1000));
+}
+
+static uintmax_t deltatime_microseconds(deltatime_t d)
+{
+	struct timeval t = timeval_from_deltatime(d);
+	return (t.tv_sec < 0 ? 0 : (uintmax_t)t.tv_sec * 1000 * 1000 + t.tv_usec);
+}
+
+static deltatime_t deltatime_from_microseconds(uintmax_t us)
+{
+	return deltatime_from_timeval((struct timeval) {
+			.tv_sec = us / 1000 / 1000,
+			.tv_usec = us % (1000 * 1000),
+		});
+}
+
+static void histogram_add(struct histogram *h, uintmax_t us)
+{
+	unsigned b = 0;
+	for (uintmax_t v = us; v > 1 && b < LATENCY_BUCKETS - 1; v >>= 1) {
+		b++;
+	}
+	h->bucket[b]++;
+	if (us > h->max) {
+		h->max = us;
+	}
+}
+
+static void latency_add(struct latency *l, struct cpu_usage usage)
+{
+	l->count++;
+	histogram_add(&l->wall, microseconds(usage.wall_seconds));
+	histogram_add(&l->cpu, microseconds(usage.thread_seconds));
+}
+
+/*
+ * Messages.
+ */
+
+static threadtime_t md_resumed(const struct msg_digest *md)
+{
+	/* never suspended? */
+	return (md->md_resumed.wall_clock.tv_sec == 0 &&
+		md->md_resumed.wall_clock.tv_nsec == 0 ? md->md_inception :
+		md->md_resumed);
+}
+
+void md_latency_suspend(struct msg_digest *md)
+{
+	if (md == NULL) {
+		return;
+	}
+	threadtime_t resumed = md_resumed(md);
+	struct cpu_usage slice = threadtime_usage(&resumed);
+	cpu_usage_add(md->md_usage, slice);
+}
+
+void md_latency_resume(struct msg_digest *md)
+{
+	if (md == NULL) {
+		return;
+	}
+	md->md_resumed = threadtime_start();
+}
+
+void record_transition_latency(const struct msg_digest *md, stf_status status)
+{
+	if (md == NULL ||
+	    (md->md_inception.wall_clock.tv_sec == 0 &&
+	     md->md_inception.wall_clock.tv_nsec == 0)) {
+		/* for instance, an initiator's fake MD */
+		return;
+	}
+
+	enum ike_version ike_version = hdr_ike_version(&md->hdr);
+	if (ike_version < IKE_VERSION_FLOOR || ike_version >= IKE_VERSION_ROOF) {
+		return;
+	}
+	unsigned exchange = md->hdr.isa_xchg;
+	enum message_role role = (ike_version == IKEv2 ? v2_msg_role(md) : NO_MESSAGE);
+
+	struct latency **slot = &transition_latency[ike_version][exchange][role];
+	if (*slot == NULL) {
+		char name[100];
+		struct jambuf buf = ARRAY_AS_JAMBUF(name);
+		jam(&buf, "ikev%d.", ike_version);
+		jam_enum_enum_short(&buf, &exchange_type_names, ike_version, exchange);
+		switch (role) {
+		case MESSAGE_REQUEST: jam_string(&buf, ".request"); break;
+		case MESSAGE_RESPONSE: jam_string(&buf, ".response"); break;
+		case NO_MESSAGE: break;
+		}
+		*slot = alloc_latency(&transitions, clone_str(name, "latency name"));
+	}
+	struct latency *l = *slot;
+
+	/* wall is from when the message was read; CPU is only while busy */
+	threadtime_t inception = md->md_inception;
+	threadtime_t resumed = md_resumed(md);
+	struct cpu_usage usage = md->md_usage;
+	cpu_usage_add(usage, threadtime_usage(&resumed));
+	usage.wall_seconds = threadtime_usage(&inception).wall_seconds;
+	latency_add(l, usage);
+
+	if (status >= STF_FAIL_v1N) {
+		status = STF_FAIL_v1N;
+	}
+	if (status >= STATUS_FLOOR) {
+		l->status[status - STATUS_FLOOR]++;
+	}
+}
+
+void record_task_latency(const char *name, deltatime_t wait,
+			 struct cpu_usage compute)
+{
+	struct latency *l = latency_by_name(&tasks, name);
+	latency_add(l, compute);
+	histogram_add(&l->wait, deltatime_microseconds(wait));
+}
+
+void record_whack_latency(const char *command, struct cpu_usage usage)
+{
+	latency_add(latency_by_name(&whacks, command), usage);
+}
+
+/*
+ * Helper pool.
+ *
+ * Unlike the per-task wait, which is only recorded when the task
+ * completes, this counts every job taken off the backlog, including
+ * those cancelled or thrown away as stale.
+ */
+
+static struct {
+	uintmax_t count;
+	struct histogram histogram;
+} backlog_wait;
+
+void record_backlog_wait(deltatime_t wait)
+{
+	backlog_wait.count++;
+	histogram_add(&backlog_wait.histogram, deltatime_microseconds(wait));
+}
+
+/*
+ * Event loop.
+ *
+ * The slowest callbacks are kept, slowest first, in a small table;
+ * the name is copied as it can be on the caller's stack.
+ */
+
+#define SLOWEST_CALLBACKS 10
+#define SLOW_CALLBACK_SECONDS 1
+
+static struct latency_class event_loop = { .what = "eventloop", .tail = &event_loop.head, };
+
+static struct {
+	uintmax_t count;
+	struct histogram histogram;
+	deltatime_t worst;		/* since last sampled */
+} event_loop_lag;
+
+static struct slow_callback {
+	uintmax_t wall;			/* microseconds; 0 when unused */
+	uintmax_t cpu;			/* microseconds */
+	const char *kind;
+	char name[64];
+	where_t where;
+	realtime_t when;
+} slowest_callbacks[SLOWEST_CALLBACKS];
+
+void record_event_loop_lag(deltatime_t lag)
+{
+	event_loop_lag.count++;
+	histogram_add(&event_loop_lag.histogram, deltatime_microseconds(lag));
+	event_loop_lag.worst = deltatime_max(event_loop_lag.worst, lag);
+}
+
+deltatime_t sample_event_loop_lag(void)
+{
+	deltatime_t worst = event_loop_lag.worst;
+	event_loop_lag.worst = deltatime_zero;
+	return worst;
+}
+
+void record_event_loop_callback(const char *kind, const char *name, where_t where,
+				const threadtime_t *start, struct logger *logger)
+{
+	struct cpu_usage usage = threadtime_usage(start);
+	latency_add(latency_by_name(&event_loop, kind), usage);
+
+	if (usage.wall_seconds >= SLOW_CALLBACK_SECONDS) {
+		llog(RC_LOG, logger, "event-loop %s callback %s "PRI_CPU_USAGE" "PRI_WHERE,
+		     kind, name, pri_cpu_usage(usage), pri_where(where));
+	}
+
+	uintmax_t wall = microseconds(usage.wall_seconds);
+	unsigned i = SLOWEST_CALLBACKS;
+	while (i > 0 && slowest_callbacks[i - 1].wall < wall) {
+		i--;
+	}
+	if (i == SLOWEST_CALLBACKS) {
+		return;
+	}
+	memmove(&slowest_callbacks[i + 1], &slowest_callbacks[i],
+		(SLOWEST_CALLBACKS - i - 1) * sizeof(slowest_callbacks[0]));
+	struct slow_callback *sc = &slowest_callbacks[i];
+	*sc = (struct slow_callback) {
+		.wall = wall,
+		.cpu = microseconds(usage.thread_seconds),
+		.kind = kind,
+		.where = where,
+		.when = realnow(),
+	};
+	jam_str(sc->name, sizeof(sc->name), name);
+}
+
+/*
+ * Report the bucket's upper bound (but no more than the max); good
+ * enough to spot a long tail.
+ */
+
+static deltatime_t histogram_quantile(const struct histogram *h, uintmax_t count,
+				      unsigned percent)
+{
+	uintmax_t rank = (count * percent + 99) / 100;
+	uintmax_t seen = 0;
+	uintmax_t us = h->max;
+	for (unsigned b = 0; b < LATENCY_BUCKETS - 1; b++) {
+		seen += h->bucket[b];
+		if (seen >= rank) {
+			uintmax_t ceiling = (uintmax_t)2 << b;
+			us = (ceiling < h->max ? ceiling : h->max);
+			break;
+		}
+	}
+	return deltatime_from_microseconds(us);
+}
+
+deltatime_t backlog_wait_quantile(unsigned percent)
+{
+	return histogram_quantile(&backlog_wait.histogram, backlog_wait.count, percent);
+}
+
+static void show_histogram(struct show *s, const char *what, const char *name,
+			   uintmax_t count, const char *series,
+			   const struct histogram *h)
+{
+	static const unsigned percentiles[] = { 50, 90, 99, };
+	FOR_EACH_ELEMENT(percent, percentiles) {
+		deltatime_buf b;
+		show(s, "total.latency.%s.%s.%s.p%u=%s", what, name, series, *percent,
+		     str_deltatime(histogram_quantile(h, count, *percent), &b));
+	}
+	deltatime_buf b;
+	show(s, "total.latency.%s.%s.%s.max=%s", what, name, series,
+	     str_deltatime(histogram_quantile(h, count, 100), &b));
+}
+
+static void show_latency_class(struct show *s, const struct latency_class *class)
+{
+	for (const struct latency *l = class->head; l != NULL; l = l->next) {
+		if (l->count == 0) {
+			continue;
+		}
+		show(s, "total.latency.%s.%s.count=%ju", class->what, l->name, l->count);
+		if (class == &tasks) {
+			show_histogram(s, class->what, l->name, l->count, "wait", &l->wait);
+		}
+		show_histogram(s, class->what, l->name, l->count, "wall", &l->wall);
+		show_histogram(s, class->what, l->name, l->count, "cpu", &l->cpu);
+		for (unsigned i = 0; i < elemsof(l->status); i++) {
+			if (l->status[i] > 0) {
+				enum_buf nm;
+				show(s, "total.latency.%s.%s.%s=%ju", class->what, l->name,
+				     str_enum_short(&stf_status_names, i + STATUS_FLOOR, &nm),
+				     l->status[i]);
+			}
+		}
+	}
+}
+
+void show_latency_histograms(struct show *s)
+{
+	show_latency_class(s, &transitions);
+	show_latency_class(s, &tasks);
+	show_latency_class(s, &whacks);
+
+	if (backlog_wait.count > 0) {
+		show(s, "total.latency.helpers.backlog.count=%ju", backlog_wait.count);
+		show_histogram(s, "helpers", "backlog", backlog_wait.count,
+			       "wait", &backlog_wait.histogram);
+	}
+
+	if (event_loop_lag.count > 0) {
+		show(s, "total.latency.eventloop.lag.count=%ju", event_loop_lag.count);
+		show_histogram(s, "eventloop", "lag", event_loop_lag.count,
+			       "wall", &event_loop_lag.histogram);
+	}
+	show_latency_class(s, &event_loop);
+	for (unsigned i = 0; i < SLOWEST_CALLBACKS && slowest_callbacks[i].wall > 0; i++) {
+		const struct slow_callback *sc = &slowest_callbacks[i];
+		deltatime_buf wb, cb;
+		realtime_buf tb;
+		show(s, "total.latency.eventloop.slowest.%u=%s (%s) seconds at %s in %s %s "PRI_WHERE,
+		     i + 1,
+		     str_deltatime(deltatime_from_microseconds(sc->wall), &wb),
+		     str_deltatime(deltatime_from_microseconds(sc->cpu), &cb),
+		     str_realtime(sc->when, /*utc*/false, &tb),
+		     sc->kind, sc->name, pri_where(sc->where));
+	}
+}
+
+/*
+ * OpenMetrics: the log2 buckets map directly onto a histogram; only
+ * buckets up to the largest measurement are shown.
+ */
+
+static void show_metric_histogram(struct show *s, const char *family,
+				  const char *name, uintmax_t count,
+				  const struct histogram *h)
+{
+	/* LABEL is either empty or 'name="NAME",' */
+	char label[100] = "";
+	if (name != NULL) {
+		snprintf(label, sizeof(label), "name=\"%s\",", name);
+	}
+	uintmax_t seen = 0;
+	for (unsigned b = 0; b < LATENCY_BUCKETS - 1 && seen < count; b++) {
+		seen += h->bucket[b];
+		uintmax_t ceiling = (uintmax_t)2 << b;
+		show(s, "%s_bucket{%sle=\"%ju.%06ju\"} %ju",
+		     family, label, ceiling / 1000000, ceiling % 1000000, seen);
+	}
+	show(s, "%s_bucket{%sle=\"+Inf\"} %ju", family, label, count);
+	if (name != NULL) {
+		show(s, "%s_count{name=\"%s\"} %ju", family, name, count);
+	} else {
+		show(s, "%s_count %ju", family, count);
+	}
+}
+
+static void show_latency_class_metrics(struct show *s,
+				       const struct latency_class *class,
+				       const char *series,
+				       size_t offset)
+{
+	char family[64];
+	snprintf(family, sizeof(family), "pluto_latency_%s_%s_seconds",
+		 class->what, series);
+	show(s, "# TYPE %s histogram", family);
+	show(s, "# UNIT %s seconds", family);
+	for (const struct latency *l = class->head; l != NULL; l = l->next) {
+		if (l->count > 0) {
+			const struct histogram *h =
+				(const void *)((const char *)l + offset);
+			show_metric_histogram(s, family, l->name, l->count, h);
+		}
+	}
+}
+
+static void show_status_metrics(struct show *s, const struct latency_class *class)
+{
+	show(s, "# TYPE pluto_latency_%s_status counter", class->what);
+	for (const struct latency *l = class->head; l != NULL; l = l->next) {
+		for (unsigned i = 0; i < elemsof(l->status); i++) {
+			if (l->status[i] > 0) {
+				enum_buf nm;
+				show(s, "pluto_latency_%s_status_total{name=\"%s\",status=\"%s\"} %ju",
+				     class->what, l->name,
+				     str_enum_short(&stf_status_names, i + STATUS_FLOOR, &nm),
+				     l->status[i]);
+			}
+		}
+	}
+}
+
+void show_latency_metrics(struct show *s)
+{
+	show_latency_class_metrics(s, &transitions, "wall", offsetof(struct latency, wall));
+	show_latency_class_metrics(s, &transitions, "cpu", offsetof(struct latency, cpu));
+	show_status_metrics(s, &transitions);
+	show_latency_class_metrics(s, &tasks, "wait", offsetof(struct latency, wait));
+	show_latency_class_metrics(s, &tasks, "wall", offsetof(struct latency, wall));
+	show_latency_class_metrics(s, &tasks, "cpu", offsetof(struct latency, cpu));
+	show(s, "# TYPE pluto_latency_helpers_backlog_wait_seconds histogram");
+	show(s, "# UNIT pluto_latency_helpers_backlog_wait_seconds seconds");
+	show_metric_histogram(s, "pluto_latency_helpers_backlog_wait_seconds", NULL,
+			      backlog_wait.count, &backlog_wait.histogram);
+	show_latency_class_metrics(s, &whacks, "wall", offsetof(struct latency, wall));
+	show_latency_class_metrics(s, &whacks, "cpu", offsetof(struct latency, cpu));
+	show_latency_class_metrics(s, &event_loop, "wall", offsetof(struct latency, wall));
+	show_latency_class_metrics(s, &event_loop, "cpu", offsetof(struct latency, cpu));
+
+	show(s, "# TYPE pluto_latency_eventloop_lag_seconds histogram");
+	show(s, "# UNIT pluto_latency_eventloop_lag_seconds seconds");
+	show_metric_histogram(s, "pluto_latency_eventloop_lag_seconds", NULL,
+			      event_loop_lag.count, &event_loop_lag.histogram);
+}
+
+static void clear_latency_class(struct latency_class *class)
+{
+	for (struct latency *l = class->head; l != NULL; l = l->next) {
+		l->count = 0;
+		zero(&l->wall);
+		zero(&l->cpu);
+		zero(&l->wait);
+		zero(&l->status);
+	}
+}
+
+void clear_latency_histograms(void)
+{
+	dbg("clearing latency histograms");
+	clear_latency_class(&transitions);
+	clear_latency_class(&tasks);
+	clear_latency_class(&whacks);
+	clear_latency_class(&event_loop);
+	zero(&backlog_wait);
+	zero(&event_loop_lag);
+	zero(&slowest_callbacks);
+}
+
+static void free_latency_class(struct latency_class *class)
+{
+	struct latency *l = class->head;
+	while (l != NULL) {
+		struct latency *next = l->next;
+		pfree(l->name);
+		pfree(l);
+		l = next;
+	}
+	class->head = NULL;
+	class->tail = &class->head;
+}
+
+void free_latency_histograms(void)
+{
+	free_latency_class(&transitions);
+	free_latency_class(&tasks);
+	free_latency_class(&whacks);
+	free_latency_class(&event_loop);
+	zero(&transition_latency);
+}
@@ -0,0 +1,77 @@
+/* latency histograms, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef PLUTO_LATENCY_H
+#define PLUTO_LATENCY_H
+
+#include "pluto_constants.h"	/* for enum ike_version, stf_status */
+#include "deltatime.h"
+#include "where.h"
+#include "pluto_timing.h"	/* for struct cpu_usage */
+
+struct msg_digest;
+struct show;
+struct logger;
+
+/*
+ * Always-on log2 bucketed histograms of wall and CPU time.  Unlike
+ * DBG_CPU_USAGE, which logs every measurement, these just count so
+ * are cheap enough to leave enabled.
+ *
+ * Histograms are reported by whack --globalstatus and reset by
+ * whack --clearstats.
+ */
+
+/*
+ * A message is timed from when it was read until its state
+ * transition completes.  While suspended (for instance waiting on a
+ * helper) the wall clock keeps running but CPU time is only billed
+ * when pluto is working on the message.
+ */
+void md_latency_suspend(struct msg_digest *md);
+void md_latency_resume(struct msg_digest *md);
+
+/* keyed by MD's IKE version, exchange and role */
+void record_transition_latency(const struct msg_digest *md, stf_status status);
+
+/* main thread: WAIT is time spent in the backlog */
+void record_task_latency(const char *name, deltatime_t wait,
+			 struct cpu_usage compute);
+
+/* main thread: every job, whatever its fate, taken off the backlog */
+void record_backlog_wait(deltatime_t wait);
+deltatime_t backlog_wait_quantile(unsigned percent);	/* 100 is max */
+
+/* main thread */
+void record_whack_latency(const char *command, struct cpu_usage usage);
+
+/*
+ * Everything runs on the one event loop.  Record how late timers fire
+ * and, for each kind of callback, how long it blocks the loop.  The
+ * slowest callbacks are remembered along with where they were
+ * scheduled; anything over a second is logged.
+ */
+void record_event_loop_lag(deltatime_t lag);
+void record_event_loop_callback(const char *kind, const char *name, where_t where,
+				const threadtime_t *start, struct logger *logger);
+deltatime_t sample_event_loop_lag(void);	/* worst since last call */
+
+void show_latency_histograms(struct show *s);
+void show_latency_metrics(struct show *s);	/* OpenMetrics text */
+void clear_latency_histograms(void);
+void free_latency_histograms(void);
+
+#endif
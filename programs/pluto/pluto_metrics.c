@@ -0,0 +1,267 @@
+/* metrics export, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include "defs.h"
+#include "log.h"
+#include "show.h"
+#include "lsw_socket.h"		/* for cloexec_socket() */
+#include "server.h"		/* for attach_fd_read_listener() */
+#include "server_pool.h"	/* for show_server_helper_status() */
+#include "ddos.h"		/* for show_ddos_overload_status() */
+#include "state.h"		/* for show_globalstate_status() */
+#include "connections.h"	/* for next_connection() */
+#include "pluto_stats.h"	/* for show_pluto_stats() */
+#include "pluto_latency.h"	/* for show_latency_metrics() */
+#include "pluto_metrics.h"
+
+char *pluto_metrics_socket = NULL;
+
+static int metrics_fd = NULL_FD;
+static struct fd_read_listener *metrics_listener = NULL;
+
+/*
+ * The response, built in memory so that it can be written in one go;
+ * doubled as needed.
+ */
+
+struct metrics {
+	chunk_t buf;
+	size_t len;
+};
+
+static void append_metrics_line(struct metrics *m, const void *ptr, size_t len)
+{
+	size_t need = m->len + len + 1/*NL*/;
+	if (need > m->buf.len) {
+		size_t size = (m->buf.len == 0 ? 4096 : m->buf.len * 2);
+		while (size < need) {
+			size *= 2;
+		}
+		chunk_t buf = alloc_chunk(size, "metrics");
+		if (m->len > 0) {
+			memcpy(buf.ptr, m->buf.ptr, m->len);
+		}
+		free_chunk_content(&m->buf);
+		m->buf = buf;
+	}
+	if (len > 0) {
+		memcpy(m->buf.ptr + m->len, ptr, len);
+	}
+	m->len += len;
+	m->buf.ptr[m->len++] = '\n';
+}
+
+/* already OpenMetrics text */
+static void capture_metric(shunk_t line, void *arg)
+{
+	struct metrics *m = arg;
+	append_metrics_line(m, line.ptr, line.len);
+}
+
+/*
+ * Convert a --globalstatus "total.a.b=N" line into the counter
+ * pluto_a_b and a "current.a.b=N" (or any other) line into the gauge
+ * pluto_a_b.  Lines without a number are dropped, as are the latency
+ * histograms which are shown natively.
+ */
+static void capture_status(shunk_t line, void *arg)
+{
+	struct metrics *m = arg;
+
+	shunk_t value = line;
+	shunk_t key = shunk_token(&value, NULL, "=");
+	if (value.ptr == NULL || value.len == 0 ||
+	    hunk_strstarteq(key, "total.latency.")) {
+		return;
+	}
+
+	char number[32];
+	if (value.len >= sizeof(number)) {
+		return;
+	}
+	memcpy(number, value.ptr, value.len);
+	number[value.len] = '\0';
+	char *end;
+	strtod(number, &end);
+	if (end != number + value.len) {
+		return;
+	}
+
+	bool counter = hunk_streat(&key, "total.");
+	if (!counter) {
+		hunk_streat(&key, "current.");
+	}
+
+	char name[LOG_WIDTH];
+	struct jambuf buf = ARRAY_AS_JAMBUF(name);
+	jam_string(&buf, "pluto_");
+	for (size_t i = 0; i < key.len; i++) {
+		char c = ((const char *)key.ptr)[i];
+		jam_char(&buf, (isalnum((unsigned char)c) ? c : '_'));
+	}
+
+	char out[LOG_WIDTH];
+	int n = snprintf(out, sizeof(out), "# TYPE %s %s", name,
+			 (counter ? "counter" : "gauge"));
+	append_metrics_line(m, out, n);
+	n = snprintf(out, sizeof(out), "%s%s %s", name,
+		     (counter ? "_total" : ""), number);
+	append_metrics_line(m, out, n);
+}
+
+static void show_connection_metrics(struct show *s, struct logger *logger)
+{
+	unsigned count[CONNECTION_KIND_ROOF] = {0};
+	struct connection_filter cq = {
+		.search = {
+			.order = NEW2OLD,
+			.logger = logger,
+			.where = HERE,
+		},
+	};
+	while (next_connection(&cq)) {
+		count[cq.c->local->kind]++;
+	}
+
+	show(s, "# TYPE pluto_connections gauge");
+	for (enum connection_kind k = CK_GROUP; k < CONNECTION_KIND_ROOF; k++) {
+		enum_buf kb;
+		show(s, "pluto_connections{kind=\"%s\"} %u",
+		     str_enum_short(&connection_kind_names, k, &kb), count[k]);
+	}
+}
+
+static void metrics_handler(int fd, void *arg UNUSED, struct logger *logger)
+{
+	int client = accept(fd, NULL, NULL);
+	if (client < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			/* client went away */
+			return;
+		}
+		llog_error(logger, errno, "metrics-socket accept() failed");
+		return;
+	}
+
+	struct metrics m = {0};
+
+	struct show *s = alloc_show_capture(logger, capture_status, &m);
+	show_globalstate_status(s);
+	show_server_helper_status(s);
+	show_ddos_overload_status(s);
+	show_pluto_stats(s);
+	free_show(&s);
+
+	s = alloc_show_capture(logger, capture_metric, &m);
+	show_connection_metrics(s, logger);
+	show_latency_metrics(s);
+	show(s, "# EOF");
+	free_show(&s);
+
+	/*
+	 * Never block the event loop: make the socket buffer big
+	 * enough for the response and then write it without waiting;
+	 * a client that isn't keeping up gets truncated output.
+	 */
+	int size = m.len;
+	if (setsockopt(client, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0) {
+		ldbg(logger, "metrics-socket setsockopt(SO_SNDBUF) failed: %s",
+		     strerror(errno));
+	}
+	ssize_t wrote = send(client, m.buf.ptr, m.len, MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (wrote < 0) {
+		ldbg(logger, "metrics-socket send() failed: %s", strerror(errno));
+	} else if ((size_t)wrote < m.len) {
+		ldbg(logger, "metrics-socket send() truncated, %zd of %zu bytes",
+		     wrote, m.len);
+	}
+
+	close(client);
+	free_chunk_content(&m.buf);
+}
+
+void init_metrics_socket(struct logger *logger)
+{
+	if (pluto_metrics_socket == NULL) {
+		return;
+	}
+
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+#ifdef USE_SOCKADDR_LEN
+		.sun_len = sizeof(struct sockaddr_un),
+#endif
+	};
+	if (strlen(pluto_metrics_socket) >= sizeof(addr.sun_path)) {
+		llog(RC_LOG, logger, "metrics-socket=%s ignored: path too long",
+		     pluto_metrics_socket);
+		return;
+	}
+	strcpy(addr.sun_path, pluto_metrics_socket);
+
+	int fd = cloexec_socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		llog_error(logger, errno, "metrics-socket=%s ignored: socket() failed",
+			   pluto_metrics_socket);
+		return;
+	}
+
+	/* like the control socket; remove stale and restrict access */
+	unlink(addr.sun_path);
+	mode_t ou = umask(~(S_IRWXU | S_IRWXG));
+	if (bind(fd, (struct sockaddr *)&addr,
+		 offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path)) < 0) {
+		llog_error(logger, errno, "metrics-socket=%s ignored: bind() failed",
+			   pluto_metrics_socket);
+		umask(ou);
+		close(fd);
+		return;
+	}
+	umask(ou);
+
+	/* accept() is only called when there's a connection */
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+	    listen(fd, 5) < 0) {
+		llog_error(logger, errno, "metrics-socket=%s ignored: listen() failed",
+			   pluto_metrics_socket);
+		unlink(addr.sun_path);
+		close(fd);
+		return;
+	}
+
+	metrics_fd = fd;
+	attach_fd_read_listener(&metrics_listener, metrics_fd, "metrics",
+				metrics_handler, NULL);
+	llog(RC_LOG, logger, "serving OpenMetrics on %s", pluto_metrics_socket);
+}
+
+void shutdown_metrics_socket(void)
+{
+	if (metrics_fd != NULL_FD) {
+		detach_fd_read_listener(&metrics_listener);
+		close(metrics_fd);
+		metrics_fd = NULL_FD;
+		unlink(pluto_metrics_socket);
+	}
+	pfreeany(pluto_metrics_socket);
+}
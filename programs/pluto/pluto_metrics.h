@@ -0,0 +1,36 @@
+/* metrics export, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef PLUTO_METRICS_H
+#define PLUTO_METRICS_H
+
+struct logger;
+
+/*
+ * metrics-socket=: when set, a local (unix domain) socket that, on
+ * connect, writes pluto's counters, state and connection counts,
+ * helper backlog and latency histograms in OpenMetrics text format
+ * and then closes.  The connection is served from the event loop and
+ * the output is written without blocking; there is no request to
+ * read.
+ */
+
+extern char *pluto_metrics_socket;
+
+void init_metrics_socket(struct logger *logger);
+void shutdown_metrics_socket(void);
+
+#endif
@@ -0,0 +1,608 @@
+/* replay captured IKE traffic, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "defs.h"
+#include "log.h"
+#include "show.h"
+#include "demux.h"		/* for alloc_md(), process_md() */
+#include "iface.h"		/* for find_iface_endpoint_by_local_endpoint() */
+#include "server.h"		/* for schedule_callback() */
+#include "server_pool.h"	/* for server_helper_jobs_outstanding() */
+#include "pluto_stats.h"	/* for pstats_ike_bytes */
+#include "pluto_latency.h"	/* for show_latency_histograms() */
+#include "pluto_timing.h"
+#include "ip_protocol.h"
+#include "names_constant.h"	/* for isakmp_xchg_type_names */
+#include "kernel.h"		/* for none_kernel_ops */
+#include "pluto_replay.h"
+
+/*
+ * Classic pcap (not pcapng).  The byte order is whatever the writer
+ * used, the magic says which.
+ */
+
+#define PCAP_MAGIC_USEC	0xa1b2c3d4
+#define PCAP_MAGIC_NSEC	0xa1b23c4d
+#define PCAP_HEADER_SIZE	24
+#define PCAP_RECORD_SIZE	16
+
+#define LINKTYPE_NULL		0
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW_BSD	12
+#define LINKTYPE_RAW		101
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_LINUX_SLL2	276
+
+#define ETHERTYPE_IPV4	0x0800
+#define ETHERTYPE_IPV6	0x86dd
+#define ETHERTYPE_VLAN	0x8100
+#define ETHERTYPE_QINQ	0x88a8
+
+struct replay_packet {
+	intmax_t us;			/* capture timestamp */
+	ip_endpoint sender;
+	ip_endpoint local;
+	chunk_t bytes;			/* IKE message, marker removed */
+};
+
+/*
+ * What each kind of message cost.  Only the synchronous part of
+ * processing on the main thread is measured here; offloaded crypto
+ * shows up in the latency histograms.
+ */
+
+struct replay_exchange {
+	unsigned major;
+	unsigned xchg;
+	bool response;
+	unsigned packets;
+	struct cpu_usage usage;
+	uintmax_t allocs;
+	uintmax_t bytes;
+};
+
+#define REPLAY_EXCHANGES 32
+
+struct replay {
+	char *file;
+	struct logger *logger;		/* keeps whack attached */
+
+	struct replay_packet *packets;
+	unsigned nr_packets;
+	unsigned next;
+
+	unsigned frames;		/* in the capture */
+	unsigned skipped;		/* not IKE, or not for us */
+	unsigned replayed;
+	uintmax_t discarded;		/* outbound, not sent */
+	uintmax_t discarded_bytes;
+
+	monotime_t clock_start;
+	intmax_t capture_start;		/* microseconds */
+	threadtime_t start;
+	struct alloc_stats allocs;
+
+	struct replay_exchange exchanges[REPLAY_EXCHANGES];
+	unsigned nr_exchanges;
+};
+
+static struct replay *replay;
+
+static callback_cb replay_packet_callback;	/* type assertion */
+static callback_cb replay_drain_callback;	/* type assertion */
+
+static uint32_t get32(const uint8_t *p, bool big)
+{
+	return (big ? ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		       (uint32_t)p[2] << 8 | p[3]) :
+		((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 |
+		 (uint32_t)p[1] << 8 | p[0]));
+}
+
+static unsigned get16n(const uint8_t *p)
+{
+	return (unsigned)p[0] << 8 | p[1];
+}
+
+/*
+ * Strip the IP and UDP headers; save the packet when it is IKE.
+ * Returns false when the frame was skipped.
+ */
+
+static bool save_ike_datagram(struct replay *r, intmax_t us,
+			      const uint8_t *ip, size_t len)
+{
+	if (len < 1) {
+		return false;
+	}
+
+	enum ip_version version;
+	struct ip_bytes src = {0}, dst = {0};
+	const uint8_t *udp;
+	size_t udp_len;
+	switch (ip[0] >> 4) {
+	case 4:
+	{
+		size_t ihl = (ip[0] & 0xf) * 4;
+		if (len < 20 || ihl < 20 || len < ihl ||
+		    ip[9] != IPPROTO_UDP) {
+			return false;
+		}
+		/* reassembly is too much; MF or offset */
+		if ((get16n(ip + 6) & 0x3fff) != 0) {
+			return false;
+		}
+		size_t total = get16n(ip + 2);
+		if (total >= ihl && total < len) {
+			len = total;	/* ethernet padding */
+		}
+		version = IPv4;
+		memcpy(src.byte, ip + 12, 4);
+		memcpy(dst.byte, ip + 16, 4);
+		udp = ip + ihl;
+		udp_len = len - ihl;
+		break;
+	}
+	case 6:
+		/* extension headers aren't followed */
+		if (len < 40 || ip[6] != IPPROTO_UDP) {
+			return false;
+		}
+		version = IPv6;
+		memcpy(src.byte, ip + 8, 16);
+		memcpy(dst.byte, ip + 24, 16);
+		udp = ip + 40;
+		udp_len = len - 40;
+		break;
+	default:
+		return false;
+	}
+
+	if (udp_len < 8) {
+		return false;
+	}
+	unsigned sport = get16n(udp + 0);
+	unsigned dport = get16n(udp + 2);
+	size_t payload_len = get16n(udp + 4);
+	if (payload_len < 8 || payload_len > udp_len) {
+		/* truncated by the snaplen */
+		return false;
+	}
+	payload_len -= 8;
+	const uint8_t *payload = udp + 8;
+
+	bool natt = (sport == NAT_IKE_UDP_PORT || dport == NAT_IKE_UDP_PORT);
+	if (!natt && sport != IKE_UDP_PORT && dport != IKE_UDP_PORT) {
+		return false;
+	}
+
+	if (natt) {
+		static const uint8_t non_esp_marker[NON_ESP_MARKER_SIZE] = {0};
+		if (payload_len < NON_ESP_MARKER_SIZE ||
+		    !memeq(payload, non_esp_marker, NON_ESP_MARKER_SIZE)) {
+			/* ESP, or a keep-alive */
+			return false;
+		}
+		payload += NON_ESP_MARKER_SIZE;
+		payload_len -= NON_ESP_MARKER_SIZE;
+	}
+
+	if (payload_len < sizeof(struct isakmp_hdr)) {
+		return false;
+	}
+
+	if (r->nr_packets % 64 == 0) {
+		realloc_things(r->packets, r->nr_packets, r->nr_packets + 64,
+			       "replay packets");
+	}
+	struct replay_packet *p = &r->packets[r->nr_packets++];
+	p->us = us;
+	p->sender = endpoint_from_raw(HERE, version, src, &ip_protocol_udp, ip_hport(sport));
+	p->local = endpoint_from_raw(HERE, version, dst, &ip_protocol_udp, ip_hport(dport));
+	p->bytes = clone_bytes_as_chunk(payload, payload_len, "replay packet");
+	return true;
+}
+
+static bool save_frame(struct replay *r, unsigned linktype, intmax_t us,
+		       const uint8_t *frame, size_t len)
+{
+	unsigned ethertype;
+	switch (linktype) {
+	case LINKTYPE_ETHERNET:
+		if (len < 14) {
+			return false;
+		}
+		ethertype = get16n(frame + 12);
+		frame += 14;
+		len -= 14;
+		while ((ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) &&
+		       len >= 4) {
+			ethertype = get16n(frame + 2);
+			frame += 4;
+			len -= 4;
+		}
+		break;
+	case LINKTYPE_LINUX_SLL:
+		if (len < 16) {
+			return false;
+		}
+		ethertype = get16n(frame + 14);
+		frame += 16;
+		len -= 16;
+		break;
+	case LINKTYPE_LINUX_SLL2:
+		if (len < 20) {
+			return false;
+		}
+		ethertype = get16n(frame + 0);
+		frame += 20;
+		len -= 20;
+		break;
+	case LINKTYPE_NULL:
+		/* the family is in host order; use the IP version */
+		if (len < 4) {
+			return false;
+		}
+		frame += 4;
+		len -= 4;
+		return save_ike_datagram(r, us, frame, len);
+	case LINKTYPE_RAW:
+	case LINKTYPE_RAW_BSD:
+		return save_ike_datagram(r, us, frame, len);
+	default:
+		return false;
+	}
+
+	if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6) {
+		return false;
+	}
+	return save_ike_datagram(r, us, frame, len);
+}
+
+static diag_t read_capture(struct replay *r, shunk_t capture)
+{
+	const uint8_t *ptr = capture.ptr;
+	size_t len = capture.len;
+
+	if (len < PCAP_HEADER_SIZE) {
+		return diag("not a pcap file, too short");
+	}
+
+	bool big;
+	bool nsec;
+	if (get32(ptr, false) == PCAP_MAGIC_USEC) {
+		big = false;
+		nsec = false;
+	} else if (get32(ptr, true) == PCAP_MAGIC_USEC) {
+		big = true;
+		nsec = false;
+	} else if (get32(ptr, false) == PCAP_MAGIC_NSEC) {
+		big = false;
+		nsec = true;
+	} else if (get32(ptr, true) == PCAP_MAGIC_NSEC) {
+		big = true;
+		nsec = true;
+	} else {
+		return diag("not a pcap file (pcapng is not supported)");
+	}
+
+	unsigned linktype = get32(ptr + 20, big) & 0xffff;
+	switch (linktype) {
+	case LINKTYPE_NULL:
+	case LINKTYPE_ETHERNET:
+	case LINKTYPE_RAW_BSD:
+	case LINKTYPE_RAW:
+	case LINKTYPE_LINUX_SLL:
+	case LINKTYPE_LINUX_SLL2:
+		break;
+	default:
+		return diag("pcap link-type %u is not supported", linktype);
+	}
+
+	ptr += PCAP_HEADER_SIZE;
+	len -= PCAP_HEADER_SIZE;
+	while (len >= PCAP_RECORD_SIZE) {
+		intmax_t secs = get32(ptr + 0, big);
+		intmax_t frac = get32(ptr + 4, big);
+		size_t incl_len = get32(ptr + 8, big);
+		ptr += PCAP_RECORD_SIZE;
+		len -= PCAP_RECORD_SIZE;
+		if (incl_len > len) {
+			return diag("pcap record %u is truncated", r->frames + 1);
+		}
+		r->frames++;
+		intmax_t us = secs * 1000000 + (nsec ? frac / 1000 : frac);
+		if (!save_frame(r, linktype, us, ptr, incl_len)) {
+			r->skipped++;
+		}
+		ptr += incl_len;
+		len -= incl_len;
+	}
+
+	if (r->nr_packets == 0) {
+		return diag("no IKE messages found in %u frames", r->frames);
+	}
+	return NULL;
+}
+
+static diag_t load_capture(struct replay *r)
+{
+	FILE *f = fopen(r->file, "r");
+	if (f == NULL) {
+		return diag_errno(errno, "open failed, ");
+	}
+
+	struct stat st;
+	if (fstat(fileno(f), &st) < 0) {
+		diag_t d = diag_errno(errno, "stat failed, ");
+		fclose(f);
+		return d;
+	}
+
+	chunk_t capture = alloc_chunk(st.st_size, "replay capture");
+	size_t n = fread(capture.ptr, 1, capture.len, f);
+	fclose(f);
+	if (n != capture.len) {
+		free_chunk_content(&capture);
+		return diag("short read, %zu of %zu bytes", n, capture.len);
+	}
+
+	diag_t d = read_capture(r, HUNK_AS_SHUNK(capture));
+	free_chunk_content(&capture);
+	return d;
+}
+
+static struct replay_exchange *replay_exchange(struct replay *r, shunk_t packet)
+{
+	const struct isakmp_hdr *hdr = (const void *)packet.ptr;
+	unsigned major = hdr->isa_version >> ISA_MAJ_SHIFT;
+	unsigned xchg = hdr->isa_xchg;
+	bool response = (major == IKEv2_MAJOR_VERSION &&
+			 (hdr->isa_flags & ISAKMP_FLAGS_v2_MSG_R));
+	for (unsigned i = 0; i < r->nr_exchanges; i++) {
+		struct replay_exchange *e = &r->exchanges[i];
+		if (e->major == major && e->xchg == xchg && e->response == response) {
+			return e;
+		}
+	}
+	if (r->nr_exchanges >= elemsof(r->exchanges)) {
+		return NULL;
+	}
+	struct replay_exchange *e = &r->exchanges[r->nr_exchanges++];
+	e->major = major;
+	e->xchg = xchg;
+	e->response = response;
+	return e;
+}
+
+static void replay_packet(struct replay *r, const struct replay_packet *p)
+{
+	/*
+	 * Move the clock forward to when the packet arrived; if
+	 * pluto is already behind, leave it.
+	 */
+	deltatime_t offset = {
+		.dt = {
+			.tv_sec = (p->us - r->capture_start) / 1000000,
+			.tv_usec = (p->us - r->capture_start) % 1000000,
+		},
+	};
+	monotime_t arrival = monotime_add(r->clock_start, offset);
+	monotime_t now = mononow();
+	if (monotime_cmp(now, <, arrival)) {
+		advance_mononow(monotimediff(arrival, now));
+	}
+
+	struct iface_endpoint *ifp = find_iface_endpoint_by_local_endpoint(p->local);
+	if (ifp == NULL) {
+		r->skipped++;
+		return;
+	}
+
+	struct replay_exchange *e = replay_exchange(r, HUNK_AS_SHUNK(p->bytes));
+	struct alloc_stats allocs = get_alloc_stats();
+	threadtime_t start = threadtime_start();
+
+	struct msg_digest *md = alloc_md(ifp, &p->sender, p->bytes.ptr, p->bytes.len, HERE);
+	md->md_inception = start;
+	pstats_ike_bytes.in += p->bytes.len;
+	process_md(md);
+	md_delref(&md);
+	iface_endpoint_delref(&ifp);
+
+	struct cpu_usage usage = threadtime_usage(&start);
+	struct alloc_stats after = get_alloc_stats();
+	if (e != NULL) {
+		e->packets++;
+		cpu_usage_add(e->usage, usage);
+		e->allocs += after.allocs - allocs.allocs;
+		e->bytes += after.bytes - allocs.bytes;
+	}
+	r->replayed++;
+}
+
+static void replay_packet_callback(const char *story UNUSED,
+				   struct state *st UNUSED,
+				   void *context UNUSED)
+{
+	struct replay *r = replay;
+	if (r == NULL) {
+		/* shutting down */
+		return;
+	}
+
+	/*
+	 * One packet per callback so that anything else (helper
+	 * answers, timers) gets a look in, just like when reading
+	 * from the network.
+	 */
+	if (r->next < r->nr_packets) {
+		replay_packet(r, &r->packets[r->next++]);
+		schedule_callback("replay", deltatime(0), SOS_NOBODY,
+				  replay_packet_callback, NULL);
+		return;
+	}
+
+	replay_drain_callback(story, st, context);
+}
+
+static void show_replay(struct show *s, const struct replay *r)
+{
+	struct cpu_usage usage = threadtime_usage(&r->start);
+	show(s, "replay: %s: %u frames, %u IKE messages replayed, %u skipped",
+	     r->file, r->frames, r->replayed, r->skipped);
+	show(s, "replay: %ju responses not sent (%ju bytes)",
+	     r->discarded, r->discarded_bytes);
+	show(s, "replay: wall %.3f seconds, cpu %.3f seconds, %.0f messages/second",
+	     usage.wall_seconds, usage.thread_seconds,
+	     (usage.wall_seconds > 0 ? r->replayed / usage.wall_seconds : 0));
+
+	if (leak_detective) {
+		struct alloc_stats allocs = get_alloc_stats();
+		show(s, "replay: %ju allocations, %ju frees, %ju bytes allocated",
+		     allocs.allocs - r->allocs.allocs,
+		     allocs.frees - r->allocs.frees,
+		     allocs.bytes - r->allocs.bytes);
+	}
+
+	for (unsigned i = 0; i < r->nr_exchanges; i++) {
+		const struct replay_exchange *e = &r->exchanges[i];
+		if (e->packets == 0) {
+			continue;
+		}
+		SHOW_JAMBUF(s, buf) {
+			jam_string(buf, "replay: ");
+			jam(buf, "IKEv%u ", e->major);
+			jam_enum_short(buf, &isakmp_xchg_type_names, e->xchg);
+			if (e->major == IKEv2_MAJOR_VERSION) {
+				jam_string(buf, (e->response ? " response" : " request"));
+			}
+			jam(buf, ": messages(%u)", e->packets);
+			jam(buf, ", cpu(%.3fms)", e->usage.thread_seconds * 1000 / e->packets);
+			jam(buf, ", wall(%.3fms)", e->usage.wall_seconds * 1000 / e->packets);
+			if (leak_detective) {
+				jam(buf, ", allocations(%ju)", e->allocs / e->packets);
+				jam(buf, ", bytes(%ju)", e->bytes / e->packets);
+			}
+		}
+	}
+
+	show_latency_histograms(s);
+}
+
+static void replay_drain_callback(const char *story UNUSED,
+				  struct state *st UNUSED,
+				  void *context UNUSED)
+{
+	struct replay *r = replay;
+	if (r == NULL) {
+		/* shutting down */
+		return;
+	}
+
+	/* let the helpers finish what the packets started */
+	if (server_helper_jobs_outstanding() > 0) {
+		schedule_callback("replay drain", deltatime_ms(1), SOS_NOBODY,
+				  replay_drain_callback, NULL);
+		return;
+	}
+
+	struct show *s = alloc_show(r->logger);
+	show_replay(s, r);
+	free_show(&s);
+
+	/* releasing the logger releases whack */
+	free_replay();
+}
+
+void whack_replay(const char *file, struct logger *logger)
+{
+	/*
+	 * While replaying nothing is sent (so live peers would see
+	 * their retransmits, DPD and rekeys go unanswered) and the
+	 * clock is moved forward for good.  Neither is acceptable on
+	 * a gateway with real tunnels.
+	 */
+	if (kernel_ops != &none_kernel_ops) {
+		llog(RC_LOG, logger, "replay of %s rejected, requires protostack=none", file);
+		return;
+	}
+
+	if (replay != NULL) {
+		llog(RC_LOG, logger, "replay of %s already in progress", replay->file);
+		return;
+	}
+
+	struct replay *r = alloc_thing(struct replay, "replay");
+	r->file = clone_str(file, "replay file");
+
+	diag_t d = load_capture(r);
+	if (d != NULL) {
+		llog(RC_LOG, logger, "replay %s failed: %s", file, str_diag(d));
+		pfree_diag(&d);
+		replay = r;
+		free_replay();
+		return;
+	}
+
+	llog(RC_LOG, logger, "replaying %u IKE messages from %s", r->nr_packets, file);
+
+	/*
+	 * Start from a clean slate so that what is reported is just
+	 * the replay.
+	 */
+	clear_latency_histograms();
+	r->logger = clone_logger(logger, HERE);
+	r->clock_start = mononow();
+	r->capture_start = r->packets[0].us;
+	r->allocs = get_alloc_stats();
+	r->start = threadtime_start();
+
+	replay = r;
+	schedule_callback("replay", deltatime(0), SOS_NOBODY,
+			  replay_packet_callback, NULL);
+}
+
+bool replay_discards_outbound(shunk_t packet)
+{
+	if (replay == NULL) {
+		return false;
+	}
+	replay->discarded++;
+	replay->discarded_bytes += packet.len;
+	return true;
+}
+
+void free_replay(void)
+{
+	struct replay *r = replay;
+	if (r == NULL) {
+		return;
+	}
+	for (unsigned i = 0; i < r->nr_packets; i++) {
+		free_chunk_content(&r->packets[i].bytes);
+	}
+	pfreeany(r->packets);
+	pfreeany(r->file);
+	if (r->logger != NULL) {
+		free_logger(&r->logger, HERE);
+	}
+	pfree(r);
+	replay = NULL;
+}
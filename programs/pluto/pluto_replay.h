@@ -0,0 +1,42 @@
+/* replay captured IKE traffic, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef PLUTO_REPLAY_H
+#define PLUTO_REPLAY_H
+
+#include <stdbool.h>
+
+#include "shunk.h"
+
+struct logger;
+
+/*
+ * whack --replay <pcap>: feed the IKE datagrams in a capture through
+ * process_md() as fast as possible, against a clock that follows the
+ * capture's timestamps, and then report what it cost.
+ *
+ * Only datagrams sent to one of pluto's interfaces are replayed.
+ * While replaying, nothing is sent; combine with protostack=none to
+ * also keep the kernel out of the picture.
+ */
+void whack_replay(const char *file, struct logger *logger);
+
+/* called by send; true when the packet should be dropped */
+bool replay_discards_outbound(shunk_t packet);
+
+void free_replay(void);
+
+#endif
@@ -26,6 +26,7 @@
 #include "log.h"
 #include "timer.h"
 #include "pluto_sd.h"
+#include "pluto_latency.h"	/* for sample_event_loop_lag() */
 
 static global_timer_cb sd_watchdog_event;
 
@@ -91,4 +92,12 @@ void pluto_sd(int action, int status)
 void sd_watchdog_event(struct logger *unused_logger UNUSED)
 {
 	pluto_sd(PLUTO_SD_WATCHDOG, SD_REPORT_NO_STATUS);
+	/*
+	 * The keepalive is sent from the event-loop so a wedged loop
+	 * stops it; also let systemd know how late things are
+	 * running.
+	 */
+	deltatime_buf lb;
+	lswsd_notifyf("STATUS=worst event-loop lag %s seconds",
+		      str_deltatime(sample_event_loop_lag(), &lb));
 }
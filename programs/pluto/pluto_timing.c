@@ -90,6 +90,11 @@ void threadtime_stop(const threadtime_t *start, long serialno, const char *fmt,
 	}
 }
 
+struct cpu_usage threadtime_usage(const threadtime_t *start)
+{
+	return threadtime_sub(threadtime_start(), *start);
+}
+
 logtime_t logtime_start(struct logger *logger)
 {
 	logtime_t start = {
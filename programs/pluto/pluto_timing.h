@@ -61,6 +61,7 @@ struct cpu_usage {
 typedef struct cpu_timing threadtime_t;
 threadtime_t threadtime_start(void);
 void threadtime_stop(const threadtime_t *start, long serialno, const char *fmt, ...) PRINTF_LIKE(3);
+struct cpu_usage threadtime_usage(const threadtime_t *start); /* since START */
 monotime_t monotime_from_threadtime(const threadtime_t start);
 
 /*
@@ -0,0 +1,79 @@
+/* USDT (user statically defined tracing) probes, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ */
+
+#ifndef PLUTO_USDT_H
+#define PLUTO_USDT_H
+
+#include <stdint.h>
+
+#include "lswcdefs.h"		/* for UNUSED */
+#include "shunk.h"
+
+/*
+ * Static probe points for eBPF (bpftrace, bcc) and SystemTap.  Unlike
+ * debug-logging, a probe costs a NOP until something attaches to it.
+ *
+ * Built with USE_USDT=true (requires <sys/sdt.h>); otherwise the
+ * probes, and their arguments, compile away.
+ *
+ * The provider is "pluto" (e.g., usdt:/usr/libexec/ipsec/pluto:pluto:send);
+ * the probes and their arguments are:
+ *
+ *   receive(msgid, length)
+ *   process_md(ike_version, exchange, msgid, flags)
+ *   transition_start(serialno, msgid, exchange)
+ *   transition_finish(serialno, msgid, stf_status)
+ *   task_enqueue(job, callback_serialno, task_serialno, "task")
+ *   task_dequeue(job, callback_serialno, task_serialno, helper)
+ *   task_complete(job, callback_serialno, task_serialno, stf_status)
+ *   netlink_send(seq, type, length)
+ *   netlink_ack(seq, type, errno)
+ *   send(serialno, msgid, length)
+ *
+ * A serial number is 0 (SOS_NOBODY) when there's no state, and a
+ * Message ID is -1 when there isn't one.
+ */
+
+#ifdef USE_USDT
+# include <sys/sdt.h>
+# define PLUTO_PROBE(NAME, ...) STAP_PROBEV(pluto, NAME, __VA_ARGS__)
+#else
+static inline void pluto_probe_unused(int unused UNUSED, ...) { }
+/* the arguments are not evaluated */
+# define PLUTO_PROBE(NAME, ...)						\
+	do {								\
+		if (0) {						\
+			pluto_probe_unused(0, __VA_ARGS__);		\
+		}							\
+	} while (0)
+#endif
+
+/*
+ * The (host order) Message ID from the raw IKE message; or -1 when
+ * it's too short (e.g., a keep-alive).
+ */
+
+static inline int64_t pluto_probe_msgid(shunk_t message)
+{
+	const uint8_t *ptr = message.ptr;
+	if (ptr == NULL || message.len < 28/*isakmp_hdr*/) {
+		return -1;
+	}
+	return ((uint32_t)ptr[20] << 24 | (uint32_t)ptr[21] << 16 |
+		(uint32_t)ptr[22] << 8 | (uint32_t)ptr[23]);
+}
+
+#endif
@@ -49,9 +49,14 @@
 #include "lswnss.h"
 #include "defs.h"
 #include "nss_ocsp.h"
+#include "ocsp_cache.h"
 #include "server_fork.h"		/* for init_server_fork() */
 #include "server.h"
 #include "kernel.h"	/* needs connections.h */
+#include "updown.h"	/* for pluto_updown_jobs et.al. */
+#ifdef USE_PAM_AUTH
+#include "pam_auth.h"	/* for pluto_pam_workers */
+#endif
 #include "log.h"
 #include "log_limiter.h"	/* for init_log_limiter() */
 #include "keys.h"
@@ -74,6 +79,9 @@
 #include "ikev2_states.h"	/* for init_ikev2_states() */
 #include "crypt_symkey.h"	/* for init_crypt_symkey() */
 #include "ddns.h"		/* for init_ddns() */
+#include "ddos.h"		/* for init_ddos_overload() */
+#include "pluto_metrics.h"	/* for init_metrics_socket() */
+#include "pluto_cost.h"		/* for init_cost_status() */
 #include "crl_queue.h"		/* for free_crl_queue() */
 #include "iface.h"		/* for pluto_listen; */
 #include "server_pool.h"
@@ -221,6 +229,9 @@ static const char compile_time_interop_options[] = ""
 #ifdef USE_LINUX_AUDIT
 	" LINUX_AUDIT"
 #endif
+#ifdef USE_USDT
+	" USDT"
+#endif
 #ifdef USE_PAM_AUTH
 	" AUTH_PAM"
 #endif
@@ -461,6 +472,13 @@ enum {
 	OPT_IMPAIR,
 	OPT_DNSSEC_ROOTKEY_FILE,
 	OPT_DNSSEC_TRUSTED,
+	OPT_OCSP_PREFETCH,
+	OPT_KERNEL_RECONCILE,
+	OPT_UPDOWN_JOBS,
+	OPT_NO_NATIVE_UPDOWN,
+	OPT_PAM_WORKERS,
+	OPT_DDOS_PUZZLES,
+	OPT_METRICS_SOCKET,
 };
 
 static const struct option long_opts[] = {
@@ -483,6 +501,7 @@ static const struct option long_opts[] = {
 	{ "log-no-audit\0", no_argument, NULL, 'a' },
 	{ "force-busy\0", no_argument, NULL, 'D' },
 	{ "force-unlimited\0", no_argument, NULL, 'U' },
+	{ "ddos-puzzles\0", no_argument, NULL, OPT_DDOS_PUZZLES },
 	{ "crl-strict\0", no_argument, NULL, 'r' },
 	{ "ocsp-strict\0", no_argument, NULL, 'o' },
 	{ "ocsp-enable\0", no_argument, NULL, 'O' },
@@ -493,6 +512,7 @@ static const struct option long_opts[] = {
 	{ "ocsp-cache-min-age\0", required_argument, NULL, 'G' },
 	{ "ocsp-cache-max-age\0", required_argument, NULL, 'H' },
 	{ "ocsp-method\0", required_argument, NULL, 'B' },
+	{ "ocsp-prefetch\0", no_argument, NULL, OPT_OCSP_PREFETCH },
 	{ "crlcheckinterval\0", required_argument, NULL, 'x' },
 	{ "uniqueids\0", no_argument, NULL, 'u' },
 	{ "no-dnssec\0", no_argument, NULL, 'R' },
@@ -520,13 +540,18 @@ static const struct option long_opts[] = {
 	{ "coredir\0>dumpdir", required_argument, NULL, 'C' },	/* redundant spelling */
 	{ "dumpdir\0<dirname>", required_argument, NULL, 'C' },
 	{ "statsbin\0<filename>", required_argument, NULL, 'S' },
+	{ "metrics-socket\0<filename>", required_argument, NULL, OPT_METRICS_SOCKET },
 	{ "ipsecdir\0<ipsec-dir>", required_argument, NULL, 'f' },
 	{ "foodgroupsdir\0>ipsecdir", required_argument, NULL, 'f' },	/* redundant spelling */
 	{ "nssdir\0<path>", required_argument, NULL, 'd' },	/* nss-tools use -d */
 	{ "keep-alive\0<delay_secs>", required_argument, NULL, '2' },
 	{ "virtual-private\0<network_list>", required_argument, NULL, '6' },
 	{ "nhelpers\0<number>", required_argument, NULL, 'j' },
+	{ "updown-jobs\0<number>", required_argument, NULL, OPT_UPDOWN_JOBS },
+	{ "no-native-updown\0", no_argument, NULL, OPT_NO_NATIVE_UPDOWN },
+	{ "pam-workers\0<number>", required_argument, NULL, OPT_PAM_WORKERS },
 	{ "expire-shunt-interval\0<secs>", required_argument, NULL, '9' },
+	{ "kernel-reconcile\0", no_argument, NULL, OPT_KERNEL_RECONCILE },
 	{ "seedbits\0<number>", required_argument, NULL, 'c' },
 	/* really an attribute type, not a value */
 	{ "ikev1-secctx-attr-type\0<number>", required_argument, NULL, 'w' },
@@ -850,6 +875,11 @@ int main(int argc, char **argv)
 			pluto_stats_binary = clone_str(optarg, "statsbin");
 			continue;
 
+		case OPT_METRICS_SOCKET:	/* --metrics-socket */
+			pfreeany(pluto_metrics_socket);
+			pluto_metrics_socket = clone_str(optarg, "metrics-socket");
+			continue;
+
 		case 'v':	/* --version */
 			printf("%s%s\n", ipsec_version_string(), /* ok */
 			       compile_time_interop_options);
@@ -873,6 +903,40 @@ int main(int argc, char **argv)
 			}
 			continue;
 
+		case OPT_UPDOWN_JOBS:	/* --updown-jobs */
+		{
+			uintmax_t u;
+			check_err(shunk_to_uintmax(shunk1(optarg), NULL/*all*/,
+						   0/*any-base*/, &u),
+				  longindex, logger);
+			/* arbitrary */
+			if (u > 1000) {
+				fatal_opt(longindex, logger, "too big, more than 1000");
+			}
+			pluto_updown_jobs = u;
+			continue;
+		}
+
+		case OPT_NO_NATIVE_UPDOWN:	/* --no-native-updown */
+			pluto_native_updown = false;
+			continue;
+
+		case OPT_PAM_WORKERS:	/* --pam-workers */
+		{
+			uintmax_t u;
+			check_err(shunk_to_uintmax(shunk1(optarg), NULL/*all*/,
+						   0/*any-base*/, &u),
+				  longindex, logger);
+			/* arbitrary */
+			if (u > 100) {
+				fatal_opt(longindex, logger, "too big, more than 100");
+			}
+#ifdef USE_PAM_AUTH
+			pluto_pam_workers = u;
+#endif
+			continue;
+		}
+
 		case 'c':	/* --seedbits */
 			pluto_nss_seedbits = atoi(optarg);
 			if (pluto_nss_seedbits == 0) {
@@ -954,6 +1018,10 @@ int main(int argc, char **argv)
 				   longindex, logger);
 			continue;
 
+		case OPT_KERNEL_RECONCILE:	/* --kernel-reconcile */
+			pluto_kernel_reconcile = true;
+			continue;
+
 		case 'L':	/* --listen ip_addr */
 		{
 			ip_address lip;
@@ -1000,6 +1068,9 @@ int main(int argc, char **argv)
 		case 'U':	/* --force-unlimited */
 			pluto_ddos_mode = DDOS_FORCE_UNLIMITED;
 			continue;
+		case OPT_DDOS_PUZZLES:	/* --ddos-puzzles */
+			pluto_ddos_puzzles = true;
+			continue;
 
 #ifdef USE_SECCOMP
 		case '3':	/* --seccomp-enabled */
@@ -1099,6 +1170,10 @@ int main(int argc, char **argv)
 			}
 			continue;
 
+		case OPT_OCSP_PREFETCH:	/* --ocsp-prefetch */
+			ocsp_prefetch = true;
+			continue;
+
 		case 'u':	/* --uniqueids */
 			uniqueIDs = true;
 			continue;
@@ -1251,6 +1326,7 @@ int main(int argc, char **argv)
 			log_to_audit = cfg->setup.options[KBF_AUDIT_LOG];
 			pluto_drop_oppo_null = cfg->setup.options[KBF_DROP_OPPO_NULL];
 			pluto_ddos_mode = cfg->setup.options[KBF_DDOS_MODE];
+			pluto_ddos_puzzles = cfg->setup.options[KBF_DDOS_PUZZLES];
 			pluto_ikev1_pol = cfg->setup.options[KBF_GLOBAL_IKEv1];
 #ifndef USE_IKEv1
 			if (pluto_ikev1_pol != GLOBAL_IKEv1_DROP) {
@@ -1281,6 +1357,7 @@ int main(int argc, char **argv)
 			}
 			ocsp_method = cfg->setup.options[KBF_OCSP_METHOD];
 			ocsp_post = (ocsp_method == OCSP_METHOD_POST);
+			ocsp_prefetch = cfg->setup.options[KBF_OCSP_PREFETCH];
 			ocsp_cache_size = cfg->setup.options[KBF_OCSP_CACHE_SIZE];
 			if (cfg->setup.set[KBF_OCSP_CACHE_MIN_AGE_SECONDS]) {
 				ocsp_cache_min_age = deltatime(cfg->setup.options[KBF_OCSP_CACHE_MIN_AGE_SECONDS]);
@@ -1337,6 +1414,7 @@ int main(int argc, char **argv)
 #ifdef XFRM_LIFETIME_DEFAULT
 			pluto_xfrmlifetime = cfg->setup.options[KBF_XFRMLIFETIME];
 #endif
+			pluto_kernel_reconcile = cfg->setup.options[KBF_KERNEL_RECONCILE];
 
 			/* no config option: rundir */
 			/* secretsfile= */
@@ -1394,6 +1472,13 @@ int main(int argc, char **argv)
 				}
 			}
 
+			if (cfg->setup.strings[KSF_METRICS_SOCKET] != NULL) {
+				/* metrics-socket= */
+				pfreeany(pluto_metrics_socket);
+				pluto_metrics_socket = clone_str(cfg->setup.strings[KSF_METRICS_SOCKET],
+								 "metrics-socket via --config");
+			}
+
 			pluto_nss_seedbits = cfg->setup.options[KBF_SEEDBITS];
 			keep_alive = deltatime(cfg->setup.options[KBF_KEEPALIVE]);
 
@@ -1402,6 +1487,11 @@ int main(int argc, char **argv)
 			set_global_redirect_dests(cfg->setup.strings[KSF_GLOBAL_REDIRECT_TO]);
 
 			nhelpers = cfg->setup.options[KBF_NHELPERS];
+			pluto_updown_jobs = cfg->setup.options[KBF_UPDOWN_JOBS];
+			pluto_native_updown = cfg->setup.options[KBF_NATIVE_UPDOWN];
+#ifdef USE_PAM_AUTH
+			pluto_pam_workers = cfg->setup.options[KBF_PAM_WORKERS];
+#endif
 			cur_debugging = cfg->setup.options[KW_DEBUG];
 
 			char *protostack = cfg->setup.strings[KSF_PROTOSTACK];
@@ -1669,6 +1759,8 @@ int main(int argc, char **argv)
 	state_db_init(logger);
 	connection_db_init(logger);
 	spd_db_init(logger);
+	init_preloaded_pubkeys(logger);
+	init_cost_status(logger);
 
 	pluto_init_nss(oco->nssdir, logger);
 	if (is_fips_mode()) {
@@ -1734,6 +1826,9 @@ int main(int argc, char **argv)
 			      str_diag(d));
 		}
 		llog(RC_LOG, logger, "NSS OCSP started");
+		if (ocsp_prefetch) {
+			init_ocsp_cache(ocsp_uri, ocsp_cache_size, logger);
+		}
 	}
 
 #ifdef USE_NSS_KDF
@@ -1835,6 +1930,7 @@ int main(int argc, char **argv)
 	init_log_limiter();
 	init_nat_traversal_timer(keep_alive, logger);
 	init_ddns();
+	init_ddos_overload();
 
 	init_virtual_ip(virtual_private, logger);
 
@@ -1857,6 +1953,10 @@ int main(int argc, char **argv)
 		exit(PLUTO_EXIT_OK);
 	}
 
+#ifdef USE_PAM_AUTH
+	/* fork while pluto is still small and has no threads */
+	start_pam_auth_workers(logger);
+#endif
 	start_server_helpers(nhelpers, logger);
 	init_kernel(logger);
 #if defined(LIBCURL) || defined(LIBLDAP)
@@ -1877,6 +1977,7 @@ int main(int argc, char **argv)
 		}
 	}
 #endif
+	init_metrics_socket(logger);
 
 	run_server(conffile, logger);
 }
@@ -1892,10 +1993,11 @@ void show_setup_plutomain(struct show *s)
 		oco->secretsfile,
 		oco->confddir);
 
-	show(s, "nssdir=%s, dumpdir=%s, statsbin=%s",
+	show(s, "nssdir=%s, dumpdir=%s, statsbin=%s, metrics-socket=%s",
 		oco->nssdir,
 		coredir,
-		pluto_stats_binary == NULL ? "unset" :  pluto_stats_binary);
+		pluto_stats_binary == NULL ? "unset" :  pluto_stats_binary,
+		pluto_metrics_socket == NULL ? "unset" : pluto_metrics_socket);
 
 #ifdef USE_DNSSEC
 	show(s, "dnssec-rootkey-file=%s, dnssec-trusted=%s",
@@ -1919,6 +2021,7 @@ void show_setup_plutomain(struct show *s)
 #ifdef XFRM_LIFETIME_DEFAULT
 		jam(buf, ", xfrmlifetime=%jds", (intmax_t) pluto_xfrmlifetime);
 #endif
+		jam(buf, ", kernel-reconcile=%s", bool_str(pluto_kernel_reconcile));
 	}
 
 	show_log(s);
@@ -1962,6 +2065,8 @@ void show_setup_plutomain(struct show *s)
 		jam_deltatime(buf, ocsp_cache_max_age);
 		jam_string(buf, ", ocsp-method=");
 		jam_string(buf, (ocsp_method == OCSP_METHOD_GET ? "get" : "post"));
+		jam_string(buf, ", ocsp-prefetch=");
+		jam_string(buf, bool_str(ocsp_prefetch));
 	}
 
 	SHOW_JAMBUF(s, buf) {
@@ -38,7 +38,7 @@
 #include "initiate.h"			/* for initiate_connection() */
 #include "acquire.h"			/* for initiate_ondemand() */
 #include "keys.h"			/* for load_preshared_secrets() */
-#include "crl_queue.h"			/* for submit_crl_fetch_requests() */
+#include "crl_queue.h"			/* for submit_crl_fetch_requests() flush_crl_issuers() */
 #include "nss_cert_reread.h"		/* for reread_cert_connections() */
 #include "root_certs.h"			/* for free_root_certs() */
 #include "server.h"			/* for listening; */
@@ -52,7 +52,12 @@
 #include "ikev2_redirect.h"		/* for find_and_active_redirect_states() */
 #include "addresspool.h"		/* for show_addresspool_status() */
 #include "pluto_stats.h"		/* for clear_pluto_stats() et.al. */
+#include "pluto_latency.h"		/* for clear_latency_histograms() et.al. */
+#include "pluto_cost.h"			/* for show_cost_status() et.al. */
+#include "server_pool.h"			/* for clear_server_helper_stats() */
+#include "pluto_replay.h"			/* for whack_replay() */
 #include "server_fork.h"		/* for show_process_status() */
+#include "updown.h"			/* for show_updown_status() */
 #include "ddns.h"			/* for connection_check_ddns() */
 
 #include "whack_add.h"
@@ -75,6 +80,7 @@
 #include "whack_trafficstatus.h"
 #include "whack_unroute.h"
 #include "whack_showstates.h"
+#include "ocsp_cache.h"		/* for list_ocsp_cache() */
 
 static void whack_rereadsecrets(struct show *s)
 {
@@ -90,6 +96,8 @@ static void whack_rereadcerts(struct show *s)
 {
 	reread_cert_connections(show_logger(s));
 	free_root_certs(show_logger(s));
+	/* re-enumerate NSS's certificates on the next CRL check */
+	flush_crl_issuers();
 }
 
 static void whack_listcacerts(struct show *s)
@@ -119,6 +127,8 @@ static void do_whacklisten(struct logger *logger)
 
 	load_preshared_secrets(logger);
 	load_groups(logger);
+	/* everything is routed; delete what the previous pluto left */
+	reconcile_kernel(logger);
 #ifdef USE_SYSTEMD_WATCHDOG
 	pluto_sd(PLUTO_SD_READY, SD_REPORT_NO_STATUS);
 #endif
@@ -201,7 +211,7 @@ static void key_add_request(const struct whack_message *msg, struct logger *logg
 			llog(LOG_STREAM/*not-whack*/, logger,
 			     "delete keyid %s", msg->keyid);
 		}
-		delete_public_keys(&pluto_pubkeys, &keyid, type);
+		delete_preloaded_pubkeys(&keyid, type);
 		/* XXX: what about private keys; suspect not easy as not 1:1? */
 	}
 
@@ -225,13 +235,15 @@ static void key_add_request(const struct whack_message *msg, struct logger *logg
 
 		/* add the public key */
 		struct pubkey *pubkey = NULL; /* must-delref */
+		struct pubkey_list *pubkeys = NULL;
 		diag_t d = unpack_dns_ipseckey(&keyid, PUBKEY_LOCAL, msg->pubkey_alg,
 					       /*install_time*/realnow(),
 					       /*until_time*/realtime_epoch,
 					       /*ttl*/0,
 					       HUNK_AS_SHUNK(msg->keyval),
 					       &pubkey/*new-public-key:must-delref*/,
-					       &pluto_pubkeys);
+					       &pubkeys);
+		add_preloaded_pubkeys(&pubkeys);
 		if (d != NULL) {
 			llog(RC_LOG, logger, "%s", str_diag(d));
 			pfree_diag(&d);
@@ -560,6 +572,7 @@ static void whack_process(const struct whack_message *const m, struct show *s)
 #if defined(LIBCURL) || defined(LIBLDAP)
 		list_crl_fetch_requests(s, m->whack_utc);
 #endif
+		list_ocsp_cache(s, m->whack_utc);
 		dbg_whack(s, "listcrls: stop:");
 	}
 
@@ -622,6 +635,9 @@ static void whack_process(const struct whack_message *const m, struct show *s)
 	if (m->whack_clear_stats) {
 		dbg_whack(s, "clearstats: start:");
 		clear_pluto_stats();
+		clear_latency_histograms();
+		clear_cost_status();
+		clear_server_helper_stats();
 		dbg_whack(s, "clearstats: stop:");
 	}
 
@@ -652,9 +668,22 @@ static void whack_process(const struct whack_message *const m, struct show *s)
 	if (m->whack_processstatus) {
 		dbg_whack(s, "processstatus: start:");
 		show_process_status(s);
+		show_updown_status(s);
 		dbg_whack(s, "processstatus: stop:");
 	}
 
+	if (m->whack_coststatus) {
+		dbg_whack(s, "coststatus: start:");
+		show_cost_status(s);
+		dbg_whack(s, "coststatus: stop:");
+	}
+
+	if (m->whack_replay != NULL) {
+		dbg_whack(s, "replay: start: %s", m->whack_replay);
+		whack_replay(m->whack_replay, logger);
+		dbg_whack(s, "replay: stop: %s", m->whack_replay);
+	}
+
 	if (m->whack_addresspoolstatus) {
 		dbg_whack(s, "addresspoolstatus: start:");
 		show_addresspool_status(s);
@@ -754,6 +783,55 @@ static void whack_process(const struct whack_message *const m, struct show *s)
 
 static void whack_handle(struct fd *whackfd, struct logger *whack_logger);
 
+/*
+ * For the latency histograms.  A message can contain several
+ * commands; bill it to the first one whack_process() would run.
+ */
+
+static const char *whack_command_name(const struct whack_message *m)
+{
+	return (!lmod_empty(m->debugging) ? "debugging" :
+		m->impairments.len > 0 ? "impair" :
+		m->whack_sa ? "sa" :
+		m->whack_delete ? "delete" :
+		m->whack_deleteuser ? "deleteuser" :
+		m->whack_deleteid ? "deleteid" :
+		m->whack_deletestate ? "deletestate" :
+		m->whack_crash ? "crash" :
+		m->whack_add ? "add" :
+		m->whack_listen ? "listen" :
+		m->whack_unlisten ? "unlisten" :
+		m->whack_ddos != DDOS_undefined ? "ddos" :
+		m->whack_ddns ? "ddns" :
+		m->whack_rereadsecrets ? "rereadsecrets" :
+		m->whack_listpubkeys ? "listpubkeys" :
+		m->whack_checkpubkeys ? "checkpubkeys" :
+		m->whack_purgeocsp ? "purgeocsp" :
+		m->whack_fetchcrls ? "fetchcrls" :
+		m->whack_rereadcerts ? "rereadcerts" :
+		m->whack_list != LEMPTY ? "list" :
+		m->whack_key ? "key" :
+		m->whack_route ? "route" :
+		m->whack_unroute ? "unroute" :
+		m->whack_initiate ? "initiate" :
+		m->whack_oppo_initiate ? "oppo_initiate" :
+		m->whack_down ? "down" :
+		m->whack_globalstatus ? "globalstatus" :
+		m->whack_clear_stats ? "clearstats" :
+		m->whack_trafficstatus ? "trafficstatus" :
+		m->whack_shuntstatus ? "shuntstatus" :
+		m->whack_fipsstatus ? "fipsstatus" :
+		m->whack_briefstatus ? "briefstatus" :
+		m->whack_processstatus ? "processstatus" :
+		m->whack_coststatus ? "coststatus" :
+		m->whack_replay != NULL ? "replay" :
+		m->whack_addresspoolstatus ? "addresspoolstatus" :
+		m->whack_connectionstatus ? "connectionstatus" :
+		m->whack_briefconnectionstatus ? "briefconnectionstatus" :
+		m->whack_showstates ? "showstates" :
+		"other");
+}
+
 void whack_handle_cb(int fd, void *arg UNUSED, struct logger *global_logger)
 {
 	threadtime_t start = threadtime_start();
@@ -829,10 +907,13 @@ static void whack_handle(struct fd *whackfd, struct logger *whack_logger)
 		return; /* force shutting down */
 	}
 
+	threadtime_t start = threadtime_start();
+
 	if (msg.basic.whack_status) {
 		struct show *s = alloc_show(whack_logger);
 		whack_status(s, mononow());
 		free_show(&s);
+		record_whack_latency("status", threadtime_usage(&start));
 		/* bail early, but without complaint */
 		return; /* don't shutdown */
 	}
@@ -840,4 +921,5 @@ static void whack_handle(struct fd *whackfd, struct logger *whack_logger)
 	struct show *s = alloc_show(whack_logger);
 	whack_process(&msg, s);
 	free_show(&s);
+	record_whack_latency(whack_command_name(&msg), threadtime_usage(&start));
 }
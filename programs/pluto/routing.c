@@ -1628,6 +1628,78 @@ void connection_resume(struct child_sa *child, where_t where)
 	dispatch(CONNECTION_RESUME, cc, logger, &annex);
 }
 
+/*
+ * Asynchronous updown (updown-jobs=) returns success before the
+ * command has run; this is the after-the-fact failure.
+ *
+ * Do what the synchronous code would have done had it known: an
+ * on-demand route that couldn't be added is unrouted; a Child SA
+ * whose "route" or "up" failed is torn down (and, per policy,
+ * revived).
+ * Anything else only gets logged.
+ */
+
+void connection_updown_failed(enum updown updown,
+			      co_serial_t co_serialno,
+			      so_serial_t so_serialno,
+			      struct logger *logger)
+{
+	switch (updown) {
+	case UPDOWN_ROUTE:
+	{
+		if (so_serialno != SOS_NOBODY) {
+			/*
+			 * The route was added while establishing the
+			 * Child SA; the synchronous path would have
+			 * failed the install so, as for up, get rid
+			 * of the Child SA.
+			 */
+			struct child_sa *child = child_sa_by_serialno(so_serialno);
+			if (child == NULL) {
+				ldbg(logger, "updown: route failed but "PRI_SO" has gone",
+				     pri_so(so_serialno));
+				return;
+			}
+			llog(RC_LOG, child->sa.logger, "route command failed, expiring %s",
+			     state_sa_name(&child->sa));
+			set_sa_expire_next_event(SA_HARD_EXPIRED, child);
+			return;
+		}
+		struct connection *c = connection_by_serialno(co_serialno);
+		if (c == NULL) {
+			ldbg(logger, "updown: route failed but "PRI_CO" has gone",
+			     pri_co(co_serialno));
+			return;
+		}
+		if (c->routing.state != RT_ROUTED_ONDEMAND) {
+			/* something else has since happened */
+			enum_buf rb;
+			ldbg_routing(c->logger, "updown: route failed but connection is %s",
+				     str_enum_short(&routing_names, c->routing.state, &rb));
+			return;
+		}
+		llog(RC_LOG, c->logger, "route command failed, unrouting connection");
+		connection_unroute(c, HERE);
+		return;
+	}
+	case UPDOWN_UP:
+	{
+		struct child_sa *child = child_sa_by_serialno(so_serialno);
+		if (child == NULL) {
+			ldbg(logger, "updown: up failed but #%lu has gone", so_serialno);
+			return;
+		}
+		llog(RC_LOG, child->sa.logger, "up command failed, expiring %s",
+		     state_sa_name(&child->sa));
+		set_sa_expire_next_event(SA_HARD_EXPIRED, child);
+		return;
+	}
+	default:
+		/* as for the synchronous case; already logged */
+		return;
+	}
+}
+
 static bool dispatch_1(enum routing_event event,
 		       struct connection *c,
 		       struct logger *logger,
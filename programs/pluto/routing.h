@@ -33,6 +33,7 @@ struct child_sa;
 struct ike_sa;
 enum direction;
 enum initiated_by;
+enum updown;
 struct spd;
 
 /*
@@ -115,6 +116,15 @@ bool connection_establish_child(struct ike_sa *ike, struct child_sa *child, wher
 bool connection_establish_inbound(struct child_sa *child, where_t where);
 bool connection_establish_outbound(struct ike_sa *ike, struct child_sa *child, where_t where);
 
+/*
+ * An asynchronous updown command failed; the connection and/or
+ * child may have since been deleted.
+ */
+void connection_updown_failed(enum updown updown,
+			      co_serial_t co_serialno,
+			      so_serial_t so_serialno,
+			      struct logger *logger);
+
 PRINTF_LIKE(2)
 void ldbg_routing(struct logger *logger, const char *fmt, ...);
 
@@ -43,6 +43,8 @@
 #include "ip_protocol.h"
 #include "iface.h"
 #include "impair_message.h"
+#include "pluto_usdt.h"
+#include "pluto_replay.h"
 
 /* send_ike_msg logic is broken into layers.
  * The rest of the system thinks it is simple.
@@ -172,6 +174,11 @@ static bool send_shunks(const char *where, bool just_a_keepalive,
 		llog_dump_hunk(DEBUG_STREAM, logger, packet);
 	}
 
+	if (replay_discards_outbound(packet)) {
+		/* pretend it was sent */
+		return true;
+	}
+
 	if (!impair_outbound(interface, packet, &remote_endpoint, logger)) {
 		ssize_t wlen = interface->io->write_packet(interface, packet,
 							   &remote_endpoint, logger);
@@ -190,6 +197,7 @@ static bool send_shunks(const char *where, bool just_a_keepalive,
 			return false;
 		}
 		pstats_ike_bytes.out += len;
+		PLUTO_PROBE(send, serialno, pluto_probe_msgid(a), len);
 	}
 
 	/*
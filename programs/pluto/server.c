@@ -86,6 +86,7 @@
 #include "hash_table.h"
 #include "ip_address.h"
 #include "ip_info.h"
+#include "pluto_latency.h"	/* for md_latency_resume() et.al. */
 
 /*
  *  Server main loop and socket initialization routines.
@@ -174,6 +175,7 @@ bool pluto_listen_udp = true;
 bool pluto_listen_tcp = false;
 
 enum ddos_mode pluto_ddos_mode = DDOS_AUTO; /* default to auto-detect */
+bool pluto_ddos_puzzles = false; /* send RFC 8019 puzzles with cookies? */
 
 enum global_ikev1_policy pluto_ikev1_pol = GLOBAL_IKEv1_DROP;
 
@@ -237,6 +239,8 @@ struct global_timer_desc {
 	struct event ev;
 	global_timer_cb *cb;
 	const char *const name;
+	monotime_t due;			/* for event-loop lag */
+	deltatime_t period;		/* when periodic */
 };
 
 static struct global_timer_desc global_timers[] = {
@@ -248,6 +252,7 @@ static struct global_timer_desc global_timers[] = {
 	E(EVENT_CHECK_CRLS),
 	E(EVENT_FREE_ROOT_CERTS),
 	E(EVENT_RESET_LOG_LIMITER),
+	E(EVENT_CHECK_OVERLOAD),
 #undef E
 };
 
@@ -262,7 +267,13 @@ static void global_timer_event_cb(evutil_socket_t fd UNUSED,
 	passert(gt < global_timers + elemsof(global_timers));
 	dbg("processing global timer %s", gt->name);
 	threadtime_t start = threadtime_start();
+	monotime_t now = monotime_from_threadtime(start);
+	record_event_loop_lag(deltatime_max(monotimediff(now, gt->due), deltatime_zero));
+	if (gt->period.is_set) {
+		gt->due = monotime_add(now, gt->period);
+	}
 	gt->cb(logger);
+	record_event_loop_callback("global", gt->name, HERE, &start, logger);
 	threadtime_stop(&start, SOS_NOBODY, "global timer %s", gt->name);
 }
 
@@ -296,6 +307,8 @@ void enable_periodic_timer(enum global_timer type, global_timer_cb *cb,
 	struct global_timer_desc *gt = &global_timers[type];
 	passert(gt->name != NULL);
 	gt->cb = cb;
+	gt->period = period;
+	gt->due = monotime_add(mononow(), period);
 	struct timeval t = timeval_from_deltatime(period);
 	EVENT_ADD(gt, EV_TIMEOUT|EV_PERSIST,
 		  (evutil_socket_t)-1, &t,
@@ -331,6 +344,7 @@ void schedule_oneshot_timer(enum global_timer type, deltatime_t delay)
 	    gt->name, str_deltatime(delay, &buf));
 	passert(event_initialized(&gt->ev));
 	passert(event_get_events(&gt->ev) == (EV_TIMEOUT));
+	gt->due = monotime_add(mononow(), delay);
 	struct timeval t = timeval_from_deltatime(delay);
 	passert(event_add(&gt->ev, &t) >= 0);
 }
@@ -418,6 +432,7 @@ static void signal_handler_handler(evutil_socket_t fd UNUSED,
 	dbg("processing signal %s", se->name);
 	threadtime_t start = threadtime_start();
 	se->cb(logger);
+	record_event_loop_callback("signal", se->name, HERE, &start, logger);
 	threadtime_stop(&start, SOS_NOBODY, "signal handler %s", se->name);
 }
 
@@ -461,6 +476,7 @@ struct fd_read_listener {
 	fd_read_listener_cb *cb;
 	void *arg;
 	const char *name;
+	where_t where;			/* who attached it */
 	struct event ev;		/* libevent data structure */
 	struct fd_read_listener *next;
 };
@@ -527,6 +543,8 @@ struct timeout {
 	void (*cb)(void *arg, const struct timer_event *event);
 	void *arg;
 	struct event ev;
+	monotime_t due;			/* for event-loop lag */
+	where_t where;
 };
 
 static void timeout(evutil_socket_t fd UNUSED,
@@ -537,19 +555,27 @@ static void timeout(evutil_socket_t fd UNUSED,
 		.inception = threadtime_start(),
 		.logger = &global_logger,
 	};
+	monotime_t now = monotime_from_threadtime(event.inception);
+	record_event_loop_lag(deltatime_max(monotimediff(now, tt->due), deltatime_zero));
+	/* the callback can free TT */
+	const char *name = tt->name;
+	where_t where = tt->where;
 	tt->cb(tt->arg, &event);
+	record_event_loop_callback("timer", name, where, &event.inception, event.logger);
 }
 
-void schedule_timeout(const char *name,
-		      struct timeout **tt, const deltatime_t delay,
-		      void (*cb)(void *arg, const struct timer_event *event),
-		      void *arg)
+void schedule_timeout_where(const char *name,
+			    struct timeout **tt, const deltatime_t delay,
+			    void (*cb)(void *arg, const struct timer_event *event),
+			    void *arg, where_t where)
 {
 	*tt = alloc_thing(struct timeout, name);
 	dbg_alloc("tt", *tt, HERE);
 	(*tt)->name = name;
 	(*tt)->cb = cb;
 	(*tt)->arg = arg;
+	(*tt)->due = monotime_add(mononow(), delay);
+	(*tt)->where = where;
 	/*
 	 * When DELAY is zero, the photon torpedo may have hit its
 	 * target before this function even returns.  Hence TT is a
@@ -642,6 +668,7 @@ static void resume_handler(void *arg, const struct timer_event *event)
 		pexpect(old_md_st == SOS_NOBODY || old_md_st == old_st);
 
 		/* run the callback */
+		md_latency_resume(e->md);
 		stf_status status = e->callback(st, e->md, e->context);
 		/* this may trash ST and/or MD.ST */
 
@@ -686,9 +713,10 @@ static void resume_handler(void *arg, const struct timer_event *event)
 	pfree(e);
 }
 
-void schedule_resume(const char *name, so_serial_t serialno,
-		     struct msg_digest **mdp,
-		     resume_cb *callback, void *context)
+void schedule_resume_where(const char *name, so_serial_t serialno,
+			   struct msg_digest **mdp,
+			   resume_cb *callback, void *context,
+			   where_t where)
 {
 	pexpect(serialno != SOS_NOBODY);
 	/*
@@ -721,7 +749,7 @@ void schedule_resume(const char *name, so_serial_t serialno,
 	 * Event may have even run on another thread before the below
 	 * call returns.
 	 */
-	schedule_timeout(name, &e->timer, deltatime(0), resume_handler, e);
+	schedule_timeout_where(name, &e->timer, deltatime(0), resume_handler, e, where);
 }
 
 /*
@@ -773,9 +801,10 @@ static void callback_handler(void *arg, const struct timer_event *event)
 	threadtime_stop(&start, SOS_NOBODY, "callback %s", e.story);
 }
 
-void schedule_callback(const char *story, deltatime_t delay,
-		       so_serial_t serialno,
-		       callback_cb *callback, void *context)
+void schedule_callback_where(const char *story, deltatime_t delay,
+			     so_serial_t serialno,
+			     callback_cb *callback, void *context,
+			     where_t where)
 {
 	struct callback_event tmp = {
 		.serialno = serialno,
@@ -790,7 +819,7 @@ void schedule_callback(const char *story, deltatime_t delay,
 	 * Event may have even run on another thread before the below
 	 * call returns.
 	 */
-	schedule_timeout(story, &e->timer, delay, callback_handler, e);
+	schedule_timeout_where(story, &e->timer, delay, callback_handler, e, where);
 }
 
 static void fd_read_listener_event_handler(evutil_socket_t fd,
@@ -799,12 +828,18 @@ static void fd_read_listener_event_handler(evutil_socket_t fd,
 {
 	struct logger logger[1] = { global_logger, }; /* event-handler */
 	struct fd_read_listener *fdl = arg;
+	/* the callback can detach FDL */
+	const char *name = fdl->name;
+	where_t where = fdl->where;
+	threadtime_t start = threadtime_start();
 	fdl->cb(fd, fdl->arg, logger);
+	record_event_loop_callback("fd", name, where, &start, logger);
 }
 
-void attach_fd_read_listener(struct fd_read_listener **fdl,
-			     int fd, const char *name,
-			     fd_read_listener_cb *cb, void *arg)
+void attach_fd_read_listener_where(struct fd_read_listener **fdl,
+				   int fd, const char *name,
+				   fd_read_listener_cb *cb, void *arg,
+				   where_t where)
 {
 	passert(*fdl == NULL);
 	passert(fd >= 0);
@@ -812,6 +847,7 @@ void attach_fd_read_listener(struct fd_read_listener **fdl,
 	*fdl = alloc_thing(struct fd_read_listener, name);
 	dbg_alloc("fdl", *fdl, HERE);
 	(*fdl)->name = name;
+	(*fdl)->where = where;
 	(*fdl)->arg = arg;
 	(*fdl)->cb = cb;
 	EVENT_ADD(*fdl, EV_READ|EV_PERSIST,
@@ -830,12 +866,13 @@ void detach_fd_read_listener(struct fd_read_listener **fdl)
 	}
 }
 
-void add_fd_read_listener(int fd, const char *name,
-			  fd_read_listener_cb *cb, void *arg)
+void add_fd_read_listener_where(int fd, const char *name,
+				fd_read_listener_cb *cb, void *arg,
+				where_t where)
 {
 	passert(in_main_thread());
 	struct fd_read_listener *fdl = NULL;
-	attach_fd_read_listener(&fdl, fd, name, cb, arg);
+	attach_fd_read_listener_where(&fdl, fd, name, cb, arg, where);
 	link_pluto_event_list(fdl);
 }
 
@@ -843,6 +880,7 @@ struct fd_accept_listener {
 	fd_accept_listener_cb *cb;
 	void *arg;
 	const char *name;
+	where_t where;			/* who attached it */
 	struct evconnlistener *ev;
 };
 
@@ -858,12 +896,17 @@ static void fd_accept_listener(struct evconnlistener *efc UNUSED,
 	};
 	passert(sockaddr_len >= 0 && (size_t)sockaddr_len <= sizeof(sa.sa));
 	memcpy(&sa.sa, sockaddr, sockaddr_len);
+	const char *name = fdl->name;
+	where_t where = fdl->where;
+	threadtime_t start = threadtime_start();
 	fdl->cb(fd, &sa, fdl->arg, logger);
+	record_event_loop_callback("accept", name, where, &start, logger);
 }
 
-void attach_fd_accept_listener(const char *name,
-			       struct fd_accept_listener **fdl,
-			       int fd, fd_accept_listener_cb *cb, void *arg)
+void attach_fd_accept_listener_where(const char *name,
+				     struct fd_accept_listener **fdl,
+				     int fd, fd_accept_listener_cb *cb, void *arg,
+				     where_t where)
 {
 	passert(*fdl == NULL);
 	passert(fd >= 0);
@@ -872,6 +915,7 @@ void attach_fd_accept_listener(const char *name,
 	(*fdl)->cb = cb;
 	(*fdl)->arg = arg;
 	(*fdl)->name = name;
+	(*fdl)->where = where;
 	(*fdl)->ev = evconnlistener_new(pluto_eb, fd_accept_listener, *fdl,
 					LEV_OPT_CLOSE_ON_FREE|LEV_OPT_CLOSE_ON_EXEC,
 					/*backlog*/-1, fd);
@@ -1102,6 +1146,8 @@ void set_whack_pluto_ddos(enum ddos_mode mode, struct logger *logger)
 
 	pluto_ddos_mode = mode;
 	llog(RC_LOG, logger, "pluto DDoS protection mode set to %s", modestr);
+	/* auto-detect may have been dropping new exchanges */
+	update_new_exchange_filters(logger);
 }
 
 struct event_base *get_pluto_event_base(void)
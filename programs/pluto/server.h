@@ -65,6 +65,7 @@ extern enum ddos_mode pluto_ddos_mode; /* auto-detect or manual */
 extern enum global_ikev1_policy pluto_ikev1_pol; /* accept, drop or reject */
 extern unsigned int pluto_max_halfopen; /* Max allowed half-open IKE SA's before refusing */
 extern unsigned int pluto_ddos_threshold; /* Max incoming IKE before activating DCOOKIES */
+extern bool pluto_ddos_puzzles; /* send RFC 8019 puzzles with cookies? */
 extern deltatime_t pluto_shunt_lifetime; /* lifetime before we cleanup bare shunts (for OE) */
 extern unsigned int pluto_sock_bufsize; /* pluto IKE socket buffer */
 extern bool pluto_sock_errqueue; /* Enable MSG_ERRQUEUE on IKE socket */
@@ -85,28 +86,39 @@ struct timer_event {
 	struct logger *logger;
 };
 
-void schedule_timeout(const char *name,
-		      struct timeout **to, const deltatime_t delay,
-		      void (*cb)(void *arg, const struct timer_event *event),
-		      void *arg);
+void schedule_timeout_where(const char *name,
+			    struct timeout **to, const deltatime_t delay,
+			    void (*cb)(void *arg, const struct timer_event *event),
+			    void *arg, where_t where);
+#define schedule_timeout(NAME, TO, DELAY, CB, ARG)			\
+	schedule_timeout_where(NAME, TO, DELAY, CB, ARG, HERE)
 void destroy_timeout(struct timeout **to);
 
 typedef void (fd_accept_listener_cb)(int fd, ip_sockaddr *sa,
 				     void *arg, struct logger *logger);
-void attach_fd_accept_listener(const char *name,
-			       struct fd_accept_listener **fdl, int fd,
-			       fd_accept_listener_cb *cb, void *arg);
+void attach_fd_accept_listener_where(const char *name,
+				     struct fd_accept_listener **fdl, int fd,
+				     fd_accept_listener_cb *cb, void *arg,
+				     where_t where);
+#define attach_fd_accept_listener(NAME, FDL, FD, CB, ARG)		\
+	attach_fd_accept_listener_where(NAME, FDL, FD, CB, ARG, HERE)
 void detach_fd_accept_listener(struct fd_accept_listener **fdl);
 
 typedef void (fd_read_listener_cb)(int fd, void *arg, struct logger *logger);
 
-void attach_fd_read_listener(struct fd_read_listener **fdl,
-			     int fd, const char *name,
-			     fd_read_listener_cb *cb, void *arg);
+void attach_fd_read_listener_where(struct fd_read_listener **fdl,
+				   int fd, const char *name,
+				   fd_read_listener_cb *cb, void *arg,
+				   where_t where);
+#define attach_fd_read_listener(FDL, FD, NAME, CB, ARG)			\
+	attach_fd_read_listener_where(FDL, FD, NAME, CB, ARG, HERE)
 void detach_fd_read_listener(struct fd_read_listener **fdl);
 
-void add_fd_read_listener(int fd, const char *name,
-			  fd_read_listener_cb *cb, void *arg);
+void add_fd_read_listener_where(int fd, const char *name,
+				fd_read_listener_cb *cb, void *arg,
+				where_t where);
+#define add_fd_read_listener(FD, NAME, CB, ARG)			\
+	add_fd_read_listener_where(FD, NAME, CB, ARG, HERE)
 
 extern void set_pluto_busy(bool busy);
 extern void set_whack_pluto_ddos(enum ddos_mode mode, struct logger *logger);
@@ -143,10 +155,13 @@ extern struct event_base *get_pluto_event_base(void);
 typedef stf_status resume_cb(struct state *st,
 			     struct msg_digest *md,
 			     void *context);
-void schedule_resume(const char *name,
-		     so_serial_t serialno,
-		     struct msg_digest **mdp,
-		     resume_cb *callback, void *context);
+void schedule_resume_where(const char *name,
+			   so_serial_t serialno,
+			   struct msg_digest **mdp,
+			   resume_cb *callback, void *context,
+			   where_t where);
+#define schedule_resume(NAME, SERIALNO, MDP, CALLBACK, CONTEXT)		\
+	schedule_resume_where(NAME, SERIALNO, MDP, CALLBACK, CONTEXT, HERE)
 
 /*
  * Schedule a callback on the main event loop now.
@@ -159,9 +174,12 @@ void schedule_resume(const char *name,
  */
 
 typedef void callback_cb(const char *story, struct state *st, void *context);
-void schedule_callback(const char *story, deltatime_t delay,
-		       so_serial_t serialno,
-		       callback_cb *callback, void *context);
+void schedule_callback_where(const char *story, deltatime_t delay,
+			     so_serial_t serialno,
+			     callback_cb *callback, void *context,
+			     where_t where);
+#define schedule_callback(STORY, DELAY, SERIALNO, CALLBACK, CONTEXT)	\
+	schedule_callback_where(STORY, DELAY, SERIALNO, CALLBACK, CONTEXT, HERE)
 
 void whack_impair_call_global_event_handler(enum global_timer type,
 					    struct logger *logger);
@@ -16,6 +16,8 @@
 #ifndef SERVER_FORK_H
 #define SERVER_FORK_H
 
+#include <sys/types.h>		/* for pid_t */
+
 struct logger;
 struct msg_digest;
 struct state;
@@ -50,12 +52,15 @@ extern int server_fork(const char *name,
 		       server_fork_op *op,
 		       server_fork_cb *callback, void *callback_context,
 		       struct logger *logger);
-void server_fork_exec(const char *path,
+/* returns -1, without calling CALLBACK, when the fork fails */
+pid_t server_fork_exec(const char *path,
 		      char *argv[], char *envp[],
 		      server_fork_cb *callback, void *callback_context,
 		      struct logger *logger);
 
 void server_fork_sigchld_handler(struct logger *logger);
+/* block until PID exits, then call its CALLBACK */
+void server_fork_wait(pid_t pid, struct logger *logger);
 void init_server_fork(struct logger *logger);
 void check_server_fork(struct logger *logger);
 void show_process_status(struct show *s);
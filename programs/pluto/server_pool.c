@@ -44,6 +44,10 @@
 #include "pluto_timing.h"
 #include "connections.h"
 #include "demux.h"			/* for md_addref() md_delref() */
+#include "timer.h"			/* for event_force() */
+#include "show.h"
+#include "pluto_latency.h"		/* for record_task_latency() */
+#include "pluto_usdt.h"
 
 #ifdef USE_SECCOMP
 # include "pluto_seccomp.h"
@@ -77,6 +81,36 @@ static callback_cb call_server_helpers_stopped_callback; /* type assertion */
 typedef enum { JOB_ID_MIN = 1, JOB_ID_MAX = UINT_MAX, } job_id_t;
 typedef enum { HELPER_ID_MIN = 1, HELPER_ID_MAX = UINT_MAX, } helper_id_t;
 
+/*
+ * Job priority classes.
+ *
+ * Under an IKE_SA_INIT flood the backlog fills up with DH work for
+ * brand new unauthenticated peers.  So that work for existing SAs
+ * (IKE_AUTH, rekeys) isn't stuck behind it (and those SAs don't
+ * expire), the backlog is split into classes and the helpers always
+ * take the oldest job from the highest priority non-empty class.
+ *
+ * A half-open job that sat in the backlog for longer than
+ * STALE_HALF_OPEN_JOB_SECONDS is for a peer that has most likely
+ * given up; instead of being computed it is thrown back to the main
+ * thread which deletes the state.
+ */
+
+enum job_priority {
+	JOB_ESTABLISHED,	/* under an established IKE SA */
+	JOB_AUTHENTICATING,	/* IKE SA past IKE_SA_INIT, or initiating */
+	JOB_HALF_OPEN,		/* responder IKE SA without SKEYSEED */
+#define JOB_PRIORITY_ROOF (JOB_HALF_OPEN + 1)
+};
+
+static const char *const job_priority_name[JOB_PRIORITY_ROOF] = {
+	[JOB_ESTABLISHED] = "established",
+	[JOB_AUTHENTICATING] = "authenticating",
+	[JOB_HALF_OPEN] = "halfopen",
+};
+
+#define STALE_HALF_OPEN_JOB_SECONDS 5
+
 struct job {
 	struct task *task;
 	const struct task_handler *handler;
@@ -85,9 +119,13 @@ struct job {
 	so_serial_t task_so;			/* sponsoring state-object's serial number */
 	struct msg_digest *md;
 	bool cancelled;
+	bool stale;
+	enum job_priority priority;
+	monotime_t queued;
 	where_t where;
 	job_id_t job_id;
 	helper_id_t helper_id;
+	deltatime_t time_waited;		/* in the backlog */
 	struct cpu_usage time_used;
 
 	/* where to send messages */
@@ -128,6 +166,9 @@ static size_t jam_backlog(struct jambuf *buf, const void *data)
 	if (job->cancelled) {
 		s += jam(buf, " cancelled");
 	}
+	if (job->stale) {
+		s += jam(buf, " stale");
+	}
 	if (job->where != NULL) {
 		s += jam(buf, " %s", job->where->func);
 	}
@@ -142,15 +183,33 @@ LIST_INFO(job, backlog, backlog_info, jam_backlog);
 static pthread_mutex_t backlog_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t backlog_cond = PTHREAD_COND_INITIALIZER;
 
-struct list_head backlog = INIT_LIST_HEAD(&backlog, &backlog_info);
-static int backlog_queue_len = 0;
+static struct list_head backlog[JOB_PRIORITY_ROOF] = {
+	[JOB_ESTABLISHED] = INIT_LIST_HEAD(&backlog[JOB_ESTABLISHED], &backlog_info),
+	[JOB_AUTHENTICATING] = INIT_LIST_HEAD(&backlog[JOB_AUTHENTICATING], &backlog_info),
+	[JOB_HALF_OPEN] = INIT_LIST_HEAD(&backlog[JOB_HALF_OPEN], &backlog_info),
+};
+static unsigned backlog_depth[JOB_PRIORITY_ROOF];
+static unsigned backlog_max[JOB_PRIORITY_ROOF];	/* since cleared */
+static unsigned backlog_max_all;		/* ditto, all classes */
+static uintmax_t stale_jobs;
+static deltatime_t backlog_wait;	/* longest wait since last sample */
 
 static void message_helpers(struct job *job)
 {
 	pthread_mutex_lock(&backlog_mutex);
 	if (job != NULL) {
-		insert_list_entry(&backlog, &job->backlog);
-		backlog_queue_len++;
+		insert_list_entry(&backlog[job->priority], &job->backlog);
+		backlog_depth[job->priority]++;
+		if (backlog_depth[job->priority] > backlog_max[job->priority]) {
+			backlog_max[job->priority] = backlog_depth[job->priority];
+		}
+		unsigned depth = 0;
+		for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+			depth += backlog_depth[p];
+		}
+		if (depth > backlog_max_all) {
+			backlog_max_all = depth;
+		}
 	}
 	/* wake up threads waiting for work */
 	pthread_cond_signal(&backlog_cond);
@@ -158,13 +217,53 @@ static void message_helpers(struct job *job)
 }
 
 /*
- * Note: this per-helper struct is never modified in a helper thread
+ * Remove the next job from the backlog, highest priority first.
+ * Caller must hold backlog_mutex.
+ */
+
+static struct job *next_job(helper_id_t helper_id)
+{
+	for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+		struct job *job = NULL;
+		FOR_EACH_LIST_ENTRY_OLD2NEW(job, &backlog[p]) { break; }
+		if (job == NULL) {
+			continue;
+		}
+		remove_list_entry(&job->backlog);
+		backlog_depth[p]--;
+		job->helper_id = helper_id;
+		deltatime_t wait = monotimediff(mononow(), job->queued);
+		backlog_wait = deltatime_max(backlog_wait, wait);
+		if (p == JOB_HALF_OPEN && !job->cancelled &&
+		    deltatime_cmp(wait, >, deltatime(STALE_HALF_OPEN_JOB_SECONDS))) {
+			job->stale = true;
+			stale_jobs++;
+		}
+		return job;
+	}
+	return NULL;
+}
+
+/*
+ * What a helper has been up to; BUSY is the wall clock time spent
+ * working on jobs.
+ */
+
+struct helper_usage {
+	uintmax_t jobs;
+	double busy;		/* seconds */
+};
+
+/*
+ * Note: this per-helper struct is never modified in a helper thread;
+ * USAGE is updated by the main thread as each job comes back.
  */
 
 struct helper_thread {
 	struct logger *logger;
 	helper_id_t helper_id;
 	pthread_t pid;
+	struct helper_usage usage;
 };
 
 /* may be NULL if we are to do all the work ourselves */
@@ -173,6 +272,28 @@ static struct helper_thread *helper_threads = NULL;
 static unsigned helper_threads_started = 0;
 static unsigned helper_threads_stopped = 0;
 
+/*
+ * Main thread only.
+ *
+ * Jobs done inline, when there are no helpers, are billed to
+ * INLINE_USAGE.  Per-task totals are kept in a short list (there are
+ * only a handful of task handlers).  A job is counted as cancelled
+ * when the state it was working for died before it came back.
+ */
+
+struct task_stats {
+	const char *name;	/* task_handler.name; static */
+	uintmax_t completed;
+	uintmax_t cancelled;
+	struct task_stats *next;
+};
+
+static struct helper_usage inline_usage;
+static struct task_stats *task_stats;
+static uintmax_t cancelled_jobs;
+static monotime_t helper_stats_start;	/* when started or cleared */
+static unsigned jobs_outstanding;	/* main thread; submitted but not freed */
+
 /*
  * If there are any helper threads, this code is always executed IN A HELPER
  * THREAD. Otherwise it is executed in the main (only) thread.
@@ -180,10 +301,15 @@ static unsigned helper_threads_stopped = 0;
 
 static void do_job(struct job *job, helper_id_t helper_id)
 {
+	job->time_waited = monotimediff(mononow(), job->queued);
+	PLUTO_PROBE(task_dequeue, job->job_id, job->callback_so, job->task_so,
+		    helper_id);
 	logtime_t start = logtime_start(job->logger);
 
 	if (job->cancelled) {
 		ldbg(job->logger, PRI_JOB": skipping as cancelled", pri_job(job));
+	} else if (job->stale) {
+		ldbg(job->logger, PRI_JOB": skipping as stale", pri_job(job));
 	} else {
 		ldbg(job->logger, PRI_JOB": started", pri_job(job));
 		job->handler->computer_fn(job->logger, job->task, helper_id);
@@ -226,18 +352,14 @@ static void *helper_thread(void *arg)
 			while (!exiting_pluto) {
 				/* grab the next entry, if there is one */
 				pexpect(job == NULL);
-				FOR_EACH_LIST_ENTRY_OLD2NEW(job, &backlog) { break; }
+				/*
+				 * Assign the entry to this thread,
+				 * removing it from the backlog.
+				 *
+				 * XXX: logged when job started.
+				 */
+				job = next_job(w->helper_id);
 				if (job != NULL) {
-					/*
-					 * Assign the entry to this
-					 * thread, removing it from
-					 * the backlog.
-					 *
-					 * XXX: logged when job
-					 * started.
-					 */
-					remove_list_entry(&job->backlog);
-					job->helper_id = w->helper_id;
 					break;
 				}
 				dbg("helper %u: waiting for work", w->helper_id);
@@ -288,6 +410,30 @@ static void inline_worker(const char *story UNUSED, struct state *unused_st UNUS
 	do_job(job, -1);
 }
 
+/*
+ * Which backlog class does work for TASK_SA belong in?
+ */
+
+static enum job_priority job_priority(const struct state *task_sa)
+{
+	if (IS_CHILD_SA(task_sa)) {
+		/*
+		 * Child SAs (and IKEv2 replacement IKE SAs) are only
+		 * negotiated once the IKE SA is up (IKEv2's IKE_AUTH
+		 * child does its crypto as part of the IKE SA).
+		 */
+		return JOB_ESTABLISHED;
+	}
+	if (IS_IKE_SA_ESTABLISHED(task_sa)) {
+		return JOB_ESTABLISHED;
+	}
+	if (task_sa->st_sa_role == SA_RESPONDER &&
+	    !task_sa->hidden_variables.st_skeyid_calculated) {
+		return JOB_HALF_OPEN;
+	}
+	return JOB_AUTHENTICATING;
+}
+
 /*
  * send_crypto_helper_request is called with a request to do some
  * cryptographic operations along with a continuation structure,
@@ -342,6 +488,8 @@ void submit_task(struct state *callback_sa,
 	struct job *job = alloc_thing(struct job, where->func);
 	dbg_alloc("job", job, HERE);
 	job->cancelled = false;
+	job->stale = false;
+	job->priority = job_priority(task_sa);
 	job->where = where;
 	init_list_entry(&backlog_info, job, &job->backlog);
 	job->callback_so = callback_sa->st_serialno;
@@ -358,6 +506,7 @@ void submit_task(struct state *callback_sa,
 
 	job->handler = handler;
 	job->task = task;
+	jobs_outstanding++;
 
 	/*
 	 * Save in case it needs to be cancelled.
@@ -365,7 +514,11 @@ void submit_task(struct state *callback_sa,
 	task_sa->st_offloaded_task = job;
 	job->logger = clone_logger(task_sa->logger, HERE);
 	job->md = md_addref(md);
-	ldbg(job->logger, PRI_JOB": added to pending queue", pri_job(job));
+	job->queued = mononow();	/* inline jobs "wait" too */
+	PLUTO_PROBE(task_enqueue, job->job_id, job->callback_so, job->task_so,
+		    job->handler->name);
+	ldbg(job->logger, PRI_JOB": added to %s pending queue",
+	     pri_job(job), job_priority_name[job->priority]);
 
 	if (callback_sa->st_ike_version == IKEv1) {
 		/*
@@ -451,6 +604,51 @@ static void free_job(struct job **jobp)
 	dbg_free("job", job, HERE);
 	pfree(job);
 	*jobp = NULL;
+	passert(jobs_outstanding > 0);
+	jobs_outstanding--;
+}
+
+unsigned server_helper_jobs_outstanding(void)
+{
+	passert(in_main_thread());
+	return jobs_outstanding;
+}
+
+static struct task_stats *task_stats_by_name(const char *name)
+{
+	for (struct task_stats *t = task_stats; t != NULL; t = t->next) {
+		if (streq(t->name, name)) {
+			return t;
+		}
+	}
+	struct task_stats *t = alloc_thing(struct task_stats, "task stats");
+	t->name = name;
+	t->next = task_stats;
+	task_stats = t;
+	return t;
+}
+
+static void account_job(const struct job *job, bool completed, bool cancelled)
+{
+	struct helper_usage *usage =
+		(helper_threads != NULL &&
+		 job->helper_id >= HELPER_ID_MIN &&
+		 job->helper_id <= helper_threads_started
+		 ? &helper_threads[job->helper_id - 1].usage
+		 : &inline_usage);
+	usage->jobs++;
+	usage->busy += job->time_used.wall_seconds;
+
+	record_backlog_wait(job->time_waited);
+
+	struct task_stats *t = task_stats_by_name(job->handler->name);
+	if (completed) {
+		t->completed++;
+	}
+	if (cancelled) {
+		t->cancelled++;
+		cancelled_jobs++;
+	}
 }
 
 static stf_status handle_helper_answer(struct state *callback_sa,
@@ -470,14 +668,26 @@ static stf_status handle_helper_answer(struct state *callback_sa,
 		/* suppressed */
 		ldbg(job->logger, PRI_JOB": job cancelled!", pri_job(job));
 		PEXPECT(job->logger, task_sa == NULL || task_sa->st_offloaded_task == NULL);
+		account_job(job, /*completed*/false, /*cancelled*/true);
 		status = STF_SKIP_COMPLETE_STATE_TRANSITION;
 	} else if (callback_sa == NULL) {
 		/* oops, the callback state disappeared! */
 		llog_pexpect(job->logger, HERE, PRI_JOB": callback disappeared!", pri_job(job));
+		account_job(job, /*completed*/false, /*cancelled*/true);
 		status = STF_SKIP_COMPLETE_STATE_TRANSITION;
 	} else if (task_sa == NULL) {
 		/* oops, the task state disappeared! */
 		llog_pexpect(job->logger, HERE, PRI_JOB": task disappeared!", pri_job(job));
+		account_job(job, /*completed*/false, /*cancelled*/true);
+		status = STF_SKIP_COMPLETE_STATE_TRANSITION;
+	} else if (job->stale) {
+		/* see JOB_HALF_OPEN; the peer has likely given up */
+		ldbg(job->logger, PRI_JOB": job stale, deleting state", pri_job(job));
+		PEXPECT(job->logger, task_sa->st_offloaded_task == job);
+		task_sa->st_offloaded_task = NULL;
+		event_force((task_sa->st_ike_version == IKEv1 ? EVENT_v1_CRYPTO_TIMEOUT :
+			     EVENT_v2_DISCARD), task_sa);
+		account_job(job, /*completed*/false, /*cancelled*/false);
 		status = STF_SKIP_COMPLETE_STATE_TRANSITION;
 	} else {
 		ldbg(job->logger, PRI_JOB": calling state's callback function", pri_job(job));
@@ -485,6 +695,11 @@ static stf_status handle_helper_answer(struct state *callback_sa,
 		task_sa->st_offloaded_task = NULL;
 		/* bill the thread time */
 		cpu_usage_add(task_sa->st_timing.helper_usage, job->time_used);
+		if (md != NULL) {
+			cpu_usage_add(md->md_usage, job->time_used);
+		}
+		record_task_latency(job->handler->name, job->time_waited, job->time_used);
+		account_job(job, /*completed*/true, /*cancelled*/false);
 		/* wall clock time not billed */
 		/* run the callback */
 		PASSERT(job->logger, job->handler->completed_cb != NULL);
@@ -493,6 +708,8 @@ static stf_status handle_helper_answer(struct state *callback_sa,
 	esb_buf buf;
 	ldbg(job->logger, PRI_JOB": final status %s; cleaning up",
 	     pri_job(job), str_enum(&stf_status_names, status, &buf));
+	PLUTO_PROBE(task_complete, job->job_id, job->callback_so, job->task_so,
+		    status);
 	free_job(&job);
 	return status;
 }
@@ -511,6 +728,7 @@ void start_server_helpers(int nhelpers, struct logger *logger)
 	helper_threads = NULL;
 	helper_threads_started = 0;
 	helper_threads_stopped = 0;
+	helper_stats_start = mononow();
 
 	/* find out how many CPUs there are, if nhelpers is -1 */
 	/* if nhelpers == 0, then we do all the work ourselves */
@@ -630,12 +848,180 @@ void free_server_helper_jobs(struct logger *logger)
 {
 	if (helper_threads_started == helper_threads_stopped) {
 		passert(helper_threads == NULL);
-		struct job *job = NULL;
-		FOR_EACH_LIST_ENTRY_OLD2NEW(job, &backlog) {
-			remove_list_entry(&job->backlog);
-			free_job(&job);
+		for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+			struct job *job = NULL;
+			FOR_EACH_LIST_ENTRY_OLD2NEW(job, &backlog[p]) {
+				remove_list_entry(&job->backlog);
+				free_job(&job);
+			}
+			backlog_depth[p] = 0;
 		}
 	} else {
 		llog(RC_LOG, logger, "WARNING: helper threads still running");
 	}
 }
+
+void free_server_helper_stats(void)
+{
+	while (task_stats != NULL) {
+		struct task_stats *next = task_stats->next;
+		pfree(task_stats);
+		task_stats = next;
+	}
+}
+
+void clear_server_helper_stats(void)
+{
+	pthread_mutex_lock(&backlog_mutex);
+	{
+		memcpy(backlog_max, backlog_depth, sizeof(backlog_max));
+		backlog_max_all = 0;
+		for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+			backlog_max_all += backlog_depth[p];
+		}
+		stale_jobs = 0;
+	}
+	pthread_mutex_unlock(&backlog_mutex);
+
+	for (unsigned h = 0; helper_threads != NULL && h < helper_threads_started; h++) {
+		zero(&helper_threads[h].usage);
+	}
+	zero(&inline_usage);
+	for (struct task_stats *t = task_stats; t != NULL; t = t->next) {
+		t->completed = 0;
+		t->cancelled = 0;
+	}
+	cancelled_jobs = 0;
+	helper_stats_start = mononow();
+}
+
+struct backlog_snapshot {
+	unsigned depth[JOB_PRIORITY_ROOF];
+	unsigned max[JOB_PRIORITY_ROOF];
+	unsigned max_all;
+	uintmax_t stale;
+};
+
+static struct backlog_snapshot snapshot_backlog(void)
+{
+	struct backlog_snapshot snap;
+	pthread_mutex_lock(&backlog_mutex);
+	{
+		memcpy(snap.depth, backlog_depth, sizeof(snap.depth));
+		memcpy(snap.max, backlog_max, sizeof(snap.max));
+		snap.max_all = backlog_max_all;
+		snap.stale = stale_jobs;
+	}
+	pthread_mutex_unlock(&backlog_mutex);
+	return snap;
+}
+
+static unsigned running_helpers(void)
+{
+	return (helper_threads == NULL ? 0 : helper_threads_started);
+}
+
+void show_server_helper_status(struct show *s)
+{
+	struct backlog_snapshot snap = snapshot_backlog();
+
+	show(s, "current.helpers.threads=%u", running_helpers());
+	for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+		show(s, "current.helpers.backlog.%s=%u", job_priority_name[p], snap.depth[p]);
+		show(s, "current.helpers.backlog.%s.max=%u", job_priority_name[p], snap.max[p]);
+	}
+	show(s, "current.helpers.backlog.max=%u", snap.max_all);
+	show(s, "total.helpers.stale=%ju", snap.stale);
+	show(s, "total.helpers.cancelled=%ju", cancelled_jobs);
+
+	for (unsigned h = 0; h < running_helpers(); h++) {
+		const struct helper_thread *w = &helper_threads[h];
+		show(s, "total.helpers.helper.%u.jobs=%ju", w->helper_id, w->usage.jobs);
+		show(s, "total.helpers.helper.%u.busy=%.6f", w->helper_id, w->usage.busy);
+	}
+	if (running_helpers() == 0) {
+		show(s, "total.helpers.inline.jobs=%ju", inline_usage.jobs);
+		show(s, "total.helpers.inline.busy=%.6f", inline_usage.busy);
+	}
+
+	for (const struct task_stats *t = task_stats; t != NULL; t = t->next) {
+		show(s, "total.helpers.task.%s.completed=%ju", t->name, t->completed);
+		show(s, "total.helpers.task.%s.cancelled=%ju", t->name, t->cancelled);
+	}
+}
+
+/*
+ * For whack --status; enough to tell if NHELPERS is too small (the
+ * backlog grows, jobs wait, helpers are always busy) or too big
+ * (helpers are mostly idle).
+ */
+
+static void show_helper_usage(struct show *s, const char *what,
+			      const struct helper_usage *usage, double elapsed)
+{
+	double idle = (elapsed > usage->busy ? elapsed - usage->busy : 0);
+	show(s, "%s: jobs(%ju), busy(%.3fs), idle(%.3fs), utilization(%.1f%%)",
+	     what, usage->jobs, usage->busy, idle,
+	     (elapsed > 0 ? usage->busy * 100 / elapsed : 0.0));
+}
+
+void show_server_helper_summary(struct show *s)
+{
+	struct backlog_snapshot snap = snapshot_backlog();
+	unsigned depth = 0;
+	for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+		depth += snap.depth[p];
+	}
+
+	deltatime_buf p50, p99, pmax;
+	show(s, "Helpers: threads(%u), backlog(%u), max-backlog(%u), stale(%ju), cancelled(%ju), wait p50(%s) p99(%s) max(%s)",
+	     running_helpers(), depth, snap.max_all, snap.stale, cancelled_jobs,
+	     str_deltatime(backlog_wait_quantile(50), &p50),
+	     str_deltatime(backlog_wait_quantile(99), &p99),
+	     str_deltatime(backlog_wait_quantile(100), &pmax));
+
+	struct timeval since = timeval_from_deltatime(monotimediff(mononow(), helper_stats_start));
+	double elapsed = since.tv_sec + since.tv_usec / 1000000.0;
+	for (unsigned h = 0; h < running_helpers(); h++) {
+		const struct helper_thread *w = &helper_threads[h];
+		char what[sizeof("Helper 4294967295")];
+		snprintf(what, sizeof(what), "Helper %u", w->helper_id);
+		show_helper_usage(s, what, &w->usage, elapsed);
+	}
+	if (running_helpers() == 0) {
+		show_helper_usage(s, "Helper inline", &inline_usage, elapsed);
+	}
+
+	for (const struct task_stats *t = task_stats; t != NULL; t = t->next) {
+		show(s, "Helper task %s: completed(%ju), cancelled(%ju)",
+		     t->name, t->completed, t->cancelled);
+	}
+}
+
+struct helper_load sample_server_helper_load(void)
+{
+	struct helper_load load = {
+		.helpers = helper_threads_started - helper_threads_stopped,
+	};
+	monotime_t now = mononow();
+	pthread_mutex_lock(&backlog_mutex);
+	{
+		/*
+		 * Include the jobs still waiting; when the helpers
+		 * are wedged nothing is being dequeued.
+		 */
+		load.wait = backlog_wait;
+		for (enum job_priority p = 0; p < JOB_PRIORITY_ROOF; p++) {
+			load.backlog += backlog_depth[p];
+			struct job *oldest = NULL;
+			FOR_EACH_LIST_ENTRY_OLD2NEW(oldest, &backlog[p]) { break; }
+			if (oldest != NULL) {
+				load.wait = deltatime_max(load.wait,
+							  monotimediff(now, oldest->queued));
+			}
+		}
+		backlog_wait = deltatime_zero;
+	}
+	pthread_mutex_unlock(&backlog_mutex);
+	return load;
+}
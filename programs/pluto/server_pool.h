@@ -37,9 +37,12 @@
 #ifndef SERVER_POOL_H
 #define SERVER_POOL_H
 
+#include "deltatime.h"
+
 struct state;
 struct msg_digest;
 struct logger;
+struct show;
 
 struct task; /*struct job*/
 
@@ -71,5 +74,26 @@ extern void submit_task(struct state *callback_sa,
 extern void start_server_helpers(int nhelpers, struct logger *logger);
 void stop_server_helpers(void (*all_server_helpers_stopped)(void));
 void free_server_helper_jobs(struct logger *logger);
+void show_server_helper_status(struct show *s);	/* --globalstatus */
+void show_server_helper_summary(struct show *s);	/* --status */
+void clear_server_helper_stats(void);
+void free_server_helper_stats(void);
+
+/* submitted, either queued, running, or waiting on the event loop */
+unsigned server_helper_jobs_outstanding(void);
+
+/*
+ * Snapshot of how busy the helpers are.  WAIT is the longest any job
+ * waited for a helper since the previous sample (including those
+ * still waiting).
+ */
+
+struct helper_load {
+	unsigned helpers;
+	unsigned backlog;
+	deltatime_t wait;
+};
+
+struct helper_load sample_server_helper_load(void);
 
 #endif
@@ -59,6 +59,12 @@ struct show {
 	 * Where to build the messages.
 	 */
 	struct logjam logjam;
+	/*
+	 * When non-NULL, lines are passed to this instead of the
+	 * logger.
+	 */
+	show_capture_cb *capture;
+	void *capture_arg;
 };
 
 struct show *alloc_show(struct logger *logger)
@@ -70,8 +76,21 @@ struct show *alloc_show(struct logger *logger)
 	return clone_thing(s, "on show");
 }
 
+struct show *alloc_show_capture(struct logger *logger,
+				show_capture_cb *capture, void *arg)
+{
+	struct show *s = alloc_show(logger);
+	s->capture = capture;
+	s->capture_arg = arg;
+	return s;
+}
+
 static void blank_line(struct show *s)
 {
+	if (s->capture != NULL) {
+		/* blank lines are for humans */
+		return;
+	}
 	/* XXX: must not use s->jambuf */
 	char blank_buf[sizeof(" "/*\0*/) + 1/*canary*/ + 1/*why-not*/];
 	struct jambuf buf = ARRAY_AS_JAMBUF(blank_buf);
@@ -145,7 +164,11 @@ void show_to_logger(struct show *s)
 	default:
 		bad_case(s->separator);
 	}
-	logjam_to_logger(&s->logjam);
+	if (s->capture != NULL) {
+		s->capture(jambuf_as_shunk(&s->logjam.barf.jambuf), s->capture_arg);
+	} else {
+		logjam_to_logger(&s->logjam);
+	}
 	s->separator = HAD_OUTPUT;
 }
 
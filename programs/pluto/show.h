@@ -17,6 +17,7 @@
 #define SHOW_H
 
 #include "lswcdefs.h"		/* for PRINTF_LIKE() */
+#include "shunk.h"
 
 struct show;
 enum rc_type;
@@ -30,6 +31,14 @@ struct logger;
 
 struct show *alloc_show(struct logger *logger);
 void free_show(struct show **s);
+/*
+ * Instead of sending each line to whack, pass it to CAPTURE (for
+ * instance, to re-format the output).  Blank lines are dropped.
+ */
+typedef void (show_capture_cb)(shunk_t line, void *arg);
+struct show *alloc_show_capture(struct logger *logger,
+				show_capture_cb *capture, void *arg);
+
 /* underlying global logger formed by alloc_show() */
 struct logger *show_logger(struct show *s);
 
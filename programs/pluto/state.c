@@ -74,6 +74,9 @@
 #include "whack_shutdown.h"		/* for exiting_pluto; */
 #include "ikev2_states.h"
 #include "crypt_cipher.h"		/* for cipher_context_destroy() */
+#include "crypt_prf.h"			/* for crypt_prf_destroy() */
+#include "ddos.h"			/* for ddos_overload */
+#include "pluto_cost.h"			/* for record_state_cost() */
 
 static void delete_state(struct state *st);
 
@@ -233,6 +236,8 @@ static void update_state_stats(struct state *st,
 	update_state_stat(st, old_state, -1);
 	update_state_stat(st, new_state, +1);
 
+	update_new_exchange_filters(st->logger);
+
 	/*
 	 * ??? this seems expensive: on each state change we do this
 	 * whole rigamarole.
@@ -876,6 +881,7 @@ void delete_state(struct state *st)
 			pri_cpu_usage(st->st_timing.main_usage),
 			pri_cpu_usage(st->st_timing.helper_usage));
 	}
+	record_state_cost(st);
 
 	/*
 	 * Audit-log failures.  Just assume any state failing to
@@ -1096,10 +1102,13 @@ void delete_state(struct state *st)
 	free_chunk_content(&st->st_ni);
 	free_chunk_content(&st->st_nr);
 	free_chunk_content(&st->st_dcookie);
+	free_chunk_content(&st->st_v2_puzzle_solution);
 	free_chunk_content(&st->st_v2_id_payload.data);
 
 	cipher_context_destroy(&st->st_ike_encrypt_cipher_context, st->logger);
 	cipher_context_destroy(&st->st_ike_decrypt_cipher_context, st->logger);
+	crypt_prf_destroy(&st->st_ike_encrypt_integ_prf);
+	crypt_prf_destroy(&st->st_ike_decrypt_integ_prf);
 
 #    define free_any_nss_symkey(p)  symkey_delref(st->logger, #p, &(p))
 
@@ -1786,11 +1795,35 @@ void send_n_log_delete_ike_family_now(struct ike_sa **ike,
 	connection_delete_ike_family(ike, where);
 }
 
+unsigned half_open_ike_sa_count(void)
+{
+	return cat_count[CAT_HALF_OPEN_IKE_SA];
+}
+
 bool require_ddos_cookies(void)
 {
 	return pluto_ddos_mode == DDOS_FORCE_BUSY ||
 		(pluto_ddos_mode == DDOS_AUTO &&
-		 cat_count[CAT_HALF_OPEN_IKE_SA] >= pluto_ddos_threshold);
+		 (cat_count[CAT_HALF_OPEN_IKE_SA] >= pluto_ddos_threshold ||
+		  ddos_overload >= DDOS_OVERLOAD_COOKIES));
+}
+
+/*
+ * Why new exchanges should be dropped, or NULL.  Shared by
+ * drop_new_exchanges() and the kernel's IKE filters so the two can't
+ * disagree.
+ */
+
+static const char *new_exchanges_overload(void)
+{
+	if (cat_count[CAT_HALF_OPEN_IKE_SA] >= pluto_max_halfopen) {
+		return "half open count >= max-halfopen";
+	}
+	if (pluto_ddos_mode == DDOS_AUTO &&
+	    ddos_overload >= DDOS_OVERLOAD_DROP) {
+		return "DDoS overload";
+	}
+	return NULL;
 }
 
 bool drop_new_exchanges(void)
@@ -1799,13 +1832,34 @@ bool drop_new_exchanges(void)
 		dbg("%s() exiting_pluto!", __func__);
 		return true;
 	}
-	if (cat_count[CAT_HALF_OPEN_IKE_SA] >= pluto_max_halfopen) {
-		dbg("%s() half open count >= %u", __func__, pluto_max_halfopen);
+	const char *overload = new_exchanges_overload();
+	if (overload != NULL) {
+		dbg("%s() %s", __func__, overload);
 		return true;
 	}
 	return false;
 }
 
+/*
+ * When pluto starts, or stops, dropping new exchanges (see
+ * drop_new_exchanges()) have the kernel's IKE filters follow along.
+ */
+
+void update_new_exchange_filters(struct logger *logger)
+{
+	static bool dropping_new_exchanges = false;
+	const char *overload = new_exchanges_overload();
+	bool overloaded = (overload != NULL);
+	if (overloaded != dropping_new_exchanges) {
+		dropping_new_exchanges = overloaded;
+		ldbg(logger, "%s dropping new exchanges%s%s; updating IKE filters",
+		     (overloaded ? "starting" : "stopping"),
+		     (overloaded ? ", " : ""),
+		     (overloaded ? overload : ""));
+		update_iface_endpoint_filters(logger);
+	}
+}
+
 void show_globalstate_status(struct show *s)
 {
 	unsigned shunts = shunt_count();
@@ -49,6 +49,7 @@
 #include "ip_selector.h"
 #include "kernel_mode.h"
 #include "sa_type.h"
+#include "sa_pcpu.h"
 #include "quirks.h"
 #include "list_entry.h"
 #include "retransmit.h"
@@ -235,6 +236,10 @@ extern const struct finite_state *finite_states[STATE_IKE_ROOF];
 struct state {
 	realtime_t st_inception;		/* time state is created, for logging */
 	struct state_timing st_timing;		/* accumulative cpu time */
+	struct {
+		unsigned completed;		/* state transitions */
+		unsigned failed;		/* of those, failures */
+	} st_transitions;			/* for cost accounting */
 	so_serial_t st_serialno;                /* serial number (for seniority)*/
 	so_serial_t st_clonedfrom;              /* serial number of parent */
 
@@ -414,6 +419,7 @@ struct state {
 	chunk_t st_gr;                          /* Responder public value */
 	chunk_t st_nr;                          /* Nr nonce */
 	chunk_t st_dcookie;                     /* DOS cookie of responder - v2 only */
+	chunk_t st_v2_puzzle_solution;		/* RFC 8019 solution for st_dcookie */
 
 	/* end of symmetric stuff */
 
@@ -569,6 +575,8 @@ struct state {
 	PK11SymKey *st_skey_ar_nss;	/* v2 IKE authentication key for responder */
 	struct cipher_context *st_ike_encrypt_cipher_context;
 	struct cipher_context *st_ike_decrypt_cipher_context;
+	struct crypt_prf *st_ike_encrypt_integ_prf;	/* keyed; clone before use */
+	struct crypt_prf *st_ike_decrypt_integ_prf;
 
 #define st_skeyid_e_nss st_skey_ei_nss	/* v1 IKE encryption KM */
 	PK11SymKey *st_skey_ei_nss;	/* v2 IKE encryption key for initiator */
@@ -659,6 +667,8 @@ struct state {
 	bool st_seen_hashnotify;		/* did we receive hash algo notification in IKE_INIT, then send in response as well */
 	bool st_v1_seen_fragments;              /* did we receive ike fragments from peer, if so use them in return as well */
 	bool st_seen_no_tfc;			/* did we receive ESP_TFC_PADDING_NOT_SUPPORTED */
+	bool st_resource_sa;			/* RFC 9611 additional per-resource Child SA */
+	struct sa_pcpu st_pcpu;			/* RFC 9611 CPU the outbound SA is pinned to */
 	bool st_seen_redirect_sup;		/* did we receive IKEv2_REDIRECT_SUPPORTED */
 	bool st_sent_redirect;			/* did we send IKEv2_REDIRECT in IKE_AUTH (response) */
 	bool st_skip_revival_as_redirecting;	/* hack */
@@ -881,6 +891,8 @@ extern void change_v2_state(struct state *st);
 
 extern bool drop_new_exchanges(void);
 extern bool require_ddos_cookies(void);
+unsigned half_open_ike_sa_count(void);
+void update_new_exchange_filters(struct logger *logger);
 extern void show_globalstate_status(struct show *s);
 extern void update_ike_endpoints(struct ike_sa *ike, const struct msg_digest *md);
 
@@ -623,7 +623,7 @@ void event_schedule_where(enum event_type type, deltatime_t delay, struct state
 	     __func__, event_name.buf, ev, str_deltatime(delay, &buf),
 	     ev->ev_state->st_serialno);
 
-	schedule_timeout(event_name.buf, &ev->timeout, delay, timer_event_cb, ev);
+	schedule_timeout_where(event_name.buf, &ev->timeout, delay, timer_event_cb, ev, where);
 }
 
 /*
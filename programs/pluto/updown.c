@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <sys/wait.h>		/* WIFEXITED() et.al. */
+#include <unistd.h>		/* for access() */
 
 #include "ip_info.h"
 
@@ -40,8 +41,12 @@
 #include "kernel.h"
 #include "ipsec_interface.h"
 #include "iface.h"
-#include "keys.h"		/* for pluto_pubkeys */
-#include "secrets.h"		/* for struct pubkey_list */
+#include "keys.h"		/* for next_preloaded_pubkey() */
+#include "secrets.h"		/* for struct pubkey */
+#include "server_fork.h"
+#include "routing.h"		/* for connection_updown_failed() */
+#include "whack_shutdown.h"	/* for exiting_pluto */
+#include "show.h"
 
 /*
  * Remove all characters but [-_.0-9a-zA-Z] from a character string.
@@ -158,11 +163,15 @@ static bool fmt_common_shell_out(char *buf,
 	JDuint("PLUTO_PEER_PROTOCOL", sr->remote->client.ipproto);
 
 	jam_string(&jb, "PLUTO_PEER_CA='");
-	for (struct pubkey_list *p = pluto_pubkeys; p != NULL; p = p->next) {
-		struct pubkey *key = p->key;
+	struct preloaded_pubkey_filter pkf = {
+		.id = &c->remote->host.id,
+		.type = &pubkey_type_rsa,
+		.where = HERE,
+	};
+	while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+		struct pubkey *key = pkf.key;
 		int pathlen;	/* value ignored */
-		if (key->content.type == &pubkey_type_rsa &&
-		    same_id(&c->remote->host.id, &key->id) &&
+		if (same_id(&c->remote->host.id, &key->id) &&
 		    trusted_ca(key->issuer, ASN1(sr->remote->host->config->ca), &pathlen)) {
 			jam_dn_or_null(&jb, key->issuer, "", jam_shell_quoted_bytes);
 			break;
@@ -281,6 +290,35 @@ static bool fmt_common_shell_out(char *buf,
 #	undef JDipaddr
 }
 
+/*
+ * Report on, and react to, the command's wait() STATUS.
+ */
+
+static bool updown_status_ok(const char *verb, const char *verb_suffix,
+			     int status, struct logger *logger)
+{
+	if (WIFEXITED(status)) {
+		if (WEXITSTATUS(status) != 0) {
+			llog(RC_LOG, logger,
+			     "%s%s command exited with status %d",
+			     verb, verb_suffix,
+			     WEXITSTATUS(status));
+			return false;
+		}
+	} else if (WIFSIGNALED(status)) {
+		llog(RC_LOG, logger,
+		     "%s%s command exited with signal %d",
+		     verb, verb_suffix, WTERMSIG(status));
+		return false;
+	} else {
+		llog(RC_LOG, logger,
+		     "%s%s command exited with unknown status %d",
+		     verb, verb_suffix, status);
+		return false;
+	}
+	return true;
+}
+
 static bool invoke_command(const char *verb, const char *verb_suffix, const char *cmd,
 			   struct logger *logger)
 {
@@ -363,39 +401,338 @@ static bool invoke_command(const char *verb, const char *verb_suffix, const char
 		}
 
 		/* report on and react to return code */
-		{
-			int r = pclose(f);
-
-			if (r == -1) {
-				llog_error(logger, errno,
-					   "pclose failed for %s%s command",
-					   verb, verb_suffix);
-				return false;
-			} else if (WIFEXITED(r)) {
-				if (WEXITSTATUS(r) != 0) {
-					llog(RC_LOG, logger,
-						    "%s%s command exited with status %d",
-						    verb, verb_suffix,
-						    WEXITSTATUS(r));
-					return false;
-				}
-			} else if (WIFSIGNALED(r)) {
-				llog(RC_LOG, logger,
-					    "%s%s command exited with signal %d",
-					    verb, verb_suffix, WTERMSIG(r));
-				return false;
-			} else {
-				llog(RC_LOG, logger,
-					    "%s%s command exited with unknown status %d",
-					    verb, verb_suffix, r);
-				return false;
+		int r = pclose(f);
+		if (r == -1) {
+			llog_error(logger, errno,
+				   "pclose failed for %s%s command",
+				   verb, verb_suffix);
+			return false;
+		}
+		return updown_status_ok(verb, verb_suffix, r, logger);
+	}
+}
+
+/*
+ * Updown statistics, per verb.
+ *
+ * WAIT is the time the command spent queued waiting for a job slot
+ * (always zero when run synchronously); RUN is the time from
+ * starting the command to collecting its exit status.
+ */
+
+static const char *const updown_verb_names[] = {
+	[UPDOWN_PREPARE] = "prepare",
+	[UPDOWN_ROUTE] = "route",
+	[UPDOWN_UNROUTE] = "unroute",
+	[UPDOWN_UP] = "up",
+	[UPDOWN_DOWN] = "down",
+#ifdef HAVE_NM
+	[UPDOWN_DISCONNECT_NM] = "disconnectNM",
+#endif
+};
+
+static struct updown_stats {
+	unsigned long runs;
+	unsigned long failures;
+	deltatime_t wait_total;
+	deltatime_t wait_max;
+	deltatime_t run_total;
+	deltatime_t run_max;
+} updown_stats[elemsof(updown_verb_names)];
+
+static void add_updown_stats(enum updown updown,
+			     monotime_t queued, monotime_t started, bool ok)
+{
+	struct updown_stats *stats = &updown_stats[updown];
+	deltatime_t wait = monotimediff(started, queued);
+	deltatime_t run = monotimediff(mononow(), started);
+	stats->runs++;
+	if (!ok) {
+		stats->failures++;
+	}
+	stats->wait_total = deltatime_add(stats->wait_total, wait);
+	stats->wait_max = deltatime_max(stats->wait_max, wait);
+	stats->run_total = deltatime_add(stats->run_total, run);
+	stats->run_max = deltatime_max(stats->run_max, run);
+}
+
+/*
+ * Asynchronous updown.
+ *
+ * With updown-jobs=N (N>0), the command is run as a fork()+exec()
+ * child of the event-loop instead of blocking it in popen().  At
+ * most N commands run in parallel.  Commands for the same connection
+ * run one at a time in the order they were requested (a "down" must
+ * not overtake the "up").
+ *
+ * Since the caller can't wait, do_updown() returns true; should the
+ * command then fail, routing is told by connection_updown_failed().
+ */
+
+unsigned pluto_updown_jobs = 0;	/* 0: run synchronously */
+bool pluto_native_updown = true;
+
+extern char **environ;		/* same as popen() */
+
+struct updown_job {
+	struct updown_job *next;
+	enum updown updown;
+	const char *verb;
+	const char *verb_suffix;
+	char *cmd;
+	co_serial_t co_serialno;
+	so_serial_t so_serialno;
+	bool running;
+	pid_t pid;
+	monotime_t queued;
+	monotime_t started;
+	struct logger *logger;
+};
+
+static struct {
+	/* oldest first; running jobs stay put until they exit */
+	struct updown_job *head;
+	struct updown_job **tail;
+	unsigned running;
+	unsigned pending;
+	bool scheduling;
+} updown_jobs = {
+	.tail = &updown_jobs.head,
+};
+
+static void free_updown_job(struct updown_job **jobp)
+{
+	struct updown_job *job = *jobp;
+	free_logger(&job->logger, HERE);
+	pfree(job->cmd);
+	pfree(job);
+	*jobp = NULL;
+}
+
+static void unlink_updown_job(struct updown_job *job)
+{
+	for (struct updown_job **jp = &updown_jobs.head; *jp != NULL; jp = &(*jp)->next) {
+		if (*jp == job) {
+			*jp = job->next;
+			if (updown_jobs.tail == &job->next) {
+				updown_jobs.tail = jp;
 			}
+			return;
 		}
 	}
-	return true;
+	llog_passert(job->logger, HERE, "updown job not queued");
 }
 
-static bool do_updown_verb(const char *verb,
+static void finish_updown_job(struct updown_job *job, bool ok)
+{
+	add_updown_stats(job->updown, job->queued, job->started, ok);
+	unlink_updown_job(job);
+	/* when exiting, everything is being torn down anyway */
+	if (!ok && !exiting_pluto) {
+		connection_updown_failed(job->updown, job->co_serialno,
+					 job->so_serialno, job->logger);
+	}
+	free_updown_job(&job);
+}
+
+static void schedule_updown_jobs(void);
+static server_fork_cb updown_job_exited; /* type assertion */
+
+static stf_status updown_job_exited(struct state *st UNUSED,
+				    struct msg_digest *md UNUSED,
+				    int status, void *context,
+				    struct logger *logger)
+{
+	struct updown_job *job = context;
+	PASSERT(logger, job->running);
+	updown_jobs.running--;
+	bool ok = updown_status_ok(job->verb, job->verb_suffix, status, job->logger);
+	deltatime_buf dtb;
+	ldbg(logger, "updown: %s%s command for "PRI_CO" %s after %ss",
+	     job->verb, job->verb_suffix, pri_co(job->co_serialno),
+	     ok ? "succeeded" : "failed",
+	     str_deltatime(monotimediff(mononow(), job->started), &dtb));
+	finish_updown_job(job, ok);
+	schedule_updown_jobs();
+	return STF_OK; /* ignored */
+}
+
+/*
+ * Start JOB returning true when it is running; false when it fell
+ * back to running synchronously, has finished, and was freed.
+ */
+
+static bool start_updown_job(struct updown_job *job)
+{
+	char *argv[] = {
+		/* server_fork() keeps a pointer to argv[0] */
+		DISCARD_CONST(char *, "updown"),
+		DISCARD_CONST(char *, "-c"),
+		job->cmd,
+		NULL,
+	};
+	job->started = mononow();
+	updown_jobs.pending--;
+	job->pid = server_fork_exec("/bin/sh", argv, environ,
+				    updown_job_exited, job, job->logger);
+	if (job->pid > 0) {
+		job->running = true;
+		updown_jobs.running++;
+		return true;
+	}
+	llog(RC_LOG, job->logger,
+	     "unable to fork %s%s command, running it synchronously",
+	     job->verb, job->verb_suffix);
+	bool ok = invoke_command(job->verb, job->verb_suffix, job->cmd, job->logger);
+	finish_updown_job(job, ok);
+	return false;
+}
+
+static void schedule_updown_jobs(void)
+{
+	/*
+	 * Starting a job can fail synchronously which, in turn, can
+	 * queue more jobs; let the outer call pick them up.
+	 */
+	if (updown_jobs.scheduling || exiting_pluto) {
+		return;
+	}
+	updown_jobs.scheduling = true;
+	struct updown_job **jp = &updown_jobs.head;
+	while (*jp != NULL && updown_jobs.running < pluto_updown_jobs) {
+		struct updown_job *job = *jp;
+		bool blocked = job->running;
+		for (const struct updown_job *prev = updown_jobs.head;
+		     !blocked && prev != job; prev = prev->next) {
+			blocked = (prev->co_serialno == job->co_serialno);
+		}
+		if (blocked || start_updown_job(job)) {
+			jp = &job->next;
+		}
+		/* else JOB was freed; *JP is the next job */
+	}
+	updown_jobs.scheduling = false;
+}
+
+static void queue_updown_job(enum updown updown,
+			     const char *verb, const char *verb_suffix,
+			     char *cmd, const struct connection *c,
+			     const struct child_sa *child,
+			     struct logger *logger)
+{
+	struct updown_job *job = alloc_thing(struct updown_job, "updown job");
+	job->updown = updown;
+	job->verb = verb;
+	job->verb_suffix = verb_suffix;
+	job->cmd = cmd;
+	job->co_serialno = c->serialno;
+	job->so_serialno = (child != NULL ? child->sa.st_serialno : SOS_NOBODY);
+	job->queued = mononow();
+	job->logger = clone_logger(logger, HERE);
+	*updown_jobs.tail = job;
+	updown_jobs.tail = &job->next;
+	updown_jobs.pending++;
+	ldbg(logger, "updown: queued %s%s command for "PRI_CO"; %u running %u pending",
+	     verb, verb_suffix, pri_co(c->serialno),
+	     updown_jobs.running, updown_jobs.pending);
+	schedule_updown_jobs();
+}
+
+static bool updown_jobs_queued(co_serial_t co_serialno)
+{
+	for (const struct updown_job *job = updown_jobs.head; job != NULL; job = job->next) {
+		if (job->co_serialno == co_serialno) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Wait for the commands already running, and then run any queued
+ * commands synchronously, oldest first, so that they are not
+ * overtaken by the commands run while shutting down.
+ */
+
+void drain_updown_jobs(struct logger *logger)
+{
+	/* reaping a job calls updown_job_exited() which frees it */
+	struct updown_job *next;
+	for (struct updown_job *job = updown_jobs.head; job != NULL; job = next) {
+		next = job->next;
+		if (job->running) {
+			ldbg(logger, "updown: waiting for running %s%s command for "PRI_CO" (pid %d)",
+			     job->verb, job->verb_suffix, pri_co(job->co_serialno), job->pid);
+			server_fork_wait(job->pid, logger);
+		}
+	}
+
+	struct updown_job **jp = &updown_jobs.head;
+	while (*jp != NULL) {
+		struct updown_job *job = *jp;
+		if (job->running) {
+			jp = &job->next;
+			continue;
+		}
+		ldbg(logger, "updown: running queued %s%s command for "PRI_CO" synchronously",
+		     job->verb, job->verb_suffix, pri_co(job->co_serialno));
+		job->started = mononow();
+		updown_jobs.pending--;
+		bool ok = invoke_command(job->verb, job->verb_suffix, job->cmd, job->logger);
+		add_updown_stats(job->updown, job->queued, job->started, ok);
+		*jp = job->next;
+		free_updown_job(&job);
+	}
+	updown_jobs.tail = jp;
+}
+
+/*
+ * The event-loop has stopped so the exit callback of any command
+ * still running is never going to be called.
+ */
+
+void free_updown_jobs(struct logger *logger)
+{
+	drain_updown_jobs(logger);
+	while (updown_jobs.head != NULL) {
+		struct updown_job *job = updown_jobs.head;
+		ldbg(logger, "updown: abandoning running %s%s command for "PRI_CO,
+		     job->verb, job->verb_suffix, pri_co(job->co_serialno));
+		updown_jobs.head = job->next;
+		updown_jobs.running--;
+		free_updown_job(&job);
+	}
+	updown_jobs.tail = &updown_jobs.head;
+}
+
+void show_updown_status(struct show *s)
+{
+	show_separator(s);
+	show(s, "updown jobs: %u, running: %u, pending: %u",
+	     pluto_updown_jobs, updown_jobs.running, updown_jobs.pending);
+	for (unsigned u = 0; u < elemsof(updown_verb_names); u++) {
+		const struct updown_stats *stats = &updown_stats[u];
+		if (stats->runs == 0) {
+			continue;
+		}
+		SHOW_JAMBUF(s, buf) {
+			jam(buf, "updown %s: runs=%lu failures=%lu",
+			    updown_verb_names[u], stats->runs, stats->failures);
+			jam_string(buf, " wait-avg=");
+			jam_deltatime(buf, deltatime_divu(stats->wait_total, stats->runs));
+			jam_string(buf, "s wait-max=");
+			jam_deltatime(buf, stats->wait_max);
+			jam_string(buf, "s run-avg=");
+			jam_deltatime(buf, deltatime_divu(stats->run_total, stats->runs));
+			jam_string(buf, "s run-max=");
+			jam_deltatime(buf, stats->run_max);
+			jam_string(buf, "s");
+		}
+	}
+}
+
+static bool do_updown_verb(enum updown updown,
+			   const char *verb,
 			   const struct connection *c,
 			   const struct spd *sr,
 			   struct child_sa *child,
@@ -469,11 +806,43 @@ static bool do_updown_verb(const char *verb,
 		return false;
 	}
 
+	if (pluto_updown_jobs > 0 && !exiting_pluto) {
+		/* CMD is now owned by the job */
+		queue_updown_job(updown, verb, verb_suffix, cmd, c, child, logger);
+		return true;
+	}
+
+	/* keep the order; flush anything queued before this */
+	drain_updown_jobs(logger);
+
+	monotime_t started = mononow();
 	bool ok = invoke_command(verb, verb_suffix, cmd, logger);
+	add_updown_stats(updown, started, started, ok);
 	pfree(cmd);
 	return ok;
 }
 
+/*
+ * The default script sources these, before doing anything, letting
+ * the admin change ROUTE, IPRARGS, IPROUTEARGS, or add firewall
+ * hooks.  Only the script can honour them.
+ */
+
+static bool updown_overridden(struct logger *logger)
+{
+	static const char *const overrides[] = {
+		IPSEC_SYSCONFDIR "/sysconfig/pluto_updown",
+		IPSEC_SYSCONFDIR "/default/pluto_updown",
+	};
+	FOR_EACH_ELEMENT(override, overrides) {
+		if (access(*override, F_OK) == 0) {
+			ldbg(logger, "kernel: %s exists, using updown script", *override);
+			return true;
+		}
+	}
+	return false;
+}
+
 bool do_updown(enum updown updown_verb,
 	       const struct connection *c,
 	       const struct spd *spd,
@@ -492,21 +861,10 @@ bool do_updown(enum updown updown_verb,
 			 (st != NULL && st->logger == logger)));
 #endif
 
-	const char *verb;
-	switch (updown_verb) {
-#define C(E,N) case E: verb = N; break
-		C(UPDOWN_PREPARE, "prepare");
-		C(UPDOWN_ROUTE, "route");
-		C(UPDOWN_UNROUTE, "unroute");
-		C(UPDOWN_UP, "up");
-		C(UPDOWN_DOWN, "down");
-#ifdef HAVE_NM
-		C(UPDOWN_DISCONNECT_NM, "disconnectNM");
-#endif
-#undef C
-	default:
+	if (updown_verb >= elemsof(updown_verb_names)) {
 		bad_case(updown_verb);
 	}
+	const char *verb = updown_verb_names[updown_verb];
 
 	/*
 	 * Support for skipping updown, eg leftupdown="".  Useful on
@@ -528,7 +886,25 @@ bool do_updown(enum updown updown_verb,
 		ldbg(logger, "kernel: running updown command \"%s\" for verb %s ", updown, verb);
 	}
 
-	return do_updown_verb(verb, c, spd, child, logger);
+	/*
+	 * The default script's common cases can be done without
+	 * forking (but not while script commands for the connection
+	 * are still queued, they'd be overtaken).
+	 */
+	if (pluto_native_updown &&
+	    kernel_ops->native_updown != NULL &&
+	    streq(updown, DEFAULT_UPDOWN) &&
+	    !updown_jobs_queued(c->serialno) &&
+	    !updown_overridden(logger)) {
+		monotime_t started = mononow();
+		bool ok;
+		if (kernel_ops->native_updown(updown_verb, c, spd, child, &ok, logger)) {
+			add_updown_stats(updown_verb, started, started, ok);
+			return ok;
+		}
+	}
+
+	return do_updown_verb(updown_verb, verb, c, spd, child, logger);
 }
 
 void do_updown_child(enum updown updown_verb, struct child_sa *child)
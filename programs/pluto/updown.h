@@ -36,6 +36,7 @@ struct spds;
 struct logger;
 struct child_sa;
 struct spd_owner;
+struct show;
 
 /* many bits reach in to use this, but maybe shouldn't */
 enum updown {
@@ -59,4 +60,19 @@ void do_updown_unroute(const struct connection *c, struct child_sa *child);
 void do_updown_unroute_spd(const struct spd *spd, const struct spd_owner *owner,
 			   struct child_sa *child, struct logger *logger);
 
+/*
+ * When non-zero, run up to this many updown commands in parallel
+ * without blocking the event-loop; see updown-jobs=.
+ */
+extern unsigned pluto_updown_jobs;
+
+/*
+ * When the kernel supports it, perform the default updown script's
+ * common operations without forking; see native-updown=.
+ */
+extern bool pluto_native_updown;
+void drain_updown_jobs(struct logger *logger);
+void free_updown_jobs(struct logger *logger);
+void show_updown_status(struct show *s);
+
 #endif
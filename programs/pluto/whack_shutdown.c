@@ -40,13 +40,14 @@
 #include "defs.h"		/* for so_serial_t */
 #include "log.h"		/* for close_log() et.al. */
 
-#include "server_pool.h"	/* for stop_crypto_helpers() */
+#include "server_pool.h"	/* for stop_server_helpers() et.al. */
 #include "pluto_sd.h"		/* for pluto_sd() */
 #include "root_certs.h"		/* for free_root_certs() */
 #include "keys.h"		/* for free_preshared_secrets() */
 #include "connections.h"
 #include "fetch.h"		/* for stop_crl_fetch_helper() et.al. */
 #include "crl_queue.h"		/* for free_crl_queue() */
+#include "ocsp_cache.h"		/* for free_ocsp_cache() */
 #include "iface.h"		/* for shutdown_ifaces() */
 #include "kernel.h"		/* for kernel_ops.shutdown() and free_kernel() */
 #include "virtual_ip.h"		/* for free_virtual_ip() */
@@ -61,9 +62,17 @@
 #include "connection_db.h"	/* for check_connection_db() */
 #include "spd_db.h"	/* for check_spd_db() */
 #include "server_fork.h"	/* for check_server_fork() */
+#include "updown.h"		/* for drain_updown_jobs() et.al. */
+#ifdef USE_PAM_AUTH
+#include "pam_auth.h"		/* for stop_pam_auth_workers() */
+#endif
 #include "pending.h"
 #include "connection_event.h"
 #include "terminate.h"
+#include "pluto_latency.h"	/* for free_latency_histograms() */
+#include "pluto_metrics.h"	/* for shutdown_metrics_socket() */
+#include "pluto_cost.h"		/* for clear_cost_status() */
+#include "pluto_replay.h"	/* for free_replay() */
 
 volatile bool exiting_pluto = false;
 static enum pluto_exit_code pluto_exit_code;
@@ -151,10 +160,14 @@ void exit_epilogue(void)
 {
 	struct logger logger[1] = { global_logger, };
 
+	/* run anything still queued, in order */
+	drain_updown_jobs(logger);
+
 	if (pluto_leave_state) {
 		shutdown_nss();
 		free_preshared_secrets(logger);
 		delete_lock();	/* delete any lock files */
+	shutdown_metrics_socket();
 		close_log();	/* close the logfiles */
 #ifdef USE_SYSTEMD_WATCHDOG
 		pluto_sd(PLUTO_SD_EXIT, pluto_exit_code);
@@ -176,11 +189,17 @@ void exit_epilogue(void)
 	 */
 	delete_every_connection(logger);
 
+#ifdef USE_PAM_AUTH
+	stop_pam_auth_workers(logger);
+#endif
 	free_server_helper_jobs(logger);
+	free_server_helper_stats();
+	free_replay();
+	free_updown_jobs(logger);
 
 	free_root_certs(logger);
 	free_preshared_secrets(logger);
-	free_remembered_public_keys();
+	free_remembered_public_keys(logger);
 	/*
 	 * free memory allocated by initialization routines.  Please don't
 	 * forget to do this.
@@ -204,6 +223,8 @@ void exit_epilogue(void)
 	 */
 	free_crl_queue();
 #endif
+	/* after the fetch thread has stopped; before NSS shuts down */
+	free_ocsp_cache();
 
 	lsw_conf_free_oco();	/* free global_oco containing path names */
 
@@ -218,6 +239,7 @@ void exit_epilogue(void)
 	shutdown_kernel(logger);
 	shutdown_nss();
 	delete_lock();	/* delete any lock files */
+	shutdown_metrics_socket();
 #ifdef USE_DNSSEC
 	unbound_ctx_free();	/* needs event-loop aka server */
 #endif
@@ -227,6 +249,8 @@ void exit_epilogue(void)
 	 */
 	free_server();
 
+	free_latency_histograms();
+	clear_cost_status();
 	free_virtual_ip();	/* virtual_private= */
 	free_pluto_main();	/* our static chars */
 	free_log();		/* call before report_leaks() */
@@ -48,6 +48,9 @@
 #include "whack_status.h"
 #include "whack_connectionstatus.h"	/* for show_connection_statuses() */
 #include "whack_showstates.h"
+#include "server_pool.h"		/* for show_server_helper_status() et.al. */
+#include "ddos.h"			/* for show_ddos_overload_status() */
+#include "pluto_latency.h"		/* for show_latency_histograms() */
 
 static void show_system_security(struct show *s)
 {
@@ -70,7 +73,10 @@ static void show_system_security(struct show *s)
 void whack_globalstatus(struct show *s)
 {
 	show_globalstate_status(s);
+	show_server_helper_status(s);
+	show_ddos_overload_status(s);
 	show_pluto_stats(s);
+	show_latency_histograms(s);
 }
 
 void whack_status(struct show *s, const monotime_t now)
@@ -87,6 +93,7 @@ void whack_status(struct show *s, const monotime_t now)
 	show_db_ops_status(s);
 	show_connection_statuses(s);
 	show_brief_status(s);
+	show_server_helper_summary(s);
 	whack_showstates(s, now);
 #if defined(KERNEL_XFRM)
 	show_shunt_status(s);
@@ -89,6 +89,7 @@ bool crl_strict = false;
 bool ocsp_strict = false;
 bool ocsp_enable = false;
 bool ocsp_post = false;
+bool ocsp_prefetch = false;
 char *curl_iface = NULL;
 
 SECItem same_shunk_as_dercert_secitem(shunk_t shunk)
@@ -733,9 +734,12 @@ bool remote_has_preloaded_pubkey(const struct state *st)
 	 */
 	if (is_permanent(c)) {
 		/* look for a matching RSA public key */
-		for (const struct pubkey_list *p = pluto_pubkeys; p != NULL;
-		     p = p->next) {
-			const struct pubkey *key = p->key;
+		struct preloaded_pubkey_filter pkf = {
+			.id = &c->remote->host.id,
+			.where = HERE,
+		};
+		while (next_preloaded_pubkey(NEW2OLD, &pkf)) {
+			const struct pubkey *key = pkf.key;
 
 			if ((key->content.type == &pubkey_type_rsa ||
 			     key->content.type == &pubkey_type_ecdsa) &&
@@ -118,6 +118,7 @@ static void help(void)
 		"	[--fragmentation {yes,no,force}] [--no-ikepad]  \\\n"
 		"	[--ikefrag-allow | --ikefrag-force] \\\n"
 		"	[--esn ] [--no-esn] [--decap-dscp] [--encap-dscp] [--nopmtudisc] [--mobike] \\\n"
+		"	[--per-cpu-sas {yes,no}] \\\n"
 		"	[--tcp <no|yes|fallback>] --tcp-remote-port <port>\\\n"
 #ifdef HAVE_NM
 		"	[--nm-configured] \\\n"
@@ -208,7 +209,9 @@ static void help(void)
 		"       [--fipsstatus] | [--processstatus] | [--shuntstatus] | [--trafficstatus] | \\\n"
 		"	[--showstates]\n"
 		"\n"
-		"statistics: [--globalstatus] | [--clearstats]\n"
+		"statistics: [--globalstatus] | [--clearstats] | [--coststatus]\n"
+		"\n"
+		"benchmark: whack --replay <pcap-file>\n"
 		"\n"
 		"refresh dns: whack --ddns\n"
 		"\n"
@@ -398,6 +401,8 @@ enum option_enums {
 	OPT_FIPSSTATUS,
 	OPT_BRIEFSTATUS,
 	OPT_PROCESSSTATUS,
+	OPT_COSTSTATUS,
+	OPT_REPLAY,
 
 #ifdef USE_SECCOMP
 	OPT_SECCOMP_CRASHTEST,
@@ -553,6 +558,7 @@ enum option_enums {
 	CD_DECAP_DSCP,
 	CD_ENCAP_DSCP,
 	CD_NOPMTUDISC,
+	CD_PER_CPU_SAS,
 	CD_IKEFRAG_ALLOW,
 	CD_IKEFRAG_FORCE,
 	CD_FRAGMENTATION,
@@ -708,6 +714,8 @@ static const struct option long_opts[] = {
 	{ "fipsstatus", no_argument, NULL, OPT_FIPSSTATUS },
 	{ "briefstatus", no_argument, NULL, OPT_BRIEFSTATUS },
 	{ "processstatus", no_argument, NULL, OPT_PROCESSSTATUS },
+	{ "coststatus", no_argument, NULL, OPT_COSTSTATUS },
+	{ "replay", required_argument, NULL, OPT_REPLAY },
 	{ "statestatus", no_argument, NULL, OPT_SHOW_STATES }, /* alias to catch typos */
 	{ "showstates", no_argument, NULL, OPT_SHOW_STATES },
 
@@ -923,6 +931,7 @@ static const struct option long_opts[] = {
 	{ "decap-dscp", optional_argument, NULL, CD_DECAP_DSCP },
 	{ "encap-dscp", optional_argument, NULL, CD_ENCAP_DSCP },
 	{ "nopmtudisc", optional_argument, NULL, CD_NOPMTUDISC },
+	{ "per-cpu-sas", optional_argument, NULL, CD_PER_CPU_SAS },
 	{ "ignore-peer-dns", optional_argument, NULL, CD_IGNORE_PEER_DNS },
 
 	{ "tcp", required_argument, NULL, CD_IKE_TCP },
@@ -1518,6 +1527,22 @@ int main(int argc, char **argv)
 			ignore_errors = true;
 			continue;
 
+		case OPT_COSTSTATUS:	/* --coststatus */
+			msg.whack_coststatus = true;
+			ignore_errors = true;
+			continue;
+
+		case OPT_REPLAY:	/* --replay <pcap-file> */
+		{
+			/* pluto has a different working directory */
+			char *path = realpath(optarg, NULL);
+			if (path == NULL) {
+				diagq(strerror(errno), optarg);
+			}
+			msg.whack_replay = path;
+			continue;
+		}
+
 		case OPT_SHOW_STATES:	/* --showstates */
 			msg.whack_showstates = true;
 			ignore_errors = true;
@@ -1889,6 +1914,11 @@ int main(int argc, char **argv)
 			msg.nopmtudisc = optarg_sparse(YN_YES, &yn_option_names);
 			continue;
 
+		/* --per-cpu-sas */
+		case CD_PER_CPU_SAS:
+			msg.per_cpu_sas = optarg_sparse(YN_YES, &yn_option_names);
+			continue;
+
 		/* --decap-dscp */
 		case CD_DECAP_DSCP:
 			msg.decap_dscp = optarg_sparse(YN_YES, &yn_option_names);
@@ -2710,6 +2740,8 @@ int main(int argc, char **argv)
 	      msg.whack_connectionstatus ||
 	      msg.whack_briefconnectionstatus ||
 	      msg.whack_processstatus ||
+	      msg.whack_coststatus ||
+	      msg.whack_replay != NULL ||
 	      msg.whack_fipsstatus ||
 	      msg.whack_briefstatus ||
 	      msg.whack_clear_stats ||
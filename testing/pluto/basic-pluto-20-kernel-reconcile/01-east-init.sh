@@ -0,0 +1,5 @@
+/testing/guestbin/swan-prep --hostkeys
+ipsec start
+../../guestbin/wait-until-pluto-started
+ipsec add westnet-eastnet
+echo "initdone"
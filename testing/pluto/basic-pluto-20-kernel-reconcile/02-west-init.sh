@@ -0,0 +1,4 @@
+/testing/guestbin/swan-prep --hostkeys
+ipsec start
+../../guestbin/wait-until-pluto-started
+echo "initdone"
@@ -0,0 +1,10 @@
+# leave the kernel state behind
+ipsec whack --shutdown --leave-state
+../../guestbin/ipsec-kernel-policy.sh
+ipsec start
+../../guestbin/wait-until-pluto-started
+../../guestbin/wait-for.sh --match '^kernel: reconcile: .* unchanged' -- cat /tmp/pluto.log
+grep -e '^kernel: reconcile:' /tmp/pluto.log
+# the old SA is still carrying traffic
+../../guestbin/ping-once.sh --up -I 192.0.1.254 192.0.2.254
+../../guestbin/ipsec-kernel-policy.sh
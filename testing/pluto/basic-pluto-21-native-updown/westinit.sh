@@ -0,0 +1,7 @@
+/testing/guestbin/swan-prep --nokeys
+rm -f /etc/sysconfig/pluto_updown /tmp/pluto_updown.log
+ipsec start
+../../guestbin/wait-until-pluto-started
+ipsec auto --add westnet-eastnet-ipv4-psk-ikev2
+ipsec whack --impair suppress_retransmits
+echo "initdone"
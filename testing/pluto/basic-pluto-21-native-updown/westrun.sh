@@ -0,0 +1,13 @@
+# native: the route is added but the script never runs
+ipsec auto --up westnet-eastnet-ipv4-psk-ikev2
+../../guestbin/ip.sh -4 route list 192.0.2.0/24
+test -f /tmp/pluto_updown.log || echo "script not run"
+ipsec auto --down westnet-eastnet-ipv4-psk-ikev2
+# with an override file, the script runs and sources it
+echo 'echo "$PLUTO_VERB" >> /tmp/pluto_updown.log' > /etc/sysconfig/pluto_updown
+ipsec auto --up westnet-eastnet-ipv4-psk-ikev2
+../../guestbin/ip.sh -4 route list 192.0.2.0/24
+cat /tmp/pluto_updown.log
+ipsec auto --down westnet-eastnet-ipv4-psk-ikev2
+rm /etc/sysconfig/pluto_updown
+echo done
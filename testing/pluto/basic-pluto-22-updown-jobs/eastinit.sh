@@ -0,0 +1,5 @@
+/testing/guestbin/swan-prep --nokeys
+ipsec start
+../../guestbin/wait-until-pluto-started
+ipsec auto --add westnet-eastnet-ipv4-psk-ikev2
+echo "initdone"
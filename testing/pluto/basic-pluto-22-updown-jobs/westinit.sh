@@ -0,0 +1,9 @@
+/testing/guestbin/swan-prep --nokeys
+cp west-updown /tmp/west-updown
+chmod +x /tmp/west-updown
+rm -f /tmp/updown.log /tmp/fail-route
+ipsec start
+../../guestbin/wait-until-pluto-started
+ipsec auto --add westnet-eastnet-ipv4-psk-ikev2
+ipsec whack --impair suppress_retransmits
+echo "initdone"
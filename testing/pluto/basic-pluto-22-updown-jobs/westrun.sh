@@ -0,0 +1,12 @@
+# the route command fails after the Child SA is established
+touch /tmp/fail-route
+ipsec auto --up westnet-eastnet-ipv4-psk-ikev2
+../../guestbin/wait-for-pluto.sh 'route command failed, expiring Child SA'
+rm /tmp/fail-route
+ipsec auto --down westnet-eastnet-ipv4-psk-ikev2
+# the down command is still running when pluto shuts down
+ipsec auto --up westnet-eastnet-ipv4-psk-ikev2
+ipsec auto --down westnet-eastnet-ipv4-psk-ikev2
+ipsec whack --shutdown
+cat /tmp/updown.log
+echo done
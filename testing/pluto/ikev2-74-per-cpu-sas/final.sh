@@ -0,0 +1,2 @@
+# east pinned its outbound per-CPU SA
+hostname | grep east > /dev/null && { grep -E 'outbound pinned to cpu=[0-9]+' /tmp/pluto.log > /dev/null || echo "Error: responder outbound SA not pinned" ; }
@@ -0,0 +1,9 @@
+ipsec auto --up westnet-eastnet-ipv4-psk-ikev2
+# traffic on CPU 0 uses the main Child SA and triggers an ACQUIRE
+taskset 0x1 ../../guestbin/ping-once.sh --up -I 192.0.1.254 192.0.2.254
+../../guestbin/wait-for-pluto.sh '#3: initiator established Child SA'
+# rekeying the main Child SA also rekeys the per-CPU Child SA
+ipsec whack --rekey-child --name westnet-eastnet-ipv4-psk-ikev2
+../../guestbin/wait-for-pluto.sh '#5: initiator rekeyed Child SA #3'
+taskset 0x1 ../../guestbin/ping-once.sh --up -I 192.0.1.254 192.0.2.254
+echo done
@@ -0,0 +1,3 @@
+# east sent the puzzle using west's PRF and accepted the solution
+hostname | grep east > /dev/null && grep -o 'with cookie and puzzle ([^,]*' /tmp/pluto.log
+hostname | grep east > /dev/null && grep -q 'puzzle solved with' /tmp/pluto.log && echo "puzzle solution verified"
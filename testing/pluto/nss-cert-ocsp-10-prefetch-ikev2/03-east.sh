@@ -0,0 +1,3 @@
+# the first exchange queued west's certificate for an OCSP fetch;
+# wait for the CRL fetch thread to cache the response
+../../guestbin/wait-for.sh --match 'next update' -- ipsec listcrls
@@ -0,0 +1,3 @@
+ipsec auto --down nss-cert-ocsp
+ipsec auto --up nss-cert-ocsp
+echo done
@@ -0,0 +1,3 @@
+# response is cached and was handed to NSS; NSS did not go to the network
+ipsec listcrls | grep -e 'cached OCSP' -e 'next update'
+grep -e 'OCSP: cache hit' /tmp/pluto.log | sed -e 's/ for .*/ for .../' | sort -u
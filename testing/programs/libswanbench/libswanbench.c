@@ -0,0 +1,479 @@
+/* libswan primitives benchmark, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Time the libswan primitives that sit on pluto's hot paths so that
+ * a change to lib/libswan can be compared before and after.
+ *
+ * Each benchmark is calibrated to run for roughly the requested time
+ * and is then repeated; the minimum and median cost per operation
+ * are reported, the minimum being the most repeatable.  For stable
+ * numbers, pin to a CPU (taskset) on an otherwise idle machine.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <limits.h>	/* for ULONG_MAX */
+
+#include "lswtool.h"
+#include "lswlog.h"
+#include "lswalloc.h"
+#include "constants.h"		/* for str_enum_short() */
+#include "names_constant.h"	/* for ikev2_exchange_names, debug_names */
+#include "pluto_constants.h"	/* for DBG_* */
+#include "ip_address.h"
+#include "ip_selector.h"
+#include "ip_info.h"
+
+#define NR_INPUTS 16		/* power of two */
+#define INPUT(I) ((I) & (NR_INPUTS - 1))
+
+/* where results go so that the compiler can't discard the work */
+static volatile uintmax_t sink;
+
+static ip_address ipv4_addresses[NR_INPUTS];
+static ip_address ipv6_addresses[NR_INPUTS];
+static ip_selector selectors[NR_INPUTS];
+static char ipv4_strings[NR_INPUTS][sizeof("255.255.255.255")];
+static char ipv6_strings[NR_INPUTS][sizeof("2001:db8:ffff::ffff")];
+static char selector_strings[NR_INPUTS][sizeof("10.255.255.0/24")];
+
+static void init_inputs(void)
+{
+	for (unsigned i = 0; i < NR_INPUTS; i++) {
+		snprintf(ipv4_strings[i], sizeof(ipv4_strings[i]),
+			 "192.0.2.%u", i * 7 + 1);
+		snprintf(ipv6_strings[i], sizeof(ipv6_strings[i]),
+			 "2001:db8:%x::%x", i, i * 7 + 1);
+		snprintf(selector_strings[i], sizeof(selector_strings[i]),
+			 "10.%u.%u.0/24", i / 4, i % 4);
+		passert(ttoaddress_num(shunk1(ipv4_strings[i]), &ipv4_info,
+				       &ipv4_addresses[i]) == NULL);
+		passert(ttoaddress_num(shunk1(ipv6_strings[i]), &ipv6_info,
+				       &ipv6_addresses[i]) == NULL);
+		ip_address nonzero_host;
+		passert(ttoselector_num(shunk1(selector_strings[i]), &ipv4_info,
+					&selectors[i], &nonzero_host) == NULL);
+	}
+}
+
+/*
+ * The benchmarks; each performs N operations.
+ */
+
+static void bench_address_eq_address_ipv4(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += address_eq_address(ipv4_addresses[INPUT(i)],
+					   ipv4_addresses[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_address_eq_address_ipv6(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += address_eq_address(ipv6_addresses[INPUT(i)],
+					   ipv6_addresses[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_address_in_selector(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += address_in_selector(ipv4_addresses[INPUT(i)],
+					    selectors[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_selector_eq_selector(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += selector_eq_selector(selectors[INPUT(i)],
+					     selectors[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_selector_in_selector(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += selector_in_selector(selectors[INPUT(i)],
+					     selectors[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_selector_overlaps_selector(unsigned long n)
+{
+	uintmax_t hits = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		hits += selector_overlaps_selector(selectors[INPUT(i)],
+						   selectors[INPUT(i * 3)]);
+	}
+	sink += hits;
+}
+
+static void bench_ttoaddress_num_ipv4(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		ip_address a;
+		err_t e = ttoaddress_num(shunk1(ipv4_strings[INPUT(i)]), &ipv4_info, &a);
+		sink += (e == NULL);
+	}
+}
+
+static void bench_ttoaddress_num_ipv6(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		ip_address a;
+		err_t e = ttoaddress_num(shunk1(ipv6_strings[INPUT(i)]), &ipv6_info, &a);
+		sink += (e == NULL);
+	}
+}
+
+static void bench_ttoselector_num(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		ip_selector s;
+		ip_address nonzero_host;
+		err_t e = ttoselector_num(shunk1(selector_strings[INPUT(i)]),
+					  &ipv4_info, &s, &nonzero_host);
+		sink += (e == NULL);
+	}
+}
+
+static void bench_jam_address_ipv4(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		address_buf ab;
+		sink += str_address(&ipv4_addresses[INPUT(i)], &ab)[0];
+	}
+}
+
+static void bench_jam_address_ipv6(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		address_buf ab;
+		sink += str_address(&ipv6_addresses[INPUT(i)], &ab)[0];
+	}
+}
+
+static void bench_jam_selector(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		selector_buf sb;
+		sink += str_selector(&selectors[INPUT(i)], &sb)[0];
+	}
+}
+
+static void bench_jam_printf(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		char buf[64];
+		struct jambuf jb = ARRAY_AS_JAMBUF(buf);
+		sink += jam(&jb, "#%lu: %s %u", i, "message", (unsigned)INPUT(i));
+	}
+}
+
+static void bench_jam_string(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		char buf[64];
+		struct jambuf jb = ARRAY_AS_JAMBUF(buf);
+		jam_string(&jb, "\"connection\"");
+		jam_string(&jb, "[1]");
+		sink += jam_string(&jb, " 192.0.2.1");
+	}
+}
+
+static void bench_jam_hex_bytes(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		char buf[80];
+		struct jambuf jb = ARRAY_AS_JAMBUF(buf);
+		sink += jam_hex_bytes(&jb, &ipv6_addresses[INPUT(i)],
+				      sizeof(ipv6_addresses[0]));
+	}
+}
+
+static void bench_str_enum_short(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		enum_buf eb;
+		unsigned long e = ISAKMP_v2_IKE_SA_INIT + (i & 3);
+		sink += str_enum_short(&ikev2_exchange_names, e, &eb)[0];
+	}
+}
+
+static void bench_enum_match(unsigned long n)
+{
+	static const char *const names[] = {
+		"IKE_SA_INIT", "ike_auth", "CREATE_CHILD_SA", "informational",
+	};
+	for (unsigned long i = 0; i < n; i++) {
+		sink += enum_match(&ikev2_exchange_names, shunk1(names[i & 3]));
+	}
+}
+
+static void bench_str_lset_short(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		lset_buf lb;
+		lset_t set = DBG_BASE | (i & 1 ? DBG_CPU_USAGE : DBG_ROUTING);
+		sink += str_lset_short(&debug_names, "+", set, &lb)[0];
+	}
+}
+
+static void bench_shunk_token(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; i++) {
+		shunk_t input = shunk1("aes_gcm256-sha2_512+sha2_256-dh19,aes128-sha1-modp2048");
+		shunk_t token;
+		do {
+			token = shunk_token(&input, NULL, "-+,");
+			sink += token.len;
+		} while (input.ptr != NULL);
+	}
+}
+
+static void bench_hunk_strcaseeq(unsigned long n)
+{
+	static const char *const names[] = {
+		"ike_sa_init", "IKE_SA_INIT", "ike_auth", "IKE_SA_INITX",
+	};
+	shunk_t hunk = shunk1("IKE_SA_INIT");
+	for (unsigned long i = 0; i < n; i++) {
+		sink += hunk_strcaseeq(hunk, names[i & 3]);
+	}
+}
+
+static void bench_clone_hunk(unsigned long n)
+{
+	shunk_t nonce = shunk2(&ipv6_addresses, sizeof(ipv6_addresses));
+	for (unsigned long i = 0; i < n; i++) {
+		chunk_t c = clone_hunk(nonce, "nonce");
+		sink += c.ptr[INPUT(i)];
+		free_chunk_content(&c);
+	}
+}
+
+struct bench {
+	const char *name;
+	void (*bench)(unsigned long n);
+};
+
+static const struct bench benches[] = {
+#define B(NAME, FN) { NAME, bench_##FN, }
+	B("address_eq_address/ipv4", address_eq_address_ipv4),
+	B("address_eq_address/ipv6", address_eq_address_ipv6),
+	B("address_in_selector", address_in_selector),
+	B("selector_eq_selector", selector_eq_selector),
+	B("selector_in_selector", selector_in_selector),
+	B("selector_overlaps_selector", selector_overlaps_selector),
+	B("ttoaddress_num/ipv4", ttoaddress_num_ipv4),
+	B("ttoaddress_num/ipv6", ttoaddress_num_ipv6),
+	B("ttoselector_num", ttoselector_num),
+	B("jam_address/ipv4", jam_address_ipv4),
+	B("jam_address/ipv6", jam_address_ipv6),
+	B("jam_selector", jam_selector),
+	B("jam/printf", jam_printf),
+	B("jam_string", jam_string),
+	B("jam_hex_bytes", jam_hex_bytes),
+	B("str_enum_short", str_enum_short),
+	B("enum_match", enum_match),
+	B("str_lset_short", str_lset_short),
+	B("shunk_token", shunk_token),
+	B("hunk_strcaseeq", hunk_strcaseeq),
+	B("clone_hunk", clone_hunk),
+#undef B
+};
+
+/*
+ * Timing.
+ */
+
+static double nanoseconds(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		perror("clock_gettime");
+		exit(1);
+	}
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_bench(const struct bench *b, unsigned long n)
+{
+	double start = nanoseconds();
+	b->bench(n);
+	return nanoseconds() - start;
+}
+
+/* find N that takes about TARGET nanoseconds */
+static unsigned long calibrate(const struct bench *b, double target)
+{
+	unsigned long n = 1;
+	double t;
+	while ((t = time_bench(b, n)) < target / 10 && n < ULONG_MAX / 2) {
+		n *= 2;
+	}
+	double scaled = n * (target / (t > 0 ? t : 1));
+	return (scaled < 1 ? 1 : scaled > ULONG_MAX / 2 ? ULONG_MAX / 2 :
+		(unsigned long)scaled);
+}
+
+static int cmp_double(const void *l, const void *r)
+{
+	double dl = *(const double *)l;
+	double dr = *(const double *)r;
+	return (dl < dr ? -1 : dl > dr ? 1 : 0);
+}
+
+struct result {
+	unsigned long iterations;
+	double min, median, max;	/* ns/op */
+};
+
+static struct result run_bench(const struct bench *b, unsigned long iterations,
+			       unsigned runs, double target)
+{
+	unsigned long n = (iterations > 0 ? iterations : calibrate(b, target));
+	/* warm up */
+	time_bench(b, n);
+	double *ns = alloc_things(double, runs, "runs");
+	for (unsigned r = 0; r < runs; r++) {
+		ns[r] = time_bench(b, n) / n;
+	}
+	qsort(ns, runs, sizeof(ns[0]), cmp_double);
+	struct result result = {
+		.iterations = n,
+		.min = ns[0],
+		.median = (runs % 2 == 1 ? ns[runs / 2] :
+			   (ns[runs / 2 - 1] + ns[runs / 2]) / 2),
+		.max = ns[runs - 1],
+	};
+	pfree(ns);
+	return result;
+}
+
+static bool selected(const char *name, char **patterns)
+{
+	if (*patterns == NULL) {
+		return true;
+	}
+	for (char **p = patterns; *p != NULL; p++) {
+		if (strstr(name, *p) != NULL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, ("usage:\n"
+			 "\tipsec _libswanbench [-n <iterations>] [-r <runs>] [-t <milliseconds>]\n"
+			 "\t\t[--json] [--list] [<name> ...]\n"
+			 "time libswan primitives; only benchmarks containing <name> are run\n"));
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct logger *logger = tool_logger(argc, argv);
+
+	unsigned long iterations = 0;	/* calibrate */
+	unsigned long runs = 5;
+	unsigned long milliseconds = 100;
+	bool json = false;
+	bool list = false;
+	char **argp = argv + 1;
+	for (; *argp != NULL && (*argp)[0] == '-'; argp++) {
+		char *end = "";
+		if (streq(*argp, "-n") && argp[1] != NULL) {
+			iterations = strtoul(*++argp, &end, 0);
+		} else if (streq(*argp, "-r") && argp[1] != NULL) {
+			runs = strtoul(*++argp, &end, 0);
+		} else if (streq(*argp, "-t") && argp[1] != NULL) {
+			milliseconds = strtoul(*++argp, &end, 0);
+		} else if (streq(*argp, "--json")) {
+			json = true;
+		} else if (streq(*argp, "--list")) {
+			list = true;
+		} else {
+			usage();
+		}
+		if (*end != '\0') {
+			usage();
+		}
+	}
+	char **patterns = argp;
+	if (runs == 0 || milliseconds == 0) {
+		usage();
+	}
+
+	if (list) {
+		FOR_EACH_ELEMENT(b, benches) {
+			printf("%s\n", b->name);
+		}
+		exit(0);
+	}
+
+	init_inputs();
+
+	if (json) {
+		printf("{\n");
+		printf("  \"runs\": %lu,\n", runs);
+		printf("  \"benchmarks\": [");
+	} else {
+		printf("%-28s %12s %12s %12s %12s\n",
+		       "benchmark", "iterations", "min ns/op", "median", "max");
+	}
+
+	const char *sep = "";
+	FOR_EACH_ELEMENT(b, benches) {
+		if (!selected(b->name, patterns)) {
+			continue;
+		}
+		struct result r = run_bench(b, iterations, runs, milliseconds * 1e6);
+		if (json) {
+			printf("%s\n    { \"name\": \"%s\", \"iterations\": %lu, "
+			       "\"ns_per_op_min\": %.3f, \"ns_per_op_median\": %.3f, "
+			       "\"ns_per_op_max\": %.3f }",
+			       sep, b->name, r.iterations, r.min, r.median, r.max);
+			sep = ",";
+		} else {
+			printf("%-28s %12lu %12.2f %12.2f %12.2f\n",
+			       b->name, r.iterations, r.min, r.median, r.max);
+		}
+		fflush(stdout);
+	}
+
+	if (json) {
+		printf("\n  ]\n}\n");
+	}
+
+	report_leaks(logger);
+	exit(0);
+}
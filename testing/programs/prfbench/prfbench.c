@@ -0,0 +1,123 @@
+/* PRF per-message cost benchmark, for libreswan
+ *
+ * Copyright (C) 2024 The Libreswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <https://www.gnu.org/licenses/gpl2.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Compare the cost of computing an SK payload's integrity when the
+ * PRF is initialized from the raw key for each message (what pluto
+ * used to do) against cloning a PRF that was keyed once (what pluto
+ * now does).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "lswtool.h"
+#include "lswlog.h"
+#include "lswnss.h"
+#include "lswalloc.h"
+#include "ike_alg.h"
+#include "crypt_prf.h"
+#include "crypt_symkey.h"
+#include "monotime.h"
+
+static unsigned long iterations = 10000;
+
+static intmax_t microseconds(monotime_t start)
+{
+	struct timeval tv = timeval_from_deltatime(monotimediff(mononow(), start));
+	return (intmax_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void bench_prf(const struct prf_desc *prf, shunk_t message,
+		      struct logger *logger)
+{
+	chunk_t raw = alloc_chunk(prf->prf_key_size, "key");
+	PK11SymKey *key = symkey_from_hunk("key", raw, logger);
+
+	/* before: import KEY for each message */
+	monotime_t start = mononow();
+	for (unsigned long i = 0; i < iterations; i++) {
+		struct crypt_prf *ctx = crypt_prf_init_symkey("integ", prf,
+							      "authkey", key, logger);
+		crypt_prf_update_hunk(ctx, "message", message);
+		struct crypt_mac mac = crypt_prf_final_mac(&ctx, NULL);
+		passert(mac.len > 0);
+	}
+	intmax_t init_us = microseconds(start);
+
+	/* after: clone a PRF keyed using KEY */
+	struct crypt_prf *keyed = crypt_prf_init_symkey("keyed", prf,
+							"authkey", key, logger);
+	start = mononow();
+	for (unsigned long i = 0; i < iterations; i++) {
+		struct crypt_prf *ctx = crypt_prf_clone("integ", keyed, logger);
+		crypt_prf_update_hunk(ctx, "message", message);
+		struct crypt_mac mac = crypt_prf_final_mac(&ctx, NULL);
+		passert(mac.len > 0);
+	}
+	intmax_t clone_us = microseconds(start);
+	crypt_prf_destroy(&keyed);
+
+	printf("%-16s init %8.3f us/message  clone %8.3f us/message\n",
+	       prf->common.fqn,
+	       (double)init_us / iterations,
+	       (double)clone_us / iterations);
+
+	symkey_delref(logger, "key", &key);
+	free_chunk_content(&raw);
+}
+
+int main(int argc, char *argv[])
+{
+	struct logger *logger = tool_logger(argc, argv);
+
+	size_t message_size = 1280;
+	for (char **argp = argv + 1; *argp != NULL; argp++) {
+		char *end;
+		if (streq(*argp, "-n") && argp[1] != NULL) {
+			iterations = strtoul(*++argp, &end, 0);
+		} else if (streq(*argp, "-s") && argp[1] != NULL) {
+			message_size = strtoul(*++argp, &end, 0);
+		} else {
+			fprintf(stderr, ("usage:\n"
+					 "\tipsec _prfbench [-n <iterations>] [-s <message-size>]\n"
+					 "compare per-message PRF cost\n"));
+			exit(1);
+		}
+	}
+
+	init_nss(NULL, (struct nss_flags) { .open_readonly = true}, logger);
+	init_crypt_symkey(logger);
+	/* don't dump the algorithm table */
+	log_to_stderr = false;
+	init_ike_alg(logger);
+	log_to_stderr = true;
+
+	chunk_t message = alloc_chunk(message_size, "message");
+	printf("%lu iterations of %zu byte messages\n", iterations, message_size);
+	for (const struct prf_desc **prfp = next_prf_desc(NULL);
+	     prfp != NULL; prfp = next_prf_desc(prfp)) {
+		if ((*prfp)->prf_mac_ops == NULL) {
+			continue;
+		}
+		bench_prf(*prfp, HUNK_AS_SHUNK(message), logger);
+	}
+	free_chunk_content(&message);
+
+	fflush(stdout);
+	shutdown_nss();
+	report_leaks(logger);
+	exit(0);
+}